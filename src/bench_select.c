@@ -0,0 +1,277 @@
+/* bench_select.c
+
+   Time the pass over the fields that selection makes (the full rescan
+   of scan_next_field: update the status of each field, count the
+   must-do, do-now and late fields, and find the ready field with the
+   fewest observations and least time left) on the Field layout, which
+   keeps the script line and observation history in Field_History, and
+   on the layout before that split, in which each field carried them
+   inline (Unsplit_Field, about 7.5 KB per field).
+
+   The same scan is compiled for both layouts (SELECTION_SCAN), so the
+   difference is only in the memory the scan has to pull through the
+   cache. The fields are a random night's worth of sky fields, the same
+   for both layouts, and the scan is repeated at times through the
+   night.
+
+   syntax: bench_select [num_fields ...]
+
+   With no arguments, times 500, 5000 and 50000 fields.
+
+*/
+
+#include "scheduler.h"
+#include <sys/time.h>
+
+#define BENCH_FIELD_SCANS 20000000 /* fields scanned per timing */
+#define BENCH_JD_START 2461331.6 /* start of the night */
+#define BENCH_NIGHT_HOURS 10.0 /* length of the night */
+
+/* Field as it was before the script line and history moved out */
+
+typedef struct {
+    int status;
+    int doable;
+    enum Selection_Code selection_code;
+    int field_number;
+    int line_number;
+    char script_line[STR_BUF_LEN];
+    double ra;
+    double dec;
+    double gal_long;
+    double gal_lat;
+    double ecl_long;
+    double ecl_lat;
+    double epoch;
+    int shutter;
+    double expt;
+    double interval;
+    int n_required;
+    int survey_code;
+    double ut_rise;
+    double ut_set;
+    double jd_rise;
+    double jd_set;
+    double jd_next;
+    int n_done;
+    double time_up;
+    double time_required;
+    double time_left;
+    double ut[MAX_OBS_PER_FIELD];
+    double jd[MAX_OBS_PER_FIELD];
+    double lst[MAX_OBS_PER_FIELD];
+    double ha[MAX_OBS_PER_FIELD];
+    double am[MAX_OBS_PER_FIELD];
+    double actual_expt[MAX_OBS_PER_FIELD];
+    char filename[FILENAME_LENGTH*MAX_OBS_PER_FIELD];
+} Unsplit_Field;
+
+static unsigned long bench_random_state=1;
+
+/************************************************************/
+
+/* uniform random number from 0 to 1, the same on every run */
+
+static double bench_random()
+{
+    bench_random_state=bench_random_state*6364136223846793005UL+1442695040888963407UL;
+
+    return((bench_random_state>>11)*(1.0/9007199254740992.0));
+}
+
+/************************************************************/
+
+/* the status update of update_field_status and the tallies of
+   scan_next_field for one layout. Returns the ready field with the
+   fewest observations left and least time left, or -1 */
+
+#define SELECTION_SCAN(NAME,TYPE) \
+static int NAME(TYPE *sequence, int num_fields, double jd, int *tally) \
+{ \
+    TYPE *f; \
+    int i,i_min,n_left,n_left_min; \
+    double time_left_min; \
+ \
+    i_min=-1; \
+    n_left_min=100000; \
+    time_left_min=1.0e10; \
+ \
+    for(i=0;i<num_fields;i++){ \
+       f=sequence+i; \
+       if(f->doable==0){ \
+          f->status=NOT_DOABLE_STATUS; \
+       } \
+       else if(f->n_done==f->n_required){ \
+          f->doable=0; \
+          f->status=NOT_DOABLE_STATUS; \
+       } \
+       else if(jd<f->jd_rise){ \
+          f->status=NOT_DOABLE_STATUS; \
+       } \
+       else if(jd>f->jd_set){ \
+          f->doable=0; \
+          f->status=NOT_DOABLE_STATUS; \
+       } \
+       else if(f->jd_next-jd>(MIN_EXECUTION_TIME/24.0)){ \
+          f->status=NOT_DOABLE_STATUS; \
+       } \
+       else if(f->shutter==DARK_CODE||f->shutter==DOME_FLAT_CODE){ \
+          f->status=DO_NOW_STATUS; \
+       } \
+       else{ \
+          f->time_required=(f->n_required-f->n_done)*f->interval; \
+          f->time_up=(f->jd_set-jd)*24.0; \
+          f->time_left=f->time_up-f->time_required; \
+          f->status=f->time_left<0 ? TOO_LATE_STATUS : READY_STATUS; \
+       } \
+ \
+       if(f->status==READY_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE)tally[0]++; \
+       if(f->status==DO_NOW_STATUS)tally[1]++; \
+       if(f->status==TOO_LATE_STATUS)tally[2]++; \
+ \
+       if(f->status==READY_STATUS){ \
+          n_left=f->n_required-f->n_done; \
+          if(n_left<n_left_min|| \
+             (n_left==n_left_min&&f->time_left<time_left_min)){ \
+             i_min=i; \
+             n_left_min=n_left; \
+             time_left_min=f->time_left; \
+          } \
+       } \
+    } \
+ \
+    return(i_min); \
+}
+
+SELECTION_SCAN(scan_split,Field)
+SELECTION_SCAN(scan_unsplit,Unsplit_Field)
+
+/************************************************************/
+
+/* time the scan of n fields in both layouts, and print one line */
+
+static int bench_fields(int n)
+{
+    Field_Table table;
+    Unsplit_Field *unsplit;
+    Field *f;
+    Unsplit_Field *u;
+    struct timeval t0,t1;
+    double jd,sec_split,sec_unsplit;
+    int i,k,n_scans,tally[3],i_split,i_unsplit,n_differ;
+
+    init_field_table(&table);
+    if(grow_field_table(&table,n)!=0)return(-1);
+    table.num_fields=n;
+
+    unsplit=(Unsplit_Field *)calloc(n,sizeof(Unsplit_Field));
+    if(unsplit==NULL){
+       fprintf(stderr,"bench_fields: could not allocate %d fields\n",n);
+       free_field_table(&table);
+       return(-1);
+    }
+
+    bench_random_state=1;
+    for(i=0;i<n;i++){
+       f=table.fields+i;
+       f->field_number=i;
+       f->shutter=SKY_CODE;
+       f->survey_code=bench_random()<0.05 ? MUSTDO_SURVEY_CODE : TNO_SURVEY_CODE;
+       f->doable=bench_random()<0.9;
+       f->n_required=3;
+       f->n_done=(int)(3.0*bench_random());
+       f->interval=1.0;
+       f->jd_rise=BENCH_JD_START+bench_random()*BENCH_NIGHT_HOURS/24.0;
+       f->jd_set=f->jd_rise+(1.0+6.0*bench_random())/24.0;
+       f->jd_next=f->jd_rise+bench_random()*2.0/24.0;
+
+       u=unsplit+i;
+       u->field_number=f->field_number;
+       u->shutter=f->shutter;
+       u->survey_code=f->survey_code;
+       u->doable=f->doable;
+       u->n_required=f->n_required;
+       u->n_done=f->n_done;
+       u->interval=f->interval;
+       u->jd_rise=f->jd_rise;
+       u->jd_set=f->jd_set;
+       u->jd_next=f->jd_next;
+    }
+
+    n_scans=BENCH_FIELD_SCANS/n;
+    if(n_scans<10)n_scans=10;
+
+    /* both layouts must choose the same fields. This also warms them */
+
+    tally[0]=tally[1]=tally[2]=0;
+    n_differ=0;
+    for(k=0;k<100;k++){
+       jd=BENCH_JD_START+k*BENCH_NIGHT_HOURS/(100.0*24.0);
+       i_split=scan_split(table.fields,n,jd,tally);
+       i_unsplit=scan_unsplit(unsplit,n,jd,tally);
+       if(i_unsplit!=i_split)n_differ++;
+    }
+
+    gettimeofday(&t0,NULL);
+    for(k=0;k<n_scans;k++){
+       jd=BENCH_JD_START+(k%100)*BENCH_NIGHT_HOURS/(100.0*24.0);
+       scan_split(table.fields,n,jd,tally);
+    }
+    gettimeofday(&t1,NULL);
+    sec_split=(t1.tv_sec-t0.tv_sec)+1.0e-6*(t1.tv_usec-t0.tv_usec);
+
+    gettimeofday(&t0,NULL);
+    for(k=0;k<n_scans;k++){
+       jd=BENCH_JD_START+(k%100)*BENCH_NIGHT_HOURS/(100.0*24.0);
+       scan_unsplit(unsplit,n,jd,tally);
+    }
+    gettimeofday(&t1,NULL);
+    sec_unsplit=(t1.tv_sec-t0.tv_sec)+1.0e-6*(t1.tv_usec-t0.tv_usec);
+
+    printf("  %8d %6d %7lu %12.3f %7lu %12.3f %7.1f %s\n",
+       n,n_scans,(unsigned long)sizeof(Unsplit_Field),
+       1.0e6*sec_unsplit/n_scans,(unsigned long)sizeof(Field),
+       1.0e6*sec_split/n_scans,sec_unsplit/sec_split,
+       n_differ>0 ? "DIFFER" : "");
+
+    free(unsplit);
+    free_field_table(&table);
+
+    if(n_differ>0)return(-1);
+
+    return(0);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    int k,n,result;
+
+    printf("# selection scan, usec per scan of all fields\n");
+    printf("# %8s %6s %7s %12s %7s %12s %7s\n","fields","scans",
+       "bytes","before_usec","bytes","after_usec","speedup");
+
+    result=0;
+    if(argc>1){
+       for(k=1;k<argc;k++){
+          n=0;
+          sscanf(argv[k],"%d",&n);
+          if(n<1){
+             fprintf(stderr,"bench_select: bad number of fields %s\n",argv[k]);
+             result=1;
+             continue;
+          }
+          if(bench_fields(n)!=0)result=1;
+       }
+    }
+    else{
+       for(n=500;n<=50000;n=10*n){
+          if(bench_fields(n)!=0)result=1;
+       }
+    }
+
+    return(result);
+}
+
+/************************************************************/
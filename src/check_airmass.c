@@ -0,0 +1,206 @@
+/* check_airmass.c
+
+   Check the batch hour angle and airmass kernel (get_airmass_batch,
+   through load_airmass_table, update_airmass_table and
+   get_table_airmass) against get_ha and get_airmass, which go through
+   altit() one field at a time, over a full-sky grid of fields at a
+   grid of LSTs.
+
+   The hour angles must agree to within CHECK_HA_TOLERANCE (an hour
+   angle of -12 and one of +12 are the same), sin(alt) (1/airmass) to
+   within CHECK_SIN_TOLERANCE, the airmasses below MAX_AIRMASS to a
+   relative CHECK_AM_TOLERANCE (nearer the horizon the relative error
+   in airmass grows as 1/sin(alt)), and both must agree on whether the
+   field is above the horizon. get_table_airmass must match the table
+   to CHECK_AM_TOLERANCE; the vectorized loop and the single entry may
+   round differently. A field within CHECK_HORIZON_ALT degrees
+   of the horizon may fall on either side of it in the two, and is
+   counted, not failed. Prints the number of cases, the largest
+   differences, the time taken by each, and any case that fails.
+   Exits with 1 if any fails.
+
+   syntax: check_airmass
+
+   Built and run by "make check".
+
+*/
+
+#include "scheduler.h"
+#include <sys/time.h>
+
+#define CHECK_RA_STEP 0.05 /* hours between fields in RA */
+#define CHECK_DEC_STEP 1.0 /* degrees between fields in dec */
+#define CHECK_NUM_LST 97 /* LSTs over 24 h, not a multiple of the RA step */
+#define CHECK_HA_TOLERANCE 1.0e-10 /* hours */
+#define CHECK_AM_TOLERANCE 1.0e-8 /* relative, below MAX_AIRMASS */
+#define CHECK_SIN_TOLERANCE 1.0e-10 /* in sin(alt), at any altitude */
+#define CHECK_HORIZON_ALT 1.0e-6 /* degrees */
+#define CHECK_MAX_FAILURES 20 /* failures printed */
+
+int verbose = 0;
+int verbose1 = 0;
+
+/************************************************************/
+
+/* used only in the verbose output of search_jd_rise_time */
+
+double get_jd()
+{
+    return(0.0);
+}
+
+/************************************************************/
+
+static double elapsed_sec(struct timeval *t0, struct timeval *t1)
+{
+    return((t1->tv_sec-t0->tv_sec)+1.0e-6*(t1->tv_usec-t0->tv_usec));
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Site_Params site;
+    Airmass_Table table;
+    Field *sequence,*f;
+    struct timeval t0,t1;
+    double lst,ha,ha_table,am,am_table,alt,az,dha,dam,dsin,dha_max,dam_max;
+    double dsin_max;
+    double batch_sec,single_sec,*ha_single,*am_single;
+    int i,k,num_fields,num_cases,num_up,num_edge,num_failed;
+
+    strcpy(site.site_name,"DEFAULT");
+    load_site(&site.longit,&site.lat,&site.stdz,&site.use_dst,
+            site.zone_name,&site.zabr,&site.elevsea,&site.elev,
+            &site.horiz,site.site_name);
+    init_site_trig(&site);
+
+    num_fields=(int)(24.0/CHECK_RA_STEP)*(int)(1.0+180.0/CHECK_DEC_STEP);
+    sequence=(Field *)calloc(num_fields,sizeof(Field));
+    ha_single=(double *)calloc(2*num_fields,sizeof(double));
+    am_single=ha_single+num_fields;
+    if(sequence==NULL||ha_single==NULL){
+       fprintf(stderr,"check_airmass: could not allocate %d fields\n",num_fields);
+       return(1);
+    }
+
+    num_fields=0;
+    for(i=0;i<=(int)(180.0/CHECK_DEC_STEP);i++){
+       for(k=0;k<(int)(24.0/CHECK_RA_STEP);k++){
+          f=sequence+num_fields;
+          f->ra=k*CHECK_RA_STEP;
+          f->dec=-90.0+i*CHECK_DEC_STEP;
+          init_field_trig(f);
+          num_fields++;
+       }
+    }
+
+    memset((void *)&table,0,sizeof(table));
+    if(load_airmass_table(&table,sequence,num_fields,&site)!=0){
+       free(sequence);
+       free(ha_single);
+       return(1);
+    }
+
+    num_cases=0;
+    num_up=0;
+    num_edge=0;
+    num_failed=0;
+    dha_max=0.0;
+    dam_max=0.0;
+    dsin_max=0.0;
+    batch_sec=0.0;
+    single_sec=0.0;
+
+    for(k=0;k<CHECK_NUM_LST;k++){
+       lst=k*24.0/CHECK_NUM_LST;
+
+       gettimeofday(&t0,NULL);
+       update_airmass_table(&table,lst);
+       gettimeofday(&t1,NULL);
+       batch_sec=batch_sec+elapsed_sec(&t0,&t1);
+
+       gettimeofday(&t0,NULL);
+       for(i=0;i<num_fields;i++){
+          f=sequence+i;
+          ha_single[i]=get_ha(f->ra,lst);
+          am_single[i]=get_airmass(ha_single[i],f->dec,&site);
+       }
+       gettimeofday(&t1,NULL);
+       single_sec=single_sec+elapsed_sec(&t0,&t1);
+
+       for(i=0;i<num_fields;i++){
+          f=sequence+i;
+          ha=ha_single[i];
+          am=am_single[i];
+          num_cases++;
+          if(am<BELOW_HORIZON_AIRMASS)num_up++;
+
+          /* the single-entry lookup must match the whole table */
+
+          am_table=get_table_airmass(&table,i,lst,&ha_table);
+          if(fabs(am_table-table.am[i])>CHECK_AM_TOLERANCE*table.am[i]||
+             ha_table!=table.ha[i]){
+             num_failed++;
+             if(num_failed<=CHECK_MAX_FAILURES){
+                fprintf(stderr,
+                   "check_airmass: ra %7.3f dec %7.2f lst %7.3f get_table_airmass %14.10f %14.10f table %14.10f %14.10f\n",
+                   f->ra,f->dec,lst,ha_table,am_table,table.ha[i],table.am[i]);
+             }
+             continue;
+          }
+
+          dha=fabs(ha-table.ha[i]);
+          if(fabs(dha-24.0)<dha)dha=fabs(dha-24.0);
+          if(dha>dha_max)dha_max=dha;
+
+          if(am<BELOW_HORIZON_AIRMASS&&table.am[i]<BELOW_HORIZON_AIRMASS){
+             dsin=fabs(1.0/am-1.0/table.am[i]);
+             if(dsin>dsin_max)dsin_max=dsin;
+             dam=0.0;
+             if(am<=MAX_AIRMASS){
+                dam=fabs(am-table.am[i])/am;
+                if(dam>dam_max)dam_max=dam;
+             }
+             if(dsin>CHECK_SIN_TOLERANCE)dam=HUGE_VAL;
+          }
+          else if(am<BELOW_HORIZON_AIRMASS||table.am[i]<BELOW_HORIZON_AIRMASS){
+             alt=altit(f->dec,ha,site.lat,&az);
+             if(fabs(alt)<=CHECK_HORIZON_ALT){
+                num_edge++;
+                continue;
+             }
+             dam=HUGE_VAL;
+          }
+          else{
+             dam=0.0;
+          }
+
+          if(dha<=CHECK_HA_TOLERANCE&&dam<=CHECK_AM_TOLERANCE)continue;
+
+          num_failed++;
+          if(num_failed<=CHECK_MAX_FAILURES){
+             fprintf(stderr,
+                "check_airmass: ra %7.3f dec %7.2f lst %7.3f get_airmass %14.10f %14.10f batch %14.10f %14.10f\n",
+                f->ra,f->dec,lst,ha,am,table.ha[i],table.am[i]);
+          }
+       }
+    }
+
+    printf("check_airmass: %d fields and LSTs, %d up, %d at the horizon, %d failed\n",
+       num_cases,num_up,num_edge,num_failed);
+    printf("check_airmass: largest difference %9.2e hours in ha, %9.2e in sin(alt), %9.2e relative in airmass below %3.1f\n",
+       dha_max,dsin_max,dam_max,MAX_AIRMASS);
+    printf("check_airmass: batch %9.4f usec, get_airmass %9.4f usec per field\n",
+       1.0e6*batch_sec/num_cases,1.0e6*single_sec/num_cases);
+
+    free_airmass_table(&table);
+    free(sequence);
+    free(ha_single);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
@@ -0,0 +1,654 @@
+/* check_convert.c
+
+   Check that obs_record_convert turns restart records and journals in
+   the old raw formats into column records that hold the same fields.
+
+   In a scratch directory, a table of synthetic fields, part way
+   through their observations, is written in each old format, and
+   obs_record_convert (CHECK_CONVERT_PROGRAM, built by make) is run on
+   it. The record it writes is read back with read_obs_record and
+   compared with the fields that should be in it. The cases are
+
+     original      a raw record of Legacy_Field, the layout with the
+                   script line and history inside each field (7
+                   numbers on the first line): the same fields
+     journaled     a raw record of the Field array followed by the
+                   Field_History array (8 numbers): the same fields,
+                   and the same generation
+     old journal   a column record with a raw journal of
+                   Legacy_Journal_Record, as the scheduler wrote before
+                   the journal was in columns. The journal holds
+                   CHECK_NUM_EXPOSURES exposures, a record of an older
+                   generation, and a torn last record: the fields with
+                   the exposures, and the next generation
+     refused       a column record with no journal: nothing written,
+                   and an error
+
+   Legacy_Field and Legacy_Journal_Record are copied from
+   obs_record_convert.c, as the layouts the old scheduler wrote.
+
+   syntax: check_convert [verbose]
+
+   Built and run by "make check". The messages of obs_record_convert
+   are discarded unless verbose is 1. Exits with 1 if any case fails.
+
+*/
+
+#include "scheduler.h"
+#include <stddef.h>
+#include <sys/wait.h>
+
+#define CHECK_CONVERT_PROGRAM "./obs_record_convert"
+#define CHECK_NUM_FIELDS 500 /* synthetic fields converted */
+#define CHECK_NUM_EXPOSURES 300 /* exposures in the old journal */
+#define CHECK_GENERATION 3 /* generation of the old records */
+
+int verbose=0;
+
+/* needed by scheduler_record.c */
+
+double focus_start=0.0;
+double focus_increment=0.0;
+double focus_default=0.0;
+
+/* layout of Field before the script line and history were moved to
+   Field_History, and before sin_dec and cos_dec were cached */
+
+typedef struct {
+    int status;
+    int doable;
+    enum Selection_Code selection_code;
+    int field_number;
+    int line_number;
+    char script_line[STR_BUF_LEN];
+    double ra;
+    double dec;
+    double gal_long;
+    double gal_lat;
+    double ecl_long;
+    double ecl_lat;
+    double epoch;
+    int shutter;
+    double expt;
+    double interval;
+    int n_required;
+    int survey_code;
+    double ut_rise;
+    double ut_set;
+    double jd_rise;
+    double jd_set;
+    double jd_next;
+    int n_done;
+    double time_up;
+    double time_required;
+    double time_left;
+    double ut[MAX_OBS_PER_FIELD];
+    double jd[MAX_OBS_PER_FIELD];
+    double lst[MAX_OBS_PER_FIELD];
+    double ha[MAX_OBS_PER_FIELD];
+    double am[MAX_OBS_PER_FIELD];
+    double actual_expt[MAX_OBS_PER_FIELD];
+    char filename[FILENAME_LENGTH*MAX_OBS_PER_FIELD];
+} Legacy_Field;
+
+/* layout of a journal record before the journal was written in the
+   columns of the record */
+
+typedef struct {
+    int magic;             /* OBS_JOURNAL_MAGIC */
+    int generation;        /* generation of the snapshot this record follows */
+    int index;             /* index of field in sequence */
+    int slot;              /* observation slot recorded, -1 for none */
+    Field field;           /* state of field after the change (hist unused) */
+    double ut;             /* values of observation slot */
+    double jd;
+    double lst;
+    double ha;
+    double am;
+    double actual_expt;
+    char filename[FILENAME_LENGTH];
+    unsigned int checksum; /* of the bytes above */
+} Legacy_Journal_Record;
+
+static char check_dir[STR_BUF_LEN];
+static char old_file[STR_BUF_LEN];
+static char journal_file[STR_BUF_LEN];
+static char new_file[STR_BUF_LEN];
+static unsigned int check_seed=1;
+
+/************************************************************/
+
+/* small portable generator, so that runs are repeatable */
+
+static double check_random()
+{
+    check_seed=check_seed*1103515245+12345;
+    return(((check_seed>>8)&0xffffff)/16777216.0);
+}
+
+/************************************************************/
+
+/* record the next exposure of f, numbered k */
+
+static void observe(Field *f, int k)
+{
+    Field_History *h;
+    int n;
+
+    h=f->hist;
+    n=f->n_done;
+    h->jd[n]=2461330.6+k*0.0003;
+    h->ut[n]=fmod(24.0*(h->jd[n]-0.5),24.0);
+    h->lst[n]=f->ra+2.0*check_random()-1.0;
+    h->ha[n]=h->lst[n]-f->ra;
+    h->am[n]=1.0+check_random();
+    h->actual_expt[n]=f->expt*(1.0+0.01*check_random());
+    snprintf(h->filename+n*FILENAME_LENGTH,FILENAME_LENGTH,"%08d%c",k,
+       n%2==0 ? 's' : 'o');
+    f->n_done=n+1;
+    f->jd_next=h->jd[n]+f->interval/24.0;
+    f->time_left=f->time_left-f->expt;
+    f->selection_code=1+k%4;
+    if(f->n_done>=f->n_required)f->status=1;
+}
+
+/************************************************************/
+
+/* fields of a night, some of them observed */
+
+static void make_fields(Field_Table *table, int num_fields)
+{
+    int i,k;
+    Field *f;
+
+    grow_field_table(table,num_fields);
+    for(i=0;i<num_fields;i++){
+       f=table->fields+i;
+       f->status=0;
+       f->doable=1;
+       f->field_number=i;
+       f->line_number=i+1;
+       f->ra=24.0*check_random();
+       f->dec=-90.0+120.0*check_random();
+       init_field_trig(f);
+       f->gal_long=360.0*check_random();
+       f->gal_lat=-90.0+180.0*check_random();
+       f->ecl_long=360.0*check_random();
+       f->ecl_lat=-90.0+180.0*check_random();
+       f->epoch=2026.8;
+       f->shutter=1;
+       f->expt=60.0/3600.0;
+       f->interval=1800.0/3600.0;
+       f->n_required=1+(int)(4*check_random());
+       f->survey_code=(int)(3*check_random());
+       f->ut_rise=24.0*check_random();
+       f->ut_set=24.0*check_random();
+       f->jd_rise=2461330.5+check_random();
+       f->jd_set=f->jd_rise+0.3;
+       f->time_up=7.2;
+       f->time_required=f->n_required*f->interval;
+       f->time_left=f->time_up-f->time_required;
+       sprintf(f->hist->script_line,"%9.6f %9.5f Y 60 1800 %d",
+          f->ra,f->dec,f->n_required);
+       for(k=(int)((f->n_required+1)*check_random());k>0;k--){
+          if(f->n_done<f->n_required)observe(f,i);
+       }
+    }
+    table->num_fields=num_fields;
+}
+
+/************************************************************/
+
+/* a field not done, at random */
+
+static int pick_field(Field_Table *table)
+{
+    int i;
+
+    do{
+       i=(int)(table->num_fields*check_random());
+    }while(table->fields[i].n_done>=table->fields[i].n_required);
+
+    return(i);
+}
+
+/************************************************************/
+
+static int copy_table(Field_Table *dest, Field_Table *src)
+{
+    int i;
+
+    if(grow_field_table(dest,src->num_fields)!=0)return(-1);
+    for(i=0;i<src->num_fields;i++){
+       copy_field(dest->fields+i,src->fields+i);
+    }
+    dest->num_fields=src->num_fields;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* return 0 if the saved members of the fields in t1 and t2 are the
+   same, as in compare_tables of obs_record_convert.c */
+
+static int compare_tables(Field_Table *t1, Field_Table *t2)
+{
+    int c1,c2,result;
+    char file1[STR_BUF_LEN],file2[STR_BUF_LEN];
+    struct tm tm;
+    FILE *input1,*input2;
+
+    memset((void *)&tm,0,sizeof(tm));
+    strcpy(file1,check_dir);
+    strcat(file1,"/compare.1");
+    strcpy(file2,check_dir);
+    strcat(file2,"/compare.2");
+
+    if(write_obs_record(file1,t1,&tm,0)!=0||
+       write_obs_record(file2,t2,&tm,0)!=0){
+       return(-1);
+    }
+
+    input1=fopen(file1,"r");
+    input2=fopen(file2,"r");
+    result=-1;
+    if(input1!=NULL&&input2!=NULL){
+       do{
+          c1=fgetc(input1);
+          c2=fgetc(input2);
+       }while(c1==c2&&c1!=EOF);
+       if(c1==c2)result=0;
+    }
+
+    if(input1!=NULL)fclose(input1);
+    if(input2!=NULL)fclose(input2);
+    unlink(file1);
+    unlink(file2);
+
+    return(result);
+}
+
+/************************************************************/
+
+/* write table to old_file as a raw record of Legacy_Field */
+
+static int write_original(Field_Table *table)
+{
+    FILE *output;
+    Legacy_Field old;
+    Field *f;
+    Field_History *h;
+    int i;
+
+    output=fopen(old_file,"w");
+    if(output==NULL){
+       fprintf(stderr,"check_convert: can't write %s\n",old_file);
+       return(-1);
+    }
+
+    fprintf(output,"%d 126 9 17 3 0 0\n",table->num_fields);
+    for(i=0;i<table->num_fields;i++){
+       f=table->fields+i;
+       h=f->hist;
+       memset((void *)&old,0,sizeof(old));
+       old.status=f->status;
+       old.doable=f->doable;
+       old.selection_code=f->selection_code;
+       old.field_number=f->field_number;
+       old.line_number=f->line_number;
+       old.ra=f->ra;
+       old.dec=f->dec;
+       old.gal_long=f->gal_long;
+       old.gal_lat=f->gal_lat;
+       old.ecl_long=f->ecl_long;
+       old.ecl_lat=f->ecl_lat;
+       old.epoch=f->epoch;
+       old.shutter=f->shutter;
+       old.expt=f->expt;
+       old.interval=f->interval;
+       old.n_required=f->n_required;
+       old.survey_code=f->survey_code;
+       old.ut_rise=f->ut_rise;
+       old.ut_set=f->ut_set;
+       old.jd_rise=f->jd_rise;
+       old.jd_set=f->jd_set;
+       old.jd_next=f->jd_next;
+       old.n_done=f->n_done;
+       old.time_up=f->time_up;
+       old.time_required=f->time_required;
+       old.time_left=f->time_left;
+       memcpy(old.script_line,h->script_line,sizeof(old.script_line));
+       memcpy(old.ut,h->ut,sizeof(old.ut));
+       memcpy(old.jd,h->jd,sizeof(old.jd));
+       memcpy(old.lst,h->lst,sizeof(old.lst));
+       memcpy(old.ha,h->ha,sizeof(old.ha));
+       memcpy(old.am,h->am,sizeof(old.am));
+       memcpy(old.actual_expt,h->actual_expt,sizeof(old.actual_expt));
+       memcpy(old.filename,h->filename,sizeof(old.filename));
+       if(fwrite((void *)&old,sizeof(old),1,output)!=1)break;
+    }
+
+    if(fclose(output)!=0||i<table->num_fields){
+       fprintf(stderr,"check_convert: can't write %s\n",old_file);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* write table to old_file as a raw record of the Field array and the
+   Field_History array */
+
+static int write_journaled(Field_Table *table)
+{
+    FILE *output;
+    int n;
+
+    output=fopen(old_file,"w");
+    if(output==NULL){
+       fprintf(stderr,"check_convert: can't write %s\n",old_file);
+       return(-1);
+    }
+
+    fprintf(output,"%d 126 9 17 3 0 0 %d\n",table->num_fields,CHECK_GENERATION);
+    n=fwrite((void *)table->fields,sizeof(Field),table->num_fields,output);
+    n=n+fwrite((void *)table->history,sizeof(Field_History),table->num_fields,
+       output);
+
+    if(fclose(output)!=0||n!=2*table->num_fields){
+       fprintf(stderr,"check_convert: can't write %s\n",old_file);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* append a raw journal record of field i of table, after its
+   exposure in slot, to output */
+
+static int write_journal_record(FILE *output, Field_Table *table, int i,
+        int slot, int generation)
+{
+    Legacy_Journal_Record r;
+    Field_History *h;
+    unsigned char *p;
+    unsigned int a,b;
+    size_t k,n;
+
+    h=table->fields[i].hist;
+    memset((void *)&r,0,sizeof(r));
+    r.magic=OBS_JOURNAL_MAGIC;
+    r.generation=generation;
+    r.index=i;
+    r.slot=slot;
+    r.field=table->fields[i];
+    r.field.hist=NULL;
+    r.ut=h->ut[slot];
+    r.jd=h->jd[slot];
+    r.lst=h->lst[slot];
+    r.ha=h->ha[slot];
+    r.am=h->am[slot];
+    r.actual_expt=h->actual_expt[slot];
+    memcpy(r.filename,h->filename+slot*FILENAME_LENGTH,FILENAME_LENGTH);
+
+    p=(unsigned char *)&r;
+    n=(unsigned char *)&(r.checksum)-p;
+    a=1;
+    b=0;
+    for(k=0;k<n;k++){
+       a=(a+p[k])%65521;
+       b=(b+a)%65521;
+    }
+    r.checksum=(b<<16)|a;
+
+    if(fwrite((void *)&r,sizeof(r),1,output)!=1)return(-1);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* write table to old_file as a column record, with a raw journal of
+   CHECK_NUM_EXPOSURES exposures after it in journal_file. The
+   exposures are made to table as well */
+
+static int write_old_journal(Field_Table *table)
+{
+    Field_Table other;
+    FILE *output;
+    struct tm tm;
+    int32_t record_size;
+    int i,k,result;
+
+    memset((void *)&tm,0,sizeof(tm));
+    if(write_obs_record(old_file,table,&tm,CHECK_GENERATION)!=0)return(-1);
+
+    /* as the scheduler wrote the record, with raw journal records */
+
+    output=fopen(old_file,"r+");
+    record_size=sizeof(Legacy_Journal_Record);
+    if(output==NULL||
+       fseek(output,offsetof(Obs_Record_Header,journal_record_size),SEEK_SET)!=0||
+       fwrite((void *)&record_size,sizeof(record_size),1,output)!=1){
+       fprintf(stderr,"check_convert: can't change %s\n",old_file);
+       if(output!=NULL)fclose(output);
+       return(-1);
+    }
+    fclose(output);
+
+    output=fopen(journal_file,"w");
+    if(output==NULL){
+       fprintf(stderr,"check_convert: can't write %s\n",journal_file);
+       return(-1);
+    }
+
+    result=0;
+    for(k=0;k<CHECK_NUM_EXPOSURES&&result==0;k++){
+       i=pick_field(table);
+       observe(table->fields+i,CHECK_NUM_FIELDS+k);
+       result=write_journal_record(output,table,i,table->fields[i].n_done-1,
+          CHECK_GENERATION);
+
+       /* a record of the snapshot before, which is passed over */
+
+       if(k==CHECK_NUM_EXPOSURES/2&&result==0){
+          init_field_table(&other);
+          result=copy_table(&other,table);
+          if(result==0){
+             i=pick_field(&other);
+             observe(other.fields+i,0);
+             result=write_journal_record(output,&other,i,
+                other.fields[i].n_done-1,CHECK_GENERATION-1);
+          }
+          free_field_table(&other);
+       }
+    }
+
+    /* and the first half of a record the scheduler was writing */
+
+    if(result==0){
+       init_field_table(&other);
+       result=copy_table(&other,table);
+       if(result==0){
+          i=pick_field(&other);
+          observe(other.fields+i,0);
+          result=write_journal_record(output,&other,i,
+             other.fields[i].n_done-1,CHECK_GENERATION);
+       }
+       free_field_table(&other);
+    }
+
+    if(fclose(output)!=0||result!=0||
+       truncate(journal_file,
+          (CHECK_NUM_EXPOSURES+1)*sizeof(Legacy_Journal_Record)+
+          sizeof(Legacy_Journal_Record)/2)!=0){
+       fprintf(stderr,"check_convert: can't write %s\n",journal_file);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* run obs_record_convert on old_file, and journal_file if journal is
+   True. Returns its exit status, or -1 if it can't be run */
+
+static int convert(bool journal)
+{
+    pid_t pid;
+    int status;
+
+    pid=fork();
+    if(pid<0)return(-1);
+    if(pid==0){
+       if(!verbose&&freopen("/dev/null","w",stderr)==NULL)_exit(127);
+       if(journal){
+          execl(CHECK_CONVERT_PROGRAM,CHECK_CONVERT_PROGRAM,old_file,new_file,
+             journal_file,(char *)NULL);
+       }
+       else{
+          execl(CHECK_CONVERT_PROGRAM,CHECK_CONVERT_PROGRAM,old_file,new_file,
+             (char *)NULL);
+       }
+       _exit(127);
+    }
+
+    if(waitpid(pid,&status,0)!=pid||!WIFEXITED(status))return(-1);
+    if(WEXITSTATUS(status)==127){
+       fprintf(stderr,"check_convert: can't run %s\n",CHECK_CONVERT_PROGRAM);
+       return(-1);
+    }
+
+    return(WEXITSTATUS(status));
+}
+
+/************************************************************/
+
+/* convert old_file (and journal_file), and check that new_file holds
+   the fields of expected, at generation. Returns 0 if it does */
+
+static int check_case(char *name, bool journal, Field_Table *expected,
+        int generation)
+{
+    Field_Table table;
+    Obs_Record_Header header;
+    int n,result;
+
+    unlink(new_file);
+    n=convert(journal);
+    if(n!=0){
+       fprintf(stderr,"check_convert: %s: obs_record_convert exits with %d\n",
+          name,n);
+       return(-1);
+    }
+
+    init_field_table(&table);
+    n=read_obs_record(new_file,&table,&header);
+    result=0;
+    if(n!=expected->num_fields){
+       fprintf(stderr,"check_convert: %s: %d fields read, not %d\n",
+          name,n,expected->num_fields);
+       result=-1;
+    }
+    else if(header.generation!=generation){
+       fprintf(stderr,"check_convert: %s: generation %d, not %d\n",
+          name,header.generation,generation);
+       result=-1;
+    }
+    else if(compare_tables(&table,expected)!=0){
+       fprintf(stderr,"check_convert: %s: the fields differ\n",name);
+       result=-1;
+    }
+    free_field_table(&table);
+
+    if(verbose){
+       fprintf(stderr,"check_convert: %-12s %d fields, generation %d%s\n",
+          name,n,header.generation,result==0 ? "" : ", failed");
+    }
+
+    return(result);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Field_Table table;
+    struct tm tm;
+    int num_cases,num_failed;
+
+    if(argc>1)verbose=atoi(argv[1]);
+
+    strcpy(check_dir,"/tmp/check_convert.XXXXXX");
+    if(mkdtemp(check_dir)==NULL){
+       fprintf(stderr,"check_convert: can't make scratch directory\n");
+       return(1);
+    }
+    strcpy(old_file,check_dir);
+    strcat(old_file,"/old_record");
+    strcpy(journal_file,check_dir);
+    strcat(journal_file,"/old_journal");
+    strcpy(new_file,check_dir);
+    strcat(new_file,"/new_record");
+
+    init_field_table(&table);
+    make_fields(&table,CHECK_NUM_FIELDS);
+
+    num_cases=0;
+    num_failed=0;
+
+    /* original */
+
+    num_cases++;
+    if(write_original(&table)!=0||check_case("original",False,&table,0)!=0){
+       num_failed++;
+    }
+
+    /* journaled */
+
+    num_cases++;
+    if(write_journaled(&table)!=0||
+       check_case("journaled",False,&table,CHECK_GENERATION)!=0){
+       num_failed++;
+    }
+
+    /* old journal */
+
+    num_cases++;
+    if(write_old_journal(&table)!=0||
+       check_case("old journal",True,&table,CHECK_GENERATION+1)!=0){
+       num_failed++;
+    }
+
+    /* refused */
+
+    num_cases++;
+    memset((void *)&tm,0,sizeof(tm));
+    unlink(new_file);
+    if(write_obs_record(old_file,&table,&tm,CHECK_GENERATION)!=0||
+       convert(False)<=0||access(new_file,F_OK)==0){
+       fprintf(stderr,"check_convert: refused: a column record was converted\n");
+       num_failed++;
+    }
+
+    unlink(old_file);
+    unlink(journal_file);
+    unlink(new_file);
+    rmdir(check_dir);
+    free_field_table(&table);
+
+    printf("check_convert: %d fields, %d journaled exposures, %d cases, %d failed\n",
+       CHECK_NUM_FIELDS,CHECK_NUM_EXPOSURES,num_cases,num_failed);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
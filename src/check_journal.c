@@ -0,0 +1,601 @@
+/* check_journal.c
+
+   Check that load_obs_record restores the fields journaled by
+   journal_field and save_obs_record (see scheduler_record.c) after
+   the scheduler stops at any point, including part way through
+   writing the journal.
+
+   In a scratch directory, CHECK_NUM_EXPOSURES exposures of
+   CHECK_NUM_FIELDS synthetic fields are journaled, with snapshots
+   saved between them, and the scheduler "crashes" by dropping the
+   journal without closing it. Each case below then damages the
+   journal, loads the snapshot and journal into a new table, and
+   compares the table with the state the fields should have:
+
+     crash          journal left as written: all exposures
+     torn record    last record cut short: all but the last exposure,
+                    and the partial record is dropped from the journal
+     short header   journal cut inside its header: the snapshot
+     checksum       a byte of the last record changed: all but the
+                    last exposure
+     generation     the journal of the previous snapshot left next to
+                    a new snapshot (a crash between writing the
+                    snapshot and starting its journal), with exposures
+                    marked undone since: the snapshot
+     layout         the column table of the journal reordered, as by
+                    a build with other columns: all exposures, folded
+                    into a new snapshot
+
+   After each load more exposures are journaled to the reloaded table,
+   and loaded again, to check that the journal is appended after the
+   last good record. Tables are compared through the snapshots
+   write_obs_record writes of them.
+
+   syntax: check_journal [verbose]
+
+   Built and run by "make check". The messages of load_obs_record are
+   discarded unless verbose is 1. Exits with 1 if any case fails.
+
+*/
+
+#include "scheduler.h"
+#include <sys/stat.h>
+
+#define CHECK_NUM_FIELDS 3000 /* synthetic fields journaled */
+#define CHECK_NUM_EXPOSURES 1200 /* exposures journaled before the crash */
+#define CHECK_NUM_SNAPSHOTS 2 /* snapshots saved among the exposures */
+#define CHECK_NUM_MORE 20 /* exposures journaled after each reload */
+#define CHECK_NUM_UNDONE 10 /* exposures marked undone in the new snapshot */
+
+int verbose=0;
+
+/* needed by scheduler_record.c */
+
+double focus_start=0.0;
+double focus_increment=0.0;
+double focus_default=0.0;
+
+static char check_dir[STR_BUF_LEN];
+static char record_file[STR_BUF_LEN];
+static char journal_file[STR_BUF_LEN];
+static FILE *check_log;
+static unsigned int check_seed=1;
+
+/************************************************************/
+
+/* small portable generator, so that runs are repeatable */
+
+static double check_random()
+{
+    check_seed=check_seed*1103515245+12345;
+    return(((check_seed>>8)&0xffffff)/16777216.0);
+}
+
+/************************************************************/
+
+static void make_fields(Field_Table *table, int num_fields)
+{
+    int i;
+    Field *f;
+
+    grow_field_table(table,num_fields);
+    for(i=0;i<num_fields;i++){
+       f=table->fields+i;
+       f->status=0;
+       f->doable=1;
+       f->field_number=i;
+       f->line_number=i+1;
+       f->ra=24.0*check_random();
+       f->dec=-90.0+120.0*check_random();
+       f->shutter=1;
+       f->expt=60.0/3600.0;
+       f->interval=1800.0/3600.0;
+       f->n_required=1+(int)(4*check_random());
+       f->survey_code=1;
+       f->jd_rise=2461330.5+check_random();
+       f->jd_set=f->jd_rise+0.3;
+       sprintf(f->hist->script_line,"%9.6f %9.5f Y 60 1800 %d",
+          f->ra,f->dec,f->n_required);
+    }
+    table->num_fields=num_fields;
+}
+
+/************************************************************/
+
+/* the next exposure of a field that is not done, as the scheduler
+   would record it */
+
+static int observe(Field_Table *table, Obs_Journal *journal, struct tm *tm,
+     int k)
+{
+    int i,n;
+    Field *f;
+    Field_History *h;
+
+    do{
+       i=(int)(table->num_fields*check_random());
+       f=table->fields+i;
+    }while(f->n_done>=f->n_required);
+
+    h=f->hist;
+    n=f->n_done;
+    h->jd[n]=2461330.6+k*0.0003;
+    h->ut[n]=fmod(24.0*(h->jd[n]-0.5),24.0);
+    h->lst[n]=f->ra+2.0*check_random()-1.0;
+    h->ha[n]=h->lst[n]-f->ra;
+    h->am[n]=1.0+check_random();
+    h->actual_expt[n]=f->expt*(1.0+0.01*check_random());
+    snprintf(h->filename+n*FILENAME_LENGTH,FILENAME_LENGTH,"%08d%c",k,
+       n%2==0 ? 's' : 'o');
+    f->n_done=n+1;
+    f->jd_next=h->jd[n]+f->interval/24.0;
+    f->time_left=f->time_left-f->expt;
+    f->selection_code=1+k%4;
+    if(f->n_done>=f->n_required)f->status=1;
+
+    return(journal_field(table,journal,i,tm));
+}
+
+/************************************************************/
+
+static int copy_table(Field_Table *dest, Field_Table *src)
+{
+    int i;
+
+    if(grow_field_table(dest,src->num_fields)!=0)return(-1);
+    for(i=0;i<src->num_fields;i++){
+       copy_field(dest->fields+i,src->fields+i);
+    }
+    dest->num_fields=src->num_fields;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* return 0 if the saved members of the fields in t1 and t2 are the
+   same, as in compare_tables of obs_record_convert.c */
+
+static int compare_tables(Field_Table *t1, Field_Table *t2)
+{
+    int c1,c2,result;
+    char file1[STR_BUF_LEN],file2[STR_BUF_LEN];
+    struct tm tm;
+    FILE *input1,*input2;
+
+    memset((void *)&tm,0,sizeof(tm));
+    strcpy(file1,check_dir);
+    strcat(file1,"/compare.1");
+    strcpy(file2,check_dir);
+    strcat(file2,"/compare.2");
+
+    if(write_obs_record(file1,t1,&tm,0)!=0||
+       write_obs_record(file2,t2,&tm,0)!=0){
+       return(-1);
+    }
+
+    input1=fopen(file1,"r");
+    input2=fopen(file2,"r");
+    result=-1;
+    if(input1!=NULL&&input2!=NULL){
+       do{
+          c1=fgetc(input1);
+          c2=fgetc(input2);
+       }while(c1==c2&&c1!=EOF);
+       if(c1==c2)result=0;
+    }
+
+    if(input1!=NULL)fclose(input1);
+    if(input2!=NULL)fclose(input2);
+    unlink(file1);
+    unlink(file2);
+
+    return(result);
+}
+
+/************************************************************/
+
+static long file_size(char *file_name)
+{
+    struct stat st;
+
+    if(stat(file_name,&st)!=0)return(-1);
+
+    return((long)st.st_size);
+}
+
+/************************************************************/
+
+static int copy_file(char *from, char *to)
+{
+    int c;
+    FILE *input,*output;
+
+    input=fopen(from,"r");
+    output=fopen(to,"w");
+    if(input==NULL||output==NULL){
+       if(input!=NULL)fclose(input);
+       if(output!=NULL)fclose(output);
+       return(-1);
+    }
+    while((c=fgetc(input))!=EOF)fputc(c,output);
+    fclose(input);
+    fclose(output);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* the size of the journal header and column table, and of a record */
+
+static int read_layout(long *data_offset, int *record_size)
+{
+    Obs_Journal_Header header;
+    FILE *input;
+
+    input=fopen(journal_file,"r");
+    if(input==NULL)return(-1);
+    if(fread((void *)&header,sizeof(header),1,input)!=1){
+       fclose(input);
+       return(-1);
+    }
+    fclose(input);
+
+    *data_offset=header.header_size+(long)header.num_columns*header.column_size;
+    *record_size=header.record_size;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* reverse the order of the entries in the column table of the
+   journal, keeping where each value is in the records */
+
+static int reorder_columns()
+{
+    int i,n;
+    Obs_Journal_Header header;
+    Obs_Record_Column *column,swap;
+    FILE *file;
+
+    file=fopen(journal_file,"r+");
+    if(file==NULL)return(-1);
+    if(fread((void *)&header,sizeof(header),1,file)!=1){
+       fclose(file);
+       return(-1);
+    }
+    n=header.num_columns;
+    column=(Obs_Record_Column *)malloc(n*sizeof(Obs_Record_Column));
+    fseek(file,header.header_size,SEEK_SET);
+    if(column==NULL||
+       fread((void *)column,sizeof(Obs_Record_Column),n,file)!=(size_t)n){
+       free(column);
+       fclose(file);
+       return(-1);
+    }
+    for(i=0;i<n/2;i++){
+       swap=column[i];
+       column[i]=column[n-1-i];
+       column[n-1-i]=swap;
+    }
+    fseek(file,header.header_size,SEEK_SET);
+    fwrite((void *)column,sizeof(Obs_Record_Column),n,file);
+    free(column);
+    fclose(file);
+
+    return(0);
+}
+
+/************************************************************/
+
+static int flip_byte(long offset)
+{
+    int c;
+    FILE *file;
+
+    file=fopen(journal_file,"r+");
+    if(file==NULL)return(-1);
+    fseek(file,offset,SEEK_SET);
+    c=fgetc(file);
+    fseek(file,offset,SEEK_SET);
+    fputc(c^0x5a,file);
+    fclose(file);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* mark the last exposure of up to CHECK_NUM_UNDONE fields undone, as
+   the scheduler does when an exposure fails. Returns the number */
+
+static int undo_exposures(Field_Table *table)
+{
+    int i,n;
+    Field *f;
+
+    n=0;
+    for(i=0;i<table->num_fields&&n<CHECK_NUM_UNDONE;i++){
+       f=table->fields+i;
+       if(f->n_done==0)continue;
+       f->n_done--;
+       f->status=0;
+       n++;
+    }
+
+    return(n);
+}
+
+/************************************************************/
+
+static void reset_files()
+{
+    unlink(record_file);
+    unlink(journal_file);
+}
+
+/************************************************************/
+
+/* journal the exposures of a new night, with num_snapshots snapshots
+   among them, and drop the journal as a crash would. live is left
+   with the state of the fields, and before with the state before the
+   last exposure. Returns the generation of the last snapshot */
+
+static int run_night(Field_Table *live, Field_Table *before,
+     int num_exposures, int num_snapshots, struct tm *tm)
+{
+    int k,n;
+    Obs_Journal journal;
+
+    reset_files();
+    check_seed=1;
+    init_field_table(live);
+    memset((void *)&journal,0,sizeof(journal));
+    if(load_obs_record(record_file,journal_file,live,&journal)!=0){
+       return(-1);
+    }
+    make_fields(live,CHECK_NUM_FIELDS);
+    if(save_obs_record(live,&journal,tm)!=0)return(-1);
+
+    n=0;
+    for(k=0;k<num_exposures;k++){
+       if(k==num_exposures-1&&copy_table(before,live)!=0)return(-1);
+       if(observe(live,&journal,tm,k)!=0)return(-1);
+       if(n<num_snapshots&&k+1==(n+1)*num_exposures/(num_snapshots+1)){
+          if(save_obs_record(live,&journal,tm)!=0)return(-1);
+          n++;
+       }
+    }
+
+    /* the crash */
+
+    fclose(journal.journal);
+    free(journal.n_journaled);
+
+    return(journal.generation);
+}
+
+/************************************************************/
+
+/* load the snapshot and journal and compare them with expected. Then
+   journal more exposures, crash again, and compare the next load */
+
+static int check_load(char *name, Field_Table *expected)
+{
+    int k,num_fields;
+    Field_Table table,again;
+    Obs_Journal journal;
+    struct tm tm;
+
+    memset((void *)&tm,0,sizeof(tm));
+    init_field_table(&table);
+    init_field_table(&again);
+    memset((void *)&journal,0,sizeof(journal));
+
+    num_fields=load_obs_record(record_file,journal_file,&table,&journal);
+    if(num_fields!=expected->num_fields){
+       fprintf(check_log,"check_journal: %s: %d fields loaded, not %d\n",
+          name,num_fields,expected->num_fields);
+       return(-1);
+    }
+    if(compare_tables(&table,expected)!=0){
+       fprintf(check_log,"check_journal: %s: loaded fields differ\n",name);
+       return(-1);
+    }
+
+    for(k=0;k<CHECK_NUM_MORE;k++){
+       if(observe(&table,&journal,&tm,CHECK_NUM_EXPOSURES+k)!=0){
+          fprintf(check_log,"check_journal: %s: can't journal after loading\n",
+             name);
+          return(-1);
+       }
+    }
+    fclose(journal.journal);
+    free(journal.n_journaled);
+    memset((void *)&journal,0,sizeof(journal));
+
+    num_fields=load_obs_record(record_file,journal_file,&again,&journal);
+    if(num_fields!=table.num_fields||compare_tables(&again,&table)!=0){
+       fprintf(check_log,"check_journal: %s: fields journaled after loading differ\n",
+          name);
+       return(-1);
+    }
+    close_obs_record(&journal);
+    free(journal.n_journaled);
+
+    free_field_table(&table);
+    free_field_table(&again);
+
+    return(0);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    int generation,record_size,num_cases,num_failed;
+    long data_offset,end;
+    char old_journal[STR_BUF_LEN];
+    struct tm tm;
+    Field_Table live,before,snapshot;
+    Obs_Record_Header header;
+
+    if(argc>1)verbose=atoi(argv[1]);
+
+    /* failures go to the real stderr, the messages of the code
+       checked only if verbose */
+
+    check_log=fdopen(dup(fileno(stderr)),"w");
+    setvbuf(check_log,NULL,_IOLBF,0);
+    if(!verbose&&freopen("/dev/null","w",stderr)==NULL){
+       fprintf(check_log,"check_journal: can't discard messages\n");
+    }
+
+    strcpy(check_dir,"/tmp/check_journal.XXXXXX");
+    if(mkdtemp(check_dir)==NULL){
+       fprintf(check_log,"check_journal: can't make scratch directory\n");
+       return(1);
+    }
+    snprintf(record_file,STR_BUF_LEN,"%s/%s",check_dir,OBS_RECORD_FILE);
+    snprintf(journal_file,STR_BUF_LEN,"%s/%s",check_dir,OBS_JOURNAL_FILE);
+    snprintf(old_journal,STR_BUF_LEN,"%s/old_journal",check_dir);
+
+    memset((void *)&tm,0,sizeof(tm));
+    init_field_table(&before);
+    init_field_table(&snapshot);
+    num_cases=0;
+    num_failed=0;
+
+    /* crash */
+
+    num_cases++;
+    generation=run_night(&live,&before,CHECK_NUM_EXPOSURES,
+       CHECK_NUM_SNAPSHOTS,&tm);
+    if(generation!=CHECK_NUM_SNAPSHOTS+1){
+       fprintf(check_log,"check_journal: crash: generation %d, not %d\n",
+          generation,CHECK_NUM_SNAPSHOTS+1);
+       num_failed++;
+    }
+    else if(check_load("crash",&live)!=0){
+       num_failed++;
+    }
+    free_field_table(&live);
+
+    /* torn record */
+
+    num_cases++;
+    run_night(&live,&before,CHECK_NUM_EXPOSURES,CHECK_NUM_SNAPSHOTS,&tm);
+    end=file_size(journal_file);
+    if(read_layout(&data_offset,&record_size)!=0||
+       truncate(journal_file,end-record_size/2)!=0){
+       fprintf(check_log,"check_journal: torn record: can't cut journal\n");
+       num_failed++;
+    }
+    else if(check_load("torn record",&before)!=0){
+       num_failed++;
+    }
+    free_field_table(&live);
+
+    /* the torn record must be gone before more are appended: the
+       journal of the second load holds whole records only */
+
+    num_cases++;
+    end=file_size(journal_file);
+    if(end<data_offset||(end-data_offset)%record_size!=0){
+       fprintf(check_log,
+         "check_journal: torn record: journal of %ld bytes is not whole records\n",
+         end);
+       num_failed++;
+    }
+
+    /* short header */
+
+    num_cases++;
+    run_night(&live,&before,CHECK_NUM_EXPOSURES,CHECK_NUM_SNAPSHOTS,&tm);
+    init_field_table(&snapshot);
+    if(read_obs_record(record_file,&snapshot,&header)!=CHECK_NUM_FIELDS||
+       truncate(journal_file,sizeof(Obs_Journal_Header)/2)!=0){
+       fprintf(check_log,"check_journal: short header: can't cut journal\n");
+       num_failed++;
+    }
+    else if(check_load("short header",&snapshot)!=0){
+       num_failed++;
+    }
+    free_field_table(&live);
+    free_field_table(&snapshot);
+
+    /* checksum */
+
+    num_cases++;
+    run_night(&live,&before,CHECK_NUM_EXPOSURES,CHECK_NUM_SNAPSHOTS,&tm);
+    end=file_size(journal_file);
+    if(read_layout(&data_offset,&record_size)!=0||
+       flip_byte(end-record_size/2)!=0){
+       fprintf(check_log,"check_journal: checksum: can't change journal\n");
+       num_failed++;
+    }
+    else if(check_load("checksum",&before)!=0){
+       num_failed++;
+    }
+    free_field_table(&live);
+
+    /* generation: the journal as it was before the last snapshot,
+       left next to that snapshot. Exposures are marked undone before
+       the snapshot, so that its state differs from the journal's */
+
+    num_cases++;
+    run_night(&live,&before,CHECK_NUM_EXPOSURES,0,&tm);
+    init_field_table(&snapshot);
+    if(copy_file(journal_file,old_journal)!=0||
+       read_obs_record(record_file,&snapshot,&header)!=CHECK_NUM_FIELDS){
+       fprintf(check_log,"check_journal: generation: can't copy journal\n");
+       num_failed++;
+    }
+    else if(undo_exposures(&live)==0||write_obs_record(record_file,&live,&tm,header.generation+1)!=0||
+       rename(old_journal,journal_file)!=0){
+       fprintf(check_log,"check_journal: generation: can't save snapshot\n");
+       num_failed++;
+    }
+    else if(check_load("generation",&live)!=0){
+       num_failed++;
+    }
+    free_field_table(&live);
+    free_field_table(&snapshot);
+
+    /* layout */
+
+    num_cases++;
+    run_night(&live,&before,CHECK_NUM_EXPOSURES,CHECK_NUM_SNAPSHOTS,&tm);
+    init_field_table(&snapshot);
+    if(reorder_columns()!=0){
+       fprintf(check_log,"check_journal: layout: can't change journal\n");
+       num_failed++;
+    }
+    else if(check_load("layout",&live)!=0){
+       num_failed++;
+    }
+    else if(read_obs_record(record_file,&snapshot,&header)!=CHECK_NUM_FIELDS||
+       header.generation!=CHECK_NUM_SNAPSHOTS+2){
+       fprintf(check_log,
+         "check_journal: layout: journal not folded into a new snapshot\n");
+       num_failed++;
+    }
+    free_field_table(&live);
+    free_field_table(&snapshot);
+    free_field_table(&before);
+
+    reset_files();
+    rmdir(check_dir);
+
+    printf("check_journal: %d fields, %d exposures, %d snapshots, %d cases, %d failed\n",
+       CHECK_NUM_FIELDS,CHECK_NUM_EXPOSURES,CHECK_NUM_SNAPSHOTS,num_cases,
+       num_failed);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
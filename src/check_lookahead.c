@@ -0,0 +1,306 @@
+/* check_lookahead.c
+
+   Check the lookahead of get_next_field (scheduler_lookahead.c) over
+   synthetic nights crowded with fields of two visits a short interval
+   apart, many of them in pairs next to each other in RA, and a few
+   must-do fields among them. Each night is observed once greedily
+   (lookahead_depth 0) and once with each depth of check_depths, as the
+   main loop observes it: each visit costs the predicted slew, the
+   exposure time and exp_overhead_hours. The cases are
+
+     must-do      every must-do field is completed, at every depth
+     completed    over all the nights, every depth completes at least
+                  CHECK_MIN_GAIN times as many fields as the greedy
+                  selection (on these nights it completes about 1.6
+                  times as many, and a lookahead that keeps the worst
+                  sequence, or does not count completed fields, about
+                  1.1 to 1.3 times)
+     time         no selection takes longer than the time-box of the
+                  lookahead, and the mean selection less than
+                  CHECK_MEAN_SELECT_SEC
+
+   Prints the fields completed and the time per selection at each
+   depth.
+
+   syntax: check_lookahead [verbose]
+
+   Built and run by "make check". Exits with 1 if any case fails.
+
+*/
+
+#include "scheduler.h"
+#include <sys/time.h>
+
+#define CHECK_NUM_NIGHTS 6 /* nights observed at each depth */
+#define CHECK_NUM_FIELDS 300 /* fields of each night, more than fit */
+#define CHECK_JD_START 2461331.6 /* start of the first night */
+#define CHECK_NIGHT_HOURS 10.0 /* length of each night */
+#define CHECK_MUSTDO 0.03 /* chance that a field is must-do */
+#define CHECK_PAIR 0.3 /* chance that a field is followed by its pair */
+#define CHECK_OVERHEAD_HOURS (30.0/3600.0) /* readout and setup per exposure */
+#define CHECK_MIN_GAIN 1.4 /* least ratio of fields completed to greedy */
+#define CHECK_MEAN_SELECT_SEC 0.005 /* longest mean time of a selection */
+
+int verbose=0;
+int verbose1=0;
+double exp_overhead_hours=CHECK_OVERHEAD_HOURS;
+
+/* the lookahead reads the bitsets only for fields they hold. The
+   check leaves them empty, so that it takes jd_rise and jd_set */
+
+Visibility_Table visibility_table;
+
+static int check_depths[]={LOOKAHEAD_DEFAULT_DEPTH,LOOKAHEAD_MAX_DEPTH};
+static unsigned int check_seed=1;
+
+/************************************************************/
+
+/* get_next_field calls these only with follow_plan, or with fields in
+   visibility_table */
+
+int planned_next_field(Field *sequence, int num_fields, double jd,
+        int bad_weather)
+{
+    return(-1);
+}
+
+double next_visible_jd(Visibility_Table *vis, int i, double jd)
+{
+    return(-1.0);
+}
+
+double visible_until_jd(Visibility_Table *vis, int i, double jd)
+{
+    return(-1.0);
+}
+
+/************************************************************/
+
+/* small portable generator, so that runs are repeatable */
+
+static double check_random()
+{
+    check_seed=check_seed*1103515245+12345;
+    return(((check_seed>>8)&0xffffff)/16777216.0);
+}
+
+/************************************************************/
+
+static double elapsed_sec(struct timeval *t0, struct timeval *t1)
+{
+    return((t1->tv_sec-t0->tv_sec)+1.0e-6*(t1->tv_usec-t0->tv_usec));
+}
+
+/************************************************************/
+
+/* fill in the fields of a night from jd_start to jd_end in table.
+   Returns 0, or -1 on an error */
+
+static int make_night(Field_Table *table, double jd_start, double jd_end)
+{
+    Field *f;
+    int i,paired;
+
+    if(grow_field_table(table,CHECK_NUM_FIELDS)!=0)return(-1);
+
+    paired=1;
+
+    for(i=0;i<CHECK_NUM_FIELDS;i++){
+       f=table->fields+i;
+       f->field_number=i+1;
+       f->line_number=i+1;
+       f->doable=1;
+       f->status=NOT_DOABLE_STATUS;
+       f->selection_code=NOT_SELECTED;
+       f->survey_code=TNO_SURVEY_CODE;
+       f->shutter=SKY_CODE;
+       f->n_done=0;
+       f->n_required=2;
+       f->interval=0.1;
+
+       if(!paired&&f[-1].survey_code!=MUSTDO_SURVEY_CODE&&
+          check_random()<CHECK_PAIR){
+          /* the pair of the field before */
+          f->ra=f[-1].ra+0.5*RA_STEP0/cos(f[-1].dec*DEG_TO_RAD);
+          if(f->ra>=24.0)f->ra=f->ra-24.0;
+          f->dec=f[-1].dec;
+          f->expt=f[-1].expt;
+          f->jd_rise=f[-1].jd_rise;
+          f->jd_set=f[-1].jd_set;
+          paired=1;
+       }
+       else{
+          paired=0;
+          f->ra=24.0*check_random();
+          f->dec=-60.0+80.0*check_random();
+          f->expt=(60.0+60.0*check_random())/3600.0;
+          f->jd_rise=jd_start+(jd_end-jd_start-2.0/24.0)*check_random();
+          f->jd_set=f->jd_rise+(0.5+2.5*check_random())/24.0;
+          if(check_random()<CHECK_MUSTDO){
+             f->survey_code=MUSTDO_SURVEY_CODE;
+             f->jd_set=f->jd_rise+2.0/24.0;
+          }
+       }
+       f->jd_next=f->jd_rise;
+    }
+
+    table->num_fields=CHECK_NUM_FIELDS;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* observe night at depth. Returns the number of fields completed, or
+   -1 on an error. Adds the must-do fields not completed to
+   *num_mustdo_missed, the selections to *num_picks and their time to
+   *select_sec, and keeps the longest in *max_select_sec */
+
+static int observe_night(int night, int depth, int *num_mustdo_missed,
+        int *num_picks, double *select_sec, double *max_select_sec)
+{
+    Field_Table table;
+    Field_Events events;
+    Selection_Settings settings;
+    struct timeval t0,t1;
+    Field *f;
+    double jd,jd_start,jd_end,ra,dec,dt;
+    int i,i_prev,num_completed;
+
+    check_seed=1+night;
+    memset((void *)&settings,0,sizeof(settings));
+    settings.slew_cost_on=1;
+    settings.lookahead_depth=depth;
+    clear_slew_position();
+
+    jd_start=CHECK_JD_START+night;
+    jd_end=jd_start+CHECK_NIGHT_HOURS/24.0;
+
+    init_field_table(&table);
+    memset((void *)&events,0,sizeof(events));
+    if(make_night(&table,jd_start,jd_end)!=0||
+       init_field_events(&events,table.num_fields)!=0){
+       fprintf(stderr,"check_lookahead: could not make %d fields\n",
+          CHECK_NUM_FIELDS);
+       free_field_table(&table);
+       return(-1);
+    }
+
+    jd=jd_start;
+    i_prev=-1;
+    while(jd<jd_end){
+       gettimeofday(&t0,NULL);
+       i=get_next_field(&settings,&events,table.fields,table.num_fields,
+          i_prev,jd,0);
+       gettimeofday(&t1,NULL);
+       dt=elapsed_sec(&t0,&t1);
+       (*num_picks)++;
+       *select_sec=*select_sec+dt;
+       if(dt>*max_select_sec)*max_select_sec=dt;
+
+       if(i<0){
+          jd=jd+LOOP_WAIT_SEC/86400.0;
+          continue;
+       }
+
+       f=table.fields+i;
+       if(get_slew_position(&ra,&dec)==0){
+          jd=jd+get_slew_time_between(ra,dec,f->ra,f->dec)/86400.0;
+       }
+       record_slew(f->ra,f->dec,f->ra,f->dec,-1.0);
+
+       f->n_done++;
+       f->jd_next=jd+f->interval/24.0;
+       field_status_changed(&events,i);
+
+       jd=jd+(f->expt+exp_overhead_hours)/24.0;
+       i_prev=i;
+    }
+
+    num_completed=0;
+    for(i=0;i<table.num_fields;i++){
+       f=table.fields+i;
+       if(f->n_done>=f->n_required){
+          num_completed++;
+       }
+       else if(f->survey_code==MUSTDO_SURVEY_CODE){
+          fprintf(stderr,"check_lookahead: night %d depth %d: must-do field %d done %d of %d\n",
+             night,depth,i,f->n_done,f->n_required);
+          (*num_mustdo_missed)++;
+       }
+    }
+
+    if(verbose){
+       fprintf(stderr,"check_lookahead: night %d depth %d: %d fields completed\n",
+          night,depth,num_completed);
+    }
+
+    free_field_events(&events);
+    free_field_table(&table);
+
+    return(num_completed);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    int num_depths,num_completed[LOOKAHEAD_MAX_DEPTH+1],num_picks,num_missed;
+    int night,d,depth,n,num_cases,num_failed,failed;
+    double select_sec,max_select_sec,max_sec;
+
+    if(argc>1)verbose=atoi(argv[1]);
+
+    memset((void *)&visibility_table,0,sizeof(visibility_table));
+
+    num_depths=1+sizeof(check_depths)/sizeof(check_depths[0]);
+    num_missed=0;
+    failed=0;
+
+    max_sec=LOOKAHEAD_READOUT_FRACTION*exp_overhead_hours*3600.0;
+    if(max_sec>LOOKAHEAD_MAX_SEC)max_sec=LOOKAHEAD_MAX_SEC;
+
+    num_cases=3;
+    num_failed=0;
+
+    for(d=0;d<num_depths;d++){
+       depth=d==0 ? 0 : check_depths[d-1];
+       num_completed[d]=0;
+       num_picks=0;
+       select_sec=0.0;
+       max_select_sec=0.0;
+       for(night=0;night<CHECK_NUM_NIGHTS;night++){
+          n=observe_night(night,depth,&num_missed,&num_picks,&select_sec,
+             &max_select_sec);
+          if(n<0)return(1);
+          num_completed[d]=num_completed[d]+n;
+       }
+
+       printf("check_lookahead: depth %d: %d fields completed, %8.4f msec per selection, at most %8.4f msec\n",
+          depth,num_completed[d],1.0e3*select_sec/num_picks,1.0e3*max_select_sec);
+
+       if(d>0&&num_completed[d]<CHECK_MIN_GAIN*num_completed[0]){
+          fprintf(stderr,"check_lookahead: completed: depth %d completes %d fields, greedy %d\n",
+             depth,num_completed[d],num_completed[0]);
+          failed=failed|1;
+       }
+       if(select_sec/num_picks>CHECK_MEAN_SELECT_SEC||max_select_sec>max_sec){
+          fprintf(stderr,"check_lookahead: time: depth %d takes %8.4f msec per selection, at most %8.4f msec\n",
+             depth,1.0e3*select_sec/num_picks,1.0e3*max_select_sec);
+          failed=failed|2;
+       }
+    }
+
+    if(num_missed>0)num_failed++;
+    if(failed&1)num_failed++;
+    if(failed&2)num_failed++;
+
+    printf("check_lookahead: %d nights, %d fields, %d cases, %d failed\n",
+       CHECK_NUM_NIGHTS,CHECK_NUM_FIELDS,num_cases,num_failed);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
@@ -0,0 +1,330 @@
+/* check_plan.c
+
+   Check that the whole-night plan of scheduler_plan.c can be repeated:
+   solved as SOLVE_PLAN and replays solve it, with no time limit, the
+   same fields from the same time and slew position must give the
+   same plan, visit for visit, on every run and on any machine.
+
+   The fields are a night's worth of random sky fields, many of them in
+   pairs next to each other in RA, with a few must-do fields, and
+   their visibility bitsets for one night (scheduler_visibility.c).
+   In a scratch directory, each plan is written with write_plan and
+   the files compared. The cases are
+
+     repeated      the plan solved twice in a row
+     after another the plan solved again after a plan from a later
+                   time, which leaves the generator of the local
+                   search and the buffers of the solver in another
+                   state
+     extended      the plan solved again by extend_plan, as after
+                   fields are added to the sequence
+
+   syntax: check_plan [verbose]
+
+   Built and run by "make check". Exits with 1 if any case fails.
+
+*/
+
+#include "scheduler.h"
+
+#define CHECK_NUM_FIELDS 80 /* fields of the night */
+#define CHECK_JD_SUNSET 2461331.46731 /* start of the night planned */
+#define CHECK_NIGHT_DAYS 0.4237 /* sunset to sunrise */
+#define CHECK_TWILIGHT_DAYS 0.06123 /* sunset to jd_start, jd_end to sunrise */
+#define CHECK_MUSTDO 0.05 /* chance that a field is must-do */
+#define CHECK_PAIR 0.3 /* chance that a field is followed by its pair */
+#define CHECK_OVERHEAD_HOURS (30.0/3600.0) /* readout and setup per exposure */
+#define CHECK_LATER_DAYS (2.0/24.0) /* start of the other plan after sunset */
+
+int verbose=0;
+int verbose1=0;
+double exp_overhead_hours=CHECK_OVERHEAD_HOURS;
+Visibility_Table visibility_table;
+
+static char check_dir[STR_BUF_LEN];
+static unsigned int check_seed=1;
+
+/************************************************************/
+
+/* used only in the verbose output of search_jd_rise_time */
+
+double get_jd()
+{
+    return(0.0);
+}
+
+/************************************************************/
+
+/* get_next_field and plan_night call these, and the check calls
+   neither */
+
+int lookahead_next_field(Field *sequence, int num_fields, int i_greedy,
+        double jd, int bad_weather, int max_depth)
+{
+    return(i_greedy);
+}
+
+int load_replay_night(struct date_time date, Site_Params *site,
+        Night_Times *nt, Night_Times *nt_5day, Night_Times *nt_10day,
+        Night_Times *nt_15day)
+{
+    return(-1);
+}
+
+int load_replay_fields(char *script_name, Field_Table *table,
+        Night_Times *nt, Night_Times *nt_5day, Night_Times *nt_10day,
+        Night_Times *nt_15day, Site_Params *site, int *num_observable)
+{
+    return(-1);
+}
+
+/************************************************************/
+
+/* no moon tonight */
+
+int moon_interference(Field *f, Night_Times *nt, double min_separation)
+{
+    return(0);
+}
+
+/************************************************************/
+
+/* small portable generator, so that runs are repeatable */
+
+static double check_random()
+{
+    check_seed=check_seed*1103515245+12345;
+    return(((check_seed>>8)&0xffffff)/16777216.0);
+}
+
+/************************************************************/
+
+/* fill in the fields of the night in sequence */
+
+static void make_fields(Field *sequence)
+{
+    Field *f;
+    int i,paired;
+
+    paired=1;
+    for(i=0;i<CHECK_NUM_FIELDS;i++){
+       f=sequence+i;
+       f->field_number=i+1;
+       f->line_number=i+1;
+       f->doable=1;
+       f->status=NOT_DOABLE_STATUS;
+       f->selection_code=NOT_SELECTED;
+       f->survey_code=TNO_SURVEY_CODE;
+       f->shutter=SKY_CODE;
+       f->n_done=0;
+
+       if(!paired&&check_random()<CHECK_PAIR){
+          /* the pair of the field before */
+          f->ra=f[-1].ra+0.5*RA_STEP0/cos(f[-1].dec*DEG_TO_RAD);
+          if(f->ra>=24.0)f->ra=f->ra-24.0;
+          f->dec=f[-1].dec;
+          f->expt=f[-1].expt;
+          f->n_required=f[-1].n_required;
+          f->interval=f[-1].interval;
+          f->survey_code=f[-1].survey_code;
+          paired=1;
+       }
+       else{
+          paired=0;
+          f->ra=24.0*check_random();
+          f->dec=-70.0+70.0*check_random();
+          f->expt=(60.0+60.0*check_random())/3600.0;
+          f->n_required=2+(int)(2.0*check_random());
+          f->interval=0.3+0.7*check_random();
+          if(check_random()<CHECK_MUSTDO)f->survey_code=MUSTDO_SURVEY_CODE;
+       }
+       init_field_trig(f);
+    }
+}
+
+/************************************************************/
+
+/* 1 if files name1 and name2 hold the same bytes */
+
+static int same_files(char *name1, char *name2)
+{
+    FILE *input1,*input2;
+    int c1,c2;
+
+    input1=fopen(name1,"r");
+    input2=fopen(name2,"r");
+    if(input1==NULL||input2==NULL){
+       fprintf(stderr,"check_plan: can't open %s or %s\n",name1,name2);
+       if(input1!=NULL)fclose(input1);
+       if(input2!=NULL)fclose(input2);
+       return(0);
+    }
+
+    do{
+       c1=fgetc(input1);
+       c2=fgetc(input2);
+    }while(c1==c2&&c1!=EOF);
+
+    fclose(input1);
+    fclose(input2);
+
+    return(c1==c2);
+}
+
+/************************************************************/
+
+/* solve the plan from jd, with extend_plan if extend is True, and
+   write it to check_dir/name. Returns the number of visits, or -1 */
+
+static int solve(char *name, Field *sequence, double jd, bool extend,
+        char *file_name)
+{
+    int n;
+
+    sprintf(file_name,"%s/%s",check_dir,name);
+
+    clear_slew_position();
+    if(extend){
+       n=extend_plan(sequence,CHECK_NUM_FIELDS,jd);
+    }
+    else{
+       clear_plan();
+       n=make_plan(sequence,CHECK_NUM_FIELDS,jd);
+    }
+    if(n<0||write_plan(file_name,sequence)!=0)return(-1);
+
+    if(verbose){
+       fprintf(stderr,"check_plan: %-13s %d visits from jd %14.6f\n",name,n,jd);
+    }
+
+    return(n);
+}
+
+/************************************************************/
+
+/* check that file_name holds the same plan as first_file */
+
+static int check_case(char *name, int n, int n_first, char *file_name,
+        char *first_file)
+{
+    if(n!=n_first||!same_files(file_name,first_file)){
+       fprintf(stderr,"check_plan: %s: %d visits planned, not the %d first planned\n",
+          name,n,n_first);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Site_Params site;
+    Night_Times nt;
+    Airmass_Table table;
+    Field *sequence;
+    char first_file[STR_BUF_LEN],file_name[STR_BUF_LEN];
+    int n,n_first,num_cases,num_failed;
+
+    if(argc>1)verbose=atoi(argv[1]);
+
+    /* solved as in a replay, with no time limit, and with none of the
+       settings of the environment */
+
+    setenv("REPLAY_POLICIES","planned",1);
+    unsetenv("PLAN_FILE");
+    unsetenv("PLAN_FRACTIONS");
+
+    strcpy(site.site_name,"DEFAULT");
+    load_site(&site.longit,&site.lat,&site.stdz,&site.use_dst,
+            site.zone_name,&site.zabr,&site.elevsea,&site.elev,
+            &site.horiz,site.site_name);
+    init_site_trig(&site);
+
+    memset((void *)&nt,0,sizeof(nt));
+    nt.jd_sunset=CHECK_JD_SUNSET;
+    nt.jd_sunrise=CHECK_JD_SUNSET+CHECK_NIGHT_DAYS;
+    nt.jd_start=nt.jd_sunset+CHECK_TWILIGHT_DAYS;
+    nt.jd_end=nt.jd_sunrise-CHECK_TWILIGHT_DAYS;
+
+    sequence=(Field *)calloc(CHECK_NUM_FIELDS,sizeof(Field));
+    if(sequence==NULL){
+       fprintf(stderr,"check_plan: could not allocate %d fields\n",
+          CHECK_NUM_FIELDS);
+       return(1);
+    }
+    make_fields(sequence);
+
+    memset((void *)&table,0,sizeof(table));
+    memset((void *)&visibility_table,0,sizeof(visibility_table));
+    if(load_airmass_table(&table,sequence,CHECK_NUM_FIELDS,&site)!=0||
+       load_visibility_table(&visibility_table,&table,sequence,
+          CHECK_NUM_FIELDS,&nt,&site)!=0){
+       free(sequence);
+       return(1);
+    }
+
+    strcpy(check_dir,"/tmp/check_plan.XXXXXX");
+    if(mkdtemp(check_dir)==NULL){
+       fprintf(stderr,"check_plan: can't make scratch directory\n");
+       free(sequence);
+       return(1);
+    }
+
+    num_cases=0;
+    num_failed=0;
+
+    n_first=solve("first",sequence,nt.jd_sunset,False,first_file);
+    if(n_first<=0){
+       fprintf(stderr,"check_plan: first plan has %d visits\n",n_first);
+       num_failed++;
+    }
+
+    /* repeated */
+
+    num_cases++;
+    n=solve("repeated",sequence,nt.jd_sunset,False,file_name);
+    if(check_case("repeated",n,n_first,file_name,first_file)!=0)num_failed++;
+    unlink(file_name);
+
+    /* after another */
+
+    num_cases++;
+    n=solve("later",sequence,nt.jd_sunset+CHECK_LATER_DAYS,False,file_name);
+    if(n<0||same_files(file_name,first_file)){
+       fprintf(stderr,"check_plan: after another: the later plan has %d visits\n",n);
+       unlink(file_name);
+       num_failed++;
+    }
+    else{
+       unlink(file_name);
+       n=solve("after another",sequence,nt.jd_sunset,False,file_name);
+       if(check_case("after another",n,n_first,file_name,first_file)!=0){
+          num_failed++;
+       }
+       unlink(file_name);
+    }
+
+    /* extended */
+
+    num_cases++;
+    n=solve("extended",sequence,nt.jd_sunset,True,file_name);
+    if(check_case("extended",n,n_first,file_name,first_file)!=0)num_failed++;
+    unlink(file_name);
+
+    unlink(first_file);
+    rmdir(check_dir);
+
+    printf("check_plan: %d fields, %d visits planned, %d cases, %d failed\n",
+       CHECK_NUM_FIELDS,n_first,num_cases,num_failed);
+
+    free_visibility_table(&visibility_table);
+    free(sequence);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
@@ -0,0 +1,178 @@
+/* check_rise_set.c
+
+   Check the analytic field rise and set times (get_jd_rise_time,
+   get_jd_set_time) against the stepwise LST search they replaced
+   (search_jd_rise_time, search_jd_set_time) over a full-sky grid of
+   fields, for observing windows that start at several LSTs and last
+   from a short summer night to a long winter one, at MAX_AIRMASS and
+   at a tighter airmass limit.
+
+   For each field and window both must agree on whether the field rises
+   (sets) in the window, and the times must agree to within one
+   LST_SEARCH_INCREMENT, the resolution of the search, plus
+   CHECK_ROUNDOFF_SEC for the rounding the search accumulates in jd as
+   it steps. The search takes one step past the window before it stops,
+   so a field that rises (sets) within a step of the end (start) of the
+   window is found by the search but not by the solver. These edge
+   cases are counted, not failed. Prints the number of cases, the
+   largest difference, the time taken by each solver, and any case
+   that fails. Exits with 1 if any fails.
+
+   syntax: check_rise_set [verbose_flag]
+
+   Built and run by "make check".
+
+*/
+
+#include "scheduler.h"
+#include <sys/time.h>
+
+#define CHECK_RA_STEP 0.7 /* hours between fields in RA, so the fields fall
+                            at many hour angles at each LST */
+#define CHECK_DEC_STEP 3.0 /* degrees between fields in dec */
+#define CHECK_NUM_LST 4 /* LSTs at which the window starts, over 24 h */
+#define CHECK_MAX_FAILURES 20 /* failures printed */
+#define CHECK_ROUNDOFF_SEC 1.0 /* allowed for rounding in the search */
+
+int verbose = 0;
+int verbose1 = 0;
+
+/************************************************************/
+
+/* used only in the verbose output of search_jd_rise_time */
+
+double get_jd()
+{
+    return(0.0);
+}
+
+/************************************************************/
+
+static double elapsed_sec(struct timeval *t0, struct timeval *t1)
+{
+    return((t1->tv_sec-t0->tv_sec)+1.0e-6*(t1->tv_usec-t0->tv_usec));
+}
+
+/************************************************************/
+
+/* compare one pair of times, returning 1 if they disagree */
+
+static int compare_times(char *name, double jd_analytic, double jd_search,
+        double ra, double dec, double max_am, Night_Times *nt,
+        double *dt_max, int *num_edge, int *num_failed)
+{
+    double dt,tolerance,jd;
+
+    tolerance=LST_SEARCH_INCREMENT/SIDEREAL_DAY_IN_HOURS+
+       CHECK_ROUNDOFF_SEC/86400.0;
+
+    if(jd_analytic<0.0&&jd_search<0.0)return(0);
+
+    if(jd_analytic>=0.0&&jd_search>=0.0){
+       dt=fabs(jd_analytic-jd_search);
+       if(dt>*dt_max)*dt_max=dt;
+       if(dt<=tolerance)return(0);
+    }
+    else{
+       jd=jd_analytic>=0.0 ? jd_analytic : jd_search;
+       if(fabs(jd-nt->jd_start)<=tolerance||fabs(jd-nt->jd_end)<=tolerance){
+          (*num_edge)++;
+          return(0);
+       }
+    }
+
+    (*num_failed)++;
+    if(*num_failed<=CHECK_MAX_FAILURES){
+       fprintf(stderr,
+          "check_rise_set: %s ra %7.3f dec %7.2f am %4.2f lst %7.3f-%7.3f analytic %14.6f search %14.6f\n",
+          name,ra,dec,max_am,nt->lst_start,nt->lst_end,jd_analytic,jd_search);
+    }
+
+    return(1);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Site_Params site;
+    Night_Times nt;
+    struct timeval t0,t1;
+    double night_hours[2]={7.0,12.0};
+    double max_am[2]={MAX_AIRMASS,1.5};
+    double ra,dec,am,ha,jd_rise[2],jd_set[2],dt_max;
+    double analytic_sec,search_sec;
+    int i_lst,i_night,i_am,num_cases,num_up,num_edge,num_failed;
+
+    if(argc>1)sscanf(argv[1],"%d",&verbose);
+    if(verbose>1)verbose1=1;
+
+    strcpy(site.site_name,"DEFAULT");
+    load_site(&site.longit,&site.lat,&site.stdz,&site.use_dst,
+            site.zone_name,&site.zabr,&site.elevsea,&site.elev,
+            &site.horiz,site.site_name);
+
+    memset((void *)&nt,0,sizeof(nt));
+
+    num_cases=0;
+    num_up=0;
+    num_edge=0;
+    num_failed=0;
+    dt_max=0.0;
+    analytic_sec=0.0;
+    search_sec=0.0;
+
+    for(i_am=0;i_am<2;i_am++){
+     for(i_night=0;i_night<2;i_night++){
+      for(i_lst=0;i_lst<CHECK_NUM_LST;i_lst++){
+
+       nt.jd_start=2461331.6+i_lst;
+       nt.jd_end=nt.jd_start+night_hours[i_night]/24.0;
+       nt.lst_start=i_lst*24.0/CHECK_NUM_LST;
+       nt.lst_end=nt.lst_start+night_hours[i_night]*24.0/SIDEREAL_DAY_IN_HOURS;
+       if(nt.lst_end>=24.0)nt.lst_end=nt.lst_end-24.0;
+
+       for(dec=-90.0;dec<=90.0;dec=dec+CHECK_DEC_STEP){
+         for(ra=0.0;ra<24.0;ra=ra+CHECK_RA_STEP){
+
+           gettimeofday(&t0,NULL);
+           jd_rise[0]=get_jd_rise_time(ra,dec,max_am[i_am],MAX_HOURANGLE,
+               &nt,&site,&am,&ha);
+           jd_set[0]=get_jd_set_time(ra,dec,max_am[i_am],MAX_HOURANGLE,
+               &nt,&site,&am,&ha);
+           gettimeofday(&t1,NULL);
+           analytic_sec=analytic_sec+elapsed_sec(&t0,&t1);
+
+           jd_rise[1]=search_jd_rise_time(ra,dec,max_am[i_am],MAX_HOURANGLE,
+               &nt,&site,&am,&ha);
+           jd_set[1]=search_jd_set_time(ra,dec,max_am[i_am],MAX_HOURANGLE,
+               &nt,&site,&am,&ha);
+           gettimeofday(&t0,NULL);
+           search_sec=search_sec+elapsed_sec(&t1,&t0);
+
+           num_cases++;
+           if(jd_rise[1]>=0.0)num_up++;
+
+           compare_times("rise",jd_rise[0],jd_rise[1],ra,dec,max_am[i_am],
+              &nt,&dt_max,&num_edge,&num_failed);
+           compare_times("set",jd_set[0],jd_set[1],ra,dec,max_am[i_am],
+              &nt,&dt_max,&num_edge,&num_failed);
+         }
+       }
+      }
+     }
+    }
+
+    printf("check_rise_set: %d fields and windows, %d up, %d at the window edges, %d failed\n",
+       num_cases,num_up,num_edge,num_failed);
+    printf("check_rise_set: largest difference %7.2f sec (search step %7.2f sec)\n",
+       dt_max*86400.0,LST_SEARCH_INCREMENT*3600.0*24.0/SIDEREAL_DAY_IN_HOURS);
+    printf("check_rise_set: analytic %9.3f usec, search %9.3f usec per field\n",
+       1.0e6*analytic_sec/num_cases,1.0e6*search_sec/num_cases);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
@@ -0,0 +1,388 @@
+/* check_select.c
+
+   Check that get_next_field, which reads the candidate sets kept by
+   scheduler_events.c, chooses the same field as scan_next_field, which
+   updates and rescans every field, on every selection of a set of
+   synthetic nights.
+
+   Each night is a random sequence of sky fields, with must-do fields
+   (some with n_required 6), pairs of fields next to each other in RA,
+   fields that are late from the start, darks, a dome flat, and
+   weather-dependent evening flats, focus and offset fields. The night
+   is stepped as the main loop steps it: the weather turns bad and
+   good again at random, and while it is bad only darks and dome flats
+   are observed; now and then the last exposure is marked undone; and
+   fields are appended to the sequence during the night, as from the
+   .add script.
+
+   The two selections run on separate copies of the fields, since both
+   may shorten the interval of the field they choose, and each
+   observation is applied to both. Each night is stepped once with ties
+   broken by slew time and once without. The check stops at the first
+   selection on which the two differ, in field or in selection code,
+   prints it, and exits with 1.
+
+   syntax: check_select [verbose_flag]
+
+   Built and run by "make check".
+
+*/
+
+#include "scheduler.h"
+
+#define CHECK_NUM_NIGHTS 8 /* nights stepped, each with and without slew cost */
+#define CHECK_JD_START 2461331.6 /* start of the first night */
+#define CHECK_NIGHT_HOURS 10.0 /* length of each night */
+#define CHECK_NUM_APPENDS 3 /* times during the night fields are appended */
+#define CHECK_BAD_WEATHER 0.01 /* chance per step that the weather turns bad */
+#define CHECK_GOOD_WEATHER 0.05 /* chance per step of bad weather that it clears */
+#define CHECK_UNDONE 0.02 /* chance that the last exposure is marked undone */
+#define CHECK_OVERHEAD_HOURS (30.0/3600.0) /* readout and setup per exposure */
+
+int verbose = 0;
+int verbose1 = 0;
+
+static unsigned long check_random_state=1;
+static int num_code[PLANNED_READY+1]; /* selections made by each rule */
+
+/************************************************************/
+
+/* get_next_field and scan_next_field call these only with a
+   lookahead_depth or follow_plan, which the check leaves at 0 */
+
+int lookahead_next_field(Field *sequence, int num_fields, int i_greedy,
+        double jd, int bad_weather, int max_depth)
+{
+    return(i_greedy);
+}
+
+int planned_next_field(Field *sequence, int num_fields, double jd,
+        int bad_weather)
+{
+    return(-1);
+}
+
+/************************************************************/
+
+/* uniform random number from 0 to 1, the same on every run */
+
+static double check_random()
+{
+    check_random_state=check_random_state*6364136223846793005UL+1442695040888963407UL;
+
+    return((check_random_state>>11)*(1.0/9007199254740992.0));
+}
+
+/************************************************************/
+
+/* fill in a random field that can be observed from jd to jd_end. One in
+   ten sky fields is followed by its pair, so n may be 1 or 2. Returns
+   the number of fields made */
+
+static int make_fields(Field *f, double jd, double jd_end)
+{
+    double u,hours;
+    int n;
+
+    f->doable=1;
+    f->status=NOT_DOABLE_STATUS;
+    f->selection_code=NOT_SELECTED;
+    f->n_done=0;
+    f->survey_code=TNO_SURVEY_CODE;
+    f->shutter=SKY_CODE;
+    f->ra=24.0*check_random();
+    f->dec=-30.0+10.0*(int)(6.0*check_random());
+    f->expt=(60.0+240.0*check_random())/3600.0;
+    f->n_required=2+(int)(3.0*check_random());
+    f->interval=0.3+1.2*check_random();
+
+    hours=(jd_end-jd)*24.0;
+    f->jd_rise=jd+check_random()*hours/24.0;
+    f->jd_set=f->jd_rise+(1.0+7.0*check_random())/24.0;
+    f->jd_next=f->jd_rise;
+
+    u=check_random();
+    if(u<0.02){
+       f->survey_code=MUSTDO_SURVEY_CODE;
+       if(check_random()<0.3){
+          f->n_required=6;
+          f->interval=0.25;
+       }
+    }
+    else if(u<0.08){
+       /* late from the start: more time required than it is up */
+       f->jd_set=f->jd_rise+0.8*f->n_required*f->interval/24.0;
+    }
+    else if(u<0.085){
+       f->shutter=DARK_CODE;
+       f->n_required=5;
+       f->interval=1.5;
+    }
+    else if(u<0.088){
+       f->shutter=DOME_FLAT_CODE;
+       f->n_required=3;
+       f->interval=0.1;
+    }
+    else if(u<0.091){
+       f->shutter=EVENING_FLAT_CODE;
+       f->n_required=2;
+       f->interval=0.05;
+    }
+    else if(u<0.094){
+       f->shutter=FOCUS_CODE;
+       f->n_required=1;
+    }
+    else if(u<0.097){
+       f->shutter=OFFSET_CODE;
+       f->n_required=1;
+    }
+
+    n=1;
+    if(f->shutter==SKY_CODE&&check_random()<0.1){
+       f[1]=f[0];
+       f[1].ra=f->ra+0.5*RA_STEP0/cos(f->dec*DEG_TO_RAD);
+       if(f[1].ra>=24.0)f[1].ra=f[1].ra-24.0;
+       n=2;
+    }
+
+    return(n);
+}
+
+/************************************************************/
+
+/* append up to n random fields to both tables, and to the events of
+   the first. Returns the number appended, or -1 on an error */
+
+static int append_fields(Field_Table *t_events, Field_Table *t_scan,
+        Field_Events *e, int n, double jd, double jd_end)
+{
+    Field f[2];
+    int i,k,m,num_fields;
+
+    num_fields=t_events->num_fields;
+    if(grow_field_table(t_events,num_fields+n+1)!=0||
+       grow_field_table(t_scan,num_fields+n+1)!=0){
+       return(-1);
+    }
+
+    k=0;
+    while(k<n){
+       memset((void *)f,0,sizeof(f));
+       m=make_fields(f,jd,jd_end);
+       for(i=0;i<m;i++){
+          f[i].field_number=num_fields+k+1;
+          f[i].line_number=num_fields+k+1;
+          f[i].hist=t_events->fields[num_fields+k].hist;
+          t_events->fields[num_fields+k]=f[i];
+          f[i].hist=t_scan->fields[num_fields+k].hist;
+          t_scan->fields[num_fields+k]=f[i];
+          k++;
+       }
+    }
+
+    t_events->num_fields=num_fields+k;
+    t_scan->num_fields=num_fields+k;
+
+    if(e->max_fields>0&&add_field_events(e,t_events->num_fields)!=0){
+       return(-1);
+    }
+
+    return(k);
+}
+
+/************************************************************/
+
+/* print the state of field i in both copies */
+
+static void print_field_pair(char *name, Field *s_events, Field *s_scan, int i)
+{
+    Field *f;
+    int k;
+
+    if(i<0)return;
+
+    for(k=0;k<2;k++){
+       f=k==0 ? s_events+i : s_scan+i;
+       fprintf(stderr,
+          "check_select:   %s %d (%s) shutter %d survey %d status %d doable %d n %d/%d time_left %10.6f interval %8.5f\n",
+          name,i,k==0 ? "events" : "scan",f->shutter,f->survey_code,
+          f->status,f->doable,f->n_done,f->n_required,f->time_left,
+          f->interval);
+    }
+}
+
+/************************************************************/
+
+/* step one night, choosing each field with both selections. Returns
+   the number of selections, or -1 at the first that differs */
+
+static int check_night(int night, int num_fields, int slew)
+{
+    Field_Table t_events,t_scan;
+    Field_Events events;
+    Selection_Settings settings;
+    Field *f;
+    double jd,jd_start,jd_end,jd_append[CHECK_NUM_APPENDS],ra,dec;
+    int i,i_events,i_scan,i_prev,n_appended,bad_weather,num_picks;
+
+    check_random_state=1+night;
+    memset((void *)&settings,0,sizeof(settings));
+    settings.slew_cost_on=slew;
+    clear_slew_position();
+
+    init_field_table(&t_events);
+    init_field_table(&t_scan);
+    memset((void *)&events,0,sizeof(events));
+
+    jd_start=CHECK_JD_START+night;
+    jd_end=jd_start+CHECK_NIGHT_HOURS/24.0;
+
+    if(append_fields(&t_events,&t_scan,&events,num_fields,jd_start,jd_end)<0||
+       init_field_events(&events,t_events.num_fields)!=0){
+       fprintf(stderr,"check_select: could not make %d fields\n",num_fields);
+       free_field_table(&t_events);
+       free_field_table(&t_scan);
+       return(-1);
+    }
+
+    for(i=0;i<CHECK_NUM_APPENDS;i++){
+       jd_append[i]=jd_start+(i+1)*(jd_end-jd_start)/(CHECK_NUM_APPENDS+1);
+    }
+
+    jd=jd_start;
+    i_prev=-1;
+    n_appended=0;
+    bad_weather=0;
+    num_picks=0;
+
+    while(jd<jd_end){
+
+       if(n_appended<CHECK_NUM_APPENDS&&jd>=jd_append[n_appended]){
+          if(append_fields(&t_events,&t_scan,&events,1+num_fields/20,jd,
+                 jd_end)<0){
+             fprintf(stderr,"check_select: could not append fields\n");
+             break;
+          }
+          n_appended++;
+       }
+
+       if(bad_weather){
+          if(check_random()<CHECK_GOOD_WEATHER)bad_weather=0;
+       }
+       else if(check_random()<CHECK_BAD_WEATHER){
+          bad_weather=1;
+       }
+
+       i_events=get_next_field(&settings,&events,t_events.fields,
+          t_events.num_fields,i_prev,jd,bad_weather);
+       i_scan=scan_next_field(&settings,t_scan.fields,t_scan.num_fields,
+          i_prev,jd,bad_weather);
+       num_picks++;
+
+       if(i_events!=i_scan||(i_events>=0&&
+           t_events.fields[i_events].selection_code!=
+           t_scan.fields[i_scan].selection_code)){
+          fprintf(stderr,
+             "check_select: night %d (%d fields, slew cost %d) selection %d at jd %14.6f bad_weather %d i_prev %d: get_next_field chose %d (code %d), scan_next_field chose %d (code %d)\n",
+             night,t_events.num_fields,slew,num_picks,jd,bad_weather,i_prev,
+             i_events,i_events>=0 ? t_events.fields[i_events].selection_code : -1,
+             i_scan,i_scan>=0 ? t_scan.fields[i_scan].selection_code : -1);
+          print_field_pair("field",t_events.fields,t_scan.fields,i_events);
+          print_field_pair("field",t_events.fields,t_scan.fields,i_scan);
+          free_field_events(&events);
+          free_field_table(&t_events);
+          free_field_table(&t_scan);
+          return(-1);
+       }
+
+       if(i_events>=0)num_code[t_events.fields[i_events].selection_code]++;
+
+       /* as the main loop: wait if nothing is selected, or if the
+          weather is bad and the field needs the sky */
+
+       i=i_events;
+       if(i<0||(bad_weather&&t_events.fields[i].shutter!=DARK_CODE&&
+                t_events.fields[i].shutter!=DOME_FLAT_CODE)){
+          jd=jd+LOOP_WAIT_SEC/86400.0;
+          continue;
+       }
+
+       /* observe it in both copies */
+
+       f=t_events.fields+i;
+       if(f->shutter!=DARK_CODE&&f->shutter!=DOME_FLAT_CODE){
+          if(get_slew_position(&ra,&dec)==0){
+             jd=jd+get_slew_time_between(ra,dec,f->ra,f->dec)/86400.0;
+          }
+          record_slew(f->ra,f->dec,f->ra,f->dec,-1.0);
+       }
+
+       f->n_done++;
+       f->jd_next=jd+f->interval/24.0;
+       t_scan.fields[i].n_done=f->n_done;
+       t_scan.fields[i].jd_next=f->jd_next;
+       field_status_changed(&events,i);
+
+       /* now and then the last exposure is lost, and marked undone */
+
+       if(i_prev>=0&&t_events.fields[i_prev].n_done>0&&
+          check_random()<CHECK_UNDONE){
+          t_events.fields[i_prev].n_done--;
+          t_events.fields[i_prev].doable=1;
+          t_scan.fields[i_prev].n_done=t_events.fields[i_prev].n_done;
+          t_scan.fields[i_prev].doable=1;
+          field_status_changed(&events,i_prev);
+       }
+
+       jd=jd+f->expt/24.0+CHECK_OVERHEAD_HOURS/24.0;
+       i_prev=i;
+    }
+
+    if(verbose){
+       fprintf(stderr,"check_select: night %d slew cost %d: %d fields, %d selections\n",
+          night,slew,t_events.num_fields,num_picks);
+    }
+
+    free_field_events(&events);
+    free_field_table(&t_events);
+    free_field_table(&t_scan);
+
+    return(num_picks);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    int night,slew,n,num_nights,num_picks,num_failed,k;
+
+    if(argc>1)sscanf(argv[1],"%d",&verbose);
+
+    num_nights=0;
+    num_picks=0;
+    num_failed=0;
+    for(night=0;night<CHECK_NUM_NIGHTS&&num_failed==0;night++){
+       for(slew=0;slew<2&&num_failed==0;slew++){
+          n=check_night(night,night%2==0 ? 3000 : 300,slew);
+          if(n<0){
+             num_failed++;
+          }
+          else{
+             num_nights++;
+             num_picks=num_picks+n;
+          }
+       }
+    }
+
+    printf("check_select: %d nights, %d selections, %d failed\n",
+       num_nights,num_picks,num_failed);
+    printf("check_select: selections by selection code:");
+    for(k=0;k<=PLANNED_READY;k++)printf(" %d",num_code[k]);
+    printf("\n");
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
@@ -0,0 +1,214 @@
+/* check_slew.c
+
+   Check that the slew model of scheduler_slew.c recovers the rates of
+   the two axes and the settling time from the pointing times given to
+   record_slew, and follows them when they change.
+
+   Synthetic slews between random positions, timed by a mount with
+   known rates and settling time (plus up to CHECK_NOISE_SEC of noise),
+   are recorded. get_slew_time_between must then predict the time of
+   the mount for moves over a grid of distances to within
+   CHECK_TOLERANCE_SEC. The cases are
+
+     unknown        before any slew, get_slew_time is 0 and the
+                    position is unknown
+     fit            CHECK_NUM_SLEWS slews of a mount unlike the initial
+                    model
+     change         CHECK_NUM_SLEWS more slews after the mount changes
+     long pointing  a pointing longer than SLEW_FIT_MAX_SEC does not
+                    change the model, but does move the position
+     wrap           a move across RA 0 takes as long as the same move
+                    away from it
+
+   syntax: check_slew [verbose]
+
+   Built and run by "make check". Exits with 1 if any case fails.
+
+*/
+
+#include "scheduler.h"
+
+#define CHECK_NUM_SLEWS 500 /* slews recorded for each mount */
+#define CHECK_NOISE_SEC 0.05 /* largest error of a timed slew */
+#define CHECK_TOLERANCE_SEC 0.1 /* largest error of a prediction */
+#define CHECK_MAX_MOVE_DEG 60.0 /* largest move of an axis */
+
+int verbose=0;
+int verbose1=0;
+
+static unsigned int check_seed=1;
+
+typedef struct {
+    double rate_ha;   /* deg/sec */
+    double rate_dec;
+    double settle;    /* sec */
+} Mount;
+
+/************************************************************/
+
+/* small portable generator, so that runs are repeatable */
+
+static double check_random()
+{
+    check_seed=check_seed*1103515245+12345;
+    return(((check_seed>>8)&0xffffff)/16777216.0);
+}
+
+/************************************************************/
+
+/* time (sec) the mount takes for a move of d_ha and d_dec (deg) */
+
+static double mount_slew_time(Mount *m, double d_ha, double d_dec)
+{
+    double t_ha,t_dec;
+
+    t_ha=d_ha/m->rate_ha;
+    t_dec=d_dec/m->rate_dec;
+
+    return(m->settle+(t_ha>t_dec ? t_ha : t_dec));
+}
+
+/************************************************************/
+
+/* record num_slews slews of mount m from the current position */
+
+static void record_slews(Mount *m, int num_slews, double *ra, double *dec)
+{
+    int i;
+    double ra1,dec1,d_ha,d_dec,t;
+
+    for(i=0;i<num_slews;i++){
+       d_ha=CHECK_MAX_MOVE_DEG*check_random();
+       d_dec=CHECK_MAX_MOVE_DEG*check_random();
+       ra1=*ra+(check_random()<0.5 ? -d_ha : d_ha)/15.0;
+       if(ra1<0.0)ra1=ra1+24.0;
+       if(ra1>=24.0)ra1=ra1-24.0;
+       dec1=*dec+(*dec>0.0 ? -d_dec : d_dec);
+       t=mount_slew_time(m,d_ha,d_dec)+CHECK_NOISE_SEC*(2.0*check_random()-1.0);
+       record_slew(*ra,*dec,ra1,dec1,t);
+       *ra=ra1;
+       *dec=dec1;
+    }
+}
+
+/************************************************************/
+
+/* largest difference (sec) between the model and mount m over a grid
+   of moves from ra, dec */
+
+static double model_error(Mount *m, double ra, double dec)
+{
+    int i,k;
+    double d_ha,d_dec,dt,dt_max;
+
+    dt_max=0.0;
+    for(i=0;i<=12;i++){
+       for(k=0;k<=12;k++){
+          d_ha=i*CHECK_MAX_MOVE_DEG/12;
+          d_dec=k*CHECK_MAX_MOVE_DEG/12;
+          dt=fabs(get_slew_time_between(ra,dec,ra+d_ha/15.0,dec-d_dec)-
+             mount_slew_time(m,d_ha,d_dec));
+          if(dt>dt_max)dt_max=dt;
+       }
+    }
+
+    return(dt_max);
+}
+
+/************************************************************/
+
+static int check_model(char *name, Mount *m, double ra, double dec)
+{
+    double dt;
+
+    dt=model_error(m,ra,dec);
+    if(verbose){
+       fprintf(stderr,"check_slew: %-13s largest error %7.4f sec\n",name,dt);
+    }
+    if(dt>CHECK_TOLERANCE_SEC){
+       fprintf(stderr,
+          "check_slew: %s: model differs from the mount (%5.2f %5.2f deg/sec, settle %5.2f sec) by %7.4f sec\n",
+          name,m->rate_ha,m->rate_dec,m->settle,dt);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Mount mount;
+    double ra,dec,ra1,dec1,t0,t1;
+    int num_cases,num_failed;
+
+    if(argc>1)verbose=atoi(argv[1]);
+
+    num_cases=0;
+    num_failed=0;
+
+    /* unknown */
+
+    num_cases++;
+    if(get_slew_time(6.0,-30.0)!=0.0||get_slew_position(&ra,&dec)==0){
+       fprintf(stderr,"check_slew: unknown: position known before any slew\n");
+       num_failed++;
+    }
+
+    /* fit */
+
+    num_cases++;
+    mount.rate_ha=0.6;
+    mount.rate_dec=1.5;
+    mount.settle=4.0;
+    ra=6.0;
+    dec=-30.0;
+    record_slews(&mount,CHECK_NUM_SLEWS,&ra,&dec);
+    if(check_model("fit",&mount,3.0,-20.0)!=0)num_failed++;
+
+    /* change */
+
+    num_cases++;
+    mount.rate_ha=2.0;
+    mount.rate_dec=0.8;
+    mount.settle=7.0;
+    record_slews(&mount,CHECK_NUM_SLEWS,&ra,&dec);
+    if(check_model("change",&mount,3.0,-20.0)!=0)num_failed++;
+
+    /* long pointing */
+
+    num_cases++;
+    ra1=ra+1.0;
+    if(ra1>=24.0)ra1=ra1-24.0;
+    dec1=dec>0.0 ? dec-10.0 : dec+10.0;
+    record_slew(ra,dec,ra1,dec1,SLEW_FIT_MAX_SEC+100.0);
+    if(check_model("long pointing",&mount,3.0,-20.0)!=0){
+       num_failed++;
+    }
+    else if(get_slew_position(&ra,&dec)!=0||ra!=ra1||dec!=dec1||
+       fabs(get_slew_time(ra1,dec1)-mount.settle)>CHECK_TOLERANCE_SEC){
+       fprintf(stderr,"check_slew: long pointing: position not moved\n");
+       num_failed++;
+    }
+
+    /* wrap */
+
+    num_cases++;
+    t0=get_slew_time_between(23.8,-20.0,0.3,-25.0);
+    t1=get_slew_time_between(12.3,-20.0,11.8,-25.0);
+    if(fabs(t0-t1)>1.0e-9){
+       fprintf(stderr,"check_slew: wrap: %9.4f sec across RA 0, %9.4f sec away from it\n",
+          t0,t1);
+       num_failed++;
+    }
+
+    printf("check_slew: %d slews, %d cases, %d failed\n",
+       2*CHECK_NUM_SLEWS,num_cases,num_failed);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
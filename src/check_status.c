@@ -0,0 +1,404 @@
+/* check_status.c
+
+   Check and time parse_status, the one-pass parser of the camera
+   status reply, on replies captured from ls4_ccp and ls4_sim.
+
+   Each captured reply is parsed by parse_status and by the parser it
+   replaced (old_parse_status, one get_value_string scan of the reply
+   per keyword), and the Camera_Status they fill must agree.
+
+   Then mutated copies of the captured replies (bytes changed to any
+   value, deleted, repeated, quotes, colons and separators inserted,
+   the reply cut short) and a few hand-made replies are fed to
+   parse_status, which must not read outside them, must return 0 or
+   -1, and must leave terminated strings and state values of -1 or
+   more in Camera_Status. Build with -fsanitize=address to catch any
+   stray read. The errors parse_status prints for these are discarded,
+   so set ASAN_OPTIONS=log_path=<file> to see what the sanitizer finds.
+
+   Finally both parsers are timed on the captured replies.
+
+   syntax: check_status [num_mutations]
+
+   Built and run by "make check". Exits with 1 if any check fails.
+
+*/
+
+#include "scheduler.h"
+#include <fcntl.h>
+#include <sys/time.h>
+
+#define CHECK_NUM_MUTATIONS 20000 /* mutated copies of each captured reply */
+#define CHECK_MAX_EDITS 8 /* edits made to each copy */
+#define CHECK_NUM_PARSES 20000 /* parses of each captured reply timed */
+#define CHECK_MAX_FAILURES 20 /* failures printed */
+
+/* replies captured from ls4_ccp (as in the example in scheduler_status.c)
+   and from ls4_sim, idle, exposing, reading out with an image in
+   memory, and with one controller in error */
+
+static char *captured_reply[] = {
+
+    "[DONE \n"
+    " {'ready': True,\n"
+    "'state': 'started',\n"
+    "'error': False,\n"
+    "'comment': 'started',\n"
+    "'date': '2025-06-24T20:15:56.00',\n"
+    "'NOSTATUS': '0000',\n"
+    "'UNKNOWN': '0000',\n"
+    "'IDLE': '1111',\n"
+    "'EXPOSING': '0000',\n"
+    "'READOUT_PENDING': '0000',\n"
+    "'READING': '0000',\n"
+    "'FETCHING': '0000',\n"
+    "'FLUSHING': '0000',\n"
+    "'ERASING': '0000',\n"
+    "'PURGING': '0000',\n"
+    "'AUTOCLEAR': '0000',\n"
+    "'AUTOFLUSH': '0000',\n"
+    "'POWERON': '1111',\n"
+    "'POWEROFF': '0000',\n"
+    "'POWERBAD': '0000',\n"
+    "'FETCH_PENDING': '0000',\n"
+    "'ERROR': '0000',\n"
+    "'ACTIVE': '0000',\n"
+    "'ERRORED': '0000', \n"
+    "'cmd_error':False, \n"
+    "'cmd_error_msg':'False', \n"
+    "'cmd_command':'', \n"
+    "'cmd_arg_value_list':'', \n"
+    "'cmd_reply':''\n"
+    "]",
+
+    "[DONE {'ready': True, 'state': 'idle', 'error': False, 'comment': 'simulated', "
+    "'date': '2026-10-17T06:12:02.00', 'NOSTATUS': '0000', 'UNKNOWN': '0000', "
+    "'IDLE': '1111', 'EXPOSING': '0000', 'READOUT_PENDING': '0000', 'READING': '0000', "
+    "'FETCHING': '0000', 'FLUSHING': '0000', 'ERASING': '0000', 'PURGING': '0000', "
+    "'AUTOCLEAR': '0000', 'AUTOFLUSH': '0000', 'POWERON': '1111', 'POWEROFF': '0000', "
+    "'POWERBAD': '0000', 'FETCH_PENDING': '0000', 'ERROR': '0000', 'ACTIVE': '0000', "
+    "'ERRORED': '0000', 'cmd_error':False, 'cmd_error_msg':'False', 'cmd_command':'', "
+    "'cmd_arg_value_list':'', 'cmd_reply':''}]\n",
+
+    "[DONE {'ready': True, 'state': 'busy', 'error': False, 'comment': 'simulated', "
+    "'date': '2026-10-17T06:12:31.00', 'NOSTATUS': '0000', 'UNKNOWN': '0000', "
+    "'IDLE': '0000', 'EXPOSING': '1111', 'READOUT_PENDING': '0000', 'READING': '0000', "
+    "'FETCHING': '0000', 'FLUSHING': '0000', 'ERASING': '0000', 'PURGING': '0000', "
+    "'AUTOCLEAR': '0000', 'AUTOFLUSH': '0000', 'POWERON': '1111', 'POWEROFF': '0000', "
+    "'POWERBAD': '0000', 'FETCH_PENDING': '0000', 'ERROR': '0000', 'ACTIVE': '0000', "
+    "'ERRORED': '0000', 'cmd_error':False, 'cmd_error_msg':'False', 'cmd_command':'', "
+    "'cmd_arg_value_list':'', 'cmd_reply':''}]\n",
+
+    "[DONE {'ready': True, 'state': 'busy', 'error': False, 'comment': 'simulated', "
+    "'date': '2026-10-17T06:12:52.00', 'NOSTATUS': '0000', 'UNKNOWN': '0000', "
+    "'IDLE': '0000', 'EXPOSING': '0000', 'READOUT_PENDING': '0000', 'READING': '1111', "
+    "'FETCHING': '0000', 'FLUSHING': '0000', 'ERASING': '0000', 'PURGING': '0000', "
+    "'AUTOCLEAR': '0000', 'AUTOFLUSH': '0000', 'POWERON': '1111', 'POWEROFF': '0000', "
+    "'POWERBAD': '0000', 'FETCH_PENDING': '1111', 'ERROR': '0000', 'ACTIVE': '0000', "
+    "'ERRORED': '0000', 'cmd_error':False, 'cmd_error_msg':'False', 'cmd_command':'', "
+    "'cmd_arg_value_list':'', 'cmd_reply':''}]\n",
+
+    "[DONE {'ready': False, 'state': 'fault', 'error': True, 'comment': 'controller 2 errored', "
+    "'date': '2026-10-17T06:13:40.00', 'NOSTATUS': '0000', 'UNKNOWN': '0000', "
+    "'IDLE': '1101', 'EXPOSING': '0000', 'READOUT_PENDING': '0000', 'READING': '0000', "
+    "'FETCHING': '0000', 'FLUSHING': '0000', 'ERASING': '0000', 'PURGING': '0000', "
+    "'AUTOCLEAR': '0000', 'AUTOFLUSH': '0000', 'POWERON': '1111', 'POWEROFF': '0000', "
+    "'POWERBAD': '0010', 'FETCH_PENDING': '0000', 'ERROR': '0010', 'ACTIVE': '1101', "
+    "'ERRORED': '0010', 'cmd_error':True, 'cmd_error_msg':'controller 2', 'cmd_command':'expose', "
+    "'cmd_arg_value_list':'', 'cmd_reply':''}]\n"
+};
+
+#define NUM_CAPTURED_REPLIES (sizeof(captured_reply)/sizeof(char *))
+
+/* hand-made replies, and the result parse_status must return */
+
+typedef struct {
+    char *reply;
+    int result;
+} Edge_Reply;
+
+static Edge_Reply edge_reply[] = {
+    {"", -1},
+    {"[DONE]", -1},
+    {"'", -1},
+    {"''", -1},
+    {"'':", -1},
+    {"[DONE {'ready'", -1},
+    {"[DONE {'ready':", 0},
+    {"[DONE {'ready': '", -1},
+    {"[DONE {'ready': True", 0},
+    {"[DONE {'IDLE': '1111", -1},
+    {"[DONE {'IDLE': 1111111111111111111111111111111111111111}]", 0},
+    {"[DONE {'\x80\x80': 1}]", -1},
+    {"[DONE {'\xff\xff\xff\xff\xff\xff\xff': '\xff'}]", -1},
+    {"[DONE {'I\xe9\xe9" "E': '\xe9', 'IDLE':\xa0'1111'}]", 0}
+};
+
+#define NUM_EDGE_REPLIES (sizeof(edge_reply)/sizeof(Edge_Reply))
+
+static unsigned long check_random_state=1;
+
+extern char *state_name[NUM_STATES]; /* from scheduler_status.c */
+
+int verbose = 0;
+int verbose1 = 0;
+
+/************************************************************/
+
+/* random integer from 0 to n-1, the same on every run */
+
+static int check_random(int n)
+{
+    check_random_state=check_random_state*6364136223846793005UL+1442695040888963407UL;
+
+    return((int)((check_random_state>>33)%n));
+}
+
+/************************************************************/
+
+static double elapsed_sec(struct timeval *t0, struct timeval *t1)
+{
+    return((t1->tv_sec-t0->tv_sec)+1.0e-6*(t1->tv_usec-t0->tv_usec));
+}
+
+/************************************************************/
+
+/* the parser parse_status replaced, which scans the reply once for
+   each keyword */
+
+static int old_parse_status(char *reply,Camera_Status *status)
+{
+  int i;
+  char temp_string[1024];
+  status->ready= get_bool_status("ready",reply);
+  status->error= get_bool_status("error",reply);
+  get_string_status("state",reply,status->state);
+  get_string_status("comment",reply,status->comment);
+  get_string_status("date",reply,status->date);
+  for (i=0;i<NUM_STATES;i++){
+     status->state_val[i]=-1;
+     get_string_status(state_name[i],reply,temp_string);
+     status->state_val[i]=binary_string_to_int(temp_string);
+  }
+  return(0);
+}
+
+/************************************************************/
+
+/* return 1 and print the difference if the two parses disagree */
+
+static int compare_status(int n, Camera_Status *s1, Camera_Status *s2)
+{
+    int i,result;
+
+    result=0;
+    if(s1->ready!=s2->ready||s1->error!=s2->error){
+       printf("check_status: reply %d ready %d %d error %d %d\n",
+          n,s1->ready,s2->ready,s1->error,s2->error);
+       result=1;
+    }
+    if(strcmp(s1->state,s2->state)!=0||strcmp(s1->comment,s2->comment)!=0||
+       strcmp(s1->date,s2->date)!=0){
+       printf("check_status: reply %d state [%s] [%s] comment [%s] [%s] date [%s] [%s]\n",
+          n,s1->state,s2->state,s1->comment,s2->comment,s1->date,s2->date);
+       result=1;
+    }
+    for(i=0;i<NUM_STATES;i++){
+       if(s1->state_val[i]!=s2->state_val[i]){
+          printf("check_status: reply %d %s %d %d\n",
+             n,state_name[i],s1->state_val[i],s2->state_val[i]);
+          result=1;
+       }
+    }
+
+    return(result);
+}
+
+/************************************************************/
+
+/* return 1 if parse_status left anything in status that it should not */
+
+static int bad_status(Camera_Status *status, int result)
+{
+    int i;
+
+    if(result!=0&&result!=-1)return(1);
+    if(memchr(status->state,0,STR_BUF_LEN)==NULL||
+       memchr(status->comment,0,STR_BUF_LEN)==NULL||
+       memchr(status->date,0,STR_BUF_LEN)==NULL)return(1);
+    for(i=0;i<NUM_STATES;i++){
+       if(status->state_val[i]<-1)return(1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* copy reply to copy (size max_len) with a few random edits, and
+   return the length of the copy */
+
+static int mutate_reply(char *reply, char *copy, int max_len)
+{
+    static char inserts[]="':,{}[] 01";
+    int n,k,num_edits,i,len,n_move;
+
+    n=strlen(reply);
+    if(n>max_len-1)n=max_len-1;
+    memcpy(copy,reply,n);
+
+    num_edits=1+check_random(CHECK_MAX_EDITS);
+    for(k=0;k<num_edits&&n>0;k++){
+       i=check_random(n);
+       switch(check_random(5)){
+         case 0: /* any byte but 0 */
+           copy[i]=(char)(1+check_random(255));
+           break;
+         case 1: /* delete up to 16 bytes */
+           len=1+check_random(16);
+           if(len>n-i)len=n-i;
+           memmove(copy+i,copy+i+len,n-i-len);
+           n=n-len;
+           break;
+         case 2: /* repeat up to 32 bytes */
+           len=1+check_random(32);
+           if(len>n-i)len=n-i;
+           if(n+len>max_len-1)break;
+           memmove(copy+i+len,copy+i,n-i);
+           n=n+len;
+           break;
+         case 3: /* insert a character the parser looks for */
+           if(n+1>max_len-1)break;
+           n_move=n-i;
+           memmove(copy+i+1,copy+i,n_move);
+           copy[i]=inserts[check_random(sizeof(inserts)-1)];
+           n++;
+           break;
+         default: /* cut short */
+           n=i;
+           break;
+       }
+    }
+
+    copy[n]=0;
+
+    return(n);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Camera_Status status,old_status;
+    struct timeval t0,t1;
+    char *copy,*reply;
+    int i,k,n,len,result,num_mutations,num_failed,saved_stderr,null_fd;
+    double new_sec,old_sec;
+
+    num_mutations=CHECK_NUM_MUTATIONS;
+    if(argc>1)sscanf(argv[1],"%d",&num_mutations);
+
+    init_status_names();
+    num_failed=0;
+
+    /* the two parsers must agree on the captured replies */
+
+    for(n=0;n<NUM_CAPTURED_REPLIES;n++){
+       result=parse_status(captured_reply[n],&status);
+       old_parse_status(captured_reply[n],&old_status);
+       if(result!=0||compare_status(n,&status,&old_status)!=0){
+          printf("check_status: captured reply %d parsed differently\n",n);
+          num_failed++;
+       }
+    }
+    printf("check_status: %d captured replies, %d parsed differently\n",
+       (int)NUM_CAPTURED_REPLIES,num_failed);
+    fflush(stdout);
+
+    /* parse_status complains about every keyword it can't find. Discard
+       that while it is fed broken replies */
+
+    fflush(stderr);
+    saved_stderr=dup(fileno(stderr));
+    null_fd=open("/dev/null",O_WRONLY);
+    if(null_fd>=0){
+       dup2(null_fd,fileno(stderr));
+       close(null_fd);
+    }
+
+    for(k=0;k<NUM_EDGE_REPLIES;k++){
+       result=parse_status(edge_reply[k].reply,&status);
+       if(result!=edge_reply[k].result||bad_status(&status,result)){
+          num_failed++;
+          printf("check_status: hand-made reply %d returns %d, not %d\n",
+             k,result,edge_reply[k].result);
+       }
+    }
+
+    /* each copy is allocated to its own length, so that a read past
+       the end is caught by -fsanitize=address */
+
+    copy=(char *)malloc(MAXBUFSIZE);
+    if(copy==NULL){
+       fprintf(stderr,"check_status: could not allocate copy\n");
+       return(1);
+    }
+    k=0;
+    for(n=0;n<NUM_CAPTURED_REPLIES;n++){
+       for(i=0;i<num_mutations;i++){
+          len=mutate_reply(captured_reply[n],copy,MAXBUFSIZE);
+          reply=(char *)malloc(len+1);
+          if(reply==NULL)continue;
+          memcpy(reply,copy,len+1);
+          result=parse_status(reply,&status);
+          if(bad_status(&status,result)){
+             k++;
+             if(k<=CHECK_MAX_FAILURES){
+                printf("check_status: mutated reply [%s] returns %d\n",reply,result);
+             }
+          }
+          free(reply);
+       }
+    }
+    free(copy);
+
+    fflush(stderr);
+    if(saved_stderr>=0){
+       dup2(saved_stderr,fileno(stderr));
+       close(saved_stderr);
+    }
+
+    printf("check_status: %d hand-made and %d mutated replies, %d failed\n",
+       (int)NUM_EDGE_REPLIES,num_mutations*(int)NUM_CAPTURED_REPLIES,k);
+    num_failed=num_failed+k;
+
+    /* time both parsers */
+
+    gettimeofday(&t0,NULL);
+    for(i=0;i<CHECK_NUM_PARSES;i++){
+       for(n=0;n<NUM_CAPTURED_REPLIES;n++){
+          parse_status(captured_reply[n],&status);
+       }
+    }
+    gettimeofday(&t1,NULL);
+    new_sec=elapsed_sec(&t0,&t1);
+
+    gettimeofday(&t0,NULL);
+    for(i=0;i<CHECK_NUM_PARSES;i++){
+       for(n=0;n<NUM_CAPTURED_REPLIES;n++){
+          old_parse_status(captured_reply[n],&old_status);
+       }
+    }
+    gettimeofday(&t1,NULL);
+    old_sec=elapsed_sec(&t0,&t1);
+
+    printf("check_status: parse_status %7.3f usec, old parser %7.3f usec per reply\n",
+       1.0e6*new_sec/(CHECK_NUM_PARSES*NUM_CAPTURED_REPLIES),
+       1.0e6*old_sec/(CHECK_NUM_PARSES*NUM_CAPTURED_REPLIES));
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
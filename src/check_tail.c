@@ -0,0 +1,432 @@
+/* check_tail.c
+
+   Check that tail_sequence, which reads only the lines appended to
+   the .add script since it was last called, loads the same fields as
+   load_sequence reading the whole script (see scheduler_script.c).
+
+   In a scratch directory a script of synthetic field lines, with
+   comments, blank lines and bad lines among them, is changed as the
+   cases below say, and tail_sequence is called after each change.
+   The fields it has loaded since the script was last read from the
+   start must be those load_sequence loads from the script, in order:
+
+     whole script   CHECK_NUM_LINES lines, read in one call
+     appends        lines appended a few at a time, and calls with
+                    nothing new, which must load nothing
+     partial line   a line appended in two writes, the first with no
+                    newline: nothing is loaded until the line is
+                    complete. A last line that never gets its newline
+                    is loaded by the call after the one that saw it
+     kept lines     the script replaced by a new file that starts with
+                    the old lines: only the new lines are loaded
+     new script     the script replaced by a new file whose first line
+                    is commented out, with lines added: all its fields
+                    are loaded
+     truncated      the script rewritten in place with fewer, other
+                    lines: all its fields are loaded
+     removed        no script: nothing is loaded
+
+   syntax: check_tail [verbose]
+
+   Built and run by "make check". The messages of tail_sequence are
+   discarded unless verbose is 1. Exits with 1 if any case fails.
+
+*/
+
+#include "scheduler.h"
+
+#define CHECK_NUM_LINES 3000 /* lines of the whole script */
+#define CHECK_NUM_APPENDS 60 /* appends of 1 to CHECK_MAX_APPEND lines */
+#define CHECK_MAX_APPEND 50
+#define CHECK_NUM_KEPT 20 /* lines added to a replaced script */
+#define CHECK_NUM_NEW 100 /* lines of a new script */
+
+int verbose=0;
+
+/* needed by scheduler_script.c */
+
+double focus_start=0.0;
+double focus_increment=0.0;
+double focus_default=0.0;
+char filter_name[STR_BUF_LEN];
+char *filter_name_ptr=0;
+
+static char check_dir[STR_BUF_LEN];
+static char script_file[STR_BUF_LEN];
+static char new_file[STR_BUF_LEN];
+static FILE *check_log;
+static unsigned int check_seed=1;
+
+/************************************************************/
+
+/* small portable generator, so that runs are repeatable */
+
+static double check_random()
+{
+    check_seed=check_seed*1103515245+12345;
+    return(((check_seed>>8)&0xffffff)/16777216.0);
+}
+
+/************************************************************/
+
+/* write n script lines to output. Most are fields. The rest are
+   comments, blank lines, and fields out of range, which are not
+   loaded */
+
+static void write_lines(FILE *output, int n)
+{
+    int i;
+    double x;
+
+    for(i=0;i<n;i++){
+       x=check_random();
+       if(x<0.05){
+          fprintf(output,"# comment %d\n",i);
+       }
+       else if(x<0.08){
+          fprintf(output,"\n");
+       }
+       else if(x<0.10){
+          fprintf(output,"%9.6f %9.5f Y 60 1800 2 1\n",30.0,0.0);
+       }
+       else{
+          fprintf(output,"%9.6f %9.5f Y %d %d %d %d\n",24.0*check_random(),
+             -90.0+120.0*check_random(),30+(int)(90*check_random()),
+             600+(int)(3000*check_random()),1+(int)(4*check_random()),
+             (int)(3*check_random()));
+       }
+    }
+}
+
+/************************************************************/
+
+/* write n lines to file_name, replacing it, or appending to it if
+   append is True */
+
+static int write_script(char *file_name, int n, bool append)
+{
+    FILE *output;
+
+    output=fopen(file_name,append ? "a" : "w");
+    if(output==NULL){
+       fprintf(check_log,"check_tail: can't write %s\n",file_name);
+       return(-1);
+    }
+    write_lines(output,n);
+    fclose(output);
+
+    return(0);
+}
+
+/************************************************************/
+
+static int write_text(char *file_name, char *text)
+{
+    FILE *output;
+
+    output=fopen(file_name,"a");
+    if(output==NULL){
+       fprintf(check_log,"check_tail: can't write %s\n",file_name);
+       return(-1);
+    }
+    fputs(text,output);
+    fclose(output);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* copy file_name to new_file, so that the copy can be added to and
+   renamed over file_name */
+
+static int copy_script(char *file_name)
+{
+    FILE *input,*output;
+    int c;
+
+    input=fopen(file_name,"r");
+    output=fopen(new_file,"w");
+    if(input==NULL||output==NULL){
+       fprintf(check_log,"check_tail: can't copy %s\n",file_name);
+       if(input!=NULL)fclose(input);
+       if(output!=NULL)fclose(output);
+       return(-1);
+    }
+    while((c=fgetc(input))!=EOF)fputc(c,output);
+    fclose(input);
+    fclose(output);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* make the first line of file_name a comment, without changing the
+   length of the file */
+
+static int comment_first_line(char *file_name)
+{
+    FILE *output;
+
+    output=fopen(file_name,"r+");
+    if(output==NULL){
+       fprintf(check_log,"check_tail: can't change %s\n",file_name);
+       return(-1);
+    }
+    fputc('#',output);
+    fclose(output);
+
+    return(0);
+}
+
+/************************************************************/
+
+static bool same_field(Field *f1, Field *f2)
+{
+    return(f1->line_number==f2->line_number&&f1->ra==f2->ra&&
+       f1->dec==f2->dec&&f1->shutter==f2->shutter&&f1->expt==f2->expt&&
+       f1->interval==f2->interval&&f1->n_required==f2->n_required&&
+       f1->survey_code==f2->survey_code&&
+       strcmp(f1->hist->script_line,f2->hist->script_line)==0);
+}
+
+/************************************************************/
+
+/* call tail_sequence, add the fields it loads to loaded, and check
+   that it loaded num_expected of them. Returns 0 if it did */
+
+static int tail(char *name, Script_Tail *script_tail, Field_Table *loaded,
+     int num_expected)
+{
+    Field_Table new_table;
+    int i,n;
+
+    init_field_table(&new_table);
+    n=tail_sequence(script_tail,&new_table);
+    if(n>0&&grow_field_table(loaded,loaded->num_fields+n)==0){
+       for(i=0;i<n;i++){
+          copy_field(loaded->fields+loaded->num_fields+i,new_table.fields+i);
+       }
+       loaded->num_fields=loaded->num_fields+n;
+    }
+    free_field_table(&new_table);
+
+    if(n!=num_expected){
+       fprintf(check_log,"check_tail: %s: %d fields loaded, not %d\n",
+          name,n,num_expected);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* compare loaded with the fields load_sequence reads from the script.
+   Returns 0 if they are the same */
+
+static int compare_script(char *name, Field_Table *loaded)
+{
+    Field_Table table;
+    int i,n,result;
+
+    init_field_table(&table);
+    n=load_sequence(script_file,&table);
+
+    result=0;
+    if(n!=loaded->num_fields){
+       fprintf(check_log,"check_tail: %s: %d fields loaded, load_sequence has %d\n",
+          name,loaded->num_fields,n);
+       result=-1;
+    }
+    else{
+       for(i=0;i<n;i++){
+          if(!same_field(loaded->fields+i,table.fields+i)){
+             fprintf(check_log,"check_tail: %s: field %d on line %d is not line %d [%s]\n",
+                name,i,loaded->fields[i].line_number,table.fields[i].line_number,
+                table.fields[i].hist->script_line);
+             result=-1;
+             break;
+          }
+       }
+    }
+    free_field_table(&table);
+
+    return(result);
+}
+
+/************************************************************/
+
+/* number of fields load_sequence reads from the script */
+
+static int count_fields()
+{
+    Field_Table table;
+    int n;
+
+    init_field_table(&table);
+    n=load_sequence(script_file,&table);
+    free_field_table(&table);
+
+    return(n);
+}
+
+/************************************************************/
+
+/* start reading the script from the start */
+
+static void restart(Script_Tail *script_tail, Field_Table *loaded)
+{
+    init_script_tail(script_tail,script_file);
+    free_field_table(loaded);
+    init_field_table(loaded);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Script_Tail script_tail;
+    Field_Table loaded;
+    int k,n,num_before,num_cases,num_failed,result;
+
+    if(argc>1)verbose=atoi(argv[1]);
+
+    /* failures go to the real stderr, the messages of the code
+       checked only if verbose */
+
+    check_log=fdopen(dup(fileno(stderr)),"w");
+    setvbuf(check_log,NULL,_IOLBF,0);
+    if(!verbose&&freopen("/dev/null","w",stderr)==NULL){
+       fprintf(check_log,"check_tail: can't discard messages\n");
+    }
+
+    strcpy(check_dir,"/tmp/check_tail.XXXXXX");
+    if(mkdtemp(check_dir)==NULL){
+       fprintf(check_log,"check_tail: can't make scratch directory\n");
+       return(1);
+    }
+    strcpy(script_file,check_dir);
+    strcat(script_file,"/script.add");
+    strcpy(new_file,check_dir);
+    strcat(new_file,"/new.add");
+
+    init_field_table(&loaded);
+    num_cases=0;
+    num_failed=0;
+
+    /* whole script */
+
+    num_cases++;
+    restart(&script_tail,&loaded);
+    if(write_script(script_file,CHECK_NUM_LINES,False)!=0||
+       tail("whole script",&script_tail,&loaded,count_fields())!=0||
+       compare_script("whole script",&loaded)!=0){
+       num_failed++;
+    }
+
+    /* appends */
+
+    num_cases++;
+    unlink(script_file);
+    restart(&script_tail,&loaded);
+    result=write_script(script_file,0,False);
+    for(k=0;k<CHECK_NUM_APPENDS&&result==0;k++){
+       num_before=count_fields();
+       n=1+(int)(CHECK_MAX_APPEND*check_random());
+       if(write_script(script_file,n,True)!=0||
+          tail("appends",&script_tail,&loaded,count_fields()-num_before)!=0||
+          tail("appends, nothing new",&script_tail,&loaded,0)!=0){
+          result=-1;
+       }
+    }
+    if(result!=0||compare_script("appends",&loaded)!=0){
+       num_failed++;
+    }
+
+    /* partial line */
+
+    num_cases++;
+    if(write_text(script_file,"12.000000  10.00000 Y 60")!=0||
+       tail("partial line",&script_tail,&loaded,0)!=0||
+       write_text(script_file," 1800 2 1\n")!=0||
+       tail("partial line, completed",&script_tail,&loaded,1)!=0||
+       compare_script("partial line",&loaded)!=0){
+       num_failed++;
+    }
+
+    /* a last line left without a newline: the same fields, but it is
+       counted as a line by itself, so this runs last on the script */
+
+    num_cases++;
+    if(write_text(script_file,"13.000000 -10.00000 Y 60 1800 2 1")!=0||
+       tail("no newline",&script_tail,&loaded,0)!=0||
+       tail("no newline, unchanged",&script_tail,&loaded,1)!=0||
+       tail("no newline, read",&script_tail,&loaded,0)!=0||
+       compare_script("no newline",&loaded)!=0){
+       num_failed++;
+    }
+
+    /* kept lines */
+
+    num_cases++;
+    restart(&script_tail,&loaded);
+    num_before=-1;
+    if(write_script(script_file,CHECK_NUM_NEW,False)==0&&
+       tail("kept lines, before",&script_tail,&loaded,count_fields())==0&&
+       copy_script(script_file)==0&&
+       write_script(new_file,CHECK_NUM_KEPT,True)==0){
+       num_before=count_fields();
+    }
+    if(num_before<0||rename(new_file,script_file)!=0||
+       tail("kept lines",&script_tail,&loaded,count_fields()-num_before)!=0||
+       compare_script("kept lines",&loaded)!=0){
+       num_failed++;
+    }
+
+    /* new script */
+
+    num_cases++;
+    free_field_table(&loaded);
+    init_field_table(&loaded);
+    if(copy_script(script_file)!=0||comment_first_line(new_file)!=0||
+       write_script(new_file,CHECK_NUM_KEPT,True)!=0||
+       rename(new_file,script_file)!=0||
+       tail("new script",&script_tail,&loaded,count_fields())!=0||
+       compare_script("new script",&loaded)!=0){
+       num_failed++;
+    }
+
+    /* truncated */
+
+    num_cases++;
+    free_field_table(&loaded);
+    init_field_table(&loaded);
+    if(write_script(script_file,CHECK_NUM_NEW/2,False)!=0||
+       tail("truncated",&script_tail,&loaded,count_fields())!=0||
+       compare_script("truncated",&loaded)!=0){
+       num_failed++;
+    }
+
+    /* removed */
+
+    num_cases++;
+    unlink(script_file);
+    if(tail("removed",&script_tail,&loaded,0)!=0){
+       num_failed++;
+    }
+
+    free_field_table(&loaded);
+    unlink(new_file);
+    rmdir(check_dir);
+
+    printf("check_tail: %d lines, %d appends, %d cases, %d failed\n",
+       CHECK_NUM_LINES,CHECK_NUM_APPENDS,num_cases,num_failed);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
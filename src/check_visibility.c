@@ -0,0 +1,487 @@
+/* check_visibility.c
+
+   Check the per-night visibility bitsets of scheduler_visibility.c
+   against get_ha and get_airmass, evaluated one field and one time at
+   a time, and check the queries on them against plain loops over the
+   bits.
+
+   The fields are a full-sky grid of sky fields, with a moon that rules
+   out some of them, and a few dark fields with windows of their own.
+   The night starts at a jd that is not a whole slot, and its dark
+   part starts and ends between slot boundaries. The cases are
+
+     sky fields        bit k is set when the field is between MIN_DEC
+                       and MAX_DEC, not ruled out by the moon, and has
+                       an airmass below MAX_AIRMASS and an hour angle
+                       within MAX_HOURANGLE at both ends of slot k,
+                       which lies between jd_start and jd_end
+     other fields      bit k is set when slot k lies between jd_rise and
+                       jd_set of a doable field. A field that is not
+                       doable, or has no window, has no bits
+     past sunrise      no bit past the last slot is set
+     field_visible     is the bit of the slot holding jd
+     next_visible_jd   and visible_until_jd, the first slot at or after
+                       jd that is set, and the first one after that
+                       which is not
+     visible_hours     the bits set from the slot holding jd0 up to the
+                       slot holding jd1
+
+   A slot with an end at which the airmass is within CHECK_AM_TOLERANCE
+   of MAX_AIRMASS, or the hour angle within CHECK_HA_TOLERANCE of
+   MAX_HOURANGLE, may go either way in the batch kernel and the single
+   evaluation, and is counted, not failed. The queries are asked at
+   CHECK_NUM_QUERIES random jds per field, from a little before sunset
+   to a little after sunrise, and at every slot boundary of one field.
+
+   syntax: check_visibility [verbose]
+
+   Built and run by "make check". Exits with 1 if any case fails.
+
+*/
+
+#include "scheduler.h"
+
+#define CHECK_RA_STEP 0.25 /* hours between fields in RA */
+#define CHECK_DEC_STEP 3.0 /* degrees between fields in dec */
+#define CHECK_NUM_DARKS 5 /* dark fields after the grid */
+#define CHECK_JD_SUNSET 2461331.46731 /* start of the night checked */
+#define CHECK_NIGHT_DAYS 0.4237 /* sunset to sunrise */
+#define CHECK_TWILIGHT_DAYS 0.06123 /* sunset to jd_start, jd_end to sunrise */
+#define CHECK_AM_TOLERANCE 1.0e-8 /* relative, at MAX_AIRMASS */
+#define CHECK_HA_TOLERANCE 1.0e-9 /* hours, at MAX_HOURANGLE */
+#define CHECK_NUM_QUERIES 50 /* random jds asked per field */
+#define CHECK_MAX_FAILURES 20 /* failures printed */
+
+int verbose=0;
+int verbose1=0;
+
+static unsigned int check_seed=1;
+static int num_failures_printed=0;
+
+/************************************************************/
+
+/* used only in the verbose output of search_jd_rise_time */
+
+double get_jd()
+{
+    return(0.0);
+}
+
+/************************************************************/
+
+/* stands in for moon_interference of scheduler.c, which brings the
+   rest of the scheduler with it: a field is ruled out within
+   min_separation degrees of the moon in dec and an hour in RA,
+   whatever its phase */
+
+int moon_interference(Field *f, Night_Times *nt, double min_separation)
+{
+    return(fabs(f->dec-nt->dec_moon)<min_separation&&
+       fabs(f->ra-nt->ra_moon)<1.0);
+}
+
+/************************************************************/
+
+/* small portable generator, so that runs are repeatable */
+
+static double check_random()
+{
+    check_seed=check_seed*1103515245+12345;
+    return(((check_seed>>8)&0xffffff)/16777216.0);
+}
+
+/************************************************************/
+
+static int get_bit(Visibility_Table *vis, int i, int k)
+{
+    return((vis->bits[i*vis->n_words+(k>>6)]>>(k&63))&1);
+}
+
+/************************************************************/
+
+/* print a failure, as long as not too many have been */
+
+static void report(char *name, int i, char *message, double x, double x_ref)
+{
+    num_failures_printed++;
+    if(num_failures_printed>CHECK_MAX_FAILURES)return;
+
+    fprintf(stderr,"check_visibility: %s: field %d: %s %14.6f, not %14.6f\n",
+       name,i,message,x,x_ref);
+}
+
+/************************************************************/
+
+/* whether sky field f is up at jd, one at a time: 1 if it is, 0 if
+   not, -1 if it is too near a limit to say */
+
+static int sky_field_up(Field *f, double jd, Site_Params *site)
+{
+    double ha,am;
+
+    ha=get_ha(f->ra,lst(jd,site->longit));
+    am=get_airmass(ha,f->dec,site);
+
+    if(fabs(am-MAX_AIRMASS)<CHECK_AM_TOLERANCE*MAX_AIRMASS)return(-1);
+    if(fabs(fabs(ha)-MAX_HOURANGLE)<CHECK_HA_TOLERANCE)return(-1);
+
+    return(am<MAX_AIRMASS&&fabs(ha)<MAX_HOURANGLE);
+}
+
+/************************************************************/
+
+/* check the bits of the sky fields. Counts the slots in *num_up and
+   those too near a limit in *num_edge. Returns the number of fields
+   that fail */
+
+static int check_sky_fields(Visibility_Table *vis, Field *sequence,
+       int num_fields, Night_Times *nt, Site_Params *site, int *num_up,
+       int *num_edge)
+{
+    int i,k,up,up_next,expected,failed,num_failed;
+    double jd;
+    Field *f;
+
+    num_failed=0;
+    for(i=0;i<num_fields;i++){
+       f=sequence+i;
+       if(f->shutter!=SKY_CODE)continue;
+
+       failed=0;
+       up=-1;
+       for(k=0;k<vis->n_slots&&!failed;k++){
+          jd=vis->jd0+k*vis->slot_days;
+          if(f->dec>MAX_DEC||f->dec<MIN_DEC||
+             moon_interference(f,nt,MIN_MOON_SEPARATION)||
+             jd<nt->jd_start||jd+vis->slot_days>nt->jd_end){
+             expected=0;
+          }
+          else{
+             if(up<0||k==0)up=sky_field_up(f,jd,site);
+             up_next=sky_field_up(f,jd+vis->slot_days,site);
+             if(up<0||up_next<0){
+                (*num_edge)++;
+                up=up_next;
+                continue;
+             }
+             expected=up&&up_next;
+             up=up_next;
+          }
+
+          if(get_bit(vis,i,k)!=expected){
+             report("sky fields",i,"bit set",(double)get_bit(vis,i,k),
+                (double)expected);
+             if(verbose){
+                fprintf(stderr,
+                   "check_visibility: sky fields: ra %6.3f dec %7.3f slot %d jd %14.6f\n",
+                   f->ra,f->dec,k,jd);
+             }
+             failed=1;
+          }
+          if(expected)(*num_up)++;
+       }
+       if(failed)num_failed++;
+    }
+
+    return(num_failed);
+}
+
+/************************************************************/
+
+/* check the bits of the fields other than sky fields. Returns the
+   number of fields that fail */
+
+static int check_other_fields(Visibility_Table *vis, Field *sequence,
+       int num_fields)
+{
+    int i,k,expected,num_failed;
+    double jd;
+    Field *f;
+
+    num_failed=0;
+    for(i=0;i<num_fields;i++){
+       f=sequence+i;
+       if(f->shutter==SKY_CODE)continue;
+
+       for(k=0;k<vis->n_slots;k++){
+          jd=vis->jd0+k*vis->slot_days;
+          expected=(f->doable&&f->jd_rise>=0.0&&jd>=f->jd_rise&&
+             jd+vis->slot_days<=f->jd_set);
+          if(get_bit(vis,i,k)!=expected){
+             report("other fields",i,"bit set",(double)get_bit(vis,i,k),
+                (double)expected);
+             num_failed++;
+             break;
+          }
+       }
+    }
+
+    return(num_failed);
+}
+
+/************************************************************/
+
+/* the answers of the queries from plain loops over the bits */
+
+static int plain_slot(Visibility_Table *vis, double jd)
+{
+    double x;
+
+    x=(jd-vis->jd0)/vis->slot_days;
+    if(x<0.0)return(0);
+    if(x>=vis->n_slots)return(vis->n_slots);
+
+    return((int)x);
+}
+
+static int plain_visible(Visibility_Table *vis, int i, double jd)
+{
+    double x;
+
+    x=(jd-vis->jd0)/vis->slot_days;
+    if(x<0.0||x>=vis->n_slots)return(0);
+
+    return(get_bit(vis,i,(int)x));
+}
+
+static double plain_next_jd(Visibility_Table *vis, int i, double jd)
+{
+    int k;
+
+    for(k=plain_slot(vis,jd);k<vis->n_slots&&!get_bit(vis,i,k);k++);
+    if(k>=vis->n_slots)return(-1.0);
+    if(vis->jd0+k*vis->slot_days<=jd)return(jd);
+
+    return(vis->jd0+k*vis->slot_days);
+}
+
+static double plain_until_jd(Visibility_Table *vis, int i, double jd)
+{
+    int k;
+
+    for(k=plain_slot(vis,jd);k<vis->n_slots&&!get_bit(vis,i,k);k++);
+    if(k>=vis->n_slots)return(-1.0);
+    for(;k<vis->n_slots&&get_bit(vis,i,k);k++);
+
+    return(vis->jd0+k*vis->slot_days);
+}
+
+static double plain_hours(Visibility_Table *vis, int i, double jd0, double jd1)
+{
+    int k,n;
+
+    n=0;
+    for(k=plain_slot(vis,jd0);k<plain_slot(vis,jd1);k++){
+       n=n+get_bit(vis,i,k);
+    }
+
+    return(n*vis->slot_days*24.0);
+}
+
+/************************************************************/
+
+/* ask the queries of field i at jd, and up to jd1 for visible_hours.
+   Adds the failures of each to num_failed */
+
+static void check_queries(Visibility_Table *vis, int i, double jd, double jd1,
+       int *num_failed)
+{
+    double x,x_ref;
+
+    x=field_visible(vis,i,jd);
+    x_ref=plain_visible(vis,i,jd);
+    if(x!=x_ref){
+       report("field_visible",i,"at jd",jd,jd);
+       num_failed[0]++;
+    }
+
+    x=next_visible_jd(vis,i,jd);
+    x_ref=plain_next_jd(vis,i,jd);
+    if(x!=x_ref){
+       report("next_visible_jd",i,"is",x,x_ref);
+       num_failed[1]++;
+    }
+
+    x=visible_until_jd(vis,i,jd);
+    x_ref=plain_until_jd(vis,i,jd);
+    if(x!=x_ref){
+       report("visible_until_jd",i,"is",x,x_ref);
+       num_failed[1]++;
+    }
+
+    x=visible_hours(vis,i,jd,jd1);
+    x_ref=plain_hours(vis,i,jd,jd1);
+    if(x!=x_ref){
+       report("visible_hours",i,"is",x,x_ref);
+       num_failed[2]++;
+    }
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Site_Params site;
+    Night_Times nt;
+    Airmass_Table table;
+    Visibility_Table vis;
+    Field *sequence,*f;
+    double jd,jd1,jd_first,jd_last;
+    int i,k,w,num_fields,num_sky,num_up,num_edge,num_cases,num_failed;
+    int num_set,query_failed[3];
+
+    if(argc>1)verbose=atoi(argv[1]);
+
+    strcpy(site.site_name,"DEFAULT");
+    load_site(&site.longit,&site.lat,&site.stdz,&site.use_dst,
+            site.zone_name,&site.zabr,&site.elevsea,&site.elev,
+            &site.horiz,site.site_name);
+    init_site_trig(&site);
+
+    memset((void *)&nt,0,sizeof(nt));
+    nt.jd_sunset=CHECK_JD_SUNSET;
+    nt.jd_sunrise=CHECK_JD_SUNSET+CHECK_NIGHT_DAYS;
+    nt.jd_start=nt.jd_sunset+CHECK_TWILIGHT_DAYS;
+    nt.jd_end=nt.jd_sunrise-CHECK_TWILIGHT_DAYS;
+    nt.percent_moon=0.9;
+    nt.ra_moon=2.1;
+    nt.dec_moon=-25.0;
+
+    num_sky=(int)(24.0/CHECK_RA_STEP)*(int)(1.0+180.0/CHECK_DEC_STEP);
+    num_fields=num_sky+CHECK_NUM_DARKS;
+    sequence=(Field *)calloc(num_fields,sizeof(Field));
+    if(sequence==NULL){
+       fprintf(stderr,"check_visibility: could not allocate %d fields\n",
+          num_fields);
+       return(1);
+    }
+
+    num_fields=0;
+    for(i=0;i<=(int)(180.0/CHECK_DEC_STEP);i++){
+       for(k=0;k<(int)(24.0/CHECK_RA_STEP);k++){
+          f=sequence+num_fields;
+          f->ra=k*CHECK_RA_STEP;
+          f->dec=-90.0+i*CHECK_DEC_STEP;
+          f->shutter=SKY_CODE;
+          f->doable=1;
+          init_field_trig(f);
+          num_fields++;
+       }
+    }
+
+    /* darks: one over part of the night, one past its ends, one not
+       doable, one without a window, and one up for a single slot */
+
+    for(i=0;i<CHECK_NUM_DARKS;i++){
+       f=sequence+num_fields;
+       f->shutter=DARK_CODE;
+       f->doable=(i!=2);
+       f->jd_rise=nt.jd_sunset+0.1234;
+       f->jd_set=nt.jd_sunset+0.2345;
+       init_field_trig(f);
+       num_fields++;
+    }
+    sequence[num_sky+1].jd_rise=nt.jd_sunset-0.5;
+    sequence[num_sky+1].jd_set=nt.jd_sunrise+0.5;
+    sequence[num_sky+3].jd_rise=-1.0;
+    sequence[num_sky+4].jd_rise=nt.jd_sunset+0.3001;
+    sequence[num_sky+4].jd_set=sequence[num_sky+4].jd_rise+
+       1.5*VISIBILITY_SLOT_MINUTES/1440.0;
+
+    memset((void *)&table,0,sizeof(table));
+    memset((void *)&vis,0,sizeof(vis));
+    if(load_airmass_table(&table,sequence,num_fields,&site)!=0||
+       load_visibility_table(&vis,&table,sequence,num_fields,&nt,&site)!=0){
+       free(sequence);
+       return(1);
+    }
+
+    num_cases=0;
+    num_failed=0;
+    num_up=0;
+    num_edge=0;
+
+    /* sky fields */
+
+    num_cases++;
+    k=check_sky_fields(&vis,sequence,num_fields,&nt,&site,&num_up,&num_edge);
+    if(k>0||num_up==0){
+       fprintf(stderr,"check_visibility: sky fields: %d of %d fields fail, %d slots up\n",
+          k,num_sky,num_up);
+       num_failed++;
+    }
+
+    /* other fields */
+
+    num_cases++;
+    if(check_other_fields(&vis,sequence,num_fields)>0)num_failed++;
+
+    /* past sunrise */
+
+    num_cases++;
+    k=0;
+    for(i=0;i<num_fields;i++){
+       for(w=vis.n_slots;w<64*vis.n_words;w++){
+          if(get_bit(&vis,i,w)){
+             report("past sunrise",i,"bit set in slot",(double)w,-1.0);
+             k++;
+             break;
+          }
+       }
+    }
+    if(k>0)num_failed++;
+
+    /* the queries, at random jds and at every slot boundary of a field
+       that is up for part of the night, but not the middle of it */
+
+    query_failed[0]=0;
+    query_failed[1]=0;
+    query_failed[2]=0;
+    jd_first=vis.jd0-0.05;
+    jd_last=vis.jd0+vis.n_slots*vis.slot_days+0.05;
+    for(i=0;i<num_fields;i++){
+       for(k=0;k<CHECK_NUM_QUERIES;k++){
+          jd=jd_first+(jd_last-jd_first)*check_random();
+          jd1=jd_first+(jd_last-jd_first)*check_random();
+          check_queries(&vis,i,jd,jd1,query_failed);
+       }
+    }
+
+    for(i=0;i<num_sky;i++){
+       num_set=0;
+       for(k=0;k<vis.n_slots;k++)num_set=num_set+get_bit(&vis,i,k);
+       if(num_set>0&&num_set<vis.n_slots/2&&!get_bit(&vis,i,vis.n_slots/2))break;
+    }
+    if(i<num_sky){
+       for(k=0;k<=vis.n_slots;k++){
+          jd=vis.jd0+k*vis.slot_days;
+          check_queries(&vis,i,jd,jd+(k%97)*vis.slot_days,query_failed);
+       }
+    }
+    else{
+       fprintf(stderr,"check_visibility: no field is up for part of the night\n");
+       query_failed[1]++;
+    }
+
+    num_cases=num_cases+3;
+    for(k=0;k<3;k++){
+       if(query_failed[k]>0)num_failed++;
+    }
+
+    if(num_failures_printed>CHECK_MAX_FAILURES){
+       fprintf(stderr,"check_visibility: %d more failures not printed\n",
+          num_failures_printed-CHECK_MAX_FAILURES);
+    }
+
+    printf("check_visibility: %d fields, %d slots, %d slots up, %d at a limit, %d cases, %d failed\n",
+       num_fields,vis.n_slots,num_up,num_edge,num_cases,num_failed);
+
+    free_visibility_table(&vis);
+    free(sequence);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
@@ -0,0 +1,240 @@
+/* check_wait.c
+
+   Check that wait_for_event (see scheduler_wait.c) ends an idle wait
+   of the main loop when it should, and only then.
+
+   In a scratch directory, with the .add script watched, a child
+   process does one thing CHECK_ACT_SEC into each wait:
+
+     timer          nothing: the wait ends on its timer, on time
+     add append     a line appended to the script: the wait ends at once
+     add replaced   the script replaced by rename: the wait ends at once
+     other file     a line written to another file in the directory:
+                    the wait ends on its timer
+     pause          SIGUSR1: the wait ends at once, and pause_flag is set
+     resume         SIGUSR2: the wait ends at once, and pause_flag is
+                    cleared
+     other signal   SIGALRM, with a handler that does nothing: the wait
+                    ends on its timer
+
+   "At once" is within CHECK_LATE_SEC of the child's action, and "on
+   time" within CHECK_LATE_SEC of the end of the wait.
+
+   syntax: check_wait [verbose]
+
+   Built and run by "make check". Exits with 1 if any case fails.
+
+*/
+
+#include "scheduler.h"
+#include <sys/wait.h>
+
+#define CHECK_WAIT_SEC 0.5 /* waits that should run to the end */
+#define CHECK_LONG_WAIT_SEC 5.0 /* waits that should end early */
+#define CHECK_ACT_SEC 0.1 /* time from the start of a wait to the action */
+#define CHECK_LATE_SEC 0.3 /* allowed lateness of the end of a wait */
+
+/* the actions of the child */
+
+#define ACT_NONE 0
+#define ACT_APPEND 1
+#define ACT_REPLACE 2
+#define ACT_OTHER_FILE 3
+#define ACT_SIGUSR1 4
+#define ACT_SIGUSR2 5
+#define ACT_SIGALRM 6
+
+int verbose=0;
+int verbose1=0;
+int pause_flag=0;
+
+static char check_dir[STR_BUF_LEN];
+static char script_file[STR_BUF_LEN];
+static char other_file[STR_BUF_LEN];
+static char new_file[STR_BUF_LEN];
+
+/************************************************************/
+
+/* called by sigterm_handler */
+
+int do_exit(int code)
+{
+    exit(code);
+}
+
+/************************************************************/
+
+static void sigalrm_handler(int sig)
+{
+    (void)sig;
+}
+
+/************************************************************/
+
+static double monotonic_sec()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC,&t);
+
+    return(t.tv_sec+1.0e-9*t.tv_nsec);
+}
+
+/************************************************************/
+
+static void append_line(char *file_name)
+{
+    FILE *output;
+
+    output=fopen(file_name,"a");
+    if(output!=NULL){
+       fprintf(output,"12.000000  10.00000 Y 60 1800 2 1\n");
+       fclose(output);
+    }
+}
+
+/************************************************************/
+
+/* start a child that does action CHECK_ACT_SEC from now, to process
+   parent. Returns its pid, or -1 */
+
+static pid_t start_action(int action, pid_t parent)
+{
+    pid_t pid;
+
+    pid=fork();
+    if(pid!=0)return(pid);
+
+    usleep((useconds_t)(CHECK_ACT_SEC*1.0e6));
+    switch(action){
+       case ACT_APPEND: append_line(script_file); break;
+       case ACT_REPLACE:
+          append_line(new_file);
+          if(rename(new_file,script_file)!=0)_exit(1);
+          break;
+       case ACT_OTHER_FILE: append_line(other_file); break;
+       case ACT_SIGUSR1: kill(parent,SIGUSR1); break;
+       case ACT_SIGUSR2: kill(parent,SIGUSR2); break;
+       case ACT_SIGALRM: kill(parent,SIGALRM); break;
+       default: break;
+    }
+    _exit(0);
+}
+
+/************************************************************/
+
+/* wait wait_sec with the child doing action. The wait must return
+   wake, and end after min_sec and before max_sec. Returns 0 if it
+   does */
+
+static int check_case(char *name, Wait_Events *w, int action, double wait_sec,
+     int wake, double min_sec, double max_sec)
+{
+    pid_t pid;
+    double t0,dt;
+    int result,status;
+
+    t0=monotonic_sec();
+    pid=start_action(action,getpid());
+    if(pid<0){
+       fprintf(stderr,"check_wait: %s: can't start child\n",name);
+       return(-1);
+    }
+    result=wait_for_event(w,wait_sec);
+    dt=monotonic_sec()-t0;
+    waitpid(pid,&status,0);
+
+    if(verbose){
+       fprintf(stderr,"check_wait: %-13s wait %4.1f sec ended by %d after %6.3f sec\n",
+          name,wait_sec,result,dt);
+    }
+
+    if(result!=wake||dt<min_sec||dt>max_sec){
+       fprintf(stderr,
+          "check_wait: %s: wait of %4.1f sec ended by %d after %6.3f sec, not by %d after %6.3f to %6.3f sec\n",
+          name,wait_sec,result,dt,wake,min_sec,max_sec);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    Wait_Events w;
+    int num_cases,num_failed;
+
+    if(argc>1)verbose=atoi(argv[1]);
+
+    strcpy(check_dir,"/tmp/check_wait.XXXXXX");
+    if(mkdtemp(check_dir)==NULL){
+       fprintf(stderr,"check_wait: can't make scratch directory\n");
+       return(1);
+    }
+    strcpy(script_file,check_dir);
+    strcat(script_file,"/script.add");
+    strcpy(other_file,check_dir);
+    strcat(other_file,"/other");
+    strcpy(new_file,check_dir);
+    strcat(new_file,"/new.add");
+
+    if(install_signal_handlers()!=0||signal(SIGALRM,sigalrm_handler)==SIG_ERR||
+       init_wait_events(&w,script_file)!=0){
+       rmdir(check_dir);
+       return(1);
+    }
+    if(w.inotify_fd<0||w.timer_fd<0){
+       fprintf(stderr,"check_wait: inotify or timerfd can't be used here\n");
+    }
+
+    num_cases=0;
+    num_failed=0;
+
+    num_cases++;
+    if(check_case("timer",&w,ACT_NONE,CHECK_WAIT_SEC,WAKE_TIMER,
+       CHECK_WAIT_SEC,CHECK_WAIT_SEC+CHECK_LATE_SEC)!=0)num_failed++;
+
+    num_cases++;
+    if(check_case("add append",&w,ACT_APPEND,CHECK_LONG_WAIT_SEC,WAKE_ADD_FILE,
+       CHECK_ACT_SEC,CHECK_ACT_SEC+CHECK_LATE_SEC)!=0)num_failed++;
+
+    num_cases++;
+    if(check_case("add replaced",&w,ACT_REPLACE,CHECK_LONG_WAIT_SEC,WAKE_ADD_FILE,
+       CHECK_ACT_SEC,CHECK_ACT_SEC+CHECK_LATE_SEC)!=0)num_failed++;
+
+    num_cases++;
+    if(check_case("other file",&w,ACT_OTHER_FILE,CHECK_WAIT_SEC,WAKE_TIMER,
+       CHECK_WAIT_SEC,CHECK_WAIT_SEC+CHECK_LATE_SEC)!=0)num_failed++;
+
+    num_cases++;
+    if(check_case("pause",&w,ACT_SIGUSR1,CHECK_LONG_WAIT_SEC,WAKE_SIGNAL,
+       CHECK_ACT_SEC,CHECK_ACT_SEC+CHECK_LATE_SEC)!=0||pause_flag!=1){
+       if(pause_flag!=1)fprintf(stderr,"check_wait: pause: pause_flag not set\n");
+       num_failed++;
+    }
+
+    num_cases++;
+    if(check_case("resume",&w,ACT_SIGUSR2,CHECK_LONG_WAIT_SEC,WAKE_SIGNAL,
+       CHECK_ACT_SEC,CHECK_ACT_SEC+CHECK_LATE_SEC)!=0||pause_flag!=0){
+       if(pause_flag!=0)fprintf(stderr,"check_wait: resume: pause_flag not cleared\n");
+       num_failed++;
+    }
+
+    num_cases++;
+    if(check_case("other signal",&w,ACT_SIGALRM,CHECK_WAIT_SEC,WAKE_TIMER,
+       CHECK_WAIT_SEC,CHECK_WAIT_SEC+CHECK_LATE_SEC)!=0)num_failed++;
+
+    unlink(script_file);
+    unlink(other_file);
+    rmdir(check_dir);
+
+    printf("check_wait: %d cases, %d failed\n",num_cases,num_failed);
+
+    if(num_failed>0)return(1);
+
+    return(0);
+}
+
+/************************************************************/
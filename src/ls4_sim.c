@@ -0,0 +1,772 @@
+/* ls4_sim.c
+
+   Stand-in for the telescope controller (questctl) and the LS4 camera
+   controller (ls4_ccp), so that the scheduler can be run end to end,
+   without FAKE_RUN, on any Linux machine.
+
+   It listens on the ports the scheduler uses:
+
+     TEL_PORT, DAYTIME_TEL_PORT   telescope commands, "ok ..." or
+                                  "error ..." replies
+     COMMAND_PORT                 camera commands, "DONE ..." or
+                                  "ERROR ..." replies
+     STATUS_PORT                  camera status dictionary
+
+   and keeps a simple model of the mount (slews at a fixed rate, then
+   settles), the focus, the dome and the camera (exposing, then
+   reading out). Every connection gets its own thread, and connections
+   are kept open between commands unless -c is given.
+
+   usage: ls4_sim [-s slew_deg_per_sec] [-S settle_sec] [-F focus_sec]
+                  [-r readout_sec] [-t transfer_sec] [-C clear_sec]
+                  [-l latency_ms] [-j jitter_ms] [-e error_fraction]
+                  [-E command] [-d] [-c] [-v]
+
+     -s   slew rate, deg/sec on the slower axis (default 1.0)
+     -S   settling time after each slew (default 5 sec)
+     -F   time to move the focus (default 2 sec)
+     -r   camera readout time (default BOTH_AMP_READOUT_TIME_SEC)
+     -t   image transfer time, hidden for exposure runs (default 5 sec)
+     -C   time to clear the camera (default 2 sec)
+     -l   latency added to every reply (default 0 ms)
+     -j   random extra latency, up to this (default 0 ms)
+     -e   fraction of commands answered with an error (default 0)
+     -E   only inject errors for this command (e.g. weather)
+     -d   start with the dome closed
+     -c   close each connection after the reply, as old servers did
+     -v   log each command
+
+   The LST is that of the DEFAULT site at the system time, shifted by
+   FAKE_UT_OFFSET if set, as in the scheduler. On SIGINT or SIGTERM a
+   summary of the commands served and of the open shutter fraction is
+   printed, for measuring the scheduler's overheads.
+
+   Run it on the machine the scheduler runs on, since the scheduler
+   connects to its own host name.
+
+*/
+
+#include "scheduler.h"
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define TEL_PORT 3911 /* TEL_COMMAND_PORT in scheduler_telescope.c */
+#define DAYTIME_TEL_PORT 3912 /* DAYTIME_TEL_COMMAND_PORT */
+
+#define NUM_SIM_PORTS 4
+#define NUM_CONTROLLERS 4 /* one bit per controller in the state values */
+#define STOW_DEC 33.0 /* dec of the stow position (deg) */
+#define MAX_SIM_COMMANDS 64 /* distinct commands counted */
+
+double lst(double jd, double longit);
+
+extern char *state_name[NUM_STATES]; /* from scheduler_status.c */
+
+enum Sim_Port_Type {TELESCOPE_SIM, CAMERA_SIM, STATUS_SIM};
+
+typedef struct {
+    int port;
+    int type;
+    int fd;
+} Sim_Port;
+
+typedef struct {
+    char name[STR_BUF_LEN];
+    int n; /* times received */
+    int n_errors; /* error replies */
+    double total_sec; /* total time to reply */
+    double max_sec; /* longest time to reply */
+} Sim_Command_Stats;
+
+/* options */
+
+static double slew_rate = 1.0;
+static double settle_sec = 5.0;
+static double focus_sec = 2.0;
+static double readout_sec = BOTH_AMP_READOUT_TIME_SEC;
+static double transfer_sec = 5.0;
+static double clear_sec = 2.0;
+static double latency_sec = 0.0;
+static double jitter_sec = 0.0;
+static double error_fraction = 0.0;
+static char error_command[STR_BUF_LEN] = "";
+static bool close_connections = False;
+static int verbose = 0;
+int verbose1 = 0;
+
+static double longit; /* site W longitude (hours) */
+static double lat; /* site latitude (deg) */
+static double ut_offset = 0.0; /* hours, from FAKE_UT_OFFSET */
+
+/* model of the telescope and camera. All guarded by sim_lock */
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double ra_start, dec_start; /* position at start of slew */
+static double ra_target, dec_target; /* position at end of slew */
+static double t_slew_start = 0.0, t_slew_end = 0.0; /* system time (sec) */
+static double focus = 25.0;
+static bool dome_open = True;
+
+static double t_exposing_end = 0.0; /* shutter closes */
+static double t_reading_end = 0.0; /* readout done */
+static bool image_in_memory = False; /* first/next image not fetched */
+
+static Sim_Command_Stats command_stats[MAX_SIM_COMMANDS];
+static int num_commands = 0;
+static int n_exposures = 0;
+static double shutter_open_sec = 0.0;
+static int n_slews = 0;
+static double slew_sec = 0.0;
+static int n_connections = 0;
+static double t_sim_start;
+
+/************************************************************/
+
+/* system time in seconds */
+
+static double get_system_time()
+{
+    struct timeval t;
+
+    gettimeofday(&t,NULL);
+
+    return(t.tv_sec+t.tv_usec*1.0e-6);
+}
+
+/************************************************************/
+
+static void sleep_sec(double sec)
+{
+    if(sec>0.0)usleep((useconds_t)(sec*1.0e6));
+}
+
+/************************************************************/
+
+/* local sidereal time (hours) at system time t */
+
+static double get_sim_lst(double t)
+{
+    double jd;
+
+    /* 2440587.5 is the jd of the system time origin */
+
+    jd=2440587.5+t/86400.0+ut_offset/24.0;
+
+    return(lst(jd,longit));
+}
+
+/************************************************************/
+
+/* telescope position at time t, part way through the last slew */
+
+static void get_position(double t, double *ra, double *dec)
+{
+    double f,d_ra;
+
+    if(t>=t_slew_end||t_slew_end<=t_slew_start){
+       *ra=ra_target;
+       *dec=dec_target;
+       return;
+    }
+
+    f=(t-t_slew_start)/(t_slew_end-t_slew_start);
+    if(f<0.0)f=0.0;
+
+    d_ra=ra_target-ra_start;
+    if(d_ra>12.0)d_ra=d_ra-24.0;
+    if(d_ra<-12.0)d_ra=d_ra+24.0;
+
+    *ra=ra_start+f*d_ra;
+    if(*ra<0.0)*ra=*ra+24.0;
+    if(*ra>=24.0)*ra=*ra-24.0;
+    *dec=dec_start+f*(dec_target-dec_start);
+}
+
+/************************************************************/
+
+/* start a slew to ra (hours), dec (deg) and return its duration (sec) */
+
+static double start_slew(double ra, double dec)
+{
+    double t,d_ra,d_dec,dt;
+
+    t=get_system_time();
+
+    pthread_mutex_lock(&sim_lock);
+
+    get_position(t,&ra_start,&dec_start);
+
+    d_ra=fabs(ra-ra_start);
+    if(d_ra>12.0)d_ra=24.0-d_ra;
+    d_ra=d_ra*15.0;
+    d_dec=fabs(dec-dec_start);
+
+    if(d_ra>d_dec){
+       dt=d_ra/slew_rate+settle_sec;
+    }
+    else{
+       dt=d_dec/slew_rate+settle_sec;
+    }
+
+    ra_target=ra;
+    dec_target=dec;
+    t_slew_start=t;
+    t_slew_end=t+dt;
+    n_slews++;
+    slew_sec=slew_sec+dt;
+
+    pthread_mutex_unlock(&sim_lock);
+
+    return(dt);
+}
+
+/************************************************************/
+
+/* stop the mount where it is */
+
+static void stop_slew()
+{
+    double t;
+
+    t=get_system_time();
+
+    pthread_mutex_lock(&sim_lock);
+    get_position(t,&ra_target,&dec_target);
+    t_slew_end=t;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+/************************************************************/
+
+/* answer a telescope command. Replies start with TEL_DONE_REPLY ("ok")
+   or TEL_ERROR_REPLY ("error"). Commands that move something return
+   once the move is done */
+
+static int telescope_reply(char *command, char *reply)
+{
+    char word[STR_BUF_LEN];
+    double t,ra,dec,value;
+
+    if(sscanf(command,"%s",word)!=1){
+       sprintf(reply,"error empty command");
+       return(-1);
+    }
+
+    t=get_system_time();
+
+    if(strcmp(word,"lst")==0){
+       sprintf(reply,"ok %10.6f",get_sim_lst(t));
+    }
+    else if(strcmp(word,"posrd")==0){
+       pthread_mutex_lock(&sim_lock);
+       get_position(t,&ra,&dec);
+       pthread_mutex_unlock(&sim_lock);
+       sprintf(reply,"ok %10.6f %10.5f",ra,dec);
+    }
+    else if(strcmp(word,"track")==0||strcmp(word,"pointrd")==0){
+       if(sscanf(command,"%s %lf %lf",word,&ra,&dec)!=3||
+            ra<0.0||ra>24.0||dec<-90.0||dec>90.0){
+          sprintf(reply,"error bad coordinates");
+          return(-1);
+       }
+       sleep_sec(start_slew(ra,dec));
+       sprintf(reply,"ok");
+    }
+    else if(strcmp(word,"stow")==0){
+       sleep_sec(start_slew(get_sim_lst(t),STOW_DEC));
+       sprintf(reply,"ok");
+    }
+    else if(strcmp(word,"stop")==0||strcmp(word,"stopmount")==0){
+       stop_slew();
+       sprintf(reply,"ok");
+    }
+    else if(strcmp(word,"domestatus")==0){
+       pthread_mutex_lock(&sim_lock);
+       sprintf(reply,"ok %s",dome_open ? "open" : "closed");
+       pthread_mutex_unlock(&sim_lock);
+    }
+    else if(strcmp(word,"opendome")==0||strcmp(word,"closedome")==0){
+       pthread_mutex_lock(&sim_lock);
+       dome_open=(strcmp(word,"opendome")==0);
+       pthread_mutex_unlock(&sim_lock);
+       sprintf(reply,"ok");
+    }
+    else if(strcmp(word,"getfocus")==0){
+       pthread_mutex_lock(&sim_lock);
+       sprintf(reply,"ok %9.5f",focus);
+       pthread_mutex_unlock(&sim_lock);
+    }
+    else if(strcmp(word,"setfocus")==0){
+       if(sscanf(command,"%s %lf",word,&value)!=2){
+          sprintf(reply,"error bad focus");
+          return(-1);
+       }
+       sleep_sec(focus_sec);
+       pthread_mutex_lock(&sim_lock);
+       focus=value;
+       pthread_mutex_unlock(&sim_lock);
+       sprintf(reply,"ok");
+    }
+    else if(strcmp(word,"weather")==0){
+       sprintf(reply,"ok temp:%5.1f humidity:%5.1f wind_speed:%5.1f wind_dir:%5.1f dew_point:%5.1f",
+          10.0,30.0,5.0,180.0,-5.0);
+    }
+    else if(strcmp(word,"filter")==0){
+       sprintf(reply,"ok filter clear");
+    }
+    else if(strcmp(word,"settracking")==0||strcmp(word,"slavedome")==0||
+            strcmp(word,"status")==0){
+       sprintf(reply,"ok");
+    }
+    else{
+       snprintf(reply,MAXBUFSIZE,"error unknown command %.100s",word);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* camera status dictionary, in the format parse_status reads */
+
+static void status_reply(char *reply)
+{
+    int i,state_val[NUM_STATES];
+    double t;
+    char date[STR_BUF_LEN],bits[NUM_CONTROLLERS+1];
+    time_t t_sec;
+    struct tm tm;
+
+    t=get_system_time();
+    t_sec=(time_t)t;
+    gmtime_r(&t_sec,&tm);
+    strftime(date,sizeof(date),"%Y-%m-%dT%H:%M:%S.00",&tm);
+
+    for(i=0;i<NUM_STATES;i++)state_val[i]=0;
+
+    pthread_mutex_lock(&sim_lock);
+    if(t<t_exposing_end){
+       state_val[EXPOSING]=1;
+    }
+    else if(t<t_reading_end){
+       state_val[READING]=1;
+    }
+    else{
+       state_val[IDLE]=1;
+    }
+    if(image_in_memory)state_val[FETCH_PENDING]=1;
+    pthread_mutex_unlock(&sim_lock);
+    state_val[POWERON]=1;
+
+    sprintf(reply,"[DONE {'ready': True, 'state': '%s', 'error': False, 'comment': 'simulated', 'date': '%s'",
+       state_val[IDLE] ? "idle" : "busy",date);
+    for(i=0;i<NUM_STATES;i++){
+       memset(bits,state_val[i] ? '1' : '0',NUM_CONTROLLERS);
+       bits[NUM_CONTROLLERS]=0;
+       sprintf(reply+strlen(reply),", '%s': '%s'",state_name[i],bits);
+    }
+    strcat(reply,", 'cmd_error':False, 'cmd_error_msg':'False', 'cmd_command':'', 'cmd_arg_value_list':'', 'cmd_reply':''}]");
+}
+
+/************************************************************/
+
+/* answer a camera command. Replies start with DONE_REPLY or
+   ERROR_REPLY. An exposure returns once it has been read out, and for
+   EXP_MODE_SINGLE and EXP_MODE_LAST, transferred */
+
+static int camera_reply(char *command, char *reply)
+{
+    char word[STR_BUF_LEN],shutter[STR_BUF_LEN],file[STR_BUF_LEN];
+    char exp_mode[STR_BUF_LEN];
+    double t,expt,dt;
+    int n;
+
+    if(sscanf(command,"%s",word)!=1){
+       sprintf(reply,"%s empty command",ERROR_REPLY);
+       return(-1);
+    }
+
+    t=get_system_time();
+
+    if(strcmp(word,EXPOSE_COMMAND)==0){
+       strcpy(exp_mode,EXP_MODE_SINGLE);
+       n=sscanf(command,"%s %s %lf %s %s",word,shutter,&expt,file,exp_mode);
+       if(n<4||expt<0.0){
+          sprintf(reply,"%s bad expose arguments",ERROR_REPLY);
+          return(-1);
+       }
+
+       pthread_mutex_lock(&sim_lock);
+       if(t<t_reading_end){
+          pthread_mutex_unlock(&sim_lock);
+          sprintf(reply,"%s camera busy",ERROR_REPLY);
+          return(-1);
+       }
+
+       /* the end of an exposure run only fetches the image in memory */
+
+       if(strcmp(exp_mode,EXP_MODE_LAST)==0&&strcmp(shutter,"False")==0&&
+            expt==0.0&&image_in_memory){
+          dt=transfer_sec;
+       }
+       else{
+          dt=expt+readout_sec;
+          if(strcmp(exp_mode,EXP_MODE_SINGLE)==0||
+               strcmp(exp_mode,EXP_MODE_LAST)==0){
+             dt=dt+transfer_sec;
+          }
+          if(strcmp(shutter,"True")==0){
+             n_exposures++;
+             shutter_open_sec=shutter_open_sec+expt;
+          }
+       }
+       t_exposing_end=t+expt;
+       t_reading_end=t+dt;
+       image_in_memory=(strcmp(exp_mode,EXP_MODE_FIRST)==0||
+            strcmp(exp_mode,EXP_MODE_NEXT)==0);
+       pthread_mutex_unlock(&sim_lock);
+
+       sleep_sec(dt);
+       sprintf(reply,"%s %7.3f",DONE_REPLY,expt);
+    }
+    else if(strcmp(word,CLEAR_COMMAND)==0){
+       sleep_sec(clear_sec);
+       sprintf(reply,"%s",DONE_REPLY);
+    }
+    else if(strcmp(word,STATUS_COMMAND)==0){
+       status_reply(reply);
+    }
+    else if(strcmp(word,HEADER_COMMAND)==0||strcmp(word,HEADER_LIST_COMMAND)==0||
+            strcmp(word,OPEN_COMMAND)==0||strcmp(word,CLOSE_COMMAND)==0||
+            strstr(word,"auto")==word||strstr(word,"power")==word||
+            strstr(word,"vsub")==word){
+       sprintf(reply,"%s",DONE_REPLY);
+    }
+    else{
+       snprintf(reply,MAXBUFSIZE,"%s unknown command %.100s",ERROR_REPLY,word);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* count command, taking dt sec, in command_stats */
+
+static void count_command(char *command, double dt, int result)
+{
+    char word[STR_BUF_LEN];
+    int i;
+
+    if(sscanf(command,"%s",word)!=1)return;
+
+    pthread_mutex_lock(&sim_lock);
+
+    for(i=0;i<num_commands&&strcmp(command_stats[i].name,word)!=0;i++);
+    if(i==num_commands){
+       if(num_commands==MAX_SIM_COMMANDS){
+          pthread_mutex_unlock(&sim_lock);
+          return;
+       }
+       strcpy(command_stats[i].name,word);
+       num_commands++;
+    }
+
+    command_stats[i].n++;
+    if(result!=0)command_stats[i].n_errors++;
+    command_stats[i].total_sec=command_stats[i].total_sec+dt;
+    if(dt>command_stats[i].max_sec)command_stats[i].max_sec=dt;
+
+    pthread_mutex_unlock(&sim_lock);
+}
+
+/************************************************************/
+
+/* True if an error should be injected for command */
+
+static bool inject_error(char *command)
+{
+    char word[STR_BUF_LEN];
+
+    if(error_fraction<=0.0)return(False);
+
+    if(error_command[0]!=0){
+       if(sscanf(command,"%s",word)!=1||strcmp(word,error_command)!=0){
+          return(False);
+       }
+    }
+
+    return(drand48()<error_fraction);
+}
+
+/************************************************************/
+
+/* serve the commands on one connection until the client closes it */
+
+static void *connection_thread(void *arg)
+{
+    Sim_Port *p;
+    char command[MAXBUFSIZE],reply[MAXBUFSIZE];
+    double t_start,t_end;
+    int n,result;
+
+    p=(Sim_Port *)arg;
+
+    while(1){
+
+       n=read(p->fd,command,MAXBUFSIZE-1);
+       if(n<=0)break;
+       command[n]=0;
+       while(n>0&&isspace(command[n-1]))command[--n]=0;
+
+       t_start=get_system_time();
+
+       sleep_sec(latency_sec+jitter_sec*drand48());
+
+       if(inject_error(command)){
+          if(p->type==TELESCOPE_SIM){
+             sprintf(reply,"error simulated fault");
+          }
+          else{
+             sprintf(reply,"%s simulated fault",ERROR_REPLY);
+          }
+          result=-1;
+       }
+       else if(p->type==TELESCOPE_SIM){
+          result=telescope_reply(command,reply);
+       }
+       else if(p->type==STATUS_SIM){
+          status_reply(reply);
+          result=0;
+       }
+       else{
+          result=camera_reply(command,reply);
+       }
+
+       t_end=get_system_time();
+       count_command(command,t_end-t_start,result);
+
+       if(verbose){
+          fprintf(stderr,"ls4_sim[%d]: %7.3f sec : [%s] -> [%.60s]\n",
+             p->port,t_end-t_start,command,reply);
+          fflush(stderr);
+       }
+
+       n=strlen(reply);
+       if(n>MAXBUFSIZE-2)n=MAXBUFSIZE-2;
+       reply[n]='\n';
+       reply[n+1]=0;
+       if(write(p->fd,reply,n+1)!=n+1)break;
+
+       if(close_connections)break;
+    }
+
+    close(p->fd);
+    free(p);
+
+    return(NULL);
+}
+
+/************************************************************/
+
+/* accept connections on port p, each served by its own thread */
+
+static void *accept_thread(void *arg)
+{
+    Sim_Port *p,*c;
+    pthread_t thread_id;
+    int fd;
+
+    p=(Sim_Port *)arg;
+
+    while(1){
+
+       fd=accept(p->fd,NULL,NULL);
+       if(fd<0){
+          if(errno==EINTR)continue;
+          perror("ls4_sim: accept");
+          sleep(1);
+          continue;
+       }
+
+       c=(Sim_Port *)malloc(sizeof(Sim_Port));
+       if(c==NULL){
+          close(fd);
+          continue;
+       }
+       *c=*p;
+       c->fd=fd;
+
+       pthread_mutex_lock(&sim_lock);
+       n_connections++;
+       pthread_mutex_unlock(&sim_lock);
+
+       if(pthread_create(&thread_id,NULL,connection_thread,c)!=0){
+          fprintf(stderr,"ls4_sim: can't start connection thread\n");
+          close(fd);
+          free(c);
+          continue;
+       }
+       pthread_detach(thread_id);
+    }
+
+    return(NULL);
+}
+
+/************************************************************/
+
+static int open_port(Sim_Port *p)
+{
+    struct sockaddr_in addr;
+    int on=1;
+
+    p->fd=socket(AF_INET,SOCK_STREAM,0);
+    if(p->fd<0){
+       perror("ls4_sim: socket");
+       return(-1);
+    }
+
+    setsockopt(p->fd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+
+    memset((void *)&addr,0,sizeof(addr));
+    addr.sin_family=AF_INET;
+    addr.sin_addr.s_addr=htonl(INADDR_ANY);
+    addr.sin_port=htons(p->port);
+
+    if(bind(p->fd,(struct sockaddr *)&addr,sizeof(addr))!=0||
+         listen(p->fd,16)!=0){
+       fprintf(stderr,"ls4_sim: can't listen on port %d: %s\n",
+          p->port,strerror(errno));
+       close(p->fd);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+static void print_summary(FILE *output)
+{
+    int i;
+    double t;
+
+    t=get_system_time()-t_sim_start;
+
+    pthread_mutex_lock(&sim_lock);
+
+    fprintf(output,"ls4_sim: %9.1f sec  %d connections\n",t,n_connections);
+    fprintf(output,"ls4_sim: %d exposures  %9.1f sec shutter open  (%5.1f%%)\n",
+       n_exposures,shutter_open_sec,t>0.0 ? 100.0*shutter_open_sec/t : 0.0);
+    fprintf(output,"ls4_sim: %d slews  %9.1f sec slewing\n",n_slews,slew_sec);
+    fprintf(output,"ls4_sim: %-16s %8s %8s %10s %10s\n",
+       "command","n","errors","mean sec","max sec");
+    for(i=0;i<num_commands;i++){
+       fprintf(output,"ls4_sim: %-16s %8d %8d %10.4f %10.4f\n",
+          command_stats[i].name,command_stats[i].n,command_stats[i].n_errors,
+          command_stats[i].total_sec/command_stats[i].n,
+          command_stats[i].max_sec);
+    }
+
+    pthread_mutex_unlock(&sim_lock);
+
+    fflush(output);
+}
+
+/************************************************************/
+
+static void usage()
+{
+    fprintf(stderr,"usage: ls4_sim [-s slew_deg_per_sec] [-S settle_sec] [-F focus_sec]\n");
+    fprintf(stderr,"               [-r readout_sec] [-t transfer_sec] [-C clear_sec]\n");
+    fprintf(stderr,"               [-l latency_ms] [-j jitter_ms] [-e error_fraction]\n");
+    fprintf(stderr,"               [-E command] [-d] [-c] [-v]\n");
+}
+
+/************************************************************/
+
+int main(int argc, char *argv[])
+{
+    Sim_Port ports[NUM_SIM_PORTS]={{TEL_PORT,TELESCOPE_SIM,-1},
+       {DAYTIME_TEL_PORT,TELESCOPE_SIM,-1},{COMMAND_PORT,CAMERA_SIM,-1},
+       {STATUS_PORT,STATUS_SIM,-1}};
+    pthread_t thread_id;
+    sigset_t signals;
+    double stdz,elevsea,elev,horiz;
+    short use_dst;
+    char zone_name[STR_BUF_LEN],zabr,site_name[STR_BUF_LEN];
+    int i,c,sig;
+
+    while((c=getopt(argc,argv,"s:S:F:r:t:C:l:j:e:E:dcv"))!=-1){
+       switch(c){
+          case 's': slew_rate=atof(optarg); break;
+          case 'S': settle_sec=atof(optarg); break;
+          case 'F': focus_sec=atof(optarg); break;
+          case 'r': readout_sec=atof(optarg); break;
+          case 't': transfer_sec=atof(optarg); break;
+          case 'C': clear_sec=atof(optarg); break;
+          case 'l': latency_sec=atof(optarg)/1000.0; break;
+          case 'j': jitter_sec=atof(optarg)/1000.0; break;
+          case 'e': error_fraction=atof(optarg); break;
+          case 'E': strncpy(error_command,optarg,STR_BUF_LEN-1); break;
+          case 'd': dome_open=False; break;
+          case 'c': close_connections=True; break;
+          case 'v': verbose=1; break;
+          default: usage(); exit(-1);
+       }
+    }
+
+    if(slew_rate<=0.0){
+       fprintf(stderr,"ls4_sim: slew rate must be > 0\n");
+       exit(-1);
+    }
+
+    if(getenv("FAKE_UT_OFFSET")!=NULL){
+       sscanf(getenv("FAKE_UT_OFFSET"),"%lf",&ut_offset);
+    }
+
+    strcpy(site_name,"DEFAULT");
+    load_site(&longit,&lat,&stdz,&use_dst,zone_name,&zabr,&elevsea,&elev,
+       &horiz,site_name);
+    init_status_names();
+    srand48(getpid());
+
+    t_sim_start=get_system_time();
+    ra_target=get_sim_lst(t_sim_start);
+    dec_target=STOW_DEC;
+
+    /* signals are taken by sigwait below, not by the other threads */
+
+    sigemptyset(&signals);
+    sigaddset(&signals,SIGINT);
+    sigaddset(&signals,SIGTERM);
+    pthread_sigmask(SIG_BLOCK,&signals,NULL);
+    signal(SIGPIPE,SIG_IGN);
+
+    for(i=0;i<NUM_SIM_PORTS;i++){
+       if(open_port(ports+i)!=0)exit(-1);
+       if(pthread_create(&thread_id,NULL,accept_thread,ports+i)!=0){
+          fprintf(stderr,"ls4_sim: can't start thread for port %d\n",
+             ports[i].port);
+          exit(-1);
+       }
+       pthread_detach(thread_id);
+    }
+
+    fprintf(stderr,"ls4_sim: site %s  telescope ports %d %d  camera ports %d %d\n",
+       site_name,TEL_PORT,DAYTIME_TEL_PORT,COMMAND_PORT,STATUS_PORT);
+    fprintf(stderr,"ls4_sim: slew %5.2f deg/sec  settle %5.1f sec  readout %5.1f sec  transfer %5.1f sec\n",
+       slew_rate,settle_sec,readout_sec,transfer_sec);
+    fflush(stderr);
+
+    sigwait(&signals,&sig);
+
+    print_summary(stderr);
+
+    exit(0);
+}
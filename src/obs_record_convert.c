@@ -0,0 +1,442 @@
+/* obs_record_convert.c
+
+   Convert a scheduler restart record (OBS_RECORD_FILE) written in one
+   of the old raw formats to the column format read by the current
+   scheduler (see scheduler_record.c).
+
+   usage: obs_record_convert old_record new_record
+
+   The old formats are a first line of text
+
+       num_fields year month day hour minute second [generation]
+
+   followed by raw binary structs:
+
+     7 numbers: the Field array, with the script line and observation
+                history inside each Field (Legacy_Field below)
+     8 numbers: the Field array followed by the Field_History array,
+                as written with the observation journal
+
+   Raw records can only be read with the same compiler and the same
+   MAX_OBS_PER_FIELD, STR_BUF_LEN and FILENAME_LENGTH as the scheduler
+   that wrote them, so build this program from the same scheduler.h.
+
+   old_record may also be a record already in the column format, if
+   only its journal is in the old format. The old journal holds a raw
+   Field in each record, and is read under the same conditions as a
+   raw record. Its records of the generation of old_record are applied
+   in order, up to the first one that is incomplete or fails its
+   checksum, and the new record gets the next generation.
+
+   The current scheduler refuses a journal in the old format, so remove
+   the old journal once it has been folded in. Without old_journal,
+   the generation of the record is kept. The new record is read back
+   and compared with the converted one before the program exits.
+
+*/
+
+#include "scheduler.h"
+
+/* needed by scheduler_record.c */
+
+int verbose=0;
+double focus_start=0.0;
+double focus_increment=0.0;
+double focus_default=0.0;
+
+/* layout of Field before the script line and history were moved to
+   Field_History, and before sin_dec and cos_dec were cached */
+
+typedef struct {
+    int status;
+    int doable;
+    enum Selection_Code selection_code;
+    int field_number;
+    int line_number;
+    char script_line[STR_BUF_LEN];
+    double ra;
+    double dec;
+    double gal_long;
+    double gal_lat;
+    double ecl_long;
+    double ecl_lat;
+    double epoch;
+    int shutter;
+    double expt;
+    double interval;
+    int n_required;
+    int survey_code;
+    double ut_rise;
+    double ut_set;
+    double jd_rise;
+    double jd_set;
+    double jd_next;
+    int n_done;
+    double time_up;
+    double time_required;
+    double time_left;
+    double ut[MAX_OBS_PER_FIELD];
+    double jd[MAX_OBS_PER_FIELD];
+    double lst[MAX_OBS_PER_FIELD];
+    double ha[MAX_OBS_PER_FIELD];
+    double am[MAX_OBS_PER_FIELD];
+    double actual_expt[MAX_OBS_PER_FIELD];
+    char filename[FILENAME_LENGTH*MAX_OBS_PER_FIELD];
+} Legacy_Field;
+
+/* layout of a journal record before the journal was written in the
+   columns of the record */
+
+typedef struct {
+    int magic;             /* OBS_JOURNAL_MAGIC */
+    int generation;        /* generation of the snapshot this record follows */
+    int index;             /* index of field in sequence */
+    int slot;              /* observation slot recorded, -1 for none */
+    Field field;           /* state of field after the change (hist unused) */
+    double ut;             /* values of observation slot */
+    double jd;
+    double lst;
+    double ha;
+    double am;
+    double actual_expt;
+    char filename[FILENAME_LENGTH];
+    unsigned int checksum; /* of the bytes above */
+} Legacy_Journal_Record;
+
+int read_legacy_fields(FILE *input, Field_Table *table, int num_fields);
+int read_journaled_fields(FILE *input, Field_Table *table, int num_fields);
+int read_legacy_journal(char *file_name, Field_Table *table, int generation);
+int compare_tables(Field_Table *t1, Field_Table *t2);
+
+/************************************************************/
+
+int main(int argc, char **argv)
+{
+    int n,num_fields,generation,column_record;
+    char string[STR_BUF_LEN];
+    struct tm tm;
+    FILE *input;
+    Field_Table table,check;
+    Obs_Record_Header header;
+
+    if(argc!=3&&argc!=4){
+       fprintf(stderr,"usage: obs_record_convert old_record new_record [old_journal]\n");
+       exit(-1);
+    }
+
+    if(strcmp(argv[1],argv[2])==0||(argc==4&&strcmp(argv[3],argv[2])==0)){
+       fprintf(stderr,"obs_record_convert: old and new records must differ\n");
+       exit(-1);
+    }
+
+    input=fopen(argv[1],"r");
+    if(input==NULL){
+       fprintf(stderr,"obs_record_convert: can't open %s\n",argv[1]);
+       exit(-1);
+    }
+
+    if(fgets(string,STR_BUF_LEN,input)==NULL){
+       fprintf(stderr,"obs_record_convert: can't read first line of %s\n",
+          argv[1]);
+       exit(-1);
+    }
+
+    memset((void *)&tm,0,sizeof(tm));
+    generation=0;
+    init_field_table(&table);
+
+    /* a record in the column format starts with OBS_RECORD_MAGIC, and
+       needs converting only if its journal is given */
+
+    column_record=(strncmp(string,OBS_RECORD_MAGIC,strlen(OBS_RECORD_MAGIC))==0);
+    if(column_record){
+       fclose(input);
+       if(argc!=4){
+          fprintf(stderr,
+            "obs_record_convert: %s is already in the column format\n",argv[1]);
+          exit(-1);
+       }
+       num_fields=read_obs_record(argv[1],&table,&header);
+       if(num_fields<=0){
+          fprintf(stderr,"obs_record_convert: can't read %s\n",argv[1]);
+          exit(-1);
+       }
+       if(header.journal_record_size!=(int)sizeof(Legacy_Journal_Record)){
+          fprintf(stderr,
+            "obs_record_convert: journal of %s has %d-byte records, not %d. Was it written with different constants?\n",
+            argv[1],header.journal_record_size,(int)sizeof(Legacy_Journal_Record));
+          exit(-1);
+       }
+       generation=header.generation;
+       tm.tm_year=header.year;
+       tm.tm_mon=header.month;
+       tm.tm_mday=header.day;
+       tm.tm_hour=header.hour;
+       tm.tm_min=header.minute;
+       tm.tm_sec=header.second;
+    }
+    else{
+       n=sscanf(string,"%d %d %d %d %d %d %d %d",
+            &num_fields,&tm.tm_year,&tm.tm_mon,&tm.tm_mday,
+            &tm.tm_hour,&tm.tm_min,&tm.tm_sec,&generation);
+       if((n!=7&&n!=8)||num_fields<0){
+          fprintf(stderr,"obs_record_convert: %s is not an old record: %s\n",
+             argv[1],string);
+          exit(-1);
+       }
+
+       if(grow_field_table(&table,num_fields)!=0){
+          exit(-1);
+       }
+
+       if(n==7){
+          n=read_legacy_fields(input,&table,num_fields);
+       }
+       else{
+          n=read_journaled_fields(input,&table,num_fields);
+       }
+
+       if(n!=num_fields){
+          fprintf(stderr,"obs_record_convert: only %d of %d fields read from %s\n",
+             n,num_fields,argv[1]);
+          exit(-1);
+       }
+
+       if(fgetc(input)!=EOF){
+          fprintf(stderr,
+            "obs_record_convert: %s is longer than %d fields. Was it written with different constants?\n",
+            argv[1],num_fields);
+          exit(-1);
+       }
+       fclose(input);
+
+       table.num_fields=num_fields;
+    }
+
+    if(argc==4){
+       n=read_legacy_journal(argv[3],&table,generation);
+       if(n<0){
+          exit(-1);
+       }
+       fprintf(stderr,"obs_record_convert: %d journal records folded in from %s\n",
+          n,argv[3]);
+       generation++;
+    }
+
+    if(write_obs_record(argv[2],&table,&tm,generation)!=0){
+       fprintf(stderr,"obs_record_convert: can't write %s\n",argv[2]);
+       exit(-1);
+    }
+
+    init_field_table(&check);
+    if(read_obs_record(argv[2],&check,&header)!=num_fields||
+       compare_tables(&table,&check)!=0){
+       fprintf(stderr,"obs_record_convert: %s does not match %s\n",
+          argv[2],argv[1]);
+       exit(-1);
+    }
+
+    fprintf(stderr,"obs_record_convert: %d fields converted, generation %d\n",
+       num_fields,generation);
+    if(argc==4){
+       fprintf(stderr,"obs_record_convert: remove %s before restarting the scheduler\n",
+          argv[3]);
+    }
+
+    free_field_table(&table);
+    free_field_table(&check);
+
+    exit(0);
+}
+
+/************************************************************/
+
+int read_legacy_fields(FILE *input, Field_Table *table, int num_fields)
+{
+    int i;
+    Field *f;
+    Field_History *hist;
+    Legacy_Field old;
+
+    for(i=0;i<num_fields;i++){
+       if(fread((void *)&old,sizeof(Legacy_Field),1,input)!=1)return(i);
+
+       f=table->fields+i;
+       hist=f->hist;
+
+       f->status=old.status;
+       f->doable=old.doable;
+       f->selection_code=old.selection_code;
+       f->field_number=old.field_number;
+       f->line_number=old.line_number;
+       f->ra=old.ra;
+       f->dec=old.dec;
+       init_field_trig(f);
+       f->gal_long=old.gal_long;
+       f->gal_lat=old.gal_lat;
+       f->ecl_long=old.ecl_long;
+       f->ecl_lat=old.ecl_lat;
+       f->epoch=old.epoch;
+       f->shutter=old.shutter;
+       f->expt=old.expt;
+       f->interval=old.interval;
+       f->n_required=old.n_required;
+       f->survey_code=old.survey_code;
+       f->ut_rise=old.ut_rise;
+       f->ut_set=old.ut_set;
+       f->jd_rise=old.jd_rise;
+       f->jd_set=old.jd_set;
+       f->jd_next=old.jd_next;
+       f->n_done=old.n_done;
+       f->time_up=old.time_up;
+       f->time_required=old.time_required;
+       f->time_left=old.time_left;
+
+       memcpy(hist->script_line,old.script_line,sizeof(hist->script_line));
+       memcpy(hist->ut,old.ut,sizeof(hist->ut));
+       memcpy(hist->jd,old.jd,sizeof(hist->jd));
+       memcpy(hist->lst,old.lst,sizeof(hist->lst));
+       memcpy(hist->ha,old.ha,sizeof(hist->ha));
+       memcpy(hist->am,old.am,sizeof(hist->am));
+       memcpy(hist->actual_expt,old.actual_expt,sizeof(hist->actual_expt));
+       memcpy(hist->filename,old.filename,sizeof(hist->filename));
+    }
+
+    return(num_fields);
+}
+
+/************************************************************/
+
+int read_journaled_fields(FILE *input, Field_Table *table, int num_fields)
+{
+    int i,n;
+
+    n=fread((void *)table->fields,sizeof(Field),num_fields,input);
+    for(i=0;i<num_fields;i++){
+       table->fields[i].hist=table->history+i;
+    }
+    if(n!=num_fields)return(n);
+
+    return(fread((void *)table->history,sizeof(Field_History),num_fields,input));
+}
+
+/************************************************************/
+
+/* apply the records of generation in the raw journal file_name to
+   table, up to the first incomplete record or bad checksum. Returns
+   the number of records applied, or -1 if the journal can't be read */
+
+int read_legacy_journal(char *file_name, Field_Table *table, int generation)
+{
+    int n_applied,n_skipped,slot;
+    size_t i,n;
+    unsigned int a,b;
+    unsigned char *p;
+    FILE *input;
+    Field *f;
+    Field_History *hist;
+    Legacy_Journal_Record r;
+
+    input=fopen(file_name,"r");
+    if(input==NULL){
+       fprintf(stderr,"read_legacy_journal: can't open %s\n",file_name);
+       return(-1);
+    }
+
+    n_applied=0;
+    n_skipped=0;
+    while(fread((void *)&r,sizeof(r),1,input)==1){
+
+       /* Fletcher-style sum over the record up to the checksum */
+
+       p=(unsigned char *)&r;
+       n=(unsigned char *)&(r.checksum)-p;
+       a=1;
+       b=0;
+       for(i=0;i<n;i++){
+          a=(a+p[i])%65521;
+          b=(b+a)%65521;
+       }
+       if(r.magic!=OBS_JOURNAL_MAGIC||r.checksum!=((b<<16)|a)){
+          break;
+       }
+
+       if(r.generation!=generation||r.index<0||r.index>=table->num_fields){
+          n_skipped++;
+          continue;
+       }
+
+       f=table->fields+r.index;
+       hist=f->hist;
+       *f=r.field;
+       f->hist=hist;
+
+       slot=r.slot;
+       if(slot>=0&&slot<MAX_OBS_PER_FIELD){
+          hist->ut[slot]=r.ut;
+          hist->jd[slot]=r.jd;
+          hist->lst[slot]=r.lst;
+          hist->ha[slot]=r.ha;
+          hist->am[slot]=r.am;
+          hist->actual_expt[slot]=r.actual_expt;
+          memcpy(hist->filename+slot*FILENAME_LENGTH,r.filename,FILENAME_LENGTH);
+       }
+       n_applied++;
+    }
+
+    if(!feof(input)||ftell(input)%(long)sizeof(r)!=0){
+       fprintf(stderr,"read_legacy_journal: %s ends in an incomplete or bad record\n",
+          file_name);
+    }
+    fclose(input);
+
+    if(n_skipped>0){
+       fprintf(stderr,"read_legacy_journal: %d records of other generations skipped\n",
+          n_skipped);
+    }
+
+    return(n_applied);
+}
+
+/************************************************************/
+
+/* return 0 if the saved members of the fields in t1 and t2 are the
+   same. Both tables are written out, and the files compared, so that
+   padding and the hist pointers are ignored */
+
+int compare_tables(Field_Table *t1, Field_Table *t2)
+{
+    int c1,c2,result;
+    char file1[STR_BUF_LEN],file2[STR_BUF_LEN];
+    struct tm tm;
+    FILE *input1,*input2;
+
+    memset((void *)&tm,0,sizeof(tm));
+    sprintf(file1,"/tmp/obs_record_convert.%d.1",(int)getpid());
+    sprintf(file2,"/tmp/obs_record_convert.%d.2",(int)getpid());
+
+    if(write_obs_record(file1,t1,&tm,0)!=0||
+       write_obs_record(file2,t2,&tm,0)!=0){
+       return(-1);
+    }
+
+    input1=fopen(file1,"r");
+    input2=fopen(file2,"r");
+    result=-1;
+    if(input1!=NULL&&input2!=NULL){
+       do{
+          c1=fgetc(input1);
+          c2=fgetc(input2);
+       }while(c1==c2&&c1!=EOF);
+       if(c1==c2)result=0;
+    }
+
+    if(input1!=NULL)fclose(input1);
+    if(input2!=NULL)fclose(input2);
+    unlink(file1);
+    unlink(file2);
+
+    return(result);
+}
+
+/************************************************************/
@@ -77,18 +77,13 @@
 // out (and possibly transfered). The scheduler will wait for the
 // exposure to be completely read out before starting a new exposure.
 
+//#define WAIT_FLAG True 
 
-// Try WAIT_FLAG True instead of False because of coding error
-#define WAIT_FLAG True 
-
-//#define WAIT_FLAG False
+#define WAIT_FLAG False
 
 
 //#define DEBUG 1
 
-#define LOOP_WAIT_SEC 10 /* seconds to wait between loops if no
-               field selected */
-
 #define WAIT_FOR_DOME_OPEN 0 /* don't need to have dome open to observer */
 
 int verbose=0;
@@ -101,7 +96,8 @@ int stow_flag=1; /* 1 for stowed, 0 for not stowed */
 double focus_start=NOMINAL_FOCUS_START;
 double focus_increment=NOMINAL_FOCUS_INCREMENT;
 double focus_default=NOMINAL_FOCUS_DEFAULT;
-FILE *hist_out,*sequence_out,*log_obs_out,*obs_record;
+FILE *hist_out,*sequence_out,*log_obs_out;
+Obs_Journal obs_journal; /* restart record of sequence */
 double ut_prev=0;
 char filter_name[STR_BUF_LEN];
 char *filter_name_ptr=0;
@@ -110,6 +106,10 @@ char *filter_name_ptr=0;
 char *host_name=NULL;
 double ut_offset=0.0;
 double exp_overhead_hours = 0.0;
+Selection_Policy *policy; /* chooses the next field */
+Airmass_Table airmass_table; /* ra, dec terms, ha and airmass of each field in sequence */
+Visibility_Table visibility_table; /* slots of the night when each field is up */
+Field_Events field_events; /* pending status changes of each field in sequence */
 
 // NOTE: each element of selection string must correspond to an element of Selection_Code 
 // defined in scheduler.h
@@ -118,7 +118,9 @@ char *selection_string[] = {"not selected", "first do_now flat", "first do_now d
        "first_do_now sky field", "first ready paired field", "first late paired field",
        "first not-ready late paired field", "first not-ready and not-late paired field",
        "late must-do field with least time left", "ready must-do field with least time left",
-       "ready field with least time left", "late ready field with most time left"};
+       "ready field with least time left", "late ready field with most time left",
+       "nearest ready field with least time left", "ready field chosen by lookahead",
+       "ready field next in plan"};
 
 /************************************************************/
       
@@ -134,9 +136,14 @@ int main(int argc, char **argv)
     Night_Times nt_10day; /* nt for 10 days later */
     Night_Times nt_15day; /* nt for 15 days later */
     char script_name[STR_BUF_LEN], new_script_name[STR_BUF_LEN];
-    Field sequence[MAX_FIELDS],new_sequence[MAX_FIELDS];
+    Field_Table field_table,new_field_table; /* fields being scheduled, fields
+                                                 read from new_script_name */
+    Script_Tail new_script_tail; /* lines of new_script_name already read */
+    Wait_Events wait_events; /* wakeups while idle */
+    double wait_sec;
+    Field *sequence,*new_sequence;
     int i,num_fields,num_observable_fields,num_completed_fields;
-    int num_new_fields, num_new_observable_fields, num_new_fields_prev;
+    int num_new_fields, num_new_observable_fields;
     int i_prev,result;
     Site_Params site;
     Telescope_Status tel_status;
@@ -145,7 +152,6 @@ int main(int argc, char **argv)
     int telescope_ready,bad_weather,delay_sec;
     Fits_Header fits_header;
     char exp_mode[256];
-    bool first_exposure = True;
     char code_string[1024];
     int selection_code;
     char site_name[1024];
@@ -179,9 +185,21 @@ int main(int argc, char **argv)
     }
     exp_overhead_hours = init_cam_readout_time(amp_dir_str);
 
+    if (getenv("SELECTION_POLICY") != NULL){
+        policy = get_selection_policy(getenv("SELECTION_POLICY"));
+    }
+    else{
+        policy = get_selection_policy(DEFAULT_SELECTION_POLICY);
+    }
+    if (policy == NULL){
+        fprintf(stderr,"unknown selection policy. Choose one of:\n");
+        print_selection_policies(stderr);
+        exit(-1);
+    }
+
     init_status_names();
 
-    init_semaphores();
+    start_camera_worker();
 
 #if FAKE_RUN    
     if(argc!=7&&argc!=6){
@@ -213,6 +231,21 @@ int main(int argc, char **argv)
     sscanf(argv[4],"%hd",&(date.d));
     sscanf(argv[5],"%d",&verbose);
     if (verbose > 1)verbose1=1;
+
+    /* with REPLAY_POLICIES set, replay the night through each of the
+       named policies instead of observing */
+
+    if (getenv("REPLAY_POLICIES") != NULL){
+        exit(replay_night(script_name,date,getenv("REPLAY_POLICIES")));
+    }
+
+    /* with SOLVE_PLAN set, solve the plan of the night and write it to
+       the named file instead of observing */
+
+    if (getenv("SOLVE_PLAN") != NULL){
+        exit(plan_night(script_name,date,getenv("SOLVE_PLAN")));
+    }
+
     sprintf(new_script_name,"%s.add",script_name);
     fprintf(stderr,"new script name is %s\n",new_script_name);
     fflush(stderr);
@@ -224,9 +257,29 @@ int main(int argc, char **argv)
     }
     fprintf(stderr,"host_name is %s\n",host_name);
 
-    num_new_fields_prev=0;
+#if FAKE_RUN
+#else
+    /* keep the telescope status refreshed in the background */
+
+    start_telemetry();
+#endif
+
     filter_name_ptr=0;
 
+    init_field_table(&field_table);
+    init_field_table(&new_field_table);
+    init_script_tail(&new_script_tail,new_script_name);
+    memset((void *)&tm,0,sizeof(tm));
+
+    /* descriptors for idle waits. Set up before the signal handlers,
+       which write to the wakeup pipe */
+
+    if(init_wait_events(&wait_events,new_script_name)!=0){
+       fprintf(stderr,"could not set up idle waits. Exitting\n");
+       fflush(stderr);
+       do_exit(-1);
+    }
+
     /* install signal handlers */
 
     if(install_signal_handlers()!=0){
@@ -279,7 +332,8 @@ int main(int argc, char **argv)
       fprintf(stderr,"loading obs_record from file %s\n",OBS_RECORD_FILE);
     }
 
-    num_fields=load_obs_record(OBS_RECORD_FILE, sequence, &obs_record);
+    num_fields=load_obs_record(OBS_RECORD_FILE, OBS_JOURNAL_FILE, &field_table,
+                 &obs_journal);
 
     if(num_fields < 0 ) {
       fprintf(stderr,"unable to load obs record. Exitting\n");
@@ -299,7 +353,7 @@ int main(int argc, char **argv)
          fprintf(stderr,"loading sequence file %s\n",script_name);
        }
 
-       num_fields=load_sequence(script_name,sequence);
+       num_fields=load_sequence(script_name,&field_table);
        if (num_fields<1){
            fprintf(stderr,"Error loading script %s\n",script_name);
            do_exit(-1);
@@ -311,6 +365,8 @@ int main(int argc, char **argv)
        }
     }
 
+    sequence=field_table.fields;
+
     /* initialize site parameters for DEFAULT observatory (ESO La Silla) */
 
     strcpy(site.site_name,"DEFAULT"); /* DEFAULT assigned to ESO La Silla */
@@ -320,6 +376,7 @@ int main(int argc, char **argv)
     }
     load_site(&site.longit,&site.lat,&site.stdz,&site.use_dst,site.zone_name,&site.zabr,
             &site.elevsea,&site.elev,&site.horiz,site.site_name);
+    init_site_trig(&site);
 
     if(verbose){
       fprintf(stderr,"# site: %s\n",site.site_name);
@@ -488,7 +545,7 @@ int main(int argc, char **argv)
       fflush(stderr);
     }
 
-    if(update_telescope_status(&tel_status)!=0){
+    if(get_telescope_status(&tel_status,STATUS_MAX_AGE_SEC)!=0){
         fprintf(stderr,
            "Telescope Status not yet available\n");
         telescope_ready=0;
@@ -522,6 +579,30 @@ int main(int argc, char **argv)
     num_observable_fields=init_fields(sequence,num_fields,
                &nt,&nt_5day,&nt_10day,&nt_15day,&site,jd,&tel_status);
 
+    if(load_airmass_table(&airmass_table,sequence,num_fields,&site)!=0){
+       fprintf(stderr,"Error loading airmass table\n");
+       do_exit(-1);
+    }
+
+    if(load_visibility_table(&visibility_table,&airmass_table,sequence,
+           num_fields,&nt,&site)!=0){
+       fprintf(stderr,"Error loading visibility table\n");
+       do_exit(-1);
+    }
+
+    if(policy->init(&policy->settings,&field_events,sequence,num_fields,jd)!=0){
+       fprintf(stderr,"Error initializing field selection\n");
+       do_exit(-1);
+    }
+
+    /* start the obs record with a snapshot of the initialized fields.
+       Changes are journaled from here on */
+
+    if(save_obs_record(&field_table,&obs_journal,&tm)!=0){
+       fprintf(stderr,"Error saving obs record\n");
+       do_exit(-1);
+    }
+
 
     fprintf(stderr,
           "# UT: %9.6f Starting observations\n",
@@ -564,15 +645,12 @@ int main(int argc, char **argv)
          num_new_fields = 0;
 #if FAKE_RUN
 
-         if(access(new_script_name,F_OK) {
-           num_new_fields = 0;
-         }
-         else if( jd>nt.jd_start + 0.1){
+         if( jd>nt.jd_start + 0.1){
            if(verbose){
          fprintf(stderr,"# UT %9.5f : checking for new observations to add to sequence\n",ut);
            }
 
-           num_new_fields=load_sequence(new_script_name,new_sequence);
+           num_new_fields=tail_sequence(&new_script_tail,&new_field_table);
          }
          else{
            num_new_fields=-1;
@@ -583,14 +661,9 @@ int main(int argc, char **argv)
            fprintf(stderr,"# UT %9.5f : checking for new observations to add to sequence\n",ut);
          }
 
-         // if file of new observations does not exist, just set num_new_fields to 0
-         if(access(new_script_name,F_OK)!=0) {
-           num_new_fields = 0;
-         }
-         // otherwise load any new fields
-         else{
-           num_new_fields=load_sequence(new_script_name,new_sequence);
-         }
+         // load any fields on lines appended since the last pass. If
+         // the file of new observations does not exist, there are none
+         num_new_fields=tail_sequence(&new_script_tail,&new_field_table);
 #endif
 
          if (num_new_fields<0){
@@ -599,35 +672,53 @@ int main(int argc, char **argv)
          else{
            if(verbose){
           if ( num_new_fields == 0 ){
-            fprintf(stderr,"no new fields to read\n");
-          }
-          else if ( num_new_fields <= num_new_fields_prev ){
-            fprintf(stderr,"no new fields: %d in file, %d already read\n",
-            num_new_fields, num_new_fields_prev);
+            fprintf(stderr,"no new fields: %d lines already read\n",
+            new_script_tail.line);
           }
           else{
             fprintf(stderr,
-            "%d new fields to be added to queue\n",num_new_fields - num_new_fields_prev);
+            "%d new fields to be added to queue\n",num_new_fields);
           }
           fflush(stderr);
            }
          }
 
-         if(num_new_fields >   num_new_fields_prev){
+         if(num_new_fields > 0){
         if (verbose ) {
            fprintf(stderr,"checking which new fields are observable\n");
            fflush(stderr);
         }
-        num_new_observable_fields=init_fields(new_sequence+num_new_fields_prev,num_new_fields,
+
+        new_sequence=new_field_table.fields;
+
+        num_new_observable_fields=init_fields(new_sequence,num_new_fields,
                &nt,&nt_5day,&nt_10day,&nt_15day,&site,jd,&tel_status);
         if ( num_new_observable_fields > 0 ) {
           fprintf(stderr,"Adding %d new fields to queue, of which %d are observable\n",
             num_new_fields,num_new_observable_fields);
           fflush(stderr);
-          if (add_new_fields(sequence,num_fields,
-            new_sequence+num_new_fields_prev,num_new_fields)==0){
+          if (add_new_fields(&field_table,new_sequence,num_new_fields)==0){
              fprintf(stderr,"%d new fields succesfully added to queue\n",num_new_fields);
-             num_fields = num_fields + num_new_fields;
+             sequence=field_table.fields;
+             num_fields=field_table.num_fields;
+             if(load_airmass_table(&airmass_table,sequence,num_fields,&site)!=0){
+                fprintf(stderr,"ERROR : could not update airmass table\n");
+                fflush(stderr);
+             }
+             if(load_visibility_table(&visibility_table,&airmass_table,
+                    sequence,num_fields,&nt,&site)!=0){
+                fprintf(stderr,"ERROR : could not update visibility table\n");
+                fflush(stderr);
+             }
+             if(policy->fields_added(&field_events,sequence,num_fields,jd)!=0){
+                fprintf(stderr,"ERROR : could not update field events\n");
+                fflush(stderr);
+             }
+             if(save_obs_record(&field_table,&obs_journal,&tm)!=0){
+                fprintf(stderr,"ERROR saving obs record\n");
+                fflush(stderr);
+                do_exit(-1);
+             }
           }
           else{
              fprintf(stderr,"ERROR : could not add new fields to queue\n");
@@ -640,7 +731,6 @@ int main(int argc, char **argv)
              fflush(stderr);
           }
         }
-        num_new_fields_prev = num_new_fields;
          }
 #if FAKE_RUN
 #else
@@ -664,7 +754,7 @@ int main(int argc, char **argv)
         status is available or the end of the night */
 
 
-         else if(update_telescope_status(&tel_status)!=0){
+         else if(get_telescope_status(&tel_status,STATUS_MAX_AGE_SEC)!=0){
             fprintf(stderr,
             "# UT : %9.6f Can't update telescope status \n",ut);
             bad_weather=1;
@@ -753,7 +843,8 @@ int main(int argc, char **argv)
         if(ut>24.0)ut=ut-24.0;
         jd=jd+(LOOP_WAIT_SEC/86400.0);
 #else
-        sleep(LOOP_WAIT_SEC);
+        /* wakes at once on the resume signal */
+        wait_for_event(&wait_events,LOOP_WAIT_SEC);
 #endif
          }/* end of pause_flag check */
 
@@ -777,11 +868,15 @@ int main(int argc, char **argv)
 #if FAKE_RUN
           if(0){
 #else
-          if(wait_camera_readout(&cam_status)!=0){
+          if(check_readout(sequence+i_prev,jd,&cam_status,RUN_END)!=0){
 #endif
               fprintf(stderr,"bad readout of last exposure in focus sequence. Trying again\n");
               fflush(stderr);
-              sequence[i_prev].n_done=sequence[i_prev].n_done-1;
+              policy->status_changed(&field_events,i_prev);
+              if(journal_field(&field_table,&obs_journal,i_prev,&tm)!=0){
+                 fprintf(stderr,"ERROR saving obs record\n");
+                 fflush(stderr);
+              }
           }
           else{
               fprintf(stderr,"Focus sequence complete. Getting and Setting best focus\n");
@@ -790,7 +885,7 @@ int main(int argc, char **argv)
               fprintf(stderr,"Unable to focus telescope. Exitting\n");fflush(stderr);
               sequence[i_prev].n_done=0;
 
-              if(save_obs_record(sequence,obs_record,num_fields,&tm)!=0){
+              if(journal_field(&field_table,&obs_journal,i_prev,&tm)!=0){
                  fprintf(stderr,"ERROR saving obs record\n");
                  fflush(stderr);
                  do_exit(-1);
@@ -825,11 +920,15 @@ int main(int argc, char **argv)
 #if FAKE_RUN
           if(0){
 #else
-          if(wait_camera_readout(&cam_status)!=0){
+          if(check_readout(sequence+i_prev,jd,&cam_status,RUN_END)!=0){
 #endif
               fprintf(stderr,"bad readout of last exposure in focus sequence. Trying again\n");
               fflush(stderr);
-              sequence[i_prev].n_done=sequence[i_prev].n_done-1;
+              policy->status_changed(&field_events,i_prev);
+              if(journal_field(&field_table,&obs_journal,i_prev,&tm)!=0){
+                 fprintf(stderr,"ERROR saving obs record\n");
+                 fflush(stderr);
+              }
           }
           else{
               fprintf(stderr,"Offset exposure complete. Getting and Setting telescope offsets\n");
@@ -859,7 +958,8 @@ int main(int argc, char **argv)
 
          /* choose next field to observe */
 
-         i=get_next_field(sequence,num_fields,i_prev,jd,bad_weather);
+         i=policy->pick(&policy->settings,&field_events,sequence,num_fields,
+            i_prev,jd,bad_weather);
          if (i>=0 ){
             selection_code = sequence[i].selection_code;
             sprintf(code_string,"%s",selection_string[selection_code]);
@@ -878,6 +978,18 @@ int main(int argc, char **argv)
 #if FAKE_RUN
 #else
 
+            /* the last exposure may still be reading out. Wait for it
+               now, rather than when the next field is observed, so a
+               bad readout is retried as soon as possible */
+
+            if(i_prev>=0&&check_readout(sequence+i_prev,jd,&cam_status,RUN_END)!=0){
+               policy->status_changed(&field_events,i_prev);
+               if(journal_field(&field_table,&obs_journal,i_prev,&tm)!=0){
+                  fprintf(stderr,"ERROR saving obs record\n");
+                  fflush(stderr);
+               }
+            }
+
             /* If there are no fields pending, and weather
                if good, stop telescope. If weather is bad,
                stow the telescope */
@@ -919,14 +1031,32 @@ int main(int argc, char **argv)
             /* Otherwise just wait a little and check again */
 
             else{
+#if FAKE_RUN
             fprintf(stderr,"Wait before checking again\n");
             fflush(stderr);
-#if FAKE_RUN
             ut=ut+(LOOP_WAIT_SEC/3600.0);
             if(ut>24.0)ut=ut-24.0;
             jd=jd+(LOOP_WAIT_SEC/86400.0);
 #else
-            sleep(LOOP_WAIT_SEC);
+            /* Nothing can be selected before the next field status
+               change or sunrise, unless fields are added, a signal
+               arrives, or the weather changes. The weather is only
+               known by polling the telescope, so keep the short wait
+               while it is bad */
+
+            wait_sec=next_field_event(&field_events);
+            if(wait_sec>nt.jd_sunrise)wait_sec=nt.jd_sunrise;
+            wait_sec=(wait_sec-jd)*86400.0;
+            if(wait_sec>MAX_IDLE_WAIT_SEC)wait_sec=MAX_IDLE_WAIT_SEC;
+            if((bad_weather||!telescope_ready)&&wait_sec>LOOP_WAIT_SEC){
+               wait_sec=LOOP_WAIT_SEC;
+            }
+            if(wait_sec<MIN_IDLE_WAIT_SEC)wait_sec=MIN_IDLE_WAIT_SEC;
+
+            fprintf(stderr,"Wait up to %7.1f sec before checking again\n",
+               wait_sec);
+            fflush(stderr);
+            wait_for_event(&wait_events,wait_sec);
 #endif
             }
          } //if(i<0){
@@ -953,20 +1083,18 @@ int main(int argc, char **argv)
             /* reset offset_done flag to 0 if this is a new offset sequence */
             else if(offset_done&&sequence[i].shutter==OFFSET_CODE)offset_done=0;
 
-            // DEBUG
-            strcpy(exp_mode,EXP_MODE_SINGLE);
-            /*
-            if (first_exposure){
-              strcpy(exp_mode,EXP_MODE_FIRST);
-              first_exposure = False;
-            }
-            else{
-              strcpy(exp_mode,EXP_MODE_NEXT);
-            }
-            */
+            /* observe_next_field sets exp_mode for each exposure */
             
-            if(observe_next_field(sequence,i,i_prev,jd,&dt,&nt,WAIT_FLAG,
-            log_obs_out,&tel_status,&cam_status,&fits_header,exp_mode)!=0){
+            result=observe_next_field(sequence,i,i_prev,jd,&dt,&nt,WAIT_FLAG,
+            log_obs_out,&tel_status,&cam_status,&fits_header,exp_mode);
+
+            /* the observed field, and the previous field if its last
+               exposure was marked undone, have new status */
+
+            policy->observed(&field_events,sequence,i,jd);
+            policy->status_changed(&field_events,i_prev);
+
+            if(result!=0){
                fprintf(stderr,"ERROR observing field %d\n",i);
                fflush(stderr);
                if(telescope_ready&&stop_flag==0){
@@ -983,10 +1111,12 @@ int main(int argc, char **argv)
                }
             }
  
-            /* Save a binary record of the status of each field so that
-               scheduler can start up where it ended if it crashes */
+            /* Append the changes to the observed field (and the previous
+               field) to the obs record so that scheduler can start up
+               where it ended if it crashes */
 
-            if(save_obs_record(sequence,obs_record,num_fields,&tm)!=0){
+            if(journal_field(&field_table,&obs_journal,i,&tm)!=0||
+               journal_field(&field_table,&obs_journal,i_prev,&tm)!=0){
               fprintf(stderr,"ERROR saving obs record\n");
               fflush(stderr);
               do_exit(-1);
@@ -1023,7 +1153,7 @@ int main(int argc, char **argv)
             }
             fflush(stderr);
 
-            sleep(LOOP_WAIT_SEC);
+            wait_for_event(&wait_events,LOOP_WAIT_SEC);
 #endif
          } //if(i<0){
          } /* end of choose and observe next field */
@@ -1039,6 +1169,13 @@ int main(int argc, char **argv)
 
 #if FAKE_RUN
 #else
+    if(i_prev>=0&&check_readout(sequence+i_prev,jd,&cam_status,RUN_END)!=0){
+         if(journal_field(&field_table,&obs_journal,i_prev,&tm)!=0){
+            fprintf(stderr,"ERROR saving obs record\n");
+            fflush(stderr);
+         }
+    }
+
     if(jd>nt.jd_sunrise){
          fprintf(stderr,
            "# UT: %9.6f Stowing Telescope\n",ut);
@@ -1052,7 +1189,7 @@ int main(int argc, char **argv)
     num_completed_fields=0;
     for(i=0;i<num_fields;i++){
        if(sequence[i].n_done==sequence[i].n_required){
-        fprintf(sequence_out,"%s",sequence[i].script_line);
+        fprintf(sequence_out,"%s",sequence[i].hist->script_line);
         num_completed_fields++;
        }
        print_field_status(sequence+i,stderr);
@@ -1072,21 +1209,23 @@ int main(int argc, char **argv)
         
 /******************************************************************/
 
-int add_new_fields(Field *sequence, int num_fields,
-        Field *new_sequence, int num_new_fields){
+int add_new_fields(Field_Table *table, Field *new_sequence,
+        int num_new_fields){
   
-    int i,field_number;
+    int i,num_fields;
 
-    if (num_fields + num_new_fields >= MAX_FIELDS ){
-     fprintf(stderr, "add_new_fields: too many new fields to add\n");
+    num_fields=table->num_fields;
+    if (grow_field_table(table,num_fields+num_new_fields)!=0){
+     fprintf(stderr, "add_new_fields: can't make room for %d new fields\n",
+        num_new_fields);
      return(-1);
     }
 
-    field_number = num_fields;
     for (i=1;i<=num_new_fields;i++){
-    *(sequence+num_fields+i-1)=*(new_sequence+i-1);
-    (sequence+num_fields+i-1)->field_number = field_number + i;
+    copy_field(table->fields+num_fields+i-1,new_sequence+i-1);
+    (table->fields+num_fields+i-1)->field_number = num_fields + i;
     }
+    table->num_fields=num_fields+num_new_fields;
 
     return(0);
 }
@@ -1111,7 +1250,7 @@ int do_stop(double ut,Telescope_Status *status)
          fflush(stderr);
     }
 
-    if(update_telescope_status(status)!=0){
+    if(get_telescope_status(status,0.0)!=0){
           fprintf(stderr,"do_stop: ERROR updating telescope status\n");
           fflush(stderr);
     }
@@ -1194,7 +1333,7 @@ int do_stow(double ut,Telescope_Status *status)
          fflush(stderr);
     }
 
-    if(update_telescope_status(status)!=0){
+    if(get_telescope_status(status,0.0)!=0){
           fprintf(stderr,"do_stow: ERROR updating telescope status\n");
           fflush(stderr);
     }
@@ -1222,7 +1361,7 @@ int close_files()
      if(hist_out!=NULL)fclose(hist_out);
      if(sequence_out!=NULL)fclose(sequence_out);
      if(log_obs_out!=NULL)fclose(log_obs_out);
-     if(obs_record!=NULL)fclose(obs_record);
+     close_obs_record(&obs_journal);
       
      return(0);
 }
@@ -1250,145 +1389,6 @@ int do_exit(int code)
 }
 /************************************************************/
 
-int save_obs_record(Field *sequence, FILE *obs_record, int num_fields,
-     struct tm *tm)
-{
-     char string[STR_BUF_LEN];
-
-     /* rewind obs_record so that next write will be at start of file
-    (overwriting previous records) */
-
-
-     if(fseek(obs_record,0,SEEK_SET)!=0){
-     fprintf(stderr,"save_obs_record: can't rewind obs_record\n");
-     fflush(stderr);
-     return(-1);
-     }
-
-     sprintf(string,"%d %d %d %d %d %d %d\n",
-      num_fields,tm->tm_year,tm->tm_mon,tm->tm_mday,
-      tm->tm_hour,tm->tm_min,tm->tm_sec);
-
-     if(fwrite((void *)string,strlen(string),1,obs_record)!=1){
-      fprintf(stderr,"save_obs_record: ERROR writing first line\n");
-      fflush(stderr);
-      return(-1);
-     }
-
-     if(fwrite((void *)sequence,sizeof(Field),
-            num_fields,obs_record)!=num_fields){
-      fprintf(stderr,"save_obs_record: ERROR writing %d fields\n",
-           num_fields);
-      fflush(stderr);
-      return(-1);
-     }
-     
-     return(0);
-
-}
-
-/************************************************************/
-
-int load_obs_record(char *file_name, Field *sequence, FILE **obs_record)
-{
-     int i,n;
-     int num_fields;
-     int n_completed;
-     int n_started;
-     int n_fresh;
-     int year,month,day,hour,minute,second;
-     Field *f;
-     char string[STR_BUF_LEN];
-
-     *obs_record=fopen(file_name,"r+");
-     if(*obs_record==NULL){
-    fprintf(stderr,"load_obs_record: can't open file %s for reading\n",
-        file_name);
-    fprintf(stderr,"load_obs_record: creating new empty record\n");
-    fflush(stderr);
-    *obs_record=fopen(file_name,"w");
-    if(*obs_record==NULL){
-      fprintf(stderr,"load_obs_record: can't create new obs record\n");
-      return(-1);
-    }
-    else{
-      return(0);
-    }
-     }
-
-     num_fields=0;
-     n_fresh=0;
-     n_started=0;
-     n_completed=0;
-
-     if(fgets(string,STR_BUF_LEN,*obs_record)==NULL){
-     fprintf(stderr,"load_obs_record: can't get first line \n");
-     fprintf(stderr,"load_obs_record: assuming no previous observations\n");
-     return(0);
-     }
-
-     if(sscanf(string,"%d %d %d %d %d %d %d",
-           &num_fields,&year,&month,&day,&hour,&minute,&second)!=7){
-     fprintf(stderr,"load_obs_record: bad first line: %s\n",string);
-     return(-1);
-     }
-     else{
-     fprintf(stderr,"load_obs_record: %s",string);
-     } 
-
-     if(num_fields>MAX_FIELDS){
-     fprintf(stderr,"load_obs_record: too many fields in obs_record\n");
-     return(-1);
-     }
-
-     i=fread((void *)sequence, sizeof(Field),num_fields,*obs_record);
-
-     if(i!= num_fields){
-     fprintf(stderr,"load_obs_record: only %d of %d fields read\n",
-        i,num_fields);
-     return(-1);
-     }
-
-     /* rewind obs_record so that next write will be at start of file
-    (overwriting previous records) */
-
-     if(fseek(*obs_record,0,SEEK_SET)!=0){
-     fprintf(stderr,"load_obs_record: can't rewind obs_record\n");
-     return(-1);
-     }
-
-     for(i=0;i<num_fields;i++){
-      f=sequence+i;
-      if(f->n_done==0){
-          n_fresh++;
-      }
-      else if (f->n_done < f->n_required){
-           n_started++;
-      }
-      else {
-           n_completed++; 
-      }
-      if(f->shutter==FOCUS_CODE){
-         n=f->n_required/2;
-         focus_start=focus_default-n*focus_increment;
-      }
-      if(num_fields>=MAX_FIELDS){
-         fprintf(stderr,
-          "load_obs_record: maximum number of fields exceeded\n");
-         fflush(stderr);
-         return(-1);
-      }
-     }
-     
-     fprintf(stderr,
-       "load_obs_record: %d total, %d fresh, %d started, %d completed\n",
-       num_fields, n_fresh,n_started,n_completed);
-
-     return(num_fields);
-}
-
-/************************************************************/
-
 int check_weather (FILE *input, double jd, struct date_time *date, Night_Times *nt)
 {
      char string[STR_BUF_LEN],s[256];
@@ -1484,7 +1484,7 @@ int init_night(struct date_time date, Night_Times *nt,
       if (print_flag ){
          fprintf(stderr,"allowing observations all day\n");
       }
-      if(update_telescope_status(&tel_status)!=0){
+      if(get_telescope_status(&tel_status,STATUS_MAX_AGE_SEC)!=0){
         fprintf(stderr,
            "Telescope Status not yet available, Can not determine pointing constraints\n");
       }
@@ -1576,6 +1576,7 @@ int observe_next_field(Field *sequence, int index, int index_prev,
     Fits_Header *fits_header, char *exp_mode)
 {
     double lst,ut,actual_expt,ha,ra_correction,dec_correction,ra,dec,dt1;
+    double ha_table;
     double ra_rate,dec_rate; /* ra and dec tracking rate corrections in arcsec/hour */
     struct timeval t0,t1,t2;
     struct tm tm;
@@ -1586,6 +1587,7 @@ int observe_next_field(Field *sequence, int index, int index_prev,
     int n_clears;
     int n,num_exposures;
     double split_expt,expt;
+    double readout_sec;
     int bad_read_count;
     int exp_error_code=0;
     //bool wait_flag = True;
@@ -1621,9 +1623,19 @@ int observe_next_field(Field *sequence, int index, int index_prev,
     ut=nt->ut_start+(jd-nt->jd_start)*24.0;
     lst=nt->lst_start+(jd-nt->jd_start)*SIDEREAL_DAY_IN_HOURS;
 #else
+    /* a run of exposures of the previous field ends here. Fetch its
+       last image while the telescope moves */
+
+    if(index!=index_prev&&exposure_run_open()){
+       if(check_readout(f_prev,jd,cam_status,RUN_END_NOWAIT)!=0){
+          fprintf(stderr,
+             "observe_next_field: bad readout before field %d\n",index);
+       }
+    }
+
     if(f->shutter==DARK_CODE||f->shutter==DOME_FLAT_CODE){
     }
-    else if(update_telescope_status(tel_status)!=0){
+    else if(get_telescope_status(tel_status,STATUS_MAX_AGE_SEC)!=0){
      fprintf(stderr,"observe_next_field: could not update telescope status\n");
      return(-1);
     }
@@ -1707,8 +1719,8 @@ int observe_next_field(Field *sequence, int index, int index_prev,
     if(ha>12)ha=ha-24.0;
 
     if(f->n_done>0&& POINTING_CORRECTIONS_ON){
-        ra_correction=get_ra_correction(f->ha[0],ha);
-        dec_correction=get_dec_correction(f->ha[0],ha);
+        ra_correction=get_ra_correction(f->hist->ha[0],ha);
+        dec_correction=get_dec_correction(f->hist->ha[0],ha);
     }
     else{
         ra_correction=0.0;
@@ -1779,12 +1791,13 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
     get_filename(filename,&tm,f->shutter);
     /* update n_done, lst_next, and compute dt */
 
-    f->ut[f->n_done]=ut;
-    f->jd[f->n_done]=jd;
-    f->ha[f->n_done]=ha;
-    f->lst[f->n_done]=lst;
-    f->actual_expt[f->n_done]=actual_expt/3600.0;
-    strncpy(f->filename+(f->n_done)*FILENAME_LENGTH,filename,FILENAME_LENGTH);
+    f->hist->ut[f->n_done]=ut;
+    f->hist->jd[f->n_done]=jd;
+    f->hist->ha[f->n_done]=ha;
+    f->hist->lst[f->n_done]=lst;
+    f->hist->am[f->n_done]=get_table_airmass(&airmass_table,index,lst,&ha_table);
+    f->hist->actual_expt[f->n_done]=actual_expt/3600.0;
+    strncpy(f->hist->filename+(f->n_done)*FILENAME_LENGTH,filename,FILENAME_LENGTH);
     f->n_done=f->n_done+1;
     f->jd_next=jd+(f->interval/24.0);
  
@@ -1834,7 +1847,7 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
        if(verbose&&POINTING_CORRECTIONS_ON){
            fprintf(stderr,
           "observe_next_field: ra, dec corrections for field %d :%9.6f %9.6f deg ha0: %9.6f ha: %9.6f\n",
-          f->field_number,ra_correction,dec_correction,f->ha[0],ha);
+          f->field_number,ra_correction,dec_correction,f->hist->ha[0],ha);
        }
     }
     else{
@@ -1855,8 +1868,8 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
        f->ra,f->dec,shutter_string,f->n_done,3600.0*expt,
        ha,jd,actual_expt,filename,field_description,f->field_number);
        /*ut,jd,actual_expt,filename,field_description,f->field_number);*/
-       if(strstr(f->script_line,"#")!=NULL){
-      fprintf(output,"%s",strstr(f->script_line,"#")+1);
+       if(strstr(f->hist->script_line,"#")!=NULL){
+      fprintf(output,"%s",strstr(f->hist->script_line,"#")+1);
        }
        else{
       fprintf(output,"\n");
@@ -1913,7 +1926,7 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
        if(verbose&&POINTING_CORRECTIONS_ON){
            fprintf(stderr,
           "observe_next_field: ra, dec corrections for field %d :%9.6f %9.6f deg ha0: %9.6f ha: %9.6f\n",
-          f->field_number,ra_correction,dec_correction,f->ha[0],ha);
+          f->field_number,ra_correction,dec_correction,f->hist->ha[0],ha);
        }
     }
     else{
@@ -1936,6 +1949,13 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
 
     gettimeofday(&t2,NULL);
 
+    /* fit the slew model to the measured pointing time */
+
+    if(tel_status->valid&TEL_STATUS_POSITION){
+       record_slew(tel_status->ra,tel_status->dec,ra,dec,
+          (t2.tv_sec-t1.tv_sec)+1.0e-6*(t2.tv_usec-t1.tv_usec));
+    }
+
     if(verbose){
        fprintf(stderr,
          "observe_next_field: done pointing telescope in %ld sec\n",
@@ -1953,7 +1973,7 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
    
     if(f->shutter==DARK_CODE||f->shutter==DOME_FLAT_CODE){
     }  
-    else if(update_telescope_status(tel_status)!=0){
+    else if(get_fresh_telescope_status(tel_status,TEL_STATUS_POSITION)!=0){
     fprintf(stderr,"observe_next_field: could not update telescope status\n");
     return(-1);
     }
@@ -1979,7 +1999,7 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
          return(-1);
        }
     
-       if(update_telescope_status(tel_status)!=0){
+       if(get_fresh_telescope_status(tel_status,TEL_STATUS_FOCUS)!=0){
          fprintf(stderr,"observe_next_field: could not update telescope status\n");
          return(-1);
        }
@@ -2040,16 +2060,14 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
        fflush(stderr);
     }
  
-    if(wait_camera_readout(cam_status)!=0){
+    /* an exposure run also ends if the camera is to be cleared */
+
+    dt1=clock_difference(ut_prev,ut);
+
+    if(check_readout(f_prev,jd,cam_status,
+         (ut_prev<0.0||dt1>CLEAR_INTERVAL)?RUN_END:RUN_CONTINUE)!=0){
     fprintf(stderr,
          "observe_next_field: bad readout before field %d\n",index);
-    if(index_prev>=0&&f_prev->n_done>0){
-        fprintf(stderr,
-           "observe_next_field: setting last exposure of field %d to undone\n",
-           index_prev);
-        f_prev->n_done=f_prev->n_done-1;
-        f_prev->jd_next=jd;
-    }
     }
       
     if(verbose){
@@ -2057,8 +2075,6 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
      fflush(stderr);
     }
 
-    dt1=clock_difference(ut_prev,ut);
-
     // DEBUG
     fprintf(stderr,"observe_next_field: skipping clears\n");
     if(ut_prev<0.0||dt1>CLEAR_INTERVAL){
@@ -2093,9 +2109,18 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
      jd=get_jd();
      actual_expt=expt;
 
+     /* leave the image in controller memory if another exposure will
+        follow at once: the next part of a split exposure, or the next
+        exposure of a field due again before a single exposure could be
+        read out and transferred (darks, flats, fast cadences) */
+
+     select_exp_mode(exp_mode,n<num_exposures||
+        (f->n_done+1<f->n_required&&f->interval<=exp_overhead_hours));
+
      if(take_exposure(f,fits_header,&actual_expt,filename,&ut,&jd,
         wait_flag,&exp_error_code,exp_mode)!=0){
        fprintf(stderr,"observe_next_field: ERROR taking exposure %d\n",n);
+       undo_lost_run_image(jd);
        return(-1);
      }
      ut_prev=ut;
@@ -2106,12 +2131,13 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
        fflush(stderr);
      }
 
-     f->ut[f->n_done]=ut;
-     f->jd[f->n_done]=jd;
-     f->ha[f->n_done]=ha;
-     f->lst[f->n_done]=lst;
-     f->actual_expt[f->n_done]=actual_expt/3600.0;
-     strncpy(f->filename+(f->n_done)*FILENAME_LENGTH,filename,FILENAME_LENGTH);
+     f->hist->ut[f->n_done]=ut;
+     f->hist->jd[f->n_done]=jd;
+     f->hist->ha[f->n_done]=ha;
+     f->hist->lst[f->n_done]=lst;
+     f->hist->am[f->n_done]=get_table_airmass(&airmass_table,index,lst,&ha_table);
+     f->hist->actual_expt[f->n_done]=actual_expt/3600.0;
+     strncpy(f->hist->filename+(f->n_done)*FILENAME_LENGTH,filename,FILENAME_LENGTH);
      f->n_done=f->n_done+1;
 
 /* this line aded 2007 Jun 14 to fix bug */
@@ -2129,8 +2155,8 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
         f->ra,f->dec,shutter_string,f->n_done,3600.0*expt,
         ha,jd,actual_expt,filename,field_description,f->field_number);
         /*ut,jd,actual_expt,filename,field_description,f->field_number);*/
-        if(strstr(f->script_line,"#")!=NULL){
-           fprintf(output,"%s",strstr(f->script_line,"#")+1);
+        if(strstr(f->hist->script_line,"#")!=NULL){
+           fprintf(output,"%s",strstr(f->hist->script_line,"#")+1);
         }
         else{
            fprintf(output,"\n");
@@ -2145,20 +2171,29 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
           fflush(stderr);
         }
  
-        if(wait_camera_readout(cam_status)!=0){
+        if(wait_camera_readout(cam_status,&readout_sec)!=0){
          fprintf(stderr,
            "observe_next_field: bad readout of exposure %d\n",n);
          fprintf(stderr,
            "observe_next_field: repeating exposure %d\n",n);
          n--;
          f->n_done=f->n_done-1;
+         if(undo_lost_run_image(jd)){
+            n--;
+         }
          bad_read_count++;
          if(bad_read_count>MAX_BAD_READOUTS){
            fprintf(stderr,"observe_next_field: too many bad reads\n");
            return(-1);
          }
         }
-        if(update_telescope_status(tel_status)!=0){
+        else if(verbose){
+          fprintf(stderr,
+           "observe_next_field: readout of exposure %d took %7.3f sec\n",
+           n,readout_sec);
+          fflush(stderr);
+        }
+        if(get_telescope_status(tel_status,STATUS_MAX_AGE_SEC)!=0){
            fprintf(stderr,"observe_next_field: could not update telescope status\n");
            return(-1);
         }
@@ -2178,6 +2213,75 @@ fprintf(stderr,"HA = %10.6f,  expt = %10.6f,  LONG_EXPTIME = %10.6f\n",
 
 /************************************************************/
 
+/* wait for the readout of the last exposure, taken of field f_prev
+   (NULL if none). run_end is RUN_CONTINUE, RUN_END or RUN_END_NOWAIT,
+   to say whether the exposure run (see end_exposure_run) ends here.
+   With RUN_END_NOWAIT the readout is not waited for: the fetch of
+   the last image is queued behind it, and the next check_readout
+   collects both. If the readout is bad, mark the exposure as undone
+   so that it will be taken again, and return -1 */
+
+int check_readout(Field *f_prev, double jd, Camera_Status *cam_status, int run_end)
+{
+    int result;
+    double readout_sec;
+
+    if(run_end==RUN_END_NOWAIT){
+       result=end_exposure_run(False);
+    }
+    else{
+       result=wait_camera_readout(cam_status,&readout_sec);
+       if(result==0&&verbose1){
+          fprintf(stderr,"check_readout: readout took %7.3f sec\n",readout_sec);
+          fflush(stderr);
+       }
+       if(result==0&&run_end==RUN_END){
+          result=end_exposure_run(True);
+       }
+    }
+
+    if(result==0){
+       return(0);
+    }
+
+    if(f_prev!=NULL&&f_prev->n_done>0){
+       fprintf(stderr,
+          "check_readout: setting last exposure of field %d to undone\n",
+          f_prev->field_number);
+       f_prev->n_done=f_prev->n_done-1;
+       f_prev->jd_next=jd;
+    }
+    undo_lost_run_image(jd);
+
+    return(-1);
+}
+
+/************************************************************/
+
+/* if a failed exposure abandoned an exposure run, the image that was
+   left in controller memory is lost as well. Mark it undone. Runs are
+   of one field, so this is the field whose exposure failed. Returns
+   1 if an exposure was marked undone, 0 otherwise */
+
+int undo_lost_run_image(double jd)
+{
+    Field *f;
+
+    f=lost_run_field();
+    if(f==NULL||f->n_done<=0)return(0);
+
+    fprintf(stderr,
+       "undo_lost_run_image: setting unfetched exposure of field %d to undone\n",
+       f->field_number);
+    fflush(stderr);
+    f->n_done=f->n_done-1;
+    f->jd_next=jd;
+
+    return(1);
+}
+
+/************************************************************/
+
 /* return offsetin ra and dec (deg) appropriate for dithering flat fields.
    The offset is on a grid with spacing DITHER_SPACING, centered on
    the nominal pointing of the telescope.
@@ -2258,61 +2362,6 @@ int get_dither(int iteration, double *ra_dither, double *dec_dither, double step
 
 /************************************************************/
 
-int get_shutter_code(char *shutter_flag)
-{
-      int code;
-
-      if(strcmp(shutter_flag,SKY_STRING)==0){
-        code=SKY_CODE;
-      }
-      else if(strcmp(shutter_flag,SKY_STRING_LC)==0){
-        code=SKY_CODE;
-      }
-      else if (strcmp(shutter_flag,DARK_STRING)==0){
-        code=DARK_CODE;
-      }
-      else if (strcmp(shutter_flag,DARK_STRING_LC)==0){
-        code=DARK_CODE;
-      }
-      else if (strcmp(shutter_flag,FOCUS_STRING)==0){
-        code=FOCUS_CODE;
-      }
-      else if (strcmp(shutter_flag,FOCUS_STRING_LC)==0){
-        code=FOCUS_CODE;
-      }
-      else if (strcmp(shutter_flag,OFFSET_STRING)==0){
-        code=OFFSET_CODE;
-      }
-      else if (strcmp(shutter_flag,OFFSET_STRING_LC)==0){
-        code=OFFSET_CODE;
-      }
-      else if (strcmp(shutter_flag,EVENING_FLAT_STRING)==0){
-        code=EVENING_FLAT_CODE;
-      }
-      else if (strcmp(shutter_flag,EVENING_FLAT_STRING_LC)==0){
-        code=EVENING_FLAT_CODE;
-      }
-      else if (strcmp(shutter_flag,MORNING_FLAT_STRING)==0){
-        code=MORNING_FLAT_CODE;
-      }
-      else if (strcmp(shutter_flag,MORNING_FLAT_STRING_LC)==0){
-        code=MORNING_FLAT_CODE;
-      }
-      else if (strcmp(shutter_flag,DOME_FLAT_STRING)==0){
-        code=DOME_FLAT_CODE;
-      }
-      else if (strcmp(shutter_flag,DOME_FLAT_STRING_LC)==0){
-        code=DOME_FLAT_CODE;
-      }
-      else{
-        code=BAD_CODE;
-      }
-
-      return(code);
-}
-
-/************************************************************/
-
 int get_shutter_string(char *string, int shutter, char *description)
 {
     switch (shutter){
@@ -2369,661 +2418,38 @@ int get_shutter_string(char *string, int shutter, char *description)
 
 /************************************************************/
 
-/* Choose the next field to observe.
-
-   This is a two pass selection loop. In the first pass, consider 
-   every field. Call update_field_status to determine if the
-   field is observable, ready to be observed, and how much time 
-   is left to observe it. If there is a field with DO_NOW_STATUS 
-   (e.g. a dark) , choose that field and return with its field index. 
-   Otherwise, keep track of how many fields have READY_STATUS
-   and TOO_LATE_STATUS. For those with READY_STATUS,
-   update the minimum value of n_left (number of fields remaining 
-   for completion).
-
-   Before starting the second pass, check if the previously
-   observed field was the first in a pair and if the
-   second in the pair is ready to be observed. If so, choose
-   the second in the pair as the next field.
-
-   In the second pass, find all the fields that are ready to observe
-   (READY_STATUS) and have n_left matching the minimum value
-   determined in the first pass. Of these, select the field
-   that has the least time remaining (time_left) to complete the
-   required observations.
-
-   If there are no fields ready to observe, choose among the "late"
-   fields (TOO_LATE_STATUS) which are observable, but for which
-   there is not enough time to
-   observe all the remaining observations. Choose the late field with
-   the most amount of time left (least negative value) and shorten
-   the time interval between fields so that there is time left. Choose
-   this field.
-
-   If there are not late fields that can be shortened (while still
-   keeping interval > MIN_INTERVAL), return -1 (no field selected).
-
-*/
+/* initialize rise and set times for each field. Set 0 values for time,
+hour angle, and airmass of each oservation for each field. Set number
+done to 0. Determine which observations are doable, and initialize
+time_up, time_required, time_left, and jd_next */
 
-int get_next_field(Field *sequence,int num_fields, int i_prev,
-                double jd, int bad_weather)
+int init_fields(Field *sequence, int num_fields, 
+        Night_Times *nt, Night_Times *nt_5day,
+        Night_Times *nt_10day, Night_Times *nt_15day,
+        Site_Params *site, double jd,
+        Telescope_Status *tel_status)
 {
-     Field *f,*f_prev,*f_next;
-     double time_left_min,time_left,time_left_max;
-     int i,n_left,n_left_min,n_left_min_must_do;
-     int i_min,i_max,status,n_ready,n_late;
-     int n_do_now,i_min_dark, i_min_flat,i_min_do_now;
-     int n_ready_must_do,n_late_must_do;
-     char field_status[256];
-
-     if(i_prev>=0&&i_prev<num_fields-1){
-       f_prev=sequence+i_prev;
-       f_next=sequence+i_prev+1;
-     }
-     else{
-       f_prev=NULL;
-       f_next=NULL;
-     }
-
-     n_left_min=100000;
-     n_left_min_must_do=100000;
-     n_ready=0;
-     n_late=0;
-     n_do_now=0;
-     i_min_dark=-1;
-     i_min_flat=-1;
-     i_min_do_now=-1;
-     n_ready_must_do=0;
-     n_late_must_do=0;
-
-     if(verbose){  
-    fprintf(stderr,"get_next_field: updating field status\n");
-     }
-
-     for(i=0;i<num_fields;i++){
-     f=sequence+i;
-
-     update_field_status(f,jd,bad_weather);
-     if(verbose1){
-       get_field_status_string(f,field_status);
-       fprintf(stderr,"field %d status %s\n",i,field_status);
-     }
-
-#if 1
-     /* for any MUST-DO field with READY_STATUS, increment the count and update minimum
-        value of n_left */
+    int i,j,n_observable,n_up_too_short,n_moon_too_close,n_never_rise;
+    int n_moon_too_close_later;
+    int n_same_ra;
+    Field *f;
+    double time_up,time_required;
+    double dark_night_duration, whole_night_duration;
+    double ra_prev,current_epoch;
+    double max_airmass;
+    double max_hourangle;
+    double new_jd_start=0.0;
+    double new_lst_start=0.0;
 
-     if (f->status==READY_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE){
-        n_ready_must_do++;
-
-        n_left=f->n_required-f->n_done;
-        
-        if(n_left<n_left_min_must_do){
-         n_left_min_must_do=n_left;
-        }
-
-     }
-
-     /* status of DO_NOW_STATUS  means must do now (i.e. darks or 2nd offset
-        field).  Return field index */
-
-     else if(f->status==DO_NOW_STATUS){
-        n_do_now++;
-        if(i_min_do_now==-1)i_min_do_now=i;
-        if(f->shutter==DARK_CODE&&i_min_dark==-1)i_min_dark=i;
-        if((f->shutter==DOME_FLAT_CODE||f->shutter==EVENING_FLAT_CODE||
-          f->shutter==MORNING_FLAT_CODE)&&i_min_flat==-1)i_min_flat=i;
-        /*return(i);*/
-     }
-
-#else
-     /* status of DO_NOW_STATUS  means must do now (i.e. darks or 2nd offset
-        field).  Return field index */
-
-     if(f->status==DO_NOW_STATUS){
-        n_do_now++;
-        if(i_min_do_now==-1)i_min_do_now=i;
-        if(f->shutter==DARK_CODE&&i_min_dark==-1)i_min_dark=i;
-        if((f->shutter==DOME_FLAT_CODE||f->shutter==EVENING_FLAT_CODE||
-          f->shutter==MORNING_FLAT_CODE)&&i_min_flat==-1)i_min_flat=i;
-        /*return(i);*/
-     }
-
-     /* for any MUST-DO field with READY_STATUS, increment the count and update minimum
-        value of n_left */
-
-     else if (f->status==READY_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE){
-        n_ready_must_do++;
-
-        n_left=f->n_required-f->n_done;
-        
-        if(n_left<n_left_min_must_do){
-         n_left_min_must_do=n_left;
-        }
-
-     }
-#endif
-
-     /* for any other field with READY_STATUS, increment the count and update minimum
-        value of n_left */
-
-     else if (f->status==READY_STATUS){
-        n_ready++;
-
-        n_left=f->n_required-f->n_done;
-        
-        if(n_left<n_left_min){
-         n_left_min=n_left;
-        }
-
-     }
-
-     /* Also count fields with TOO_LATE_STATUS */
-
-     else if (f->status==TOO_LATE_STATUS){
-        n_late++;
-        if(f->survey_code==MUSTDO_SURVEY_CODE)n_late_must_do++;
-     }
-
-     } //for(i=0;i<num_fields;i++){
-
-     /* If there are MUST_DO fields with READY_STATUS, 
-    choose the one that has least time left to complete the 
-    required observations */       
-
-     if(n_ready_must_do>0){
-       if(verbose){
-       fprintf(stderr,"get_next_field: checking %d ready must-do fields \n",n_ready_must_do);
-       }
-      
-       if(verbose) {
-      fprintf(stderr,"get_next_field: %d must-do fields ready\n",n_ready_must_do);
-       }
-
-       time_left_min=10000.0;
-       i_min=-1;
-
-       for(i=0;i<num_fields;i++){
-     f=sequence+i;
-     if(f->status==READY_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE){
-        n_left=f->n_required-f->n_done;
-        if((f->n_required==6||n_left==n_left_min_must_do)&&f->time_left<time_left_min){
-         i_min=i;
-         time_left_min=f->time_left;
-        }
-     }
-       }
-
-       if(verbose){
-      fprintf(stderr,"get_next_field: returning ready must-do field : %d\n",i_min);
-       }
-       (sequence+i_min)->selection_code = LEAST_TIME_READY_MUST_DO;
-       return(i_min);
-
-     }
-
-      /* If there are MUST-DO fields with TOO_LATE_STATUS, choose the one
-    that has the least time left.  Shorten the interval so 
-    that time_left=0.  If still doable, choose this field*/
-
-     if (n_late_must_do>0){
-    if(verbose1){
-       fprintf(stderr,"get_next_field: checking %d too-late must-do fields \n",n_late_must_do);
-    }
-
-    if(verbose1) {
-      fprintf(stderr,"get_next_field: %d must-do late fields\n",n_late_must_do);
-    }
-
-    i_min=-1;
-    time_left_min=10000.0;
-    for(i=0;i<=num_fields;i++){
-      f=sequence+i;
-      if(f->status==TOO_LATE_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE&&f->time_left<time_left_min){
-          time_left_min=f->time_left;
-          i_min=i;
-      }
-    }
-
-    // This shouldn't happen
-    if(i_min<0){
-       fprintf(stderr,
-          "ERROR: get_next_field: n_late_must_do [%d] > 0 but non appear in the field list\n",
-          n_late_must_do);
-       fflush(stdout);
-       fflush(stderr);
-       //return(-1);
-    }
-       
-    if(verbose1){
-       fprintf(stderr,
-        "get_next_field: choosing field %d to shorten intervals\n",
-         i_min);
-    }
-       
-    f=sequence+i_min;
-    shorten_interval(f);
-    update_field_status(f,jd,bad_weather);
-
-    if(verbose1){
-       fprintf(stderr,
-          "get_next_field: interval shortened to %10.6f\n",
-          f->interval*3600.0);
-    }
-    if(verbose1){
-      fprintf(stderr,"get_next_field: returning late must-do field : %d\n",i_min);
-    }
-    (sequence+i_min)->selection_code = LEAST_TIME_LATE_MUST_DO;
-    return(i_min);
-     }
-
- 
-     /* If there were fields with DO_NOW_STATUS, choose the first flat,
-    or else the first dark, or else the first field */
-
-     if(n_do_now>0){
-    if(verbose1){
-       fprintf(stderr,"get_next_field: checking %d do_now fields\n",n_do_now);
-    }
-
-    if(i_min_flat>=0){
-          if(verbose1){
-          fprintf(stderr,"get_next_field: returning i_min_flat: %d\n",i_min_flat);
-          }
-          (sequence+i_min_flat)->selection_code = FIRST_DO_NOW_FLAT;
-          return(i_min_flat);
-    }
-    else if(i_min_dark>=0){
-          if(verbose1){
-          fprintf(stderr,"get_next_field: returning i_min_dark: %d\n",i_min_dark);
-          }
-          (sequence+i_min_dark)->selection_code = FIRST_DO_NOW_DARK;
-          return(i_min_dark);
-    }
-    else{
-          if(verbose1){
-          fprintf(stderr,"get_next_field: returning i_min_do_now: %d\n",i_min_do_now);
-          }
-          (sequence+i_min_do_now)->selection_code = FIRST_DO_NOW;
-          return(i_min_do_now);
-    }
-     }
-  
-     /* if the pair to the previous fields is doable, choose the paired field */
-
-     if(f_prev!=NULL&&paired_fields(f_next,f_prev)&&f_next->doable){
-    if(verbose1){
-        fprintf(stderr,"get_next_field: checking for doable pair to previous field %d\n",i_prev);
-    }
-
-    if(verbose1){
-        fprintf(stderr,"get_next_field: field %d is paired with field %d \n",
-            i_prev+1,i_prev);
-    }
-    if(f_next->status==READY_STATUS){
-        if(verbose1){
-        fprintf(stderr,"get_next_field: returning paired field %d \n", i_prev+1);
-        }
-        (sequence+i_prev+1)->selection_code = FIRST_READY_PAIR;
-        return(i_prev+1);
-    }
-    else if(f_next->status==TOO_LATE_STATUS){
-      shorten_interval(f_next);
-      update_field_status(f_next,jd,bad_weather);
-      if(f_next->status==READY_STATUS){
-         if(verbose1){
-        fprintf(stderr,"get_next_field: returning late paired field %d \n", i_prev+1);
-         }
-         (sequence+i_prev+1)->selection_code = FIRST_LATE_PAIR;
-         return(i_prev+1);
-      }
-      else{
-         if(verbose1){
-           fprintf(stderr,"get_next_field: returning  not-ready paired field %d \n", i_prev+1);
-         }
-         (sequence+i_prev+1)->selection_code = FIRST_NOT_READY_LATE_PAIR;
-         return(i_prev+1);
-      }
-    }
-    else{
-         if(verbose1){
-           fprintf(stderr,
-          "get_next_field: returning paired field %d that is neither ready nor too late\n",
-          i_prev+1);
-         }
-         (sequence+i_prev+1)->selection_code = FIRST_NOT_READY_NOT_LATE_PAIR;
-         return(i_prev+1);
-    }
-     }
-
-     /* If there are fields with READY_STATUS, choose the one 
-    that has least time left to complete the required observations */
-
-     if(n_ready>0){
-     if(verbose1){
-        fprintf(stderr,"get_next_field: checking %d ready fields \n",n_ready);
-     }
-    
-     time_left_min=10000.0;
-     i_min=-1;
-
-     for(i=0;i<num_fields;i++){
-       f=sequence+i;
-       if(f->status==READY_STATUS){
-          n_left=f->n_required-f->n_done;
-          if(n_left==n_left_min&&f->time_left<time_left_min){
-           i_min=i;
-           time_left_min=f->time_left;
-          }
-       }
-     }
-     if(verbose1){
-        fprintf(stderr,"get_next_field: returning ready field : %d\n",i_min);
-     }
-
-     (sequence+i_min)->selection_code = LEAST_TIME_READY;
-     return(i_min);
-
-     }
-
-     /* If there are no observable fields ready to observe,  but there are
-    fields with TOO_LATE_STATUS, choose the first one with MUSTDO_SURVEY_CODE, or
-    else the field that has the most time left. Shorten the interval so 
-    that time_left=0.  If still doable, choose this field. Otherwise return -1 */
-
-     if (n_late>0){
-
-    if(verbose1){
-        fprintf(stderr,"get_next_field: checking %d late fields \n",n_late);
-    }
-
-    i_max=-1;
-    time_left_max=-1000;
-    for(i=0;i<=num_fields;i++){
-      f=sequence+i;
-      if(f->status==TOO_LATE_STATUS&&f->time_left>time_left_max){
-          time_left_max=f->time_left;
-          i_max=i;
-      }
-    }
-
-
-    if(i_max<0){
-       if(verbose1)fprintf(stderr,"get_next_field: No fields to shorten\n");
-       //return(-1);
-    } 
-    else{
-       
-      if(verbose1){
-         fprintf(stderr,
-          "get_next_field: choosing field %d to shorten intervals\n",
-           i_max);
-      }
-         
-      f=sequence+i_max;
-      shorten_interval(f);
-      update_field_status(f,jd,bad_weather);
-      if(f->status==READY_STATUS){
-
-         if(verbose1){
-        fprintf(stderr,
-           "get_next_field: interval shortened to %10.6f\n",
-           f->interval*3600.0);
-         }
-         (sequence+i_max)->selection_code = MOST_TIME_READY_LATE;
-         return(i_max);
-      }
-      else{
-         if(verbose1){
-        fprintf(stderr,
-           "get_next_field: could not shorten interval of field %d\n",
-           i_max);
-         }
-      }  // if (f->status==READY_STATUS
-    } //if(i_max<0){
- 
-     }  // if(n_late>0)
-
-     if(verbose) {
-    fprintf(stderr,"get_next_field: No fields to observe\n");
-     }
-     return(-1);
-
-}
-/*******************************************************/
-
-int paired_fields(Field *f1, Field *f2)
-{
-    double dra;
-
-    if(f1->shutter!=SKY_CODE||f2->shutter!=SKY_CODE)return(0);
-
-    /*dra=1.1*RA_STEP0/cos(f1->dec*DEG_TO_RAD);*/
-    dra=RA_STEP0/cos(f1->dec*DEG_TO_RAD);
-
-    if(f2->dec==f1->dec&&
-       fabs(clock_difference(f1->ra,f2->ra))<dra){
-    return(1);
-    }
-    else{
-    return(0);
-    }
-}
-
-/*******************************************************/
-
-/* shorten interval between exposures so that time_left=0. If new 
-   interval is less than MIN_INTERVAL, set doable to 0 */
-
-int shorten_interval(Field *f)
-{
-    double new_interval,new_time_required;
-
-
-    new_time_required=f->time_up;
-    new_interval = new_time_required/(f->n_required-f->n_done);
-    /*new_interval = f->interval/2.0;*/
-
-    if(new_interval>MIN_INTERVAL){
-       f->time_required=new_time_required;
-       f->interval=new_interval;
-       f->time_left=0;
-    }
-    else{
-       f->doable=0.0;
-    }
-
-    return(0);
-}
-
-/************************************************************/
-
-/* If not doable, already completed, or already set,  set doable flag to 0,
-   set status to NO_DOABLE_STATUS and return NOT_DOABLE_STATUS. 
-
-   If not yet risen or not yet ready to observe, don't change doable flag,
-   but still set status to NO_DOABLE_STATUS and return NOT_DOABLE_STATUS. 
-
-   For any dark, status to DO_NOW_STATUS and return status.
-
-   For focus, or flat ready to observe, set status to DO_NOW_STATUS if
-   the bad_weather flag is 0 and return status.
-
-   For any other field,  update time_required, time_up , and time left.
-   If time_left<0, keep doable = 1 but return TOO_LATE_STATUS.
-   Otherwise, this is field is observable. Return READY_STATUS 
-
-*/
-
-int  get_field_status_string(Field *f, char *string)
-{
-    switch (f->status){
-
-    case TOO_LATE_STATUS -1:
-      sprintf(string,"Too late");
-      break;
-    case NOT_DOABLE_STATUS -1:
-      sprintf(string,"Not doable");
-      break;
-    case READY_STATUS -1:
-      sprintf(string,"Ready");
-      break;
-    case DO_NOW_STATUS -1:
-      sprintf(string,"Do now");
-      break;
-    default:
-      sprintf(string,"Unknown status");
-      break;
-    }
-
-    return (0);
-}
-
-int update_field_status(Field *f, double jd, int bad_weather)
-{
-
-      /* Isn't doable */
-      if(f->doable==0){
-      f->status=NOT_DOABLE_STATUS;
-      return(NOT_DOABLE_STATUS);
-      }
-
-      /* Has been completed. */
-
-      else if(f->n_done==f->n_required){
-     f->doable=0; 
-     f->status=NOT_DOABLE_STATUS;
-     return(NOT_DOABLE_STATUS);
-      }
-    
-      /* hasn't risen yet */
-
-      else if(jd<f->jd_rise){
-     f->status=NOT_DOABLE_STATUS;
-     return(NOT_DOABLE_STATUS);
-      }
-
-      /* has already set 0 */
-
-      else if(jd>f->jd_set){
-     f->doable=0;
-     f->status=NOT_DOABLE_STATUS;
-     return(NOT_DOABLE_STATUS);
-      }
-
-      /* not yet time to reobserve */
-
-#if 1
-      else if (f->jd_next-jd>(MIN_EXECUTION_TIME/24.0)){
-#else
-      else if (f->jd_next-jd>f->interval/(2.0*24.0)){
-#endif
-        f->status=NOT_DOABLE_STATUS;
-        return(NOT_DOABLE_STATUS);
-      }
-
-
-      /* darks  and domes that  are ready to
-      observe get highest priority (DO_NOW_STATUS) */
-
-      else if (f->shutter==DARK_CODE||f->shutter==DOME_FLAT_CODE){
-        f->status=DO_NOW_STATUS;
-        return(DO_NOW_STATUS);
-      }
-
-
-      /* sky flats, focus and pointing_offsets fields  that are ready to
-     observe get highest priority (DO_NOW_STATUS)  as long as bad_weather flag is 0*/
-
-      else if (f->shutter==EVENING_FLAT_CODE||
-        f->shutter==MORNING_FLAT_CODE||f->shutter==FOCUS_CODE||
-        f->shutter==OFFSET_CODE){
-    if( !bad_weather){
-       f->status=DO_NOW_STATUS;
-       return(DO_NOW_STATUS);
-    }
-    else {
-       f->status=NOT_DOABLE_STATUS;
-       return(NOT_DOABLE_STATUS);
-    }
-      }      
-
-
-      /* Any other field is either ready to observe (READY_STATUS) or
-     too late to observe (TOO_LATE_STATUS ) */
-
-      else{
-
-      /* Update time_required, time_up , time left. */
-
-    f->time_required=(f->n_required-f->n_done)*f->interval;
-
-    /* time up is now to when the field sets */
-
-    f->time_up=(f->jd_set-jd)*24.0;
-
-    /* time left is time up - time required to finish the
-       observations.  */
-
-    f->time_left=f->time_up-f->time_required; 
-      
-    if(f->time_left<0){
-          f->status=TOO_LATE_STATUS;
-#if DEBUG
-  if ( f->field_number > 37 && f->field_number < 47 ){
-    fprintf(stderr,"update_field_status: field: %d jd: %12.6f time_required: %10.6f  jd_set: %12.6f time_up: %10.6f  time_left: %10.6f  status: %s\n",
-    f->field_number, jd, f->time_required, f->jd_set, f->time_up, f->time_left, "TOO_LATE");
-  }
-#endif
-          return(TOO_LATE_STATUS);
-    }
-    else{
-        f->status=READY_STATUS;
-#if DEBUG
-  if ( f->field_number > 37 && f->field_number < 47 ){
-    fprintf(stderr,"update_field_status: field: %d jd: %12.6f time_required: %10.6f  jd_set: %12.6f time_up: %10.6f  time_left: %10.6f  status: %s\n",
-    f->field_number, jd, f->time_required, f->jd_set, f->time_up, f->time_left, "READY_STATUS");
-  }
-#endif
-        return(READY_STATUS);
-    }
-      }
-}
-
-/************************************************************/
-
-/* initialize rise and set times for each field. Set 0 values for time,
-hour angle, and airmass of each oservation for each field. Set number
-done to 0. Determine which observations are doable, and initialize
-time_up, time_required, time_left, and jd_next */
-
-int init_fields(Field *sequence, int num_fields, 
-        Night_Times *nt, Night_Times *nt_5day,
-        Night_Times *nt_10day, Night_Times *nt_15day,
-        Site_Params *site, double jd,
-        Telescope_Status *tel_status)
-{
-    int i,j,n_observable,n_up_too_short,n_moon_too_close,n_never_rise;
-    int n_moon_too_close_later;
-    int n_same_ra;
-    Field *f;
-    double am,ha,time_up,time_required;
-    double dark_night_duration, whole_night_duration;
-    double ra_prev,current_epoch;
-    double max_airmass;
-    double max_hourangle;
-    double new_jd_start=0.0;
-    double new_lst_start=0.0;
-
-    n_up_too_short=0;
-    n_moon_too_close=0;
-    n_moon_too_close_later=0;
-    n_never_rise=0;
-    n_same_ra=1;
-    ra_prev=0.0;
-    
-    /* if initializing fields after jd_start, set jd_start to
-       current jd */
+    n_up_too_short=0;
+    n_moon_too_close=0;
+    n_moon_too_close_later=0;
+    n_never_rise=0;
+    n_same_ra=1;
+    ra_prev=0.0;
+    
+    /* if initializing fields after jd_start, set jd_start to
+       current jd */
 
     if (jd > nt->jd_start){
     new_jd_start = jd;
@@ -3067,12 +2493,13 @@ int init_fields(Field *sequence, int num_fields,
     f->n_done=0;
     f->status=0;
     f->selection_code = NOT_SELECTED;
+    init_field_trig(f);
     for(j=0;j<f->n_required;j++){
-       f->ut[j]=0.0;
-       f->jd[j]=0.0;
-       f->lst[j]=0.0;
-       f->ha[j]=0.0;
-       f->am[j]=0.0;
+       f->hist->ut[j]=0.0;
+       f->hist->jd[j]=0.0;
+       f->hist->lst[j]=0.0;
+       f->hist->ha[j]=0.0;
+       f->hist->am[j]=0.0;
     }
 
     if(verbose1){
@@ -3092,9 +2519,9 @@ int init_fields(Field *sequence, int num_fields,
     max_airmass=MAX_AIRMASS;
     max_hourangle=MAX_HOURANGLE;
     f->jd_rise=get_jd_rise_time(f->ra,f->dec,max_airmass,
-        max_hourangle, nt,site,&am, &ha);
+        max_hourangle, nt,site,NULL,NULL);
     f->jd_set=get_jd_set_time(f->ra,f->dec,max_airmass,
-        max_hourangle, nt,site,&am, &ha);
+        max_hourangle, nt,site,NULL,NULL);
     f->ut_rise = nt->ut_start + (f->jd_rise - nt->jd_start)*24.0;
     f->ut_set = nt->ut_start + (f->jd_set - nt->jd_start)*24.0;
     
@@ -3458,335 +2885,6 @@ f->ra,f->dec,nt->ra_moon,nt->dec_moon, dra,ddec,dmoon);
 
 /************************************************************/
 
-/* If object is already up at current jd, return current jd value.
-   If it rises before the end of the night, return with the rise time.
-   If it never rises, return -1
-*/
-
-double get_jd_rise_time(double ra,double dec, double max_am, double max_ha,
-       Night_Times *nt, Site_Params *site, double *am, double *ha)
-{
-    double lst,jd,current_jd,dt;
-
-    /* get lst, hour angle, jd, and airmass at start time of observing window.
-       If am is less than max_am and absolute value of ha is less than max_am, 
-       object is already up. Return with jd.
-       Otherwise, stepwise search from jd_start to jd_end to find the 
-       time when am < max_am and fabs(ha) < max_ha (the rise time)
-       If it never rises, return -1. Otherwise return the jd when it does.
-    */
-
-    lst=nt->lst_start;
-    jd=nt->jd_start;
-
-    current_jd = get_jd();
-
-
-    *ha=get_ha(ra,lst);
-    *am=get_airmass(*ha,dec,site);
-
-    if(verbose1){
-       fprintf(stderr,"jd_start: %12.6f  lst_start: %10.6f\n",jd,lst);
-       fprintf(stderr,"ra: %12.6f  dec: %12.6f\n",ra,dec);
-       fprintf(stderr,"ha: %10.6f   am: %10.6f\n",*ha,*am);
-    }
-
-    if (*am < max_am && fabs (*ha) < max_ha ) {
-       if(verbose1){
-      fprintf(stderr,"init am and ha within limits. returning with jd = %12.6f\n",jd);
-       }
-       return (jd);
-    }
-     
-    if(verbose1){
-       fprintf(stderr,"init_fields: searching for jd at rise time\n");
-    }
-
-      
-    while(jd<nt->jd_end&&(*am>max_am||fabs(*ha)>max_ha)){
-    jd=jd+(LST_SEARCH_INCREMENT/SIDEREAL_DAY_IN_HOURS);
-    lst=lst+LST_SEARCH_INCREMENT;
-    if(lst>24.0)lst=lst-24.0;
-    *ha=get_ha(ra,lst);
-    *am=get_airmass(*ha,dec,site);
-    //if(verbose1){
-    //    fprintf(stderr,"jd: %12.6f lst: %10.6f am: %10.6f ha: %10.6f\n",
-    //       jd,lst,*am,*ha);
-    //}
-    }
-
-    if(*am>max_am){
-       if(verbose1){
-      fprintf(stderr,"field never rises below am %10.6f\n",max_am);
-       }
-       return(-1.0);
-    }
-    else if(fabs(*ha)>max_ha){
-       if(verbose1){
-      fprintf(stderr,"field ha is always greater than  %10.6f\n",max_ha);
-       }
-       return(-1.0);
-    }
-    else{
-       if(verbose1){
-      dt = (jd-current_jd)*24.0;
-      fprintf(stderr,"field rises at jd  %10.6f (in %10.6f h)\n",jd,dt);
-       }
-       return(jd);
-    }
-     
-    
-}
-
-/************************************************************/
-
-
-double get_jd_set_time(double ra,double dec, double max_am, double max_ha,
-       Night_Times *nt, Site_Params *site, double *am, double *ha)
-{
-    double lst,jd;
-
-    /* get lst, hour angle, jd, and airmass at end time of observing window.
-       If am is less than max_am and absolute value of ha is less than
-       max_ha, object is still up. Return with jd.
-       Otherwise, stepwise search from jd_end to jd_start to find the 
-       set_time. If it sets before lst_start, return -1. 
-       Otherwise return the jd when the am gets above max_am or 
-       the ha gets above max_ha*/
-
-
-    lst=nt->lst_end;
-    jd=nt->jd_end;
-    *ha=get_ha(ra,lst);
-    *am=get_airmass(*ha,dec,site);
-
-    if (*am < max_am && fabs (*ha) < max_ha ) return (jd);
-
-   
-    while(jd>nt->jd_start&&(*am>max_am||fabs(*ha)>max_ha)){
-      lst=lst-LST_SEARCH_INCREMENT;
-      jd=jd-(LST_SEARCH_INCREMENT/SIDEREAL_DAY_IN_HOURS);
-      if(lst<0.0)lst=lst+24.0;
-      *ha=get_ha(ra,lst);
-      *am=get_airmass(*ha,dec,site);
-    }
-
-    if(*am>max_am){
-       return(-1.0);
-    }
-    else if(fabs(*ha)>max_ha){
-       return(-1.0);
-    }
-    else{
-       return(jd);
-    }
-     
-    
-}
-/************************************************************/
-
-/* Given two clock values (interval 0 to 24), return
-   their difference, h2 - h1, assuming there difference can not
-   be greater than 12 or less than -12 */
-
-double clock_difference(double h1,double h2)
-{
-   double dt;
-
-   dt = h2 - h1;
-   if(dt>12.0)dt=dt-24.0;
-   if(dt<-12.0)dt=dt+24.0;
-   
-   return (dt);
-}
-/************************************************************/
-
-double get_airmass(double ha, double dec, Site_Params *site) {
- 
-  double alt, az, am;
-
-  alt = altit(dec,ha,site->lat,&az);
-  if (alt <= 0) {
-     am=1000.0; /* below horizon */
-  }
-  else{
-     am = 1.0/sin(alt/DEGTORAD);
-  }
-  return(am);
-}
-                                                   
-
-/************************************************************/
-
-double get_ha(double ra, double lst) {
-  double ha;
- 
-  ha = lst - ra;
-  if (ha <= -12.0) {
-    ha += 24.0;
-  } else if (ha >= 12.0) {
-    ha -= 24.0;
-  }
-  return(ha);
-}
-
-/************************************************************/
-
-int load_sequence(char *script_name, Field *sequence)
-{
-
-    FILE *input;
-    int n,n_fields,line,n1;
-    char string[STR_BUF_LEN+1],*s_ptr,shutter_flag[3],s[256];
-    int string_length=0;
-    Field *f;
-
-    /* if file can not be opened for reading, return error. Otherwise
-     * load any new sequences
-    */
-
-    input=fopen(script_name,"r");
-    if (input==NULL){
-       fprintf(stderr,"load_sequence: can't open file %s\n",script_name);
-       return(-1);
-    }
-
-    n_fields=0;
-    line=0;
-    string[STR_BUF_LEN-1]=0;
-    while(fgets(string,STR_BUF_LEN,input)!=NULL){
-
-      line++;
-      // make sure last element if string is still 0. If not, the line read from the input is
-      // longer than buffer length (STR_BUF_LEN)
-      if(string[STR_BUF_LEN-1]!=0){
-      fprintf(stderr,"load_sequence: WARNING: sequence line [%d] is too long. Ignoring \n",line);
-      fflush(stderr);
-      string[STR_BUF_LEN-1]=0;
-      }
-      else{
-
-    /* get rid of leading spaces */
-    s_ptr=string;
-    while(strncmp(s_ptr," ",1)==0&&*s_ptr!=0)s_ptr++;
-
-    /* get length of string, starting at s_ptr */
-    string_length = strlen(s_ptr);
-
-    /* add a space to the end of s_ptr to make sure it is processed
-     * correctly by camera server
-    */
-
-    sprintf(s_ptr+string_length," ");
-    string_length++;
-
-    /* if there are more characters left in the string, and if the
-       current character is not "#", then read in the next line */
-
-     if (string_length<=1){
-       /* line too short, pass */
-       if(verbose){
-         fprintf(stderr,"WARNING: line [%d] is too short [%s]\n",line,s_ptr);
-       }
-     }
-     else if (strncmp(s_ptr,"#",1)==0){
-       /* comment line. pass */
-       if(verbose){
-         fprintf(stderr,"line [%d] is a commented out [%s]\n",line,s_ptr);
-       }
-     }
-     else if(strncmp(s_ptr,"FILTER",6) == 0 || strncmp(s_ptr,"filter",6)==0 ){
-       sscanf(s_ptr,"%s %s",s,filter_name);
-       filter_name_ptr=filter_name;
-       if(check_filter_name(filter_name)!=0){
-         fprintf(stderr,"WARNING: unexpeced filter name: %s",filter_name);
-       }
-     }
-     else{
-
-        f=sequence+n_fields;
-        f->field_number=n_fields;
-        f->line_number=line;
-        strcpy(f->script_line,string);
-
-        n=sscanf(s_ptr,"%lf %lf %s %lf %lf %d %d",
-          &(f->ra),&(f->dec),shutter_flag,&(f->expt),&(f->interval),
-          &(f->n_required),&(f->survey_code));
-
-        if (f->survey_code == LIGO_SURVEY_CODE)f->survey_code = MUSTDO_SURVEY_CODE;
-        f->interval=f->interval/3600.0;
-        f->expt=f->expt/3600.0;
-
-        f->shutter=get_shutter_code(shutter_flag);
-
-        /* if this is a focus field, read the focus start, increment, and
-           default setting from the script line */
-
-        if(f->shutter==FOCUS_CODE){
-           sscanf(s_ptr,"%s %s %s %s %s %s %s %lf %lf",
-          s,s,s,s,s,s,s,&focus_increment,&focus_default);
-           n1 = f->n_required/2;
-           focus_start=focus_default-n1*focus_increment;
-           if(verbose){
-          fprintf(stderr,
-              "load_sequence: focus start, incr, default: %8.5f %8.5f %8.5f\n",
-              focus_start,focus_increment,focus_default);
-         fflush(stderr);
-           }
-          
-        }
-
-        /* if the focus parameters are out of range for a focus field
-           skip the field */
-
-        if(f->shutter==FOCUS_CODE&&
-           (focus_start<MIN_FOCUS||focus_increment<MIN_FOCUS_INCREMENT||
-          focus_start>MAX_FOCUS||focus_increment>MAX_FOCUS_INCREMENT||
-          focus_start+(f->n_required*focus_increment)>MAX_FOCUS)){
-           fprintf(stderr,"focus parameters out of range: %s",s_ptr);
-        }
-
-         /* Also make sure 6 parameters are read from the line, and that
-           the parameters are within range. If not, skip this field. */
-
-        else if(n!=7||f->ra<0.0||f->ra>24.0||f->dec<-90.0||f->dec>90.0||
-          f->expt>MAX_EXPT||f->expt<0||
-          f->interval>MAX_INTERVAL||f->interval<MIN_INTERVAL||f->n_required<1||
-          f->n_required>MAX_OBS_PER_FIELD||f->shutter==BAD_CODE||
-          f->survey_code<MIN_SURVEY_CODE||f->survey_code>MAX_SURVEY_CODE){
-           fprintf(stderr,"load_sequence: bad field line %d: %s\n",
-          line,string);
-        }
-
-        /* Accept the field */
-
-        else{
-           n_fields++;
-        }
-     } //if (strlen<=1){
-      } //if(string[STR_BUF_LEN-1]!=0{
-    } //while(fgets(string,STR_BUF_LEN,input)!=NULL){
-
-    fclose(input);
-
-    return(n_fields);
-
-}
-/************************************************************/
-
-/* if name is an expected filter name (see  FILTER_NAME in scheduler.h)
- * return 0. Otherwise return -1
-*/
-
-int check_filter_name(char *name)
-{
-    for (enum Filter_Index i =1; i<= NUM_FILTERS; i++){
-      if(strcmp(name, FILTER_NAME[i-1]) == 0) return(0);
-    }
-    return(-1);
-}
-/************************************************************/
-
 int print_field_status (Field *f, FILE *output)
 {
     int i;
@@ -3804,19 +2902,19 @@ int print_field_status (Field *f, FILE *output)
     fprintf(output,"Required : %d  Done: %d Interval : %10.6f LSTs : ",
         f->n_required,f->n_done,f->interval);
     for(i=0;i<f->n_done;i++){
-    fprintf(output,"%10.6f ",f->lst[i]);
+    fprintf(output,"%10.6f ",f->hist->lst[i]);
     }
 #if 0
     fprintf(output," dLSTs: ");
     for(i=1;i<f->n_done;i++){
-    dt=f->lst[i]-f->lst[i-1];
+    dt=f->hist->lst[i]-f->hist->lst[i-1];
     if(dt<0.0)dt=dt+24.0;
     fprintf(output,"%10.6f ",dt);
     }
 #endif
     fprintf(output," HAs: ");
     for(i=0;i<f->n_done;i++){
-    fprintf(output,"%10.6f ",f->ha[i]);
+    fprintf(output,"%10.6f ",f->hist->ha[i]);
     }
 
 
@@ -11,10 +11,12 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <math.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "sky_utils.h"
 #include "socket.h"
 #include "scheduler_camera.h"
@@ -29,6 +31,8 @@
 //#define UT_OFFSET 0.00 /* ut offset for debugging */
 #define DEEP_DITHER_ON 0 /* turn on dithering for deep coadds */
 #
+#define PARALLEL_STATUS_QUERIES 1 /* set to 1 to send the telescope status
+                                     queries all at once, 0 for one at a time */
 #define USE_TELESCOPE_OFFSETS 0 /* change to 1 to use telescope_offsets file for offset */
 
 #define DEBUG 0
@@ -52,16 +56,63 @@
 #define SELECTED_FIELDS_FILE "fields.completed"
 #define LOG_OBS_FILE "log.obs"
 #define OBS_RECORD_FILE "scheduler.bin"  /* binary record of fields */
+#define OBS_RECORD_MAGIC "LS4OBSRC" /* first 8 bytes of OBS_RECORD_FILE */
+#define OBS_RECORD_VERSION 1 /* increment when the record layout changes */
+#define OBS_RECORD_BYTE_ORDER 0x01020304 /* written in host order, to catch
+                                            records from other-endian hosts */
+#define OBS_COLUMN_NAME_LENGTH 16 /* length of column names in OBS_RECORD_FILE */
+#define OBS_COLUMN_INT 1 /* column of 32-bit ints */
+#define OBS_COLUMN_DOUBLE 2 /* column of IEEE doubles */
+#define OBS_COLUMN_CHAR 3 /* column of fixed-length strings */
+#define OBS_JOURNAL_FILE "scheduler.jnl"  /* changes to fields since OBS_RECORD_FILE */
+#define OBS_JOURNAL_HEADER_MAGIC "LS4OBSJN" /* first 8 bytes of OBS_JOURNAL_FILE */
+#define OBS_JOURNAL_VERSION 1 /* increment when the journal header or the
+                                 record prefix changes */
+#define OBS_JOURNAL_MAGIC 0x4c53344a /* first word of each journal record */
+#define OBS_JOURNAL_MAX_COLUMNS 4096 /* sanity limit on the journal column table */
+#define OBS_SNAPSHOT_RECORDS 500 /* rewrite OBS_RECORD_FILE after this many
+                                    journal records */
 
 #define DEGTORAD 57.29577951 /* 180/pi */
 //#define LST_SEARCH_INCREMENT 0.0166 /* 1 minute in hours */
 #define LST_SEARCH_INCREMENT 0.00166 /* 1 minute in hours */
+#define ANALYTIC_RISE_SET 1 /* set to 1 to solve field rise/set times from the
+                               limiting hour angle, 0 for stepwise LST search */
 #define FAKE_RUN_TIME_STEP  0.0167 /* 1 minute in hours */
+#define LOOP_WAIT_SEC 10 /* seconds to wait between loops if no
+               field selected */
+#define MAX_IDLE_WAIT_SEC 600 /* longest wait for the next field status
+                                 change when no field is ready */
+#define MIN_IDLE_WAIT_SEC 1 /* shortest such wait */
+#define WAKE_TIMER 1 /* wait_for_event ran to the end of the wait */
+#define WAKE_SIGNAL 2 /* a signal handler called wake_scheduler */
+#define WAKE_ADD_FILE 4 /* the .add script changed */
+
+#define TEL_STATUS_DOME 1 /* Telescope_Status.valid bits */
+#define TEL_STATUS_LST 2
+#define TEL_STATUS_FOCUS 4
+#define TEL_STATUS_POSITION 8
+#define TEL_STATUS_WEATHER 16
+#define TEL_STATUS_REQUIRED (TEL_STATUS_DOME|TEL_STATUS_LST) /* update fails
+                                     without these */
+#define TEL_STATUS_RETRIES 2 /* times get_fresh_telescope_status reads the
+                                status again for a missing value */
+#define TELEMETRY_PERIOD_SEC 5.0 /* seconds between telescope status
+                                    refreshes by the telemetry thread */
+#define TELEMETRY_RETRY_SEC 30.0 /* seconds between refreshes while the
+                                    controller does not answer */
+#define TELEMETRY_WAIT_SEC 600.0 /* longest wait for a requested refresh */
+#define STATUS_MAX_AGE_SEC 10.0 /* oldest telescope status used for
+                                   scheduling and weather checks */
 
 #define MAX_AIRMASS 2.0
+#define BELOW_HORIZON_AIRMASS 1000.0 /* airmass returned for fields below horizon */
+#define AIRMASS_TABLE_BLOCK 512 /* initial number of entries in an Airmass_Table */
+#define VISIBILITY_SLOT_MINUTES 1.0 /* length of a slot in a Visibility_Table */
+#define VISIBILITY_TABLE_BLOCK 512 /* initial number of fields in a Visibility_Table */
 #define MAX_HOURANGLE 4.3
 #define MAX_OBS_PER_FIELD 100 /* maximum number of observations per field */
-#define MAX_FIELDS 500  /* maximum number of fields per script */
+#define FIELD_TABLE_BLOCK 512  /* initial number of fields in a Field_Table */
 #define OBSERVATORY_SITE "La Silla"
 #define MAX_EXPT 1000.0
 #define MAX_INTERVAL (43200.0/3600.0)
@@ -81,6 +132,9 @@
 #define MAX_FOCUS_CHANGE 0.3 /* maximum change from expected default mm */
 #define MIN_MOON_SEPARATION 15.0 /* minimum pointing separation (deg) from moon */
 #define MAX_BAD_READOUTS 3 /* quit trying exposure after this many bad readouts */
+#define RUN_CONTINUE 0 /* check_readout: leave the exposure run open */
+#define RUN_END 1 /* end the exposure run and wait for its last image */
+#define RUN_END_NOWAIT 2 /* end the exposure run, but don't wait */
 #ifdef POINTING_TEST
 #define LONG_EXPTIME (60.0/3600.0) /* expsure time longer than this must be split into
 				       shorter exposure times west of the meridian */
@@ -124,6 +178,64 @@
 #define READY_STATUS 1
 #define DO_NOW_STATUS 2
 
+#define DEFAULT_SELECTION_POLICY "reference" /* field selection policy used if
+                                 SELECTION_POLICY is not set (scheduler_policy.c) */
+#define FIELD_EVENTS_BLOCK 512 /* initial number of fields in Field_Events */
+
+#define SLEW_COST_ON 1 /* set to 1 for the reference policy to choose the nearest
+                          of the ready fields whose time left is within
+                          SLEW_TIE_HOURS of the least (scheduler_slew.c). 0 to
+                          take the least time left */
+#define SLEW_TIE_HOURS 0.05 /* ready fields with this much more time left than
+                               the least are taken as equally urgent */
+#define SLEW_COST_WEIGHT 1.0 /* hours of time left traded per hour of slew */
+#define MAX_SLEW_CANDIDATES 32 /* most ready fields compared by slew time */
+#define SLEW_RATE_HA 1.0 /* initial slew rates (deg/sec) and settling time (sec) */
+#define SLEW_RATE_DEC 1.0
+#define SLEW_SETTLE_SEC 10.0
+#define SLEW_RATE_MIN 0.05 /* range of fitted slew rates (deg/sec) */
+#define SLEW_RATE_MAX 20.0
+#define SLEW_FIT_SAMPLES 50.0 /* slews remembered by the fit */
+#define SLEW_FIT_MIN_SAMPLES 3.0 /* slews needed on an axis to fit it */
+#define SLEW_FIT_MIN_DEG 1.0 /* spread in distance (deg) needed to fit an axis */
+#define SLEW_FIT_MAX_SEC 600.0 /* longer pointings (e.g. retries) are not fit */
+
+#define LOOKAHEAD_MAX_DEPTH 8 /* most selections simulated ahead by get_next_field
+                                 (scheduler_lookahead.c). The depth is set by the
+                                 LOOKAHEAD_DEPTH environment variable, 0 (the
+                                 default) for no lookahead */
+#define LOOKAHEAD_BEAM 8 /* sequences kept at each depth of the lookahead */
+#define LOOKAHEAD_BRANCH 4 /* fields tried after each sequence */
+#define LOOKAHEAD_FIELDS 64 /* most urgent fields simulated by the lookahead */
+#define LOOKAHEAD_READOUT_FRACTION 0.5 /* fraction of the readout time the
+                                          lookahead may take */
+#define LOOKAHEAD_MAX_SEC 2.0 /* and at most this many seconds */
+#define LOOKAHEAD_COMPLETION_BONUS 1.0 /* score (visits) of each field completed */
+#define LOOKAHEAD_LATE_PENALTY 2.0 /* score lost for each field that goes too
+                                      late or sets unfinished */
+#define LOOKAHEAD_MUSTDO_PENALTY 100.0 /* score lost for each such must-do field */
+#define LOOKAHEAD_DEFAULT_DEPTH 4 /* depth of the lookahead policy if
+                                     LOOKAHEAD_DEPTH is not set */
+
+/* replay of a night (scheduler_replay.c) */
+#define REPLAY_ADD_DEFAULT_HOURS 2.0 /* hours after sunset a replay adds the
+                                       fields of REPLAY_ADD_FILE */
+
+/* whole-night plan of the planned policy (scheduler_plan.c) */
+#define PLAN_ITERATIONS 20000 /* most local search steps when solving a plan */
+#define PLAN_MAX_SEC 10.0 /* and at most this many seconds, except when
+                             solved offline or in a replay */
+#define PLAN_SEED 1 /* seed of the local search, so plans can be repeated */
+#define PLAN_OFFSET_STEP 0.25 /* hours a step moves the urgency of a field */
+#define PLAN_MUSTDO_WEIGHT 100.0 /* score of each must-do field completed */
+#define PLAN_PAIR_BONUS 0.5 /* score of each pair with both fields completed */
+#define PLAN_WASTE_PENALTY 1.0 /* score lost per field of visits made to
+                                  fields left unfinished */
+#define PLAN_FRACTION_WEIGHT 1.0 /* score lost per field of difference from the
+                                    PLAN_FRACTIONS of survey codes 0, 1, 2 */
+#define PLAN_REPAIR_WINDOW 8 /* upcoming visits of the plan get_next_field
+                                may take out of order */
+
 /* nominal focus start, increment, and default setting (mm) */
 #define NOMINAL_FOCUS_START 25.30
 #define NOMINAL_FOCUS_INCREMENT 0.05
@@ -137,13 +249,30 @@
 // selection codes set by get_next_field()
 enum Selection_Code {NOT_SELECTED,FIRST_DO_NOW_FLAT, FIRST_DO_NOW_DARK, FIRST_DO_NOW, FIRST_READY_PAIR, FIRST_LATE_PAIR,
       FIRST_NOT_READY_LATE_PAIR, FIRST_NOT_READY_NOT_LATE_PAIR, LEAST_TIME_LATE_MUST_DO,
-      LEAST_TIME_READY_MUST_DO, LEAST_TIME_READY, MOST_TIME_READY_LATE};
+      LEAST_TIME_READY_MUST_DO, LEAST_TIME_READY, MOST_TIME_READY_LATE,
+      NEAREST_READY, LOOKAHEAD_READY, PLANNED_READY};
 
 // define accepted filter names and enumerate an index for each filter name
 #define FILTER_NAME (const char*[]) { "rgzz", "none", "fake", "clear", NULL }
 enum Filter_Index { RGIZ_INDEX, NONE_INDEX, FAKE_INDEX, CLEAR_INDEX, NUM_FILTERS };
 
 
+/* script text and observation history of a field. These are only
+   touched when a field is loaded, observed, or printed, so they are
+   kept out of Field, which holds the scheduling state read on every
+   selection */
+
+typedef struct {
+    char script_line[STR_BUF_LEN];    
+    double ut[MAX_OBS_PER_FIELD]; /* ut (hours) of completed obs (start time) */
+    double jd[MAX_OBS_PER_FIELD]; /* lst (hours) of completed obs */
+    double lst[MAX_OBS_PER_FIELD]; /* lst (hours) of completed obs */
+    double ha[MAX_OBS_PER_FIELD]; /* hour angle (hours) of completed obs  */
+    double am[MAX_OBS_PER_FIELD]; /* airmass of completed obs  */
+    double actual_expt[MAX_OBS_PER_FIELD]; /* actual exposure time (hours) of obs*/
+    char filename[FILENAME_LENGTH*MAX_OBS_PER_FIELD]; /* filename prefix */
+} Field_History;
+
 typedef struct {
     int status; /* 0 if not doable, 2 if must observe pronto, 1 if ready to observe,
                    -1 if not enough time to observe remaining fields */
@@ -151,9 +280,10 @@ typedef struct {
     enum Selection_Code selection_code;
     int field_number;
     int line_number;
-    char script_line[STR_BUF_LEN];    
     double ra; /* hours */
     double dec; /*deg */
+    double sin_dec; /* sin(dec), cached by init_field_trig */
+    double cos_dec; /* cos(dec), cached by init_field_trig */
     double gal_long; /*deg*/
     double gal_lat; /* deg */
     double ecl_long; /* deg */
@@ -176,15 +306,44 @@ typedef struct {
                              remaining observations */
     double time_left; /* time remaining (hours) before time_required 
                          exceeds time_up -- i.e. time_up-time_required */
-    double ut[MAX_OBS_PER_FIELD]; /* ut (hours) of completed obs (start time) */
-    double jd[MAX_OBS_PER_FIELD]; /* lst (hours) of completed obs */
-    double lst[MAX_OBS_PER_FIELD]; /* lst (hours) of completed obs */
-    double ha[MAX_OBS_PER_FIELD]; /* hour angle (hours) of completed obs  */
-    double am[MAX_OBS_PER_FIELD]; /* airmass of completed obs  */
-    double actual_expt[MAX_OBS_PER_FIELD]; /* actual exposure time (hours) of obs*/
-    char filename[FILENAME_LENGTH*MAX_OBS_PER_FIELD]; /* filename prefix */
+    Field_History *hist; /* script line and completed obs (see Field_Table) */
 } Field;
 
+/* growable array of fields. Indices are stable; the arrays themselves
+   may move when fields are added (see scheduler_fields.c). history[i]
+   is the Field_History of fields[i] */
+
+typedef struct {
+    int num_fields;        /* number of fields in use */
+    int max_fields;        /* number of fields allocated */
+    Field *fields;
+    Field_History *history;
+} Field_Table;
+
+/* position reached in a script that is being appended to (see
+   tail_sequence) */
+
+typedef struct {
+    char file_name[STR_BUF_LEN];
+    long offset;           /* bytes read, up to the end of the last line */
+    int line;              /* lines read */
+    unsigned long hash;    /* of the bytes read */
+    long partial_size;     /* file size when an unfinished last line was
+                              left unread, 0 if none */
+    ino_t inode;           /* identity of the file read */
+    dev_t device;
+} Script_Tail;
+
+/* descriptors the main loop waits on when idle (see scheduler_wait.c) */
+
+typedef struct {
+    int inotify_fd;        /* -1 if inotify not available */
+    int watch;             /* watch descriptor of dir_name */
+    int timer_fd;          /* -1 if timerfd not available */
+    char dir_name[STR_BUF_LEN];  /* directory of the .add script */
+    char file_name[STR_BUF_LEN]; /* name of the .add script in dir_name */
+} Wait_Events;
+
 /*  site-specific parameters  */
 
 typedef struct {
@@ -201,9 +360,176 @@ typedef struct {
     double elev;           /* well, sorta -- height above horizon */
     double horiz;
     double stdz;           /* standard time zone offset, hours */
+    double sin_lat;        /* sin(lat), cached by init_site_trig */
+    double cos_lat;        /* cos(lat), cached by init_site_trig */
 
 } Site_Params;
 
+/* ra, sin/cos(dec) of a field table in separate columns (entry i is
+   field i), and the hour angle and airmass of each field at lst, as
+   filled by update_airmass_table */
+
+typedef struct {
+    int num_fields;        /* number of entries in use */
+    int max_fields;        /* number of entries allocated */
+    double sin_lat;        /* cached from Site_Params */
+    double cos_lat;
+    double lst;            /* lst (hours) of last update, -1 if none */
+    double *ra;            /* hours */
+    double *sin_dec;
+    double *cos_dec;
+    double *ha;            /* hours, -12 to +12 */
+    double *am;            /* airmass, BELOW_HORIZON_AIRMASS if not up */
+} Airmass_Table;
+
+/* for each field of a table (entry i is field i), one bit per slot of
+   the night from sunset to sunrise, set if the field can be observed
+   throughout the slot (see scheduler_visibility.c) */
+
+typedef struct {
+    int num_fields;        /* number of fields in use */
+    int max_fields;        /* number of fields allocated */
+    int max_words;         /* number of words allocated */
+    int n_slots;           /* slots in the night */
+    int n_words;           /* words per field */
+    double jd0;            /* start of slot 0 (sunset) */
+    double slot_days;      /* length of a slot (days) */
+    uint64_t *bits;        /* field i at bits+i*n_words, slot k at bit k */
+} Visibility_Table;
+
+/* OBS_RECORD_FILE starts with an Obs_Record_Header, followed by
+   num_columns Obs_Record_Column entries, each describing one value
+   (or fixed-length array of values) stored for every field. The data
+   of each column follow, 8-byte aligned, num_fields*count*size bytes
+   each (see scheduler_record.c) */
+
+typedef struct {
+    char magic[8];         /* OBS_RECORD_MAGIC, not terminated */
+    int32_t version;       /* OBS_RECORD_VERSION of the writer */
+    int32_t byte_order;    /* OBS_RECORD_BYTE_ORDER */
+    int32_t header_size;   /* bytes in header, where column table starts */
+    int32_t column_size;   /* bytes in each column table entry */
+    int32_t num_columns;
+    int32_t num_fields;
+    int32_t generation;    /* journal generation of this snapshot */
+    int32_t journal_record_size; /* bytes per journal record of the writer
+                                    (see Obs_Journal_Header) */
+    int32_t year;          /* time of the snapshot, as in struct tm */
+    int32_t month;
+    int32_t day;
+    int32_t hour;
+    int32_t minute;
+    int32_t second;
+} Obs_Record_Header;
+
+typedef struct {
+    char name[OBS_COLUMN_NAME_LENGTH]; /* name of the Field or Field_History
+                                          member */
+    int32_t type;          /* OBS_COLUMN_INT, OBS_COLUMN_DOUBLE, OBS_COLUMN_CHAR */
+    int32_t size;          /* bytes per value */
+    int32_t count;         /* values per field */
+    int32_t spare;
+    int64_t offset;        /* bytes from start of file to column data */
+} Obs_Record_Column;
+
+/* OBS_JOURNAL_FILE starts with an Obs_Journal_Header, followed by
+   num_columns Obs_Record_Column entries, each describing one value
+   stored in every record, at offset bytes from the start of the
+   record. Records of record_size bytes follow: an Obs_Journal_Record,
+   the column values, and a 32-bit checksum of the bytes before it
+   (see scheduler_record.c) */
+
+typedef struct {
+    char magic[8];         /* OBS_JOURNAL_HEADER_MAGIC, not terminated */
+    int32_t version;       /* OBS_JOURNAL_VERSION of the writer */
+    int32_t byte_order;    /* OBS_RECORD_BYTE_ORDER */
+    int32_t header_size;   /* bytes in header, where column table starts */
+    int32_t column_size;   /* bytes in each column table entry */
+    int32_t num_columns;
+    int32_t record_size;   /* bytes in each record, checksum included */
+} Obs_Journal_Header;
+
+/* start of one change to a field, appended to OBS_JOURNAL_FILE */
+
+typedef struct {
+    int32_t magic;         /* OBS_JOURNAL_MAGIC */
+    int32_t generation;    /* generation of the snapshot this record follows */
+    int32_t index;         /* index of field in sequence */
+    int32_t slot;          /* observation slot recorded, -1 for none */
+} Obs_Journal_Record;
+
+typedef struct {
+    char record_file[STR_BUF_LEN];  /* snapshot */
+    char journal_file[STR_BUF_LEN];
+    FILE *journal;         /* open for appending */
+    int generation;        /* generation of last snapshot */
+    int num_records;       /* records since last snapshot */
+    int max_fields;
+    int *n_journaled;      /* exposures of each field already journaled */
+} Obs_Journal;
+
+/* heap of field indices ordered on (key1, key2, index). pos, key1 and key2
+   are indexed by field index. Used by scheduler_events.c */
+
+typedef struct {
+    int n;                 /* number of fields in heap */
+    int *item;             /* field indices in heap order */
+    int *pos;              /* position of each field in item, -1 if absent */
+    double *key1;
+    double *key2;
+} Field_Heap;
+
+/* unordered set of field indices */
+
+typedef struct {
+    int n;
+    int *item;
+    int *pos;              /* position of each field in item, -1 if absent */
+} Field_Set;
+
+/* pending status changes and candidate sets for get_next_field
+   (see scheduler_events.c) */
+
+typedef struct {
+    int num_fields;        /* number of fields tracked */
+    int max_fields;        /* number of fields allocated */
+    int initialized;       /* 0 until first update */
+    int bad_weather;       /* bad_weather flag at last update */
+    double jd;             /* jd of last update */
+    double jd_ref;         /* reference jd for deadlines, set on first update */
+    Field_Heap events;     /* key1 = jd of next possible status change */
+    Field_Heap ready;      /* READY, not must-do. key1 = n_left, key2 = deadline */
+    Field_Heap late;       /* TOO_LATE, not must-do. key1 = -deadline */
+    Field_Set do_now;      /* DO_NOW */
+    Field_Set ready_must_do; /* READY, must-do */
+    Field_Set late_must_do;  /* TOO_LATE, must-do */
+} Field_Events;
+
+/* how get_next_field chooses among the ready fields, as set by a
+   selection policy */
+
+typedef struct {
+    int slew_cost_on;      /* break ties by slew time */
+    int lookahead_depth;   /* selections simulated ahead, 0 for none */
+    int follow_plan;       /* take ready fields from the whole-night plan */
+} Selection_Settings;
+
+/* a way of choosing the next field (see scheduler_policy.c) */
+
+typedef struct {
+    char *name;
+    char *description;
+    int (*init)(Selection_Settings *s, Field_Events *e, Field *sequence,
+                int num_fields, double jd);
+    void (*status_changed)(Field_Events *e, int i);
+    int (*pick)(Selection_Settings *s, Field_Events *e, Field *sequence,
+                int num_fields, int i_prev, double jd, int bad_weather);
+    void (*observed)(Field_Events *e, Field *sequence, int i, double jd);
+    int (*fields_added)(Field_Events *e, Field *sequence, int num_fields,
+                double jd);
+    Selection_Settings settings; /* given to pick. init may change them */
+} Selection_Policy;
+
 typedef struct{
     double temperature;
     double humidity;
@@ -224,7 +550,9 @@ typedef struct {
     double ra_offset; /* Correction to RA pointing in degrees */
     double dec_offset; /* Correction to Dec  pointing in degrees */
     Weather_Info weather;
-    double update_time;
+    double update_time; /* system time (sec) when the values were read */
+    int valid; /* TEL_STATUS_ bits of the values read on the last update.
+                  Other values are left from earlier updates */
 } Telescope_Status;
 
 typedef struct {
@@ -275,6 +603,7 @@ typedef struct {
 typedef struct{
      char keyword[256];
      char value[256];
+     int changed; /* 1 if value has not been sent to the camera */
 } Fits_Word;
 
 typedef struct {
@@ -350,20 +679,15 @@ typedef struct {
 #define MORNING_FLAT_TYPE "amskyflat"
 #define DOME_FLAT_TYPE "domeskyflat"
 
-int add_new_fields(Field *sequence, int num_fields,
-		Field *new_sequence, int num_new_fields);
+int add_new_fields(Field_Table *table, Field *new_sequence,
+		int num_new_fields);
 
-int load_obs_record(char *file_name, Field *sequence, FILE **obs_record);
-int save_obs_record(Field *sequence, FILE *obs_record, int num_fields,
-         struct tm *tm);
 
 int adjust_date(struct date_time *date, int n_days);
 
 int init_night(struct date_time date, Night_Times *nt, 
                       Site_Params *site, int print_flag);
 
-int load_sequence(char *script_name, Field *sequence);
-
 int check_weather(FILE *input, double jd, 
 			struct date_time *date, Night_Times *nt);
 
@@ -374,6 +698,8 @@ int observe_next_field(Field *sequence, int index, int index_prev,
 		Night_Times *nt, bool wait_flag, FILE *output,
 		Telescope_Status *tel_status,Camera_Status *cam_status,
                 Fits_Header *fits_header, char *exp_mode);
+int check_readout(Field *f_prev, double jd, Camera_Status *cam_status, int run_end);
+int undo_lost_run_image(double jd);
 
 int do_stop(double ut,Telescope_Status *status);
 
@@ -388,29 +714,6 @@ int init_fields(Field *sequence, int num_fields,
 
 int moon_interference(Field *f, Night_Times *nt, double separation);
 
-double get_jd_rise_time(double ra,double dec, double max_am, double max_ha,
-       Night_Times *nt, Site_Params *site, double *am, double *ha);
-
-double get_jd_set_time(double ra,double dec, double max_am, double max_ha,
-       Night_Times *nt, Site_Params *site, double *am, double *ha);
-
-double get_airmass(double ha, double dec, Site_Params *site);
-
-double get_ha(double ra, double lst);
-
-double clock_difference(double h1,double h2);
-
-int get_next_field(Field *sequence,int num_fields, int i_prev, double jd,
-                    int bad_weather);
-
-int paired_fields(Field *f1, Field *f2);
-
-int update_field_status(Field *sequence, double jd, int bad_weather);
-int  get_field_status_string(Field *f, char *string);
-
-
-int shorten_interval(Field *f);
-
 int print_field_status (Field *f, FILE *output);
 
 int print_history(double lst,Field *sequence, int num_fields,FILE *output);
@@ -423,14 +726,30 @@ int do_exit(int code);
 
 int get_shutter_string(char *string, int shutter, char *description);
 
-int get_shutter_code(char *string);
-
 int advance_tm_day(struct tm *tm);
 
 int leap_year_check(int year);
 
+/* from scheduler_script.c */
+int load_sequence(char *script_name, Field_Table *table);
+int parse_sequence_line(char *string, int line, Field *f);
+int init_script_tail(Script_Tail *tail, char *script_name);
+int tail_sequence(Script_Tail *tail, Field_Table *table);
+int get_shutter_code(char *string);
 int check_filter_name(char *name);
 
+/* from scheduler_select.c */
+int get_next_field(Selection_Settings *s, Field_Events *events,
+                    Field *sequence,int num_fields, int i_prev, double jd,
+                    int bad_weather);
+int scan_next_field(Selection_Settings *s, Field *sequence,int num_fields,
+                    int i_prev, double jd, int bad_weather);
+int paired_fields(Field *f1, Field *f2);
+int shorten_interval(Field *f);
+int get_field_status_string(Field *f, char *string);
+int update_field_status(Field *sequence, double jd, int bad_weather);
+double clock_difference(double h1,double h2);
+
 /* from scheduler_telescope.c */
 int init_telescope_offsets(Telescope_Status *status);
 int get_telescope_offsets(Field *f, Telescope_Status *status);
@@ -450,9 +769,9 @@ int get_telescope_focus (double *focus);
 
 
 /* from scheduler_camera.c */
-double init_readout_time(int amp_dir_code);
+double init_cam_readout_time(char *amp_direction);
 
-int init_semaphores();
+int start_camera_worker();
 int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
 		    char *name, double *ut, double *jd,
 		    bool wait_flag, int *exp_error_code, char *exp_mode);
@@ -462,13 +781,19 @@ double wait_exp_done(double expt, bool skip_status_check);
 int init_camera();
 int clear_camera();
 int update_camera_status(Camera_Status *cam_status);
-void *do_camera_command_thread(void *args);
+int wait_camera_event(int events, double t_expected, double t_end);
+int run_camera_command(char *command, char *reply, int timeout);
 int do_status_command(char *command, char *reply, int timeout_sec,int id, char *host);
 int do_camera_command(char *command, char *reply, int timeout_sec, int id, char *host);
 int do_command(char *command, char *reply, int timeout_sec, int port, int id, char *host);
 int bad_readout();
 int get_filename(char *filename,struct tm *tm,int shutter);
-int wait_camera_readout(Camera_Status *status);
+int wait_camera_readout(Camera_Status *status, double *readout_sec);
+int start_camera_command(char *command, int timeout);
+void select_exp_mode(char *exp_mode, bool continue_run);
+bool exposure_run_open();
+int end_exposure_run(bool wait_flag);
+Field *lost_run_field();
 int print_camera_status(Camera_Status *status, FILE *output);
 double expose_timeout (char *exp_mode, double exp_time, bool wait_flag);
 
@@ -478,6 +803,7 @@ int init_status_names();
 int binary_string_to_int(char *binaryString) ;
 int int_to_binary_string(int n, char *string);
 int get_value_string(char *reply, char *keyword, char *separator, char *value_string);
+bool get_bool_status(char *keyword, char *reply);
 int get_string_status(char *keyword, char *reply, char *status);
 int parse_status(char *reply,Camera_Status *status);
 int print_camera_status(Camera_Status *status,FILE *output);
@@ -489,6 +815,136 @@ double get_dec_correction(double ha0, double ha);
 double get_ra_rate(double ha, double dec);
 double get_dec_rate(double ha, double dec);
 
+/* from scheduler_record.c */
+
+int journal_field(Field_Table *table, Obs_Journal *journal, int index,
+         struct tm *tm);
+int save_obs_record(Field_Table *table, Obs_Journal *journal,
+         struct tm *tm);
+int load_obs_record(char *file_name, char *journal_name, Field_Table *table,
+         Obs_Journal *journal);
+int close_obs_record(Obs_Journal *journal);
+int write_obs_record(char *file_name, Field_Table *table, struct tm *tm,
+         int generation);
+int read_obs_record(char *file_name, Field_Table *table,
+         Obs_Record_Header *header);
+
+/* from scheduler_fields.c */
+
+int init_field_table(Field_Table *table);
+int grow_field_table(Field_Table *table, int n);
+void free_field_table(Field_Table *table);
+int copy_field(Field *dest, Field *src);
+
+/* from scheduler_events.c */
+
+int refresh_field_events(Field_Events *e, Field *sequence, int i,
+        double jd, int bad_weather);
+void field_status_changed(Field_Events *e, int i);
+int init_field_events(Field_Events *e, int num_fields);
+int add_field_events(Field_Events *e, int num_fields);
+int update_field_events(Field_Events *e, Field *sequence, double jd,
+        int bad_weather);
+void free_field_events(Field_Events *e);
+double next_field_event(Field_Events *e);
+int get_ready_ties(Field_Events *e, double window, int *item, int max_items);
+
+/* from scheduler_riseset.c */
+
+double get_jd_rise_time(double ra,double dec, double max_am, double max_ha,
+       Night_Times *nt, Site_Params *site, double *am, double *ha);
+
+double get_jd_set_time(double ra,double dec, double max_am, double max_ha,
+       Night_Times *nt, Site_Params *site, double *am, double *ha);
+
+double search_jd_rise_time(double ra,double dec, double max_am, double max_ha,
+       Night_Times *nt, Site_Params *site, double *am, double *ha);
+
+double search_jd_set_time(double ra,double dec, double max_am, double max_ha,
+       Night_Times *nt, Site_Params *site, double *am, double *ha);
+
+double get_max_up_ha(double dec, double max_am, double max_ha, Site_Params *site);
+
+double get_airmass(double ha, double dec, Site_Params *site);
+
+double get_ha(double ra, double lst);
+
+/* from scheduler_slew.c */
+
+void record_slew(double ra0, double dec0, double ra1, double dec1,
+        double slew_sec);
+double get_slew_time(double ra, double dec);
+double get_slew_time_between(double ra0, double dec0, double ra1, double dec1);
+int get_slew_position(double *ra, double *dec);
+void clear_slew_position();
+
+/* from scheduler_lookahead.c */
+
+int lookahead_next_field(Field *sequence, int num_fields, int i_greedy,
+        double jd, int bad_weather, int max_depth);
+
+/* from scheduler_policy.c */
+
+Selection_Policy *get_selection_policy(char *name);
+void print_selection_policies(FILE *output);
+
+/* from scheduler_replay.c */
+
+int load_replay_night(struct date_time date, Site_Params *site,
+        Night_Times *nt, Night_Times *nt_5day, Night_Times *nt_10day,
+        Night_Times *nt_15day);
+int load_replay_fields(char *script_name, Field_Table *table,
+        Night_Times *nt, Night_Times *nt_5day, Night_Times *nt_10day,
+        Night_Times *nt_15day, Site_Params *site, int *num_observable);
+int replay_night(char *script_name, struct date_time date, char *policy_names);
+
+/* from scheduler_plan.c */
+
+void clear_plan();
+int make_plan(Field *sequence, int num_fields, double jd);
+int extend_plan(Field *sequence, int num_fields, double jd);
+int write_plan(char *file_name, Field *sequence);
+int planned_next_field(Field *sequence, int num_fields, double jd,
+        int bad_weather);
+int plan_night(char *script_name, struct date_time date, char *plan_file);
+
+/* from scheduler_airmass.c */
+
+int init_site_trig(Site_Params *site);
+int init_field_trig(Field *f);
+int get_airmass_batch(int n, const double * restrict ra,
+        const double * restrict sin_dec, const double * restrict cos_dec,
+        double lst, double sin_lat, double cos_lat,
+        double * restrict ha, double * restrict am);
+int load_airmass_table(Airmass_Table *table, Field *sequence,
+        int num_fields, Site_Params *site);
+int update_airmass_table(Airmass_Table *table, double lst);
+double get_table_airmass(Airmass_Table *table, int i, double lst, double *ha);
+void free_airmass_table(Airmass_Table *table);
+
+/* from scheduler_visibility.c */
+
+int load_visibility_table(Visibility_Table *vis, Airmass_Table *table,
+        Field *sequence, int num_fields, Night_Times *nt, Site_Params *site);
+int get_visibility_slot(Visibility_Table *vis, double jd);
+int field_visible(Visibility_Table *vis, int i, double jd);
+double next_visible_jd(Visibility_Table *vis, int i, double jd);
+double visible_until_jd(Visibility_Table *vis, int i, double jd);
+double visible_hours(Visibility_Table *vis, int i, double jd0, double jd1);
+void free_visibility_table(Visibility_Table *vis);
+
+/* from scheduler_wait.c */
+
+int init_wait_events(Wait_Events *w, char *file_name);
+void wake_scheduler();
+int wait_for_event(Wait_Events *w, double wait_sec);
+
+/* from scheduler_telemetry.c */
+
+int start_telemetry();
+int get_telescope_status(Telescope_Status *status, double max_age_sec);
+int get_fresh_telescope_status(Telescope_Status *status, int required);
+
 /* from scheduler_signals.c */
 
 int install_signal_handlers();
@@ -0,0 +1,194 @@
+/* scheduler_airmass.c
+
+   Batch hour-angle and airmass calculation for whole field tables.
+
+   get_airmass(ha,dec,site) goes through altit() one field at a time,
+   re-evaluating sin/cos of the site latitude and of the field declination
+   on every call. The routines here cache sin/cos(lat) in Site_Params
+   (init_site_trig) and sin/cos(dec) per field (Field.sin_dec,
+   Field.cos_dec, and the Airmass_Table columns), then evaluate the
+   hour angle and airmass of every field at a given lst in one pass.
+
+   get_airmass_batch is the kernel. It works on plain arrays (structure
+   of arrays) with no branches in the loop body, so it can be used by
+   the survey simulators as well as the live scheduler, and so the
+   compiler can vectorize it (see the rule for this file in the Makefile).
+
+   The airmass returned matches get_airmass(): 1/sin(alt), or
+   BELOW_HORIZON_AIRMASS when the field is at or below the horizon.
+
+*/
+
+#include "scheduler.h"
+
+/************************************************************/
+
+/* cache sin and cos of the site latitude */
+
+int init_site_trig(Site_Params *site)
+{
+    site->sin_lat=sin(site->lat/DEGTORAD);
+    site->cos_lat=cos(site->lat/DEGTORAD);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* cache sin and cos of the declination of field f */
+
+int init_field_trig(Field *f)
+{
+    f->sin_dec=sin(f->dec/DEGTORAD);
+    f->cos_dec=cos(f->dec/DEGTORAD);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* For n positions with ra (hours) and cached sin/cos(dec), compute
+   the hour angle (hours, -12 to +12) and airmass at the given lst (hours)
+   for a site with cached sin/cos(lat). */
+
+int get_airmass_batch(int n, const double * restrict ra,
+        const double * restrict sin_dec, const double * restrict cos_dec,
+        double lst, double sin_lat, double cos_lat,
+        double * restrict ha, double * restrict am)
+{
+    int i;
+    double h,sin_alt;
+
+    for(i=0;i<n;i++){
+       /* ra and lst are both 0 to 24, so one wrap is enough. Written
+          as arithmetic on the comparisons rather than with floor(),
+          which does not vectorize without SSE4.1 */
+       h=lst-ra[i];
+       h=h+24.0*(h<-12.0)-24.0*(h>=12.0);
+       sin_alt=sin_dec[i]*sin_lat+cos_dec[i]*cos_lat*cos(h/HRS_IN_RADIAN);
+       ha[i]=h;
+       am[i]=sin_alt>0.0 ? 1.0/sin_alt : BELOW_HORIZON_AIRMASS;
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* make sure the table can hold n entries */
+
+static int grow_airmass_table(Airmass_Table *table, int n)
+{
+    int n_alloc;
+    double *p;
+
+    if(n<=table->max_fields)return(0);
+
+    n_alloc=table->max_fields>0 ? table->max_fields : AIRMASS_TABLE_BLOCK;
+    while(n_alloc<n)n_alloc=2*n_alloc;
+
+    /* one allocation for all five columns */
+
+    p=(double *)realloc(table->ra,5*n_alloc*sizeof(double));
+    if(p==NULL){
+       fprintf(stderr,"grow_airmass_table: could not allocate %d entries\n",
+          n_alloc);
+       return(-1);
+    }
+
+    table->ra=p;
+    table->sin_dec=p+n_alloc;
+    table->cos_dec=p+2*n_alloc;
+    table->ha=p+3*n_alloc;
+    table->am=p+4*n_alloc;
+    table->max_fields=n_alloc;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* copy ra and cached sin/cos(dec) of the fields in sequence into
+   the table columns. Entry i of the table corresponds to sequence[i].
+   The site latitude terms are taken from site (see init_site_trig). */
+
+int load_airmass_table(Airmass_Table *table, Field *sequence,
+        int num_fields, Site_Params *site)
+{
+    int i;
+    Field *f;
+
+    if(grow_airmass_table(table,num_fields)!=0){
+       fprintf(stderr,"load_airmass_table: could not load %d fields\n",
+          num_fields);
+       return(-1);
+    }
+
+    for(i=0;i<num_fields;i++){
+       f=sequence+i;
+       table->ra[i]=f->ra;
+       table->sin_dec[i]=f->sin_dec;
+       table->cos_dec[i]=f->cos_dec;
+       table->ha[i]=0.0;
+       table->am[i]=BELOW_HORIZON_AIRMASS;
+    }
+
+    table->num_fields=num_fields;
+    table->sin_lat=site->sin_lat;
+    table->cos_lat=site->cos_lat;
+    table->lst=-1.0;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* fill the ha and am columns of the table for the given lst */
+
+int update_airmass_table(Airmass_Table *table, double lst)
+{
+    get_airmass_batch(table->num_fields,table->ra,table->sin_dec,
+       table->cos_dec,lst,table->sin_lat,table->cos_lat,
+       table->ha,table->am);
+    table->lst=lst;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* return the airmass of table entry i at the given lst, and the
+   hour angle in *ha. Uses the same kernel as update_airmass_table
+   so single-field and whole-table values agree, to the last bits the
+   vectorized loop may round differently. */
+
+double get_table_airmass(Airmass_Table *table, int i, double lst, double *ha)
+{
+    double am;
+
+    if(i<0||i>=table->num_fields){
+       *ha=0.0;
+       return(BELOW_HORIZON_AIRMASS);
+    }
+
+    get_airmass_batch(1,table->ra+i,table->sin_dec+i,table->cos_dec+i,
+       lst,table->sin_lat,table->cos_lat,ha,&am);
+
+    return(am);
+}
+
+/************************************************************/
+
+void free_airmass_table(Airmass_Table *table)
+{
+    if(table->ra!=NULL)free(table->ra);
+    table->ra=NULL;
+    table->sin_dec=NULL;
+    table->cos_dec=NULL;
+    table->ha=NULL;
+    table->am=NULL;
+    table->num_fields=0;
+    table->max_fields=0;
+}
+
+/************************************************************/
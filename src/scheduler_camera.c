@@ -18,28 +18,96 @@
 // status check in wait_exp_done
 #define SKIP_STATUS_CHECK True
 
+/* A command for the camera worker thread, which sends the commands
+ * queued for the command port one at a time. The storage belongs to
+ * whoever queued the command, and must stay valid until done posts.
+ * The worker fills in reply and result before posting done.
+*/
+
 typedef struct{
-   char *command;
-   char *reply;
+   char command[MAXBUFSIZE];
+   char reply[MAXBUFSIZE];
    int timeout;
-   sem_t *start_semaphore;
-   sem_t *done_semaphore;
    int command_id;
-} Do_Command_Args;
-
-// semaphores used to synchronize do_camera_command_thread
-// with parent thread
-sem_t command_done_semaphore; 
-sem_t command_start_semaphore; 
+   int result;
+   struct timeval t_done; /* when the reply was read */
+   sem_t done;
+} Camera_Command;
+
+/* queue of commands waiting for the worker */
+
+static pthread_mutex_t camera_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t camera_queue_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t camera_queue_not_full = PTHREAD_COND_INITIALIZER;
+static Camera_Command *camera_queue[CAMERA_QUEUE_LENGTH];
+static int camera_queue_head = 0;
+static int camera_queue_count = 0;
+static bool camera_worker_running = False;
+
+/* the exposure (or fetch) command whose readout is collected by
+   wait_camera_readout. readout_command_busy stays True until then,
+   or, if the wait timed out, until the worker has finished with it */
+
+static Camera_Command readout_command;
+static bool readout_command_busy = False;
+
+/* the EXP_MODE_LAST fetch that ends an exposure run, queued behind
+   readout_command by end_exposure_run so that the telescope can move
+   while both run. fetch_queued is True until wait_camera_readout
+   collects it, fetch_command_busy until the worker has finished it */
+
+static Camera_Command fetch_command;
+static bool fetch_queued = False;
+static bool fetch_command_busy = False;
+static double fetch_deadline = 0.0; /* as readout_deadline */
 
 /* set status_channel_active to True if ls4_ccp has been configured
  * to reply to status queries on a dedicated socket */
 
 bool status_channel_active = True; 
 
+/* persistent connection to STATUS_PORT. Only used by the main thread */
+
+static Socket_Connection status_connection;
+
+/* header_stale is True after a camera command got no reply, or an
+   exposure failed. The controller may have been restarted and lost the
+   fits header words sent to it, so imprint_fits_header sends them all
+   again */
+
+static bool header_stale = False;
+
 /* readout_pending will be True while an exposure is occuring  */
 bool readout_pending = False;
 
+/* system time (sec) by which the camera worker will have finished
+   readout_command */
+double readout_deadline = 0.0;
+
+/* Exposure runs: back-to-back exposures taken with EXP_MODE_FIRST,
+   EXP_MODE_NEXT, ... , EXP_MODE_NEXT and ended by EXP_MODE_LAST. Each
+   image is left in controller memory and fetched while the next one
+   is exposed, so the transfer time is hidden */
+
+static bool fetch_pending = False; /* last image not yet fetched */
+static char fetch_filename[STR_BUF_LEN]; /* file name of that image */
+static Field *fetch_field = NULL; /* field of that image */
+static Field *readout_fetch_field = NULL; /* field of the image fetched by
+                                             readout_command (EXP_MODE_NEXT) */
+static Field *lost_field = NULL; /* field of an image lost when the run
+                                    was abandoned (see lost_run_field) */
+static int run_exposures = 0; /* exposures in the current run */
+static double run_dead_time = 0.0; /* sec between exposures of the run */
+static struct timeval t_exp_end; /* end of the last exposure */
+
+static void note_exposure_run(char *exp_mode, char *filename, Field *f);
+static void abandon_exposure_run(Field *f_lost);
+static bool reap_readout_command();
+static int queue_fetch_command(char *command, int timeout);
+static int collect_fetch_command(bool readout_ok);
+static int queue_camera_command(Camera_Command *c, char *command, int timeout);
+static int check_camera_reply(char *command, char *reply, int id);
+
 extern int verbose;
 extern int verbose1;
 
@@ -168,25 +236,12 @@ Return value:
 
 */
 
-int init_semaphores()
-{
-    if(verbose1){
-        fprintf(stderr,"init_semaphores: initializing start_semaphore\n");
-    }
-    sem_init(&command_start_semaphore,0,0);
-
-    if(verbose1){
-        fprintf(stderr,"init_semaphores: initializing done_semaphore\n");
-    }
-    sem_init(&command_done_semaphore,0,0);
-
-}
 
 int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
 		    char *name, double *ut, double *jd,
 		    bool wait_flag, int *exp_error_code, char *exp_mode)
 {
-    char command[MAXBUFSIZE],reply[MAXBUFSIZE],command_copy[MAXBUFSIZE];
+    char command[MAXBUFSIZE],reply[MAXBUFSIZE];
     char filename[STR_BUF_LEN],date_string[STR_BUF_LEN],shutter_string[256],field_description[STR_BUF_LEN];
     char comment_line[STR_BUF_LEN];
     char s[256],code_string[STR_BUF_LEN],ujd_string[256],string[STR_BUF_LEN];
@@ -196,7 +251,6 @@ int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
     int shutter;
     int timeout = 0;
     pthread_t command_thread;
-    double t;
 
     int result = 0;
     *exp_error_code = 0;
@@ -256,9 +310,9 @@ int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
 
     /* update comment line in FITS header with comments from script record */
 
-    if(strstr(f->script_line,"#")!=NULL){
+    if(strstr(f->hist->script_line,"#")!=NULL){
         sprintf(comment_line,"                      ");
-        sprintf(comment_line,"'%s",strstr(f->script_line,"#")+1);
+        sprintf(comment_line,"'%s",strstr(f->hist->script_line,"#")+1);
         strcpy(comment_line+strlen(comment_line)-1,"'");
     }
     else{
@@ -293,37 +347,19 @@ int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
       strcpy(shutter_state,"False");
 
 
-    /* initialize command semaphores to 0. 
-     *
-     * If do_camera_command thread executes the expose command (wait = False),
-     * that thread will pause until the start semaphore is posted (changed to 1).
-     * The thread will post the done semaphore when the expose command returns.
-     *
-     * If the thread is  not used, neither will be posted.
-     *
-    */
-    if(verbose1){
-        fprintf(stderr,"take_exposure: set readout_pending to True\n");
-    }
-    readout_pending = True;
-
-    /* If wait_flag is False, then launch a new thread (command_thread) to execute 
-     * the call to do_camera_command (which sends an EXPOSE_COMMAND to the camera
-     * control program (ls4_ccp). 
+    /* If wait_flag is False, then queue the EXPOSE_COMMAND for the camera
+     * worker thread, which sends it to the camera control program (ls4_ccp). 
      *
      * Meanwhile, monitor the status of the camera. When the camera status show that  
      * the exposure time has elapsed (but the controller has not year read out the image),
      * return from the program.
      *
-     * The command_thread will continue executing the exposure, and read out the
-     * image when the exposure time has elapsed. It will post do the command_done_semaphore
-     * just before it exists.
-     *
-     * If wait flag is True, do not launch a new thread. Just execute the call to 
-     * to do_camera_command and wait for it to complete before returning. Set
-     * exp_error_code appropriately if do_camera_command returns with an error.
+     * The worker will continue executing the exposure, and read out the
+     * image when the exposure time has elapsed. wait_camera_readout
+     * collects the result.
      *
-     * Note that the action taken by 
+     * If wait flag is True, do not return until the command completes. Set
+     * exp_error_code appropriately if the command returns with an error.
     */
 
 
@@ -364,54 +400,11 @@ int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
          fflush(stderr);
        }
 
-       pthread_t thread_id;
-       Do_Command_Args *command_args;
-
-       strcpy(command_copy,command);
-       command_args = (Do_Command_Args *)malloc(sizeof(Do_Command_Args));
-       command_args->command = command_copy;
-       command_args->reply = reply;
-       command_args->timeout = timeout;
-       command_args->start_semaphore = &command_start_semaphore;
-       command_args->done_semaphore = &command_done_semaphore;
-       command_args->command_id = command_id++;
-
-       if(verbose1){
-          fprintf(stderr,"take_exposure: creating do_camera_command_thread with command_args->command = %s\n",
-                 command_args->command);
-          fflush(stderr);
-       }
-
-       if(pthread_create(&thread_id,NULL,do_camera_command_thread,\
-		       (void *)command_args)!=0){
-         fprintf(stderr,"take_exposure: ERROR creating do_camera_command_thread\n");
-         fflush(stderr);
+       if(start_camera_command(command,timeout)!=0){
 	     readout_pending = False;
 	     return -1;
        }
-
-       if(verbose1){
-          fprintf(stderr,"take_exposure: success creating do_camera_command_thread, thread_id = %d\n",
-                 thread_id);
-          fflush(stderr);
-       }
-
-       if(verbose1){
-           fprintf(stderr,"take_exposure: do_camera_command_thread running\n");
-           fflush(stderr);
-       }
-
-       // post to command_start_semaphore. This tells the do_camera_command_thread to start
-       // executing the exposre command
-       if(verbose1){
-	       t = get_ut();
-           fprintf(stderr,"take_exposure: time %12.6f : posting to start_semaphore\n",t);
-           fflush(stderr);
-       }
-       sem_post(&command_start_semaphore);
-
-       // record time at start of exposure
-       gettimeofday(&t_exp_start, NULL);
+       note_exposure_run(exp_mode,filename,f);
 
        if(verbose1){
            fprintf(stderr,"take_exposure: time %12.6f : waiting for exposure time to end\n",get_ut());
@@ -423,6 +416,12 @@ int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
           fprintf(stderr,"take_exposure: time %12.6f : error waiting for exposure to end\n",get_ut());
           fflush(stderr);
 	      *actual_expt = 0;
+
+          /* the exposure is not counted, so collect its readout here
+             rather than charge it to the exposure before it */
+
+          wait_camera_readout(NULL,NULL);
+          header_stale = True;
 	      return -1;
        }
        if(verbose1){
@@ -440,17 +439,24 @@ int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
        // record time at start of exposure
        gettimeofday(&t_exp_start, NULL);
 
-       command_id++;
-       if(do_camera_command(command,reply,timeout,command_id,host_name)!=0){
+       if(run_camera_command(command,reply,timeout)!=0){
          fprintf(stderr,"take_exposure: error sending exposure command : %s\n",command);
          fprintf(stderr,"take_exposure: reply was : %s\n",reply);
          *actual_expt=0.0;
          readout_pending = False;
+         header_stale = True;
+
+         /* an EXP_MODE_NEXT exposure also fetches the image before it */
+
+         if (fetch_pending && strstr(exp_mode,EXP_MODE_NEXT)!=NULL){
+           abandon_exposure_run(fetch_field);
+         }
          return -1;
        }
        else{
          sscanf(reply,"%lf",actual_expt);
        }
+       note_exposure_run(exp_mode,filename,f);
 
        readout_pending = False;
 
@@ -462,11 +468,55 @@ int take_exposure(Field *f, Fits_Header *header, double *actual_expt,
        }
     }
 
+    gettimeofday(&t_exp_end, NULL);
+
     strncpy(name,filename,FILENAME_LENGTH);
     
     return(0);
 }
 
+/*****************************************************/
+
+/* queue command for the camera worker and return at once. The
+   result is collected by wait_camera_readout. timeout is the time
+   allowed for the command (sec) */
+
+int start_camera_command(char *command, int timeout)
+{
+
+    /* readout_command can't be reused until the worker is done with
+       it. This only waits if the last wait_camera_readout timed out */
+
+    if (readout_command_busy){
+       fprintf(stderr,"start_camera_command: waiting for previous command [%s]\n",
+              readout_command.command);
+       fflush(stderr);
+       while (sem_wait(&readout_command.done) != 0 && errno == EINTR);
+       sem_destroy(&readout_command.done);
+       readout_command_busy = False;
+    }
+
+    if (queue_camera_command(&readout_command,command,timeout) != 0){
+      return -1;
+    }
+    readout_command_busy = True;
+    readout_pending = True;
+
+    // record time at start of exposure
+    gettimeofday(&t_exp_start, NULL);
+    if (fetch_pending){
+       run_dead_time = run_dead_time + (t_exp_start.tv_sec - t_exp_end.tv_sec) +
+                   (t_exp_start.tv_usec - t_exp_end.tv_usec)/1000000.0;
+    }
+
+    /* the worker gives up on the command after timeout sec, once it
+       reaches the front of the queue */
+    readout_deadline = t_exp_start.tv_sec + t_exp_start.tv_usec/1000000.0 +
+                timeout + CAMERA_TIMEOUT_SEC;
+
+    return(0);
+}
+
 /*****************************************************/
 /* return total time to take an exposure. If the exposure occurs */
 
@@ -480,6 +530,18 @@ double expose_timeout (char *exp_mode, double exp_time, bool wait_flag)
 
    if ( ! wait_flag){
       t = exp_time + readout_time_sec;
+
+      /* single and last transfer an image before replying. Next
+         transfers the previous image during the exposure */
+      if (strstr(exp_mode,EXP_MODE_SINGLE)!=NULL){
+        t = t + TRANSFER_TIME_SEC;
+      }
+      else if (strstr(exp_mode,EXP_MODE_NEXT)!=NULL){
+        if (t < TRANSFER_TIME_SEC) t = TRANSFER_TIME_SEC;
+      }
+      else if (strstr(exp_mode,EXP_MODE_LAST)!=NULL){
+        t = TRANSFER_TIME_SEC;
+      }
    }
    else{
      if (strstr(exp_mode,EXP_MODE_SINGLE)!=NULL){
@@ -552,27 +614,136 @@ int get_filename(char *filename,struct tm *tm,int shutter)
 
 /*****************************************************/
 
-/* The camera controller updates the image fits header with info specific to the camera status. 
- * This command to add info the header maintained by the controller. This additional
- * info will be save to the fits header when the image is read out and saved by the controller
-*/
+/* send the header words listed in word_index in one HEADER_LIST_COMMAND,
+   and mark them as sent if the camera accepts them. Returns 1 if the
+   camera answers with an ERROR_REPLY, -1 on any other failure */
 
-int imprint_fits_header(Fits_Header *header)
+static int send_header_list(Fits_Header *header, int *word_index, int n)
+{
+    char command[MAXBUFSIZE];
+    char reply[MAXBUFSIZE];
+    int i,len;
+
+    len = sprintf(command,"%s",HEADER_LIST_COMMAND);
+    for(i=0;i<n;i++){
+      len = len + sprintf(command+len,"%s%s %s",
+                i == 0 ? " " : HEADER_LIST_SEPARATOR,
+                header->fits_word[word_index[i]].keyword,
+                header->fits_word[word_index[i]].value);
+    }
+
+    if(run_camera_command(command,reply,CAMERA_TIMEOUT_SEC)!=0){
+      fprintf(stderr,
+          "send_header_list: error sending command %s\n",command);
+      if(strstr(reply,ERROR_REPLY)!=NULL) return(1);
+      return(-1);
+    }
+
+    for(i=0;i<n;i++){
+      header->fits_word[word_index[i]].changed = 0;
+    }
+
+    return(0);
+}
+
+/*****************************************************/
+
+/* send each changed header word in its own HEADER_COMMAND */
+
+static int send_header_words(Fits_Header *header)
 {
     char command[MAXBUFSIZE];
     char reply[MAXBUFSIZE];
     int i;
 
-    command_id++;
     for(i=0;i<header->num_words;i++){
+      if(! header->fits_word[i].changed) continue;
       sprintf(command,"%s %s %s",
 		HEADER_COMMAND,header->fits_word[i].keyword,
                 header->fits_word[i].value);
-      if(do_camera_command(command,reply,CAMERA_TIMEOUT_SEC,command_id,host_name)!=0){
+      if(run_camera_command(command,reply,CAMERA_TIMEOUT_SEC)!=0){
         fprintf(stderr,
-          "imprint_fits_header: error sending command %s\n",command);
+          "send_header_words: error sending command %s\n",command);
+        return(-1);
+      }
+      header->fits_word[i].changed = 0;
+    }
+
+    return(0);
+}
+
+/*****************************************************/
+
+/* The camera controller updates the image fits header with info specific to the camera status. 
+ * This command to add info the header maintained by the controller. This additional
+ * info will be save to the fits header when the image is read out and saved by the controller
+ *
+ * The controller keeps the words it has been sent, so only the words
+ * changed since the last imprint are sent. They go in a single
+ * HEADER_LIST_COMMAND (more if they don't fit in one command), so the
+ * imprint costs one round trip instead of one per word. If the
+ * controller answers HEADER_LIST_COMMAND with an ERROR_REPLY, it is
+ * taken to be an older version and HEADER_COMMAND is used from then on.
+ * Any other failure just fails the imprint.
+ *
+ * After a camera command gets no reply, or an exposure fails (see
+ * header_stale), all the words are sent again.
+*/
+
+int imprint_fits_header(Fits_Header *header)
+{
+    static bool use_header_list = True;
+    int word_index[MAX_FITS_WORDS];
+    int i,n,len,word_len,result;
+
+    if(header_stale){
+      for(i=0;i<header->num_words;i++){
+        header->fits_word[i].changed = 1;
+      }
+      header_stale = False;
+    }
+
+    result = 0;
+    if(use_header_list){
+      n = 0;
+      len = strlen(HEADER_LIST_COMMAND);
+      for(i=0;i<header->num_words && result == 0;i++){
+        if(! header->fits_word[i].changed) continue;
+
+        word_len = strlen(HEADER_LIST_SEPARATOR) +
+                   strlen(header->fits_word[i].keyword) + 1 +
+                   strlen(header->fits_word[i].value);
+        if(n > 0 && len + word_len > MAXBUFSIZE-2){
+          result = send_header_list(header,word_index,n);
+          n = 0;
+          len = strlen(HEADER_LIST_COMMAND);
+        }
+        word_index[n] = i;
+        n++;
+        len = len + word_len;
+      }
+
+      if(result == 0 && n > 0){
+        result = send_header_list(header,word_index,n);
+      }
+
+      if(result == 0){
+        return(0);
+      }
+      else if(result < 0){
+        fprintf(stderr,"imprint_fits_header: error imprinting header\n");
         return(-1);
       }
+
+      fprintf(stderr,"imprint_fits_header: camera does not take %s. Using %s\n",
+          HEADER_LIST_COMMAND,HEADER_COMMAND);
+      fflush(stderr);
+      use_header_list = False;
+    }
+
+    if(send_header_words(header)!=0){
+      fprintf(stderr,"imprint_fits_header: error imprinting header\n");
+      return(-1);
     }
 
     return(0);
@@ -581,7 +752,7 @@ int imprint_fits_header(Fits_Header *header)
 /*****************************************************/
 
 /* wait for camera exposure to end while the command to take an
- * exposure occurs in a parallel thread (do_camera_command_thread). 
+ * exposure runs in the camera worker thread (camera_worker). 
  * This routine is used by the "take_exposure" command when
  * the wait_flag argument is False. 
  *
@@ -589,23 +760,27 @@ int imprint_fits_header(Fits_Header *header)
  * through a status socket distinct from the command socket.
  *
  * When the exposure has ended, it is then read out by
- * the controller. This may proceed in the parallel thread while
+ * the controller. This may proceed in the worker thread while
  * the main thread continues to perform other functions (such as
  * moving the telescope to the next position).
  *
- * The parallel thread posts to the done_semaphore just before it exits,
- * signifying the exposure command has completed.
+ * The worker posts readout_command.done when the exposure command
+ * has completed.
  *
  * If skip_status_chekl is True, assume exposure is successful and return
  # after sleepimng for expt sec.
+ *
+ * Returns the exposure time (sec), or -1 if the end of the exposure
+ * could not be followed. Even then it does not return before the
+ * shutter must have closed (expt + SHUTTER_CLOSE_MARGIN_SEC).
 */
  
 double wait_exp_done(double expt, bool skip_status_check)
 {
-    struct timeval t_val,t_val_start,t_val_end, t_val1, t_val2;
-    double t,t_start,t_end;
+    struct timeval t_val,t_val_start,t_val_end;
+    double t_start,t_end;
     int timeout_sec;
-    double wait_time,dt;
+    double wait_time;
     double act_expt;
     useconds_t sleep_time_usec;
 
@@ -628,82 +803,45 @@ double wait_exp_done(double expt, bool skip_status_check)
     /* timeout occurs if wait time exceeds t-end */
     t_end = t_start + timeout_sec;
 
-    sleep_time_usec = expt *1000000;
-    if(verbose1){
-      fprintf(stderr, "wait_exp_done: sleeping %d usec\n",sleep_time_usec);
-      fflush(stderr);
-    }
-    usleep(sleep_time_usec);
-
-    /* if the status channel is active, query the camera status to determine whenb
-     * the exposure ends. Otherwise, just assume it has ended when the expected 
-     * exposure time has been waited */
+    /* if the status channel is active, watch the camera status for the
+     * shutter to close. Otherwise, just assume it has closed when the
+     * expected exposure time has been waited, allowing for the delay
+     * between sending the expose command and the shutter opening, so the
+     * telescope does not move before the shutter closes */
 
     if (status_channel_active && ! skip_status_check){
 
-        t=t_start;
-        bool done = False;
-        bool error_flag = False;
-  
-        while (t < t_end && ! done && ! error_flag){
-          gettimeofday(&t_val,NULL);
-          t = t_val.tv_sec + (double)(t_val.tv_usec/1000000.0);
-
-          if(update_camera_status(NULL)!=0){
-            fprintf(stderr,"wait_exp_done: WARNING: could not update camera status\n");
-            //error_flag = True;
-            //done = True;
-          }
-          gettimeofday(&t_val2,NULL);
-          dt = (t_val2.tv_sec - t_val.tv_sec) + ((double)(t_val2.tv_usec - t_val.tv_usec)/1000000.0);
-          fprintf(stderr,"wait_exp_done: it took %7.3f sec to check status\n", dt);
-         
-          if( cam_status.error){
-            fprintf(stderr,"wait_exp_done: ERROR : camera status error\n");
-            error_flag = True;
-          }
-          else if (cam_status.state_val[EXPOSING] == ALL_NEGATIVE_VAL){
-             done = True;
-          }
-          else{
-            fprintf(stderr,"wait_exp_done: cam_status.state_val[EXPOSING] = %d\n",cam_status.state_val[EXPOSING]);
-            //usleep(100000);
-            //usleep(1000);
-            //gettimeofday(&t_val,NULL);
-            //t = t_val.tv_sec + (double)(t_val.tv_usec/1000000.0);
-          }
-        }
+        int events = wait_camera_event(CAMERA_SHUTTER_CLOSED,t_start+expt,t_end);
 
         gettimeofday(&t_val_end,NULL);
         wait_time = (t_val_end.tv_sec - t_val_start.tv_sec) + ((double)(t_val_end.tv_usec - t_val_start.tv_usec)/1000000.0);
 
-        if (! done ){
-           if (error_flag){
-             fprintf(stderr,"wait_exp_done: time %12.6f : ERROR waiting for exposure to end\n",get_ut());
-             print_camera_status(&cam_status,stderr);
-           }
-           else if (t>t_end){
-             fprintf(stderr,"wait_exp_done: time %12.6f : WARNING timeout waiting for exposure to end\n",get_ut());
-           }
-           else{
-             fprintf(stderr,"wait_exp_done: time %12.6f : WARNING wait loop exited for unknown reason\n",get_ut());
-           }
-           fflush(stderr);
-        }
-        else{
+        /* the camera status could not be followed, and the shutter
+           may still be open. Don't return, and let the telescope move,
+           before it must have closed */
 
-           if(verbose1){
-             fprintf(stderr,
-               "wait_exp_done: exposure successfully ended in  %7.3f sec\n",wait_time);
-             fflush(stderr);
+        if (events < 0){
+           fprintf(stderr,"wait_exp_done: time %12.6f : ERROR waiting for exposure to end\n",get_ut());
+           fflush(stderr);
+           if (wait_time < expt + SHUTTER_CLOSE_MARGIN_SEC){
+              usleep((useconds_t)((expt + SHUTTER_CLOSE_MARGIN_SEC - wait_time)*1000000));
            }
+           return(-1.0);
         }
-        if( !done ){
-            act_expt=-1.0;
+        else if(verbose1){
+           fprintf(stderr,
+               "wait_exp_done: exposure successfully ended in  %7.3f sec\n",wait_time);
+           fflush(stderr);
         }
         act_expt = wait_time;
     }
     else{
+        sleep_time_usec = (expt + SHUTTER_CLOSE_MARGIN_SEC) *1000000;
+        if(verbose1){
+          fprintf(stderr, "wait_exp_done: sleeping %d usec\n",sleep_time_usec);
+          fflush(stderr);
+        }
+        usleep(sleep_time_usec);
         act_expt = expt;
     }
 
@@ -759,8 +897,12 @@ int update_camera_status(Camera_Status *status)
      if(do_status_command(STATUS_COMMAND,reply,CAMERA_TIMEOUT_SEC,command_id,host_name)!=0){
        return(-1);
      }
+     else if (parse_status(reply,&cam_status) != 0){
+       fprintf(stderr,"update_camera_status: can't parse status reply [%s]\n",reply);
+       fflush(stderr);
+       return(-1);
+     }
      else {
-       parse_status(reply,&cam_status);
        if (status != NULL) *status = cam_status;
      }
 
@@ -768,80 +910,265 @@ int update_camera_status(Camera_Status *status)
 
 }
 /*****************************************************/
-// thread wrapper
-//
-void *do_camera_command_thread(void *args){
-
-     int *result = malloc(sizeof(int));
-     Do_Command_Args *command_args;
-     int timeout_sec;
-     char *command;
-     char *reply;
-     sem_t *done_semaphore;
-     sem_t *start_semaphore;
-     double t_start, t_end;
-     int id;
-
-     command_args = (Do_Command_Args *)args;
-     command = command_args->command;
-     reply = command_args->reply;
-     timeout_sec =  command_args->timeout;
-     start_semaphore = command_args->start_semaphore;
-     done_semaphore = command_args->done_semaphore;
-     id = command_args->command_id;
 
+/* return the events (CAMERA_SHUTTER_CLOSED, CAMERA_READOUT_STARTED)
+   shown by the change in camera state from prev to status */
 
-     if(verbose1){
-          fprintf(stderr,"do_camera_command_thread[%d]: time %12.6f : command_args->command = %s\n",
-			  id,get_ut(),command_args->command);
-          fflush(stderr);
+static int camera_events(Camera_Status *prev, Camera_Status *status)
+{
+     int events = 0;
+
+     if (prev->state_val[EXPOSING] != ALL_NEGATIVE_VAL &&
+         status->state_val[EXPOSING] == ALL_NEGATIVE_VAL){
+        events = events | CAMERA_SHUTTER_CLOSED;
+     }
+     if (prev->state_val[READING] == ALL_NEGATIVE_VAL &&
+         status->state_val[READING] > ALL_NEGATIVE_VAL){
+        events = events | CAMERA_READOUT_STARTED;
      }
 
+     return(events);
+}
 
-     *result = 0;
+/*****************************************************/
 
+/* poll the camera status until one of events is seen, where events
+ * is a combination of CAMERA_SHUTTER_CLOSED and CAMERA_READOUT_STARTED.
+ * t_expected is the system time (sec) the first of them is expected,
+ * and t_end the time to give up.
+ *
+ * Polls are sparse until close to t_expected: each wait is half the
+ * time left, within STATUS_POLL_MIN_SEC and STATUS_POLL_MAX_SEC. The
+ * first poll gives the starting state, so a transition is only seen
+ * once the camera has been watched going through it. Since the
+ * exposure may not have started at the first poll, an event is also
+ * taken to have happened if its end state is seen after t_expected.
+ *
+ * Returns the events seen, or -1 on a timeout or camera error.
+*/
 
-     struct timespec t;
-     t.tv_sec = timeout_sec;
-     t.tv_nsec = 0;
+int wait_camera_event(int events, double t_expected, double t_end)
+{
+     Camera_Status prev;
+     struct timeval t_val;
+     double t,dt;
+     int seen,n_polls,n_errors;
 
-     if(verbose1){
-          fprintf(stderr,"do_camera_command_thread[%d]: time %12.6f : waiting for start_semaphore to post with timeout %ld sec\n",
-			  id,get_ut(),t.tv_sec);
-          fflush(stderr);
-     }
+     memset((void *)&prev,0,sizeof(prev));
+     seen = 0;
+     n_polls = 0;
+     n_errors = 0;
 
-     /* wait for the start_semaphore to post, or else timeout */
-     if ( sem_timedwait(start_semaphore,&t) != 0){
-        fprintf(stderr,"do_camera_command_thread[%d]: time %12.6f : error waiting for start_semaphore to post\n",id,get_ut());
-	perror("timeout waiting for start_semaphore to post in do_camera_command");
-        fflush(stderr);
-        *result = -1;
+     gettimeofday(&t_val,NULL);
+     t = t_val.tv_sec + t_val.tv_usec/1000000.0;
+
+     while (True){
+
+        dt = (t_expected - t)/2.0;
+        if (dt > STATUS_POLL_MAX_SEC) dt = STATUS_POLL_MAX_SEC;
+        if (n_polls > 0 && dt < STATUS_POLL_MIN_SEC) dt = STATUS_POLL_MIN_SEC;
+        if (t + dt > t_end) dt = t_end - t;
+        if (dt > 0.0) usleep((useconds_t)(dt*1000000));
+
+        if(update_camera_status(NULL)!=0){
+           fprintf(stderr,"wait_camera_event: WARNING: could not update camera status\n");
+           fflush(stderr);
+           n_errors++;
+        }
+        else{
+           if (cam_status.error){
+              fprintf(stderr,"wait_camera_event: ERROR : camera status error\n");
+              print_camera_status(&cam_status,stderr);
+              fflush(stderr);
+              return(-1);
+           }
+
+           if (n_polls > 0){
+              seen = seen | camera_events(&prev,&cam_status);
+           }
+           prev = cam_status;
+           n_polls++;
+        }
+
+        gettimeofday(&t_val,NULL);
+        t = t_val.tv_sec + t_val.tv_usec/1000000.0;
+
+        if (n_polls > 0 && t >= t_expected){
+           if (cam_status.state_val[EXPOSING] == ALL_NEGATIVE_VAL){
+              seen = seen | CAMERA_SHUTTER_CLOSED;
+           }
+           if (cam_status.state_val[READING] > ALL_NEGATIVE_VAL){
+              seen = seen | CAMERA_READOUT_STARTED;
+           }
+        }
+
+        if ((seen & events) != 0){
+           if(verbose1){
+              fprintf(stderr,"wait_camera_event: time %12.6f : events %d seen after %d polls\n",
+                   get_ut(),seen,n_polls);
+              fflush(stderr);
+           }
+           return(seen & events);
+        }
+        else if (t >= t_end){
+           fprintf(stderr,"wait_camera_event: time %12.6f : WARNING timeout waiting for events %d (%d polls, %d failed)\n",
+                   get_ut(),events,n_polls,n_errors);
+           fflush(stderr);
+           return(-1);
+        }
      }
-     /* once the start semaphore posts, execute the command and then post to the
-      * done semaphore */
-     else{
-	    t_start = get_ut();
+}
+
+/*****************************************************/
+/* camera worker thread. Sends the queued commands one at a time, in
+   the order queued */
+
+static void *camera_worker(void *arg)
+{
+     Camera_Command *c;
+     double t_start;
+
+     while (True){
+
+        pthread_mutex_lock(&camera_queue_lock);
+        while (camera_queue_count == 0){
+           pthread_cond_wait(&camera_queue_not_empty,&camera_queue_lock);
+        }
+        c = camera_queue[camera_queue_head];
+        camera_queue_head = (camera_queue_head + 1) % CAMERA_QUEUE_LENGTH;
+        camera_queue_count--;
+        pthread_cond_signal(&camera_queue_not_full);
+        pthread_mutex_unlock(&camera_queue_lock);
+
+        t_start = get_ut();
         if(verbose1){
-          fprintf(stderr,"do_camera_command_thread[%d]: start time %12.6f : sending command [%s] with timeout %d sec\n",
-			  id,t_start,command,timeout_sec);
+          fprintf(stderr,"camera_worker[%d]: start time %12.6f : sending command [%s] with timeout %d sec\n",
+			  c->command_id,t_start,c->command,c->timeout);
           fflush(stderr);
         }
-        *result = do_camera_command(command,reply, timeout_sec,id,host_name);
-	    t_end = get_ut();
+
+        c->result = do_camera_command(c->command,c->reply,c->timeout,
+                                      c->command_id,host_name);
+        gettimeofday(&c->t_done,NULL);
+
         if(verbose1){
-          fprintf(stderr,"do_camera_command_thread[%d]: done time %12.6f : result is [%d] \n",id,t_end,*result);
-          fprintf(stderr,"do_camera_command_thread[%d]: time %12.6f : posting to done_semaphore\n", id,t_end);
+          fprintf(stderr,"camera_worker[%d]: done time %12.6f : result is [%d] \n",
+                          c->command_id,get_ut(),c->result);
 	      fflush(stderr);
 	    }
-	    sem_post(done_semaphore);
+
+        /* c may be reused by its owner as soon as this posts */
+        sem_post(&c->done);
      }
 
-     pthread_exit(result);
+     return(NULL);
+}
+
+/*****************************************************/
+
+/* start the camera worker thread. If it can't be started, commands
+   are sent as they are queued, and exposures can't overlap slews */
+
+int start_camera_worker()
+{
+    pthread_t thread_id;
+
+    if (pthread_create(&thread_id,NULL,camera_worker,NULL) != 0){
+       fprintf(stderr,"start_camera_worker: ERROR creating camera worker. Camera commands will block\n");
+       fflush(stderr);
+       return(-1);
+    }
+    pthread_detach(thread_id);
+    camera_worker_running = True;
+
+    return(0);
 }
 
+/*****************************************************/
+
+/* queue command for the camera worker. done is posted when it has
+   been sent and the reply read. If the queue is full, wait for room */
+
+static int queue_camera_command(Camera_Command *c, char *command, int timeout)
+{
+    if (strlen(command) > MAXBUFSIZE-1){
+       fprintf(stderr,"queue_camera_command: command too long : [%s]\n",command);
+       fflush(stderr);
+       return(-1);
+    }
+
+    strcpy(c->command,command);
+    c->reply[0] = 0;
+    c->timeout = timeout;
+    c->command_id = ++command_id;
+    c->result = -1;
+    sem_init(&c->done,0,0);
+
+    if (! camera_worker_running){
+       c->result = do_camera_command(c->command,c->reply,c->timeout,
+                                     c->command_id,host_name);
+       gettimeofday(&c->t_done,NULL);
+       sem_post(&c->done);
+       return(0);
+    }
+
+    pthread_mutex_lock(&camera_queue_lock);
+    while (camera_queue_count == CAMERA_QUEUE_LENGTH){
+       pthread_cond_wait(&camera_queue_not_full,&camera_queue_lock);
+    }
+    camera_queue[(camera_queue_head + camera_queue_count) % CAMERA_QUEUE_LENGTH] = c;
+    camera_queue_count++;
+    pthread_cond_signal(&camera_queue_not_empty);
+    pthread_mutex_unlock(&camera_queue_lock);
+
+    return(0);
+}
+
+/*****************************************************/
+
+/* send command through the camera worker, after any commands already
+   queued, and wait for the reply. Returns the do_camera_command
+   result */
+
+int run_camera_command(char *command, char *reply, int timeout)
+{
+    Camera_Command c;
+
+    if (queue_camera_command(&c,command,timeout) != 0){
+       return(-1);
+    }
+
+    while (sem_wait(&c.done) != 0 && errno == EINTR);
+    sem_destroy(&c.done);
+
+    strcpy(reply,c.reply);
+
+    /* no reply at all: the next command opens a new connection, maybe
+       to a restarted controller */
+
+    if (c.result != 0 && strstr(reply,ERROR_REPLY) == NULL){
+       header_stale = True;
+    }
+
+    return(c.result);
+}
+
+/*****************************************************/
+
+/* status queries are answered at once, so they go over a persistent
+   connection and without COMMAND_DELAY_USEC */
+
 int do_status_command(char *command, char *reply, int timeout_sec,int id, char *host){
-    return do_command(command, reply, timeout_sec, STATUS_PORT,id, host);
+
+     if(send_connection_command(&status_connection,host,STATUS_PORT,
+                command,reply,timeout_sec)!=0){
+         fprintf(stderr,
+          "do_status_command[%d]: error sending command %s\n", id,command);
+         fflush(stderr);
+         return(-1);
+     }
+
+     return(check_camera_reply(command,reply,id));
 }
 
 int do_camera_command(char *command, char *reply, int timeout_sec, int id, char *host){
@@ -868,13 +1195,26 @@ int do_command(char *command, char *reply, int timeout_sec, int port,int id, cha
      usleep(COMMAND_DELAY_USEC);
 
      if (returnval == 0){
+       returnval = check_camera_reply(command,reply,id);
+     }
+
+
+     return(returnval);
+
+}
+/*****************************************************/
+
+/* return -1 if reply to command is not a DONE_REPLY */
+
+static int check_camera_reply(char *command, char *reply, int id)
+{
        //if(strstr(reply,ERROR_REPLY)!=NULL || strlen(reply) == 0 ){
        if( strstr(reply,DONE_REPLY)==NULL || strlen(reply) == 0  || strstr(reply,"ERROR_REPLY") != NULL){
          fprintf(stderr,
             "do_command[%d]: time %12.6f : command [%s] returns error: %s\n", 
              id,get_ut(), command,reply);
          fflush(stderr);
-	 returnval = -1;
+	 return(-1);
        }
        else {
          if(verbose1){
@@ -882,11 +1222,8 @@ int do_command(char *command, char *reply, int timeout_sec, int port,int id, cha
            fflush(stderr);
          }
        }
-     }
-
-
-     return(returnval);
 
+       return(0);
 }
 /*****************************************************/
 
@@ -896,78 +1233,107 @@ int do_command(char *command, char *reply, int timeout_sec, int port,int id, cha
  * A new exposure may also begin, depending on the exposure mode of the previous
  * observatopn.
  *
- * If a readout is not pending, wait the the command_done_semaphore
+ * If a readout is pending, wait for readout_command.done
  * to post. This signifies the exposure and readout have completed.
  * Return with result = 0 if no timeout or other error occurs while
- * waiting for the readout. Otherwise return -1.
+ * waiting for the readout, and the exposure command succeeded.
+ * Otherwise return -1.
+ *
+ * The wait blocks in sem_timedwait until readout_deadline, by which
+ * time the camera worker will have given up on the command. So
+ * when the exposure is read out while the telescope slews to the
+ * next field, only the part of the readout not hidden by the slew
+ * is waited for here, and the wait ends as soon as the readout does.
+ *
+ * If readout_sec is not NULL, it is set to the time (sec) from the
+ * end of the exposure to the end of the readout, or 0 if the readout
+ * did not complete.
+ *
+ * If end_exposure_run queued a fetch behind the readout, wait for it
+ * too. Return -1 if it failed.
  *
  * If no readout is pending, just return with result = 0
 */
 
-int wait_camera_readout(Camera_Status *status)
+int wait_camera_readout(Camera_Status *status, double *readout_sec)
 {
-    struct timeval t1,t2;
-    double t,t_start,t_end,dt,t_prev;
+    struct timespec t_deadline;
+    double t_start,t_end,dt;
     int result=0;
-    int timeout_sec = readout_time_sec;
+    int wait_result;
+
+    if (readout_sec != NULL) *readout_sec = 0.0;
 
     if (readout_pending){
-      gettimeofday(&t1,NULL);
-      if(verbose){
-	    fprintf(stderr,"wait_camera_readout: time %12.6f : waiting for readout to complete\n",get_ut());
-	    fflush(stderr);
-      }
-      /* wait for the done_semphore to post, or else timeout */
+
+      /* sem_timedwait takes an absolute CLOCK_REALTIME time, the same
+         clock as gettimeofday */
+
+      t_deadline.tv_sec = (time_t)readout_deadline + 1;
+      t_deadline.tv_nsec = (long)((readout_deadline - (time_t)readout_deadline) * 1.0e9);
 
       t_start = get_ut();
-      if(verbose1){
-	    fprintf(stderr,"wait_camera_readout: time = %12.6f : waiting for done_semaphore to post with timeout %d\n",t_start,timeout_sec);
+      if(verbose){
+	    fprintf(stderr,"wait_camera_readout: time %12.6f : waiting for readout to complete\n",t_start);
 	    fflush(stderr);
       }
-      //HERE
-      /* If a timeout or error occurs while waiting for ther done_semaphore to
+
+      /* If a timeout or error occurs while waiting for readout_command.done to
        * post, return -1.
       */
-      t = t_start*3600.0;
-      t_end = t + timeout_sec;
-      t_prev = -1;
-      bool done = False;
-      while (t < t_end  && !done){
-         if ( sem_trywait(&command_done_semaphore) != 0){
-            if(verbose1 && t > t_prev + 1){
-              fprintf(stderr,"wait_camera_readout: time = %12.6f : waiting for done_semaphore\n",
-                    get_ut());
-              t_prev = t;
-             }
-             usleep(100000);
-             t = t + 0.1;
-         }
-         else{
-            done = True;
-            if(verbose1){
-              fprintf(stderr,"wait_camera_readout: time = %12.6f : done_semaphore has posted\n",
-                      get_ut());
-            }
-         }   
-      }
+      while ((wait_result = sem_timedwait(&readout_command.done,&t_deadline)) != 0 &&
+              errno == EINTR);
+
       t_end = get_ut();
       dt = (t_end - t_start) * 3600.0;
-      if ( ! done ){
-        fprintf(stderr,"wait_camera_readout: time = %12.6f: dt = %12.6f: error waiting for done_semaphore to post\n",t_end,dt);
+
+      /* the readout is failed, and reported as failed, only once. The
+         worker still owns readout_command (readout_command_busy), and
+         its late done post is collected by reap_readout_command */
+
+      if ( wait_result != 0 ){
+        fprintf(stderr,"wait_camera_readout: time = %12.6f: dt = %12.6f: error waiting for readout_command.done to post: %s\n",
+                t_end,dt,strerror(errno));
         fflush(stderr);
+        readout_pending = False;
         result = -1;
       }
-      /* Otherwise if done_semaphore posts, the readout is is done.  Set readout_pending to
-       * False and return 0
+      /* Otherwise if readout_command.done posts, the readout is is done.  Set readout_pending to
+       * False and return the result of the exposure command
       */
       else{
     	readout_pending = False;
+        readout_command_busy = False;
+        sem_destroy(&readout_command.done);
+        if (readout_command.result != 0){
+          fprintf(stderr,"wait_camera_readout: time = %12.6f: exposure command failed\n",t_end);
+          fflush(stderr);
+          result = -1;
+        }
+        else if (readout_sec != NULL){
+          *readout_sec = (readout_command.t_done.tv_sec - t_exp_end.tv_sec) +
+                (readout_command.t_done.tv_usec - t_exp_end.tv_usec)/1000000.0;
+        }
         if(verbose1){
-     	  //fprintf(stderr,"wait_camera_readout: time = %12.6f : done_semaphore has posted\n",t_end);
      	  fprintf(stderr,"wait_camera_readout: time = %12.6f : waited %7.3f sec for readout to end\n",t_end,dt);
      	  fflush(stderr);
         }
       }
+
+      /* after a failure, the images left in controller memory can't
+         be relied on */
+
+      if (result != 0){
+        header_stale = True;
+      }
+      if (result != 0 && (fetch_pending || fetch_queued)){
+        abandon_exposure_run(readout_fetch_field);
+      }
+    }
+    else if (! reap_readout_command()){
+       fprintf(stderr,"wait_camera_readout: command [%s] given up on is still busy\n",
+              readout_command.command);
+       fflush(stderr);
     }
     else{
        if(verbose1){
@@ -975,6 +1341,13 @@ int wait_camera_readout(Camera_Status *status)
 	     fflush(stderr);
        }
     }
+
+    /* the last image of an exposure run ended while the readout ran */
+
+    if (fetch_queued && collect_fetch_command(result == 0) != 0){
+       header_stale = True;
+       result = -1;
+    }
 /*
     if(update_camera_status(NULL)!=0){
 	result=-1;
@@ -991,6 +1364,237 @@ int wait_camera_readout(Camera_Status *status)
 
 /*****************************************************/
 
+/* collect readout_command if the worker has finished it since
+   wait_camera_readout gave up on it. Its result is only logged: the
+   readout was already reported as failed. Returns False if the worker
+   still has it */
+
+static bool reap_readout_command()
+{
+    if (! readout_command_busy) return(True);
+
+    if (sem_trywait(&readout_command.done) != 0) return(False);
+
+    sem_destroy(&readout_command.done);
+    readout_command_busy = False;
+
+    fprintf(stderr,"reap_readout_command: command [%s] ended late with result %d\n",
+           readout_command.command,readout_command.result);
+    fflush(stderr);
+
+    return(True);
+}
+
+/*****************************************************/
+
+/* queue command, the fetch that ends an exposure run, behind the
+   exposure in readout_command. timeout is the time allowed for it
+   (sec) once the worker reaches it */
+
+static int queue_fetch_command(char *command, int timeout)
+{
+    /* fetch_command can't be reused until the worker is done with it.
+       This only waits if an earlier fetch was given up on */
+
+    if (fetch_command_busy){
+       fprintf(stderr,"queue_fetch_command: waiting for previous command [%s]\n",
+              fetch_command.command);
+       fflush(stderr);
+       while (sem_wait(&fetch_command.done) != 0 && errno == EINTR);
+       sem_destroy(&fetch_command.done);
+       fetch_command_busy = False;
+    }
+
+    if (queue_camera_command(&fetch_command,command,timeout) != 0){
+       return(-1);
+    }
+    fetch_command_busy = True;
+    fetch_queued = True;
+    fetch_deadline = readout_deadline + timeout + CAMERA_TIMEOUT_SEC;
+
+    return(0);
+}
+
+/*****************************************************/
+
+/* collect the result of fetch_command. If readout_ok is False, the
+   exposure before it failed, so the fetched image can't be relied on
+   and the worker may not have reached the fetch yet. It is then left
+   to queue_fetch_command. Returns 0 if the image was fetched, -1
+   otherwise */
+
+static int collect_fetch_command(bool readout_ok)
+{
+    struct timespec t_deadline;
+    int wait_result;
+
+    fetch_queued = False;
+    if (! readout_ok) return(-1);
+
+    t_deadline.tv_sec = (time_t)fetch_deadline + 1;
+    t_deadline.tv_nsec = (long)((fetch_deadline - (time_t)fetch_deadline) * 1.0e9);
+
+    while ((wait_result = sem_timedwait(&fetch_command.done,&t_deadline)) != 0 &&
+            errno == EINTR);
+
+    if (wait_result != 0){
+       fprintf(stderr,"collect_fetch_command: error waiting for command [%s]: %s\n",
+              fetch_command.command,strerror(errno));
+       fflush(stderr);
+       return(-1);
+    }
+
+    sem_destroy(&fetch_command.done);
+    fetch_command_busy = False;
+    if (fetch_command.result != 0){
+       fprintf(stderr,"collect_fetch_command: command [%s] failed\n",
+              fetch_command.command);
+       fflush(stderr);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/*****************************************************/
+
+/* choose exp_mode for the next exposure. continue_run is True if
+   another exposure is expected to follow at once, so that its image
+   can be left in controller memory until then */
+
+void select_exp_mode(char *exp_mode, bool continue_run)
+{
+    if (fetch_pending){
+       strcpy(exp_mode,EXP_MODE_NEXT);
+    }
+    else if (continue_run){
+       strcpy(exp_mode,EXP_MODE_FIRST);
+    }
+    else{
+       strcpy(exp_mode,EXP_MODE_SINGLE);
+    }
+}
+
+/*****************************************************/
+
+/* update the exposure run after an exposure of field f is started
+   with exp_mode. An EXP_MODE_NEXT exposure fetches the image left in
+   controller memory by the one before it, so that image is lost if
+   the exposure fails */
+
+static void note_exposure_run(char *exp_mode, char *filename, Field *f)
+{
+    readout_fetch_field = NULL;
+
+    if (strstr(exp_mode,EXP_MODE_FIRST)!=NULL){
+       run_exposures = 1;
+       run_dead_time = 0.0;
+    }
+    else if (strstr(exp_mode,EXP_MODE_NEXT)!=NULL){
+       run_exposures++;
+       readout_fetch_field = fetch_field;
+    }
+    else{
+       return;
+    }
+
+    fetch_pending = True;
+    strcpy(fetch_filename,filename);
+    fetch_field = f;
+}
+
+/*****************************************************/
+
+/* give up on the exposure run after a failure. The images left in
+   controller memory can't be relied on. f_lost is the field of an
+   image that was counted as taken but will not be fetched, or NULL */
+
+static void abandon_exposure_run(Field *f_lost)
+{
+    fprintf(stderr,"abandon_exposure_run: abandoning exposure run of %d exposures\n",
+       run_exposures);
+    fflush(stderr);
+
+    fetch_pending = False;
+    fetch_field = NULL;
+    lost_field = f_lost;
+}
+
+/*****************************************************/
+
+/* return the field whose image was lost when the exposure run was
+   last abandoned, or NULL, and forget it. The observation is to be
+   marked undone */
+
+Field *lost_run_field()
+{
+    Field *f;
+
+    f = lost_field;
+    lost_field = NULL;
+
+    return(f);
+}
+
+/*****************************************************/
+
+/* return True if the image of the last exposure is still to be
+   fetched with EXP_MODE_LAST */
+
+bool exposure_run_open()
+{
+    return(fetch_pending);
+}
+
+/*****************************************************/
+
+/* end the current exposure run, if any, by fetching its last image.
+   If wait_flag is False, the fetch runs in the camera worker and its
+   result is collected by wait_camera_readout. If the last exposure
+   is still reading out, the fetch is queued behind it, and
+   wait_camera_readout collects both. Otherwise the readout of the
+   last exposure must be complete */
+
+int end_exposure_run(bool wait_flag)
+{
+    char command[MAXBUFSIZE],reply[MAXBUFSIZE];
+    int timeout;
+
+    if (! fetch_pending) return(0);
+    fetch_pending = False;
+    fetch_field = NULL;
+
+    /* single exposures would each have waited for the transfer as well
+       as the readout */
+
+    fprintf(stderr,
+       "end_exposure_run: %d exposures with %7.1f sec between them, %7.1f sec less than single exposures\n",
+       run_exposures,run_dead_time,
+       (run_exposures-1)*(readout_time_sec+TRANSFER_TIME_SEC)-run_dead_time);
+    fflush(stderr);
+
+    sprintf(command,"%s False %9.3f %s %s",EXPOSE_COMMAND,0.0,fetch_filename,
+       EXP_MODE_LAST);
+    timeout = expose_timeout(EXP_MODE_LAST,0.0,wait_flag);
+
+    if (! wait_flag && readout_pending){
+       return(queue_fetch_command(command,timeout));
+    }
+    if (! wait_flag){
+       return(start_camera_command(command,timeout));
+    }
+
+    if(run_camera_command(command,reply,timeout)!=0){
+       fprintf(stderr,"end_exposure_run: error fetching %s\n",fetch_filename);
+       fflush(stderr);
+       return(-1);
+    }
+
+    return(0);
+}
+
+/*****************************************************/
+
 int clear_camera()
 {
      char reply[MAXBUFSIZE];
@@ -1005,8 +1609,7 @@ int clear_camera()
      }
      sprintf(command_string,"%s %d",CLEAR_COMMAND,clear_time);
 
-     command_id++;
-     if(do_camera_command(command_string,reply,timeout,command_id,host_name)!=0){
+     if(run_camera_command(command_string,reply,timeout)!=0){
        if(verbose){
          fprintf(stderr,"clear_camera: error clearing camera for %7.3f sec\n",clear_time);
          fflush(stderr);
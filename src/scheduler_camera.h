@@ -35,6 +35,19 @@ enum Amp_Direction_Code {BOTH_AMP_DIR,LEFT_AMP_DIR,RIGHT_AMP_DIR};
 #define BOTH_AMP_READOUT_TIME_SEC 20
 #define SINGLE_AMP_READOUT_TIME_SEC 40
 #define TRANSFER_TIME_SEC 10 /* normally 5 sec. Add 5 sec just in case */
+#define SHUTTER_CLOSE_MARGIN_SEC 1.0 /* extra wait for the shutter to close
+                                        when the camera status is not checked */
+#define CAMERA_QUEUE_LENGTH 8 /* commands that can wait for the camera worker */
+
+/* camera status polling (see wait_camera_event). Before the expected
+   time of an event, the wait between polls is half the time left,
+   kept within these limits. After it, the minimum is used */
+#define STATUS_POLL_MIN_SEC 0.05
+#define STATUS_POLL_MAX_SEC 5.0
+
+/* camera events seen by wait_camera_event */
+#define CAMERA_SHUTTER_CLOSED 1 /* EXPOSING cleared on all controllers */
+#define CAMERA_READOUT_STARTED 2 /* READING set on any controller */
 
 /* macro to calculate exposure overhead in hours given readout time insec */
 
@@ -84,6 +97,8 @@ enum Amp_Direction_Code {BOTH_AMP_DIR,LEFT_AMP_DIR,RIGHT_AMP_DIR};
 #define STATUS_COMMAND "status"
 #define CLEAR_COMMAND "clear"
 #define HEADER_COMMAND "header" /* h keyword value */
+#define HEADER_LIST_COMMAND "header_list" /* keyword value|keyword value... */
+#define HEADER_LIST_SEPARATOR "|" /* between keyword value pairs */
 #define EXPOSE_COMMAND "expose" /* shutter exptime fileroot */
 #define SHUTDOWN_COMMAND "shutdown"
 #define REBOOT_COMMAND "reboot"
@@ -0,0 +1,534 @@
+/* scheduler_events.c
+
+   Event-driven bookkeeping of field status for get_next_field.
+
+   The status of a field (see update_field_status in scheduler.c) only
+   changes at known instants:
+
+     jd_rise                         NOT_DOABLE -> observable
+     jd_next - MIN_EXECUTION_TIME    NOT_DOABLE -> observable
+     jd_set - time_required          READY -> TOO_LATE (time_left < 0)
+     jd_set                          any -> NOT_DOABLE (set)
+
+   or when the field itself is changed (observed, interval shortened,
+   exposure marked undone, new fields added), or when the bad_weather
+   flag toggles.
+
+   Each field has one entry in a min-heap (events) keyed on the jd of
+   its next possible status change. update_field_events pops the
+   entries that have come due and re-evaluates only those fields.
+   Fields changed by the scheduler are queued for re-evaluation with
+   field_status_changed.
+
+   The re-evaluated status also places each field in one of these
+   candidate sets, which get_next_field reads directly:
+
+     do_now         DO_NOW_STATUS
+     ready_must_do  READY_STATUS, MUSTDO_SURVEY_CODE
+     late_must_do   TOO_LATE_STATUS, MUSTDO_SURVEY_CODE
+     ready          READY_STATUS, other survey codes
+     late           TOO_LATE_STATUS, other survey codes
+
+   For READY and TOO_LATE fields, time_left at jd is
+   (jd_set - jd)*24 - time_required, so at any jd the order of
+   time_left between two fields is the order of their deadlines,
+   jd_set - time_required/24 (kept as hours from a reference jd,
+   jd_ref, to keep its precision). That lets the ready and late sets be
+   heaps keyed on (n_left, deadline) and (-deadline), with the
+   field index as the final tie-break so the same field is chosen
+   as by a scan in index order. The must-do and do_now sets are
+   short and are kept as plain lists.
+
+*/
+
+#include "scheduler.h"
+
+extern int verbose1;
+
+#define NO_STATUS_CHANGE HUGE_VAL /* event key for fields that can't change */
+#define CHANGED_NOW (-HUGE_VAL)   /* event key for fields changed by the caller */
+
+/************************************************************/
+
+/* heap ordering: key1, then key2, then field index */
+
+static int heap_less(Field_Heap *h, int i1, int i2)
+{
+    if(h->key1[i1]!=h->key1[i2])return(h->key1[i1]<h->key1[i2]);
+    if(h->key2[i1]!=h->key2[i2])return(h->key2[i1]<h->key2[i2]);
+    return(i1<i2);
+}
+
+/************************************************************/
+
+static void heap_swap(Field_Heap *h, int p1, int p2)
+{
+    int i1,i2;
+
+    i1=h->item[p1];
+    i2=h->item[p2];
+    h->item[p1]=i2;
+    h->item[p2]=i1;
+    h->pos[i2]=p1;
+    h->pos[i1]=p2;
+}
+
+/************************************************************/
+
+static void heap_up(Field_Heap *h, int p)
+{
+    int parent;
+
+    while(p>0){
+       parent=(p-1)/2;
+       if(!heap_less(h,h->item[p],h->item[parent]))break;
+       heap_swap(h,p,parent);
+       p=parent;
+    }
+}
+
+/************************************************************/
+
+static void heap_down(Field_Heap *h, int p)
+{
+    int child;
+
+    while((child=2*p+1)<h->n){
+       if(child+1<h->n&&heap_less(h,h->item[child+1],h->item[child]))child++;
+       if(!heap_less(h,h->item[child],h->item[p]))break;
+       heap_swap(h,p,child);
+       p=child;
+    }
+}
+
+/************************************************************/
+
+/* insert field i with the given keys, or move it if already present */
+
+static void heap_set(Field_Heap *h, int i, double key1, double key2)
+{
+    int p;
+
+    h->key1[i]=key1;
+    h->key2[i]=key2;
+
+    if(h->pos[i]<0){
+       p=h->n;
+       h->item[p]=i;
+       h->pos[i]=p;
+       h->n++;
+       heap_up(h,p);
+    }
+    else{
+       p=h->pos[i];
+       heap_up(h,p);
+       heap_down(h,h->pos[i]);
+    }
+}
+
+/************************************************************/
+
+static void heap_remove(Field_Heap *h, int i)
+{
+    int p,last,moved;
+
+    p=h->pos[i];
+    if(p<0)return;
+
+    last=h->n-1;
+    if(p!=last){
+       heap_swap(h,p,last);
+    }
+    h->n--;
+    h->pos[i]=-1;
+
+    /* restore heap order around the entry moved into position p */
+
+    if(p<h->n){
+       moved=h->item[p];
+       heap_up(h,p);
+       heap_down(h,h->pos[moved]);
+    }
+}
+
+/************************************************************/
+
+static void set_add(Field_Set *s, int i)
+{
+    if(s->pos[i]>=0)return;
+    s->item[s->n]=i;
+    s->pos[i]=s->n;
+    s->n++;
+}
+
+/************************************************************/
+
+static void set_remove(Field_Set *s, int i)
+{
+    int p,last;
+
+    p=s->pos[i];
+    if(p<0)return;
+
+    last=s->item[s->n-1];
+    s->item[p]=last;
+    s->pos[last]=p;
+    s->n--;
+    s->pos[i]=-1;
+}
+
+/************************************************************/
+
+static int grow_heap(Field_Heap *h, int n_old, int n_new)
+{
+    int i;
+    int *item,*pos;
+    double *key1,*key2;
+
+    item=(int *)realloc(h->item,n_new*sizeof(int));
+    if(item!=NULL)h->item=item;
+    pos=(int *)realloc(h->pos,n_new*sizeof(int));
+    if(pos!=NULL)h->pos=pos;
+    key1=(double *)realloc(h->key1,n_new*sizeof(double));
+    if(key1!=NULL)h->key1=key1;
+    key2=(double *)realloc(h->key2,n_new*sizeof(double));
+    if(key2!=NULL)h->key2=key2;
+
+    if(item==NULL||pos==NULL||key1==NULL||key2==NULL)return(-1);
+
+    for(i=n_old;i<n_new;i++){
+       h->pos[i]=-1;
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+static int grow_set(Field_Set *s, int n_old, int n_new)
+{
+    int i;
+    int *item,*pos;
+
+    item=(int *)realloc(s->item,n_new*sizeof(int));
+    if(item!=NULL)s->item=item;
+    pos=(int *)realloc(s->pos,n_new*sizeof(int));
+    if(pos!=NULL)s->pos=pos;
+
+    if(item==NULL||pos==NULL)return(-1);
+
+    for(i=n_old;i<n_new;i++){
+       s->pos[i]=-1;
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+static int grow_field_events(Field_Events *e, int num_fields)
+{
+    int n_alloc;
+
+    if(num_fields<=e->max_fields)return(0);
+
+    n_alloc=e->max_fields>0 ? e->max_fields : FIELD_EVENTS_BLOCK;
+    while(n_alloc<num_fields)n_alloc=2*n_alloc;
+
+    if(grow_heap(&e->events,e->max_fields,n_alloc)!=0||
+       grow_heap(&e->ready,e->max_fields,n_alloc)!=0||
+       grow_heap(&e->late,e->max_fields,n_alloc)!=0||
+       grow_set(&e->do_now,e->max_fields,n_alloc)!=0||
+       grow_set(&e->ready_must_do,e->max_fields,n_alloc)!=0||
+       grow_set(&e->late_must_do,e->max_fields,n_alloc)!=0){
+       fprintf(stderr,"grow_field_events: could not allocate %d entries\n",
+          n_alloc);
+       return(-1);
+    }
+
+    e->max_fields=n_alloc;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* jd of the next possible change in the status of field f, which
+   has just been updated at jd. Mirrors the tests in update_field_status.
+   The result is always later than jd so that a field is re-evaluated
+   at most once per call to update_field_events. */
+
+static double next_status_change(Field *f, double jd)
+{
+    double jd_change;
+
+    if(f->doable==0){
+       return(NO_STATUS_CHANGE);
+    }
+    else if(jd<f->jd_rise){
+       jd_change=f->jd_rise;
+    }
+    else if(f->jd_next-jd>(MIN_EXECUTION_TIME/24.0)){
+       jd_change=f->jd_next-(MIN_EXECUTION_TIME/24.0);
+    }
+    else if(f->status==READY_STATUS){
+       jd_change=f->jd_set-(f->time_required/24.0);
+    }
+    else{
+       /* status is fixed until the field sets (jd > jd_set) */
+       jd_change=nextafter(f->jd_set,HUGE_VAL);
+    }
+
+    if(jd_change<=jd)jd_change=nextafter(jd,HUGE_VAL);
+
+    return(jd_change);
+}
+
+/************************************************************/
+
+/* re-evaluate the status of field i at jd and move it to the
+   matching candidate set */
+
+int refresh_field_events(Field_Events *e, Field *sequence, int i,
+        double jd, int bad_weather)
+{
+    Field *f;
+    double deadline,jd_change;
+
+    f=sequence+i;
+
+    update_field_status(f,jd,bad_weather);
+
+    heap_remove(&e->ready,i);
+    heap_remove(&e->late,i);
+    set_remove(&e->do_now,i);
+    set_remove(&e->ready_must_do,i);
+    set_remove(&e->late_must_do,i);
+
+    /* deadline in hours from jd_ref rather than as a jd, so that
+       it keeps the precision of time_left */
+
+    deadline=(f->jd_set-e->jd_ref)*24.0-f->time_required;
+
+    if(f->status==DO_NOW_STATUS){
+       set_add(&e->do_now,i);
+    }
+    else if(f->status==READY_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE){
+       set_add(&e->ready_must_do,i);
+    }
+    else if(f->status==READY_STATUS){
+       heap_set(&e->ready,i,(double)(f->n_required-f->n_done),deadline);
+    }
+    else if(f->status==TOO_LATE_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE){
+       set_add(&e->late_must_do,i);
+    }
+    else if(f->status==TOO_LATE_STATUS){
+       heap_set(&e->late,i,-deadline,0.0);
+    }
+
+    jd_change=next_status_change(f,jd);
+    if(jd_change==NO_STATUS_CHANGE){
+       heap_remove(&e->events,i);
+    }
+    else{
+       heap_set(&e->events,i,jd_change,0.0);
+    }
+
+    return(f->status);
+}
+
+/************************************************************/
+
+/* queue field i for re-evaluation on the next update */
+
+void field_status_changed(Field_Events *e, int i)
+{
+    if(i<0||i>=e->num_fields)return;
+    heap_set(&e->events,i,CHANGED_NOW,0.0);
+}
+
+/************************************************************/
+
+/* start tracking num_fields fields. All are evaluated on the
+   next update */
+
+int init_field_events(Field_Events *e, int num_fields)
+{
+    int i;
+
+    if(grow_field_events(e,num_fields)!=0){
+       fprintf(stderr,"init_field_events: could not track %d fields\n",
+          num_fields);
+       return(-1);
+    }
+
+    for(i=0;i<e->num_fields;i++){
+       heap_remove(&e->events,i);
+       heap_remove(&e->ready,i);
+       heap_remove(&e->late,i);
+       set_remove(&e->do_now,i);
+       set_remove(&e->ready_must_do,i);
+       set_remove(&e->late_must_do,i);
+    }
+
+    e->num_fields=num_fields;
+    e->initialized=0;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* extend tracking to fields appended to the sequence, which now
+   holds num_fields fields */
+
+int add_field_events(Field_Events *e, int num_fields)
+{
+    int i,n_old;
+
+    if(grow_field_events(e,num_fields)!=0){
+       fprintf(stderr,"add_field_events: could not track %d fields\n",
+          num_fields);
+       return(-1);
+    }
+
+    n_old=e->num_fields;
+    e->num_fields=num_fields;
+    for(i=n_old;i<num_fields;i++){
+       field_status_changed(e,i);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* bring the status of every field up to date at jd, re-evaluating
+   only fields with a pending event. All fields are re-evaluated on
+   the first call, when bad_weather changes, or if jd goes backwards.
+   Returns the number of fields re-evaluated. */
+
+int update_field_events(Field_Events *e, Field *sequence, double jd,
+        int bad_weather)
+{
+    int i,n;
+
+    if(!e->initialized||bad_weather!=e->bad_weather||jd<e->jd){
+       if(!e->initialized)e->jd_ref=jd;
+       for(i=0;i<e->num_fields;i++){
+          field_status_changed(e,i);
+       }
+       e->initialized=1;
+       e->bad_weather=bad_weather;
+    }
+    e->jd=jd;
+
+    n=0;
+    while(e->events.n>0&&e->events.key1[e->events.item[0]]<=jd){
+       i=e->events.item[0];
+       refresh_field_events(e,sequence,i,jd,bad_weather);
+       n++;
+    }
+
+    if(verbose1){
+       fprintf(stderr,
+         "update_field_events: %d of %d fields re-evaluated. do_now %d ready_must_do %d late_must_do %d ready %d late %d\n",
+         n,e->num_fields,e->do_now.n,e->ready_must_do.n,e->late_must_do.n,
+         e->ready.n,e->late.n);
+    }
+
+    return(n);
+}
+
+/************************************************************/
+
+/* jd of the next pending status change, as of the last update, or
+   HUGE_VAL if no field can change */
+
+double next_field_event(Field_Events *e)
+{
+    if(e->events.n==0)return(NO_STATUS_CHANGE);
+
+    return(e->events.key1[e->events.item[0]]);
+}
+
+/************************************************************/
+
+/* copy to item the ready fields with the same n_left as the top of
+   the ready heap and a deadline no more than window hours later, up
+   to max_items of them, top first. Since no entry is less than its
+   parent, the subtree under an entry outside these bounds can be
+   skipped. Returns the number of fields copied */
+
+int get_ready_ties(Field_Events *e, double window, int *item, int max_items)
+{
+    Field_Heap *h;
+    int stack[2*MAX_SLEW_CANDIDATES+1];
+    int n,n_stack,p,i,child;
+    double key1,key2_max;
+
+    h=&e->ready;
+    if(h->n==0||max_items<=0)return(0);
+    if(max_items>MAX_SLEW_CANDIDATES)max_items=MAX_SLEW_CANDIDATES;
+
+    key1=h->key1[h->item[0]];
+    key2_max=h->key2[h->item[0]]+window;
+
+    n=0;
+    n_stack=0;
+    stack[n_stack++]=0;
+    while(n_stack>0&&n<max_items){
+       p=stack[--n_stack];
+       i=h->item[p];
+       if(h->key1[i]!=key1||h->key2[i]>key2_max)continue;
+       item[n++]=i;
+       for(child=2*p+2;child>=2*p+1;child--){
+          if(child<h->n)stack[n_stack++]=child;
+       }
+    }
+
+    return(n);
+}
+
+/************************************************************/
+
+static void free_heap(Field_Heap *h)
+{
+    if(h->item!=NULL)free(h->item);
+    if(h->pos!=NULL)free(h->pos);
+    if(h->key1!=NULL)free(h->key1);
+    if(h->key2!=NULL)free(h->key2);
+    h->item=NULL;
+    h->pos=NULL;
+    h->key1=NULL;
+    h->key2=NULL;
+    h->n=0;
+}
+
+/************************************************************/
+
+static void free_set(Field_Set *s)
+{
+    if(s->item!=NULL)free(s->item);
+    if(s->pos!=NULL)free(s->pos);
+    s->item=NULL;
+    s->pos=NULL;
+    s->n=0;
+}
+
+/************************************************************/
+
+void free_field_events(Field_Events *e)
+{
+    free_heap(&e->events);
+    free_heap(&e->ready);
+    free_heap(&e->late);
+    free_set(&e->do_now);
+    free_set(&e->ready_must_do);
+    free_set(&e->late_must_do);
+    e->num_fields=0;
+    e->max_fields=0;
+    e->initialized=0;
+}
+
+/************************************************************/
@@ -0,0 +1,109 @@
+/* scheduler_fields.c
+
+   Growable, heap-allocated store for the fields of a sequence.
+
+   The fields are kept in one contiguous array so that the selection
+   code can keep addressing them as sequence+i. Fields are only ever
+   appended, so the index of a field never changes. The array is
+   reallocated (doubling) as it grows, so callers must refresh any
+   Field pointer into the table after a call that can add fields
+   (grow_field_table, load_sequence, add_new_fields, load_obs_record).
+
+   Field holds only the scheduling state. The script line and the
+   per-observation history (several KB per field) are kept in a
+   parallel array of Field_History, reached through f->hist, so that
+   a pass over the fields does not pull them through the cache.
+   grow_field_table re-points f->hist of every field whenever the
+   history array moves. Fields copied between tables must go through
+   copy_field so that the history is copied too.
+
+*/
+
+#include "scheduler.h"
+
+/************************************************************/
+
+int init_field_table(Field_Table *table)
+{
+    table->num_fields=0;
+    table->max_fields=0;
+    table->fields=NULL;
+    table->history=NULL;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* make sure the table has room for at least n fields. New entries are
+   zeroed */
+
+int grow_field_table(Field_Table *table, int n)
+{
+    int i,n_alloc;
+    Field *fields;
+    Field_History *history;
+
+    if(n<=table->max_fields)return(0);
+
+    n_alloc=table->max_fields>0 ? table->max_fields : FIELD_TABLE_BLOCK;
+    while(n_alloc<n)n_alloc=2*n_alloc;
+
+    fields=(Field *)realloc(table->fields,n_alloc*sizeof(Field));
+    if(fields==NULL){
+       fprintf(stderr,"grow_field_table: could not allocate %d fields\n",
+          n_alloc);
+       return(-1);
+    }
+
+    table->fields=fields;
+
+    history=(Field_History *)realloc(table->history,n_alloc*sizeof(Field_History));
+    if(history==NULL){
+       fprintf(stderr,"grow_field_table: could not allocate history for %d fields\n",
+          n_alloc);
+       return(-1);
+    }
+    table->history=history;
+
+    memset(fields+table->max_fields,0,
+       (n_alloc-table->max_fields)*sizeof(Field));
+    memset(history+table->max_fields,0,
+       (n_alloc-table->max_fields)*sizeof(Field_History));
+
+    for(i=0;i<n_alloc;i++){
+       fields[i].hist=history+i;
+    }
+
+    table->max_fields=n_alloc;
+
+    return(0);
+}
+
+/************************************************************/
+
+void free_field_table(Field_Table *table)
+{
+    if(table->fields!=NULL)free(table->fields);
+    if(table->history!=NULL)free(table->history);
+    init_field_table(table);
+}
+
+/************************************************************/
+
+/* copy field src, including its history, to dest. dest keeps its own
+   history slot */
+
+int copy_field(Field *dest, Field *src)
+{
+    Field_History *hist;
+
+    hist=dest->hist;
+    *dest=*src;
+    dest->hist=hist;
+    *(dest->hist)=*(src->hist);
+
+    return(0);
+}
+
+/************************************************************/
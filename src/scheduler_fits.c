@@ -43,7 +43,10 @@ int update_fits_header(Fits_Header *header, char *keyword, char *value)
       return(-1);
     }
 
-    strcpy(header->fits_word[i].value,value);
+    if(strcmp(header->fits_word[i].value,value)!=0){
+       strcpy(header->fits_word[i].value,value);
+       header->fits_word[i].changed=1;
+    }
 
     if(verbose){
        fprintf(stderr,"update_fits_header: %d %s %s\n",
@@ -92,6 +95,7 @@ int add_fits_word(Fits_Header *header,char *keyword, char *value)
 
     strcpy(header->fits_word[n].keyword,keyword);
     strcpy(header->fits_word[n].value,value);
+    header->fits_word[n].changed=1;
 
     n++;
     header->num_words=n;
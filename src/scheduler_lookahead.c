@@ -0,0 +1,496 @@
+/* scheduler_lookahead.c
+
+   Optional lookahead for get_next_field. When the next field is to be
+   chosen among the ready fields, simulate the next lookahead_depth
+   selections of the selection policy (see scheduler_policy.c) and
+   take the first step of the best sequence found.
+
+   The simulation runs on copies of the LOOKAHEAD_FIELDS most urgent
+   sky fields that are ready, or become ready within the horizon, with
+   must-do fields first. At each step the status of each copy is found
+   with update_field_status, and the next field is chosen as
+   get_next_field would: a ready must-do field, then a late must-do
+   field, then the pair to the last field, are taken without a choice.
+   Otherwise up to LOOKAHEAD_BRANCH ready fields are tried: the most
+   urgent ones, and the nearest one by slew time. Each visit costs the
+   predicted slew (get_slew_time_between), the exposure time and
+   exp_overhead_hours.
+
+   This is a beam search: the LOOKAHEAD_BEAM best sequences are kept at
+   each depth. A sequence scores (n_done/n_required)^2 for each visit,
+   so that visits which finish fields count most, and
+   LOOKAHEAD_COMPLETION_BONUS for each field it completes, less the
+   time it takes (in units of the mean visit), LOOKAHEAD_LATE_PENALTY
+   for each field that goes too late or sets unfinished, and
+   LOOKAHEAD_MUSTDO_PENALTY if that field is a must-do field.
+
+   Whether a field is up within the horizon, and whether its remaining
+   visits can still be made before it sets, are read from the
+   visibility bitsets (scheduler_visibility.c).
+
+   The search is stopped after LOOKAHEAD_READOUT_FRACTION of the
+   readout time (or LOOKAHEAD_MAX_SEC), so that it runs while the last
+   exposure reads out. It then uses the last depth it completed.
+
+*/
+
+#include "scheduler.h"
+#include <sys/time.h>
+
+extern int verbose1;
+extern double exp_overhead_hours;
+extern Visibility_Table visibility_table;
+
+typedef struct {
+    double jd;          /* end of the last simulated visit */
+    double ra;          /* telescope position (hours, deg) */
+    double dec;
+    int position_known;
+    double score;
+    int n_visits;
+    double progress;    /* sum over visits of (n_done/n_required)^2 after each */
+    int first;          /* candidate visited first, -1 if none */
+    int last;           /* candidate visited last, -1 if none */
+    int n_done[LOOKAHEAD_FIELDS];
+    double jd_next[LOOKAHEAD_FIELDS];
+} Lookahead_Node;
+
+/* fields simulated by the lookahead */
+
+typedef struct {
+    int n;
+    double jd_start;
+    double visit_hours;               /* mean time of a visit */
+    int index[LOOKAHEAD_FIELDS];      /* index in sequence */
+    double key[LOOKAHEAD_FIELDS];     /* urgency, must-do fields first */
+    int pair[LOOKAHEAD_FIELDS];       /* candidate paired with this one, or -1 */
+    int paired_after[LOOKAHEAD_FIELDS]; /* candidate this one is paired after, or -1 */
+    double jd_until[LOOKAHEAD_FIELDS]; /* end of the time it is up */
+    int doable[LOOKAHEAD_FIELDS];     /* doable at the start */
+    int late[LOOKAHEAD_FIELDS];       /* too late at the start */
+    Field work[LOOKAHEAD_FIELDS];     /* copies evaluated at each node */
+} Lookahead_Fields;
+
+static Lookahead_Fields cand;
+static Lookahead_Node beam[LOOKAHEAD_BEAM];
+static Lookahead_Node next_beam[LOOKAHEAD_BEAM*LOOKAHEAD_BRANCH];
+
+/************************************************************/
+
+static double elapsed_sec(struct timeval *t0)
+{
+    struct timeval t;
+
+    gettimeofday(&t,NULL);
+    return((t.tv_sec-t0->tv_sec)+1.0e-6*(t.tv_usec-t0->tv_usec));
+}
+
+/************************************************************/
+
+/* 1 if field i of sequence is up at some time between jd and jd_end */
+
+static int up_between(Field *sequence, int i, double jd, double jd_end)
+{
+    double jd_up;
+
+    if(i>=visibility_table.num_fields){
+       return(sequence[i].jd_set>jd&&sequence[i].jd_rise<=jd_end);
+    }
+
+    jd_up=next_visible_jd(&visibility_table,i,jd);
+
+    return(jd_up>=0.0&&jd_up<=jd_end);
+}
+
+/************************************************************/
+
+/* jd at which field i of sequence stops being up, after it is next
+   up at or after jd */
+
+static double up_until(Field *sequence, int i, double jd)
+{
+    if(i>=visibility_table.num_fields)return(sequence[i].jd_set);
+
+    return(visible_until_jd(&visibility_table,i,jd));
+}
+
+/************************************************************/
+
+/* 1 if candidate k, as of node, is still up for the last of its
+   remaining visits made as soon as it is ready */
+
+static int can_finish(Lookahead_Node *node, int k)
+{
+    Field *w;
+    double jd;
+
+    w=cand.work+k;
+
+    jd=node->jd_next[k];
+    if(jd<node->jd)jd=node->jd;
+
+    jd=jd+(w->n_required-node->n_done[k]-1)*w->interval/24.0;
+
+    return(jd<cand.jd_until[k]);
+}
+
+/************************************************************/
+
+/* collect the most urgent sky fields that can be observed between jd
+   and jd_end, in order of urgency */
+
+static int get_candidates(Field *sequence, int num_fields, double jd,
+        double jd_end, int bad_weather)
+{
+    Field *f;
+    double key,visit_hours;
+    int i,j,k;
+
+    cand.n=0;
+    cand.jd_start=jd;
+
+    for(i=0;i<num_fields;i++){
+       f=sequence+i;
+       if(!f->doable||f->shutter!=SKY_CODE||f->n_done>=f->n_required)continue;
+       if(!up_between(sequence,i,jd,jd_end))continue;
+       if(f->jd_next-(MIN_EXECUTION_TIME/24.0)>jd_end)continue;
+
+       /* deadline in hours from jd, as in scheduler_events.c */
+
+       key=(f->jd_set-jd)*24.0-(f->n_required-f->n_done)*f->interval;
+       if(f->survey_code==MUSTDO_SURVEY_CODE)key=key-MAX_INTERVAL*100.0;
+
+       if(cand.n==LOOKAHEAD_FIELDS&&key>=cand.key[cand.n-1])continue;
+       if(cand.n<LOOKAHEAD_FIELDS)cand.n++;
+       for(k=cand.n-1;k>0&&cand.key[k-1]>key;k--){
+          cand.key[k]=cand.key[k-1];
+          cand.index[k]=cand.index[k-1];
+       }
+       cand.key[k]=key;
+       cand.index[k]=i;
+    }
+
+    for(k=0;k<cand.n;k++)cand.paired_after[k]=-1;
+
+    visit_hours=0.0;
+    for(k=0;k<cand.n;k++){
+       i=cand.index[k];
+       cand.work[k]=sequence[i];
+       cand.doable[k]=sequence[i].doable;
+       cand.jd_until[k]=up_until(sequence,i,jd);
+       cand.pair[k]=-1;
+       for(j=0;j<cand.n;j++){
+          if(cand.index[j]==i+1&&paired_fields(sequence+i+1,sequence+i)){
+             cand.pair[k]=j;
+             cand.paired_after[j]=k;
+          }
+       }
+       update_field_status(cand.work+k,jd,bad_weather);
+       cand.late[k]=(cand.work[k].status==TOO_LATE_STATUS);
+       visit_hours=visit_hours+cand.work[k].expt+exp_overhead_hours;
+    }
+    if(cand.n>0)cand.visit_hours=visit_hours/cand.n;
+
+    return(cand.n);
+}
+
+/************************************************************/
+
+/* find the status of each candidate at the end of node, and score it */
+
+static void evaluate_node(Lookahead_Node *node, int bad_weather)
+{
+    Field *w;
+    double score;
+    int k;
+
+    score=node->progress;
+    if(cand.visit_hours>0.0){
+       score=score-(node->jd-cand.jd_start)*24.0/cand.visit_hours;
+    }
+
+    for(k=0;k<cand.n;k++){
+       w=cand.work+k;
+       w->n_done=node->n_done[k];
+       w->jd_next=node->jd_next[k];
+       w->doable=cand.doable[k];
+       update_field_status(w,node->jd,bad_weather);
+
+       /* all candidates were unfinished at the start */
+
+       if(w->n_done==w->n_required){
+          score=score+LOOKAHEAD_COMPLETION_BONUS;
+       }
+       else if(!cand.late[k]&&
+               (w->status==TOO_LATE_STATUS||!can_finish(node,k))){
+          if(w->survey_code==MUSTDO_SURVEY_CODE){
+             score=score-LOOKAHEAD_MUSTDO_PENALTY;
+          }
+          else{
+             score=score-LOOKAHEAD_LATE_PENALTY;
+          }
+       }
+    }
+
+    node->score=score;
+}
+
+/************************************************************/
+
+/* 1 if candidate k1 comes before k2 in the ready heap: fewer
+   observations left, then less time left */
+
+static int more_urgent(int k1, int k2)
+{
+    Field *w1,*w2;
+
+    w1=cand.work+k1;
+    w2=cand.work+k2;
+    if(w1->n_required-w1->n_done!=w2->n_required-w2->n_done){
+       return(w1->n_required-w1->n_done<w2->n_required-w2->n_done);
+    }
+    return(w1->time_left<w2->time_left);
+}
+
+/************************************************************/
+
+/* 1 if candidate k is the second of a pair whose first field is still
+   to be observed as often, so that choosing k would break the order
+   of the pair */
+
+static int out_of_pair_order(Lookahead_Node *node, int k)
+{
+    int j;
+
+    j=cand.paired_after[k];
+
+    return(j>=0&&cand.work[j].doable&&node->n_done[j]<=node->n_done[k]);
+}
+
+/************************************************************/
+
+/* the choices of the next candidate after node, as get_next_field
+   would make them. At the root, only ready fields are tried, starting
+   with k_greedy. Returns the number of choices */
+
+static int get_choices(Lookahead_Node *node, int k_greedy, int *choice)
+{
+    Field *w;
+    double slew,slew_min;
+    int k,j,n,k_must_do,k_late_must_do,k_late,k_near;
+
+    if(k_greedy<0){
+       k_must_do=-1;
+       k_late_must_do=-1;
+       for(k=0;k<cand.n;k++){
+          w=cand.work+k;
+          if(w->survey_code!=MUSTDO_SURVEY_CODE)continue;
+          if(w->status==READY_STATUS&&(k_must_do<0||
+             w->time_left<cand.work[k_must_do].time_left))k_must_do=k;
+          if(w->status==TOO_LATE_STATUS&&(k_late_must_do<0||
+             w->time_left<cand.work[k_late_must_do].time_left))k_late_must_do=k;
+       }
+       if(k_must_do>=0){
+          choice[0]=k_must_do;
+          return(1);
+       }
+       if(k_late_must_do>=0){
+          choice[0]=k_late_must_do;
+          return(1);
+       }
+
+       k=node->last;
+       if(k>=0&&cand.pair[k]>=0&&cand.work[cand.pair[k]].doable){
+          choice[0]=cand.pair[k];
+          return(1);
+       }
+    }
+
+    /* the LOOKAHEAD_BRANCH-1 most urgent ready fields (after k_greedy
+       at the root) */
+
+    n=0;
+    if(k_greedy>=0)choice[n++]=k_greedy;
+    for(k=0;k<cand.n;k++){
+       if(cand.work[k].status!=READY_STATUS||k==k_greedy)continue;
+       if(out_of_pair_order(node,k))continue;
+       if(n==LOOKAHEAD_BRANCH-1&&!more_urgent(k,choice[n-1]))continue;
+       if(n<LOOKAHEAD_BRANCH-1)n++;
+       for(j=n-1;j>(k_greedy>=0?1:0)&&more_urgent(k,choice[j-1]);j--){
+          choice[j]=choice[j-1];
+       }
+       choice[j]=k;
+    }
+
+    /* and the nearest one */
+
+    k_near=-1;
+    slew_min=HUGE_VAL;
+    if(node->position_known){
+       for(k=0;k<cand.n;k++){
+          w=cand.work+k;
+          if(w->status!=READY_STATUS||out_of_pair_order(node,k))continue;
+          slew=get_slew_time_between(node->ra,node->dec,w->ra,w->dec);
+          if(slew<slew_min){
+             slew_min=slew;
+             k_near=k;
+          }
+       }
+    }
+    for(j=0;j<n;j++){
+       if(choice[j]==k_near)k_near=-1;
+    }
+    if(k_near>=0)choice[n++]=k_near;
+
+    /* with no field ready, the late field with the most time left */
+
+    if(n==0&&k_greedy<0){
+       k_late=-1;
+       for(k=0;k<cand.n;k++){
+          w=cand.work+k;
+          if(w->status==TOO_LATE_STATUS&&(k_late<0||
+             w->time_left>cand.work[k_late].time_left))k_late=k;
+       }
+       if(k_late>=0)choice[n++]=k_late;
+    }
+
+    return(n);
+}
+
+/************************************************************/
+
+/* child is node followed by a visit to candidate k */
+
+static void visit_candidate(Lookahead_Node *child, Lookahead_Node *node, int k)
+{
+    Field *w;
+    double jd;
+
+    w=cand.work+k;
+    *child=*node;
+
+    jd=node->jd;
+    if(node->position_known){
+       jd=jd+get_slew_time_between(node->ra,node->dec,w->ra,w->dec)/86400.0;
+    }
+
+    child->n_done[k]=node->n_done[k]+1;
+    child->jd_next[k]=jd+(w->interval/24.0);
+    child->jd=jd+(w->expt+exp_overhead_hours)/24.0;
+    child->ra=w->ra;
+    child->dec=w->dec;
+    child->position_known=1;
+    child->n_visits=node->n_visits+1;
+    child->progress=node->progress+
+       (double)child->n_done[k]*child->n_done[k]/(w->n_required*w->n_required);
+    child->last=k;
+    if(node->first<0)child->first=k;
+}
+
+/************************************************************/
+
+/* Choose the next field among the ready fields by simulating
+   max_depth selections ahead. i_greedy is the ready field
+   get_next_field would choose. Returns the index of the chosen field,
+   which is i_greedy if lookahead is off or finds nothing better */
+
+int lookahead_next_field(Field *sequence, int num_fields, int i_greedy,
+        double jd, int bad_weather, int max_depth)
+{
+    struct timeval t0;
+    Lookahead_Node *node;
+    double max_sec,jd_end;
+    int choice[LOOKAHEAD_BRANCH+1];
+    int depth,n_beam,n_next,n_choice,b,c,k,k_greedy,k_best,timed_out;
+
+    if(max_depth<=0||i_greedy<0)return(i_greedy);
+
+    gettimeofday(&t0,NULL);
+
+    max_sec=LOOKAHEAD_READOUT_FRACTION*exp_overhead_hours*3600.0;
+    if(max_sec<=0.0||max_sec>LOOKAHEAD_MAX_SEC)max_sec=LOOKAHEAD_MAX_SEC;
+
+    jd_end=jd+max_depth*(MAX_EXPT/3600.0+exp_overhead_hours)/24.0;
+
+    if(get_candidates(sequence,num_fields,jd,jd_end,bad_weather)<2){
+       return(i_greedy);
+    }
+
+    k_greedy=-1;
+    for(k=0;k<cand.n;k++){
+       if(cand.index[k]==i_greedy)k_greedy=k;
+    }
+    if(k_greedy<0||cand.work[k_greedy].status!=READY_STATUS){
+       return(i_greedy);
+    }
+
+    node=beam;
+    node->jd=jd;
+    node->position_known=(get_slew_position(&node->ra,&node->dec)==0);
+    node->score=0.0;
+    node->n_visits=0;
+    node->progress=0.0;
+    node->first=-1;
+    node->last=-1;
+    for(k=0;k<cand.n;k++){
+       node->n_done[k]=cand.work[k].n_done;
+       node->jd_next[k]=cand.work[k].jd_next;
+    }
+    evaluate_node(node,bad_weather);
+    n_beam=1;
+
+    timed_out=0;
+    for(depth=0;depth<max_depth&&!timed_out;depth++){
+       n_next=0;
+       for(b=0;b<n_beam&&!timed_out;b++){
+          if(depth>0)evaluate_node(beam+b,bad_weather);
+          n_choice=get_choices(beam+b,depth==0?k_greedy:-1,choice);
+          if(n_choice==0){
+             next_beam[n_next++]=beam[b];
+             continue;
+          }
+          for(c=0;c<n_choice;c++){
+             visit_candidate(next_beam+n_next,beam+b,choice[c]);
+             evaluate_node(next_beam+n_next,bad_weather);
+             n_next++;
+          }
+          if(elapsed_sec(&t0)>max_sec)timed_out=1;
+       }
+
+       /* a depth cut short is dropped, unless it is the first */
+
+       if(timed_out&&depth>0)break;
+
+       /* keep the best LOOKAHEAD_BEAM sequences, earlier ones first on
+          equal scores (so the greedy choice wins ties) */
+
+       for(b=0;b<LOOKAHEAD_BEAM&&b<n_next;b++){
+          k_best=b;
+          for(c=b+1;c<n_next;c++){
+             if(next_beam[c].score>next_beam[k_best].score)k_best=c;
+          }
+          beam[b]=next_beam[k_best];
+          for(c=k_best;c>b;c--)next_beam[c]=next_beam[c-1];
+       }
+       n_beam=b;
+    }
+
+    k_best=0;
+    for(b=1;b<n_beam;b++){
+       if(beam[b].score>beam[k_best].score)k_best=b;
+    }
+    if(beam[k_best].first<0)return(i_greedy);
+
+    k=beam[k_best].first;
+
+    if(verbose1){
+       fprintf(stderr,
+          "lookahead_next_field: field %d (greedy %d) score %7.3f after %d visits, depth %d of %d, %d candidates, %7.4f sec%s\n",
+          cand.index[k],i_greedy,beam[k_best].score,beam[k_best].n_visits,
+          depth,max_depth,cand.n,elapsed_sec(&t0),timed_out?" (timed out)":"");
+    }
+
+    return(cand.index[k]);
+}
+
+/************************************************************/
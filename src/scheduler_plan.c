@@ -0,0 +1,738 @@
+/* scheduler_plan.c
+
+   Whole-night plan: an ordered list of the visits to make tonight,
+   solved before the night starts, that the planned selection policy
+   then follows.
+
+   Solving the plan
+
+   The plan is found by simulating the night on the visibility bitsets
+   of the fields (scheduler_visibility.c). At each step the simulation
+   chooses among the sky fields of the plan as get_next_field would: a
+   ready must-do field, then the pair to the last field, then the
+   ready field with the fewest visits left and the least slack (the
+   time until it must start its remaining visits to finish them before
+   it sets), less a per-field offset. A field is ready when its
+   interval has passed, it is up, and its remaining visits still fit
+   before it sets. When no field is ready the simulation skips ahead
+   to when the next one will be. Each visit costs the predicted slew,
+   the exposure time, and exp_overhead_hours.
+
+   The plan is scored with
+
+     1                    for each field completed
+     PLAN_MUSTDO_WEIGHT   more for each must-do field completed
+     PLAN_PAIR_BONUS      for each pair with both fields completed
+     -PLAN_WASTE_PENALTY  times n_done/n_required of each field left
+                          unfinished
+     -PLAN_FRACTION_WEIGHT times the number of completed fields of
+                          survey codes 0, 1 and 2, times the sum of the
+                          differences between the fraction of each code
+                          and its target, when PLAN_FRACTIONS
+                          ("f0,f1,f2") is set
+
+   and improved by local search. Each step takes a field, or both
+   fields of a pair, and either drops it from the plan, puts it back,
+   or moves its offset by PLAN_OFFSET_STEP hours. The night is then
+   simulated again, and the step is kept if the score is no worse.
+   Must-do fields are never dropped. The search stops after
+   PLAN_ITERATIONS steps. When the plan is solved as the scheduler
+   starts observing, it also stops after PLAN_MAX_SEC seconds, so that
+   the plan, unlike those solved offline (SOLVE_PLAN) or in a replay
+   (REPLAY_POLICIES), may depend on the speed of the machine.
+
+   This takes the place of the repeated whole-night simulations and
+   cut_fields of sequencer.c: dropping low-value fields until the
+   survey codes come out in the target fractions is one of the local
+   search steps, and each simulation only steps through the bitsets.
+
+   With SOLVE_PLAN set to a file name, the scheduler solves the plan
+   for the night of the sequence file and date, writes it to that file
+   and exits:
+
+     SOLVE_PLAN=plan_file scheduler sequence_file yyyy mm dd 0
+
+   Following the plan
+
+   With SELECTION_POLICY=planned, get_next_field still takes must-do,
+   do-now and paired fields first. Among the ready fields, it takes
+   the first of the next PLAN_REPAIR_WINDOW visits of the plan whose
+   field is ready for that visit. If none is, it falls back to its own
+   choice. Visits already made, in or out of order, are passed over,
+   so the plan repairs itself as the night drifts from it. The plan is
+   read from PLAN_FILE, or, if that is not set, solved when the policy
+   is initialized, before the scheduler starts observing. When fields
+   are added to the sequence later, the plan is solved again from then
+   (extend_plan), unless it was read from PLAN_FILE. The fields added
+   to a plan from PLAN_FILE are only taken by the fallback.
+
+*/
+
+#include "scheduler.h"
+#include <sys/time.h>
+
+extern int verbose;
+extern double exp_overhead_hours;
+extern Visibility_Table visibility_table;
+
+typedef struct {
+    int index;      /* field in the sequence */
+    int visit;      /* visit of the field, n_done+1 when it is made */
+    double jd;      /* planned start */
+} Plan_Entry;
+
+typedef struct {
+    int n;
+    int max;
+    int next;              /* first entry not yet passed */
+    Plan_Entry *entry;
+} Plan;
+
+/* state of the solver. Fields are taken in units: a single field, or
+   both fields of a pair */
+
+typedef struct {
+    int n;                 /* sky fields in the plan */
+    int *index;            /* field in the sequence of each */
+    int *unit;             /* unit of each */
+    int *included;         /* 1 if the unit of each is in the plan */
+    double *offset;        /* urgency offset (hours) of each */
+    int *n_done;           /* simulated visits of each */
+    double *jd_next;       /* simulated time of next visit of each */
+    int *dead;             /* 1 once it can no longer be finished */
+    int n_units;
+    int *unit_first;       /* first field of each unit */
+    int *unit_size;        /* fields in each unit */
+    double fraction[3];    /* target fractions of survey codes 0, 1, 2 */
+    int use_fractions;
+} Plan_Solver;
+
+static Plan plan={0,0,0,NULL};
+static Plan trial={0,0,0,NULL};
+
+static unsigned long plan_random_state=PLAN_SEED;
+
+/************************************************************/
+
+static double plan_elapsed_sec(struct timeval *t0)
+{
+    struct timeval t;
+
+    gettimeofday(&t,NULL);
+    return((t.tv_sec-t0->tv_sec)+1.0e-6*(t.tv_usec-t0->tv_usec));
+}
+
+/************************************************************/
+
+/* uniform random integer from 0 to n-1, the same on every run */
+
+static int plan_random(int n)
+{
+    plan_random_state=plan_random_state*6364136223846793005UL+1442695040888963407UL;
+
+    return((int)((plan_random_state>>33)%n));
+}
+
+/************************************************************/
+
+static int add_plan_entry(Plan *p, int index, int visit, double jd)
+{
+    Plan_Entry *entry;
+    int n_alloc;
+
+    if(p->n==p->max){
+       n_alloc=p->max>0 ? 2*p->max : FIELD_TABLE_BLOCK;
+       entry=(Plan_Entry *)realloc(p->entry,n_alloc*sizeof(Plan_Entry));
+       if(entry==NULL){
+          fprintf(stderr,"add_plan_entry: could not allocate %d entries\n",
+             n_alloc);
+          return(-1);
+       }
+       p->entry=entry;
+       p->max=n_alloc;
+    }
+
+    p->entry[p->n].index=index;
+    p->entry[p->n].visit=visit;
+    p->entry[p->n].jd=jd;
+    p->n++;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* forget the plan, before a new one is made */
+
+void clear_plan()
+{
+    plan.n=0;
+    plan.next=0;
+}
+
+/************************************************************/
+
+static void free_plan_solver(Plan_Solver *s)
+{
+    if(s->index!=NULL)free(s->index);
+    if(s->offset!=NULL)free(s->offset);
+    memset((void *)s,0,sizeof(Plan_Solver));
+}
+
+/************************************************************/
+
+/* collect the sky fields of sequence that can still be observed
+   tonight, and group them in units */
+
+static int init_plan_solver(Plan_Solver *s, Field *sequence, int num_fields)
+{
+    Field *f;
+    char *fractions;
+    int i,k;
+
+    memset((void *)s,0,sizeof(Plan_Solver));
+
+    /* one allocation for the int columns, one for the doubles */
+
+    s->index=(int *)malloc(7*num_fields*sizeof(int));
+    s->offset=(double *)malloc(2*num_fields*sizeof(double));
+    if(s->index==NULL||s->offset==NULL){
+       fprintf(stderr,"init_plan_solver: could not allocate %d fields\n",
+          num_fields);
+       free_plan_solver(s);
+       return(-1);
+    }
+    s->unit=s->index+num_fields;
+    s->included=s->index+2*num_fields;
+    s->n_done=s->index+3*num_fields;
+    s->dead=s->index+4*num_fields;
+    s->unit_first=s->index+5*num_fields;
+    s->unit_size=s->index+6*num_fields;
+    s->jd_next=s->offset+num_fields;
+
+    for(i=0;i<num_fields&&i<visibility_table.num_fields;i++){
+       f=sequence+i;
+       if(f->shutter!=SKY_CODE||!f->doable||f->n_done>=f->n_required)continue;
+
+       k=s->n++;
+       s->index[k]=i;
+       s->offset[k]=0.0;
+
+       if(k>0&&s->index[k-1]==i-1&&paired_fields(f,f-1)){
+          s->unit[k]=s->unit[k-1];
+          s->unit_size[s->unit[k]]++;
+       }
+       else{
+          s->unit[k]=s->n_units;
+          s->unit_first[s->n_units]=k;
+          s->unit_size[s->n_units]=1;
+          s->n_units++;
+       }
+       s->included[k]=1;
+    }
+
+    fractions=getenv("PLAN_FRACTIONS");
+    if(fractions!=NULL&&sscanf(fractions,"%lf,%lf,%lf",s->fraction,
+          s->fraction+1,s->fraction+2)==3){
+       s->use_fractions=1;
+    }
+
+    return(s->n);
+}
+
+/************************************************************/
+
+/* 1 if the k-th field of the solver is ready at jd. Marks it dead
+   once it can no longer finish */
+
+static int plan_field_ready(Plan_Solver *s, Field *sequence, int k, double jd)
+{
+    Field *f;
+    double jd_until;
+    int i,n_left;
+
+    if(!s->included[k]||s->dead[k])return(0);
+
+    i=s->index[k];
+    f=sequence+i;
+    n_left=f->n_required-s->n_done[k];
+    if(n_left<=0)return(0);
+    if(s->jd_next[k]-jd>MIN_EXECUTION_TIME/24.0)return(0);
+    if(!field_visible(&visibility_table,i,jd))return(0);
+
+    jd_until=visible_until_jd(&visibility_table,i,jd);
+    if((jd_until-jd)*24.0<n_left*f->interval){
+       s->dead[k]=1;
+       return(0);
+    }
+
+    return(1);
+}
+
+/************************************************************/
+
+/* simulate the night from jd, choosing among the included fields, and
+   append the visits to p. Returns the score */
+
+static double simulate_plan(Plan_Solver *s, Field *sequence, double jd,
+        Plan *p)
+{
+    Field *f;
+    double jd_end,jd_wait,jd_up,ra,dec,slew_sec,slack,slack_min;
+    double score,n_completed,n_code[3];
+    int k,k_best,k_prev,n_left,n_left_min,must_do,position_known;
+
+    p->n=0;
+
+    for(k=0;k<s->n;k++){
+       f=sequence+s->index[k];
+       s->n_done[k]=f->n_done;
+       s->jd_next[k]=f->jd_next;
+       s->dead[k]=0;
+    }
+
+    jd_end=visibility_table.jd0+visibility_table.n_slots*visibility_table.slot_days;
+    position_known=(get_slew_position(&ra,&dec)==0);
+    k_prev=-1;
+
+    while(jd<jd_end){
+
+       k_best=-1;
+
+       /* the pair to the last field */
+
+       if(k_prev>=0&&k_prev+1<s->n&&s->unit[k_prev+1]==s->unit[k_prev]&&
+          s->n_done[k_prev+1]<s->n_done[k_prev]&&
+          plan_field_ready(s,sequence,k_prev+1,jd)){
+          k_best=k_prev+1;
+       }
+
+       /* else a must-do field, then the fewest visits left and least
+          slack */
+
+       if(k_best<0){
+          must_do=0;
+          n_left_min=MAX_OBS_PER_FIELD+1;
+          slack_min=HUGE_VAL;
+          for(k=0;k<s->n;k++){
+             if(!plan_field_ready(s,sequence,k,jd))continue;
+             f=sequence+s->index[k];
+             if(must_do&&f->survey_code!=MUSTDO_SURVEY_CODE)continue;
+             n_left=f->n_required-s->n_done[k];
+             slack=(visible_until_jd(&visibility_table,s->index[k],jd)-jd)*24.0-
+                n_left*f->interval-s->offset[k];
+             if((f->survey_code==MUSTDO_SURVEY_CODE&&!must_do)||
+                n_left<n_left_min||(n_left==n_left_min&&slack<slack_min)){
+                k_best=k;
+                n_left_min=n_left;
+                slack_min=slack;
+                if(f->survey_code==MUSTDO_SURVEY_CODE)must_do=1;
+             }
+          }
+       }
+
+       /* nothing ready: skip ahead to when a field next will be */
+
+       if(k_best<0){
+          jd_wait=jd_end;
+          for(k=0;k<s->n;k++){
+             if(!s->included[k]||s->dead[k])continue;
+             f=sequence+s->index[k];
+             if(s->n_done[k]>=f->n_required)continue;
+             jd_up=next_visible_jd(&visibility_table,s->index[k],jd);
+             if(jd_up<0.0){
+                s->dead[k]=1;
+                continue;
+             }
+             if(jd_up<s->jd_next[k]-MIN_EXECUTION_TIME/24.0){
+                jd_up=s->jd_next[k]-MIN_EXECUTION_TIME/24.0;
+             }
+             if(jd_up<jd_wait)jd_wait=jd_up;
+          }
+          if(jd_wait<=jd)jd_wait=jd+visibility_table.slot_days;
+          jd=jd_wait;
+          continue;
+       }
+
+       f=sequence+s->index[k_best];
+
+       slew_sec=0.0;
+       if(position_known){
+          slew_sec=get_slew_time_between(ra,dec,f->ra,f->dec);
+       }
+       jd=jd+slew_sec/86400.0;
+
+       if(add_plan_entry(p,s->index[k_best],s->n_done[k_best]+1,jd)!=0){
+          break;
+       }
+
+       s->n_done[k_best]++;
+       s->jd_next[k_best]=jd+(f->interval/24.0);
+       jd=jd+(f->expt+exp_overhead_hours)/24.0;
+       ra=f->ra;
+       dec=f->dec;
+       position_known=1;
+       k_prev=k_best;
+    }
+
+    /* score */
+
+    score=0.0;
+    n_completed=0.0;
+    n_code[0]=n_code[1]=n_code[2]=0.0;
+    for(k=0;k<s->n;k++){
+       f=sequence+s->index[k];
+       if(s->n_done[k]>=f->n_required){
+          score=score+1.0;
+          if(f->survey_code==MUSTDO_SURVEY_CODE){
+             score=score+PLAN_MUSTDO_WEIGHT;
+          }
+          else if(f->survey_code>=0&&f->survey_code<3){
+             n_code[f->survey_code]=n_code[f->survey_code]+1.0;
+             n_completed=n_completed+1.0;
+          }
+          if(k>0&&s->unit[k-1]==s->unit[k]&&
+             s->n_done[k-1]>=sequence[s->index[k-1]].n_required){
+             score=score+PLAN_PAIR_BONUS;
+          }
+       }
+       else if(s->n_done[k]>f->n_done){
+          score=score-PLAN_WASTE_PENALTY*
+             (s->n_done[k]-f->n_done)/(double)f->n_required;
+       }
+    }
+
+    if(s->use_fractions&&n_completed>0.0){
+       for(k=0;k<3;k++){
+          score=score-PLAN_FRACTION_WEIGHT*
+             fabs(n_code[k]-s->fraction[k]*n_completed);
+       }
+    }
+
+    return(score);
+}
+
+/************************************************************/
+
+/* solve the plan for the fields of sequence from jd into plan, in
+   PLAN_ITERATIONS steps or max_sec seconds, if max_sec is more than 0.
+   Returns the number of visits planned, or -1 on an error */
+
+static int solve_plan(Field *sequence, int num_fields, double jd,
+        double max_sec)
+{
+    Plan_Solver s;
+    Plan swap;
+    struct timeval t0;
+    double score,score_best,offset;
+    int iter,u,k,k0,move,n_kept,n_included;
+
+    gettimeofday(&t0,NULL);
+    plan_random_state=PLAN_SEED;
+
+    if(init_plan_solver(&s,sequence,num_fields)<0)return(-1);
+
+    score_best=simulate_plan(&s,sequence,jd,&plan);
+    n_kept=0;
+
+    for(iter=0;iter<PLAN_ITERATIONS&&s.n_units>0;iter++){
+       if(max_sec>0.0&&plan_elapsed_sec(&t0)>max_sec)break;
+
+       u=plan_random(s.n_units);
+       k0=s.unit_first[u];
+       if(sequence[s.index[k0]].survey_code==MUSTDO_SURVEY_CODE){
+          move=2;
+       }
+       else{
+          move=plan_random(3);
+       }
+
+       offset=0.0;
+       if(move<2){
+          for(k=k0;k<k0+s.unit_size[u];k++)s.included[k]=!s.included[k];
+       }
+       else{
+          offset=plan_random(2) ? PLAN_OFFSET_STEP : -PLAN_OFFSET_STEP;
+          for(k=k0;k<k0+s.unit_size[u];k++)s.offset[k]=s.offset[k]+offset;
+       }
+
+       score=simulate_plan(&s,sequence,jd,&trial);
+
+       if(score>=score_best){
+          if(score>score_best)n_kept++;
+          score_best=score;
+          swap=plan;
+          plan=trial;
+          trial=swap;
+       }
+       else if(move<2){
+          for(k=k0;k<k0+s.unit_size[u];k++)s.included[k]=!s.included[k];
+       }
+       else{
+          for(k=k0;k<k0+s.unit_size[u];k++)s.offset[k]=s.offset[k]-offset;
+       }
+    }
+
+    n_included=0;
+    for(k=0;k<s.n;k++)n_included=n_included+s.included[k];
+
+    if(verbose){
+       fprintf(stderr,
+          "solve_plan: %d visits to %d of %d fields, score %9.3f after %d steps (%d improved) in %7.3f sec\n",
+          plan.n,n_included,s.n,score_best,iter,n_kept,plan_elapsed_sec(&t0));
+    }
+
+    free_plan_solver(&s);
+
+    return(plan.n);
+}
+
+/************************************************************/
+
+/* write the plan, one visit per line */
+
+int write_plan(char *file_name, Field *sequence)
+{
+    FILE *output;
+    Field *f;
+    Plan_Entry *e;
+    int k;
+
+    output=fopen(file_name,"w");
+    if(output==NULL){
+       fprintf(stderr,"write_plan: can't open file %s\n",file_name);
+       return(-1);
+    }
+
+    fprintf(output,"# index line visit jd ra dec survey_code\n");
+    for(k=0;k<plan.n;k++){
+       e=plan.entry+k;
+       f=sequence+e->index;
+       fprintf(output,"%d %d %d %14.6f %10.6f %10.5f %d\n",
+          e->index,f->line_number,e->visit,e->jd,f->ra,f->dec,f->survey_code);
+    }
+
+    fclose(output);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* read the plan in file_name for the fields of sequence. Visits to
+   fields that do not match the sequence are left out. Returns the
+   number of visits read, or -1 on an error */
+
+static int read_plan(char *file_name, Field *sequence, int num_fields)
+{
+    FILE *input;
+    Field *f;
+    char string[STR_BUF_LEN];
+    double jd,ra,dec;
+    int index,line,visit,survey_code,n_bad;
+
+    input=fopen(file_name,"r");
+    if(input==NULL){
+       fprintf(stderr,"read_plan: can't open file %s\n",file_name);
+       return(-1);
+    }
+
+    plan.n=0;
+    n_bad=0;
+    while(fgets(string,STR_BUF_LEN,input)!=NULL){
+       if(string[0]=='#')continue;
+       if(sscanf(string,"%d %d %d %lf %lf %lf %d",&index,&line,&visit,
+             &jd,&ra,&dec,&survey_code)!=7){
+          continue;
+       }
+       if(index<0||index>=num_fields){
+          n_bad++;
+          continue;
+       }
+       f=sequence+index;
+       if(f->line_number!=line||
+          fabs(f->ra-ra)>1.0e-5||fabs(f->dec-dec)>1.0e-4){
+          n_bad++;
+          continue;
+       }
+       if(add_plan_entry(&plan,index,visit,jd)!=0)break;
+    }
+
+    fclose(input);
+
+    if(n_bad>0){
+       fprintf(stderr,"read_plan: %d visits in %s do not match the sequence\n",
+          n_bad,file_name);
+    }
+
+    return(plan.n);
+}
+
+/************************************************************/
+
+/* seconds the scheduler may spend solving a plan. A replay solves the
+   whole PLAN_ITERATIONS steps, so that it can be repeated */
+
+static double plan_max_sec()
+{
+    if(getenv("REPLAY_POLICIES")!=NULL)return(0.0);
+
+    return(PLAN_MAX_SEC);
+}
+
+/************************************************************/
+
+/* make the plan for the planned policy, from PLAN_FILE if that is set,
+   or else by solving it from jd. Returns the number of visits, or -1
+   on an error */
+
+int make_plan(Field *sequence, int num_fields, double jd)
+{
+    int n;
+
+    plan.next=0;
+
+    if(getenv("PLAN_FILE")!=NULL){
+       n=read_plan(getenv("PLAN_FILE"),sequence,num_fields);
+    }
+    else{
+       n=solve_plan(sequence,num_fields,jd,plan_max_sec());
+    }
+
+    if(n<0)plan.n=0;
+    if(verbose){
+       fprintf(stderr,"make_plan: %d visits planned\n",plan.n);
+    }
+
+    return(n);
+}
+
+
+/************************************************************/
+
+/* plan the fields of sequence again from jd, after fields were added
+   to it. A plan read from PLAN_FILE is kept as it is, and so is the
+   old plan if the new one can't be solved. Returns the number of
+   visits, or -1 on an error */
+
+int extend_plan(Field *sequence, int num_fields, double jd)
+{
+    int n,next;
+
+    if(getenv("PLAN_FILE")!=NULL)return(plan.n);
+
+    next=plan.next;
+    plan.next=0;
+    n=solve_plan(sequence,num_fields,jd,plan_max_sec());
+    if(n<0){
+       plan.next=next;
+       return(-1);
+    }
+
+    if(verbose){
+       fprintf(stderr,"extend_plan: %d visits planned for %d fields\n",
+          plan.n,num_fields);
+    }
+
+    return(n);
+}
+
+/************************************************************/
+
+/* the field of the first of the next PLAN_REPAIR_WINDOW visits of the
+   plan that is ready for that visit at jd, or -1 if there is none */
+
+int planned_next_field(Field *sequence, int num_fields, double jd,
+        int bad_weather)
+{
+    Field w;
+    Plan_Entry *e;
+    int k,n;
+
+    /* pass over visits already made */
+
+    while(plan.next<plan.n&&
+          sequence[plan.entry[plan.next].index].n_done>=plan.entry[plan.next].visit){
+       plan.next++;
+    }
+
+    n=0;
+    for(k=plan.next;k<plan.n&&n<PLAN_REPAIR_WINDOW;k++){
+       e=plan.entry+k;
+       if(e->index>=num_fields)continue;
+       if(sequence[e->index].n_done>=e->visit)continue;
+       n++;
+
+       if(sequence[e->index].n_done+1!=e->visit)continue;
+
+       w=sequence[e->index];
+       if(update_field_status(&w,jd,bad_weather)==READY_STATUS){
+          return(e->index);
+       }
+    }
+
+    return(-1);
+}
+
+/************************************************************/
+
+/* solve the plan for the night of date for the fields in script_name,
+   and write it to plan_file. Returns 0, or -1 on an error */
+
+int plan_night(char *script_name, struct date_time date, char *plan_file)
+{
+    Site_Params site;
+    Night_Times nt,nt_5day,nt_10day,nt_15day;
+    Field_Table table;
+    Field *f;
+    int i,k,num_fields,num_observable,num_planned,num_completed;
+    int *n_visits;
+
+    load_replay_night(date,&site,&nt,&nt_5day,&nt_10day,&nt_15day);
+
+    init_field_table(&table);
+    num_fields=load_replay_fields(script_name,&table,&nt,&nt_5day,&nt_10day,
+       &nt_15day,&site,&num_observable);
+    if(num_fields<1){
+       free_field_table(&table);
+       return(-1);
+    }
+
+    clear_slew_position();
+    if(solve_plan(table.fields,num_fields,nt.jd_sunset,0.0)<0||
+       write_plan(plan_file,table.fields)!=0){
+       free_field_table(&table);
+       return(-1);
+    }
+
+    n_visits=(int *)calloc(num_fields,sizeof(int));
+    if(n_visits==NULL){
+       free_field_table(&table);
+       return(-1);
+    }
+    for(k=0;k<plan.n;k++)n_visits[plan.entry[k].index]++;
+
+    num_planned=0;
+    num_completed=0;
+    for(i=0;i<num_fields;i++){
+       f=table.fields+i;
+       if(n_visits[i]>0)num_planned++;
+       if(n_visits[i]>0&&f->n_done+n_visits[i]>=f->n_required)num_completed++;
+    }
+
+    printf("# plan of %s for %04d %02d %02d written to %s\n",
+       script_name,date.y,date.mo,date.d,plan_file);
+    printf("# %d visits to %d fields, %d of %d observable fields completed\n",
+       plan.n,num_planned,num_completed,num_observable);
+    if(plan.n>0){
+       printf("# first visit jd %12.6f, last visit jd %12.6f\n",
+          plan.entry[0].jd-2450000,plan.entry[plan.n-1].jd-2450000);
+    }
+
+    free(n_visits);
+    free_field_table(&table);
+
+    return(0);
+}
+
+/************************************************************/
@@ -0,0 +1,234 @@
+/* scheduler_policy.c
+
+   Field selection policies. The main loop, and replay_night, choose
+   fields only through a Selection_Policy:
+
+     init            set up the selection for num_fields fields, before
+                     the night is observed from jd
+     status_changed  field i was changed by the caller (e.g. its last
+                     exposure was marked undone)
+     pick            choose the next field to observe at jd, or -1
+     observed        field i was observed at jd
+     fields_added    fields were appended to the sequence (from the .add
+                     script) at jd, which now has num_fields fields
+
+   The policy is chosen by name at run time, with the SELECTION_POLICY
+   environment variable (DEFAULT_SELECTION_POLICY if not set):
+
+     reference   get_next_field, as configured: ties broken by slew
+                 time if SLEW_COST_ON, and a lookahead of LOOKAHEAD_DEPTH
+                 selections if that is set
+     least_time  get_next_field with neither: the ready field with the
+                 least time left
+     nearest     get_next_field with ties broken by slew time
+     lookahead   get_next_field with a lookahead of LOOKAHEAD_DEPTH (or
+                 LOOKAHEAD_DEFAULT_DEPTH) selections
+     scan        scan_next_field, which re-evaluates every field on each
+                 selection rather than keeping Field_Events
+     planned     get_next_field taking the ready fields in the order of
+                 the whole-night plan of scheduler_plan.c, read from
+                 PLAN_FILE or solved by init. Fields added later are
+                 planned by solving the plan again, unless it was read
+                 from PLAN_FILE
+
+   pick is given the settings of the policy: whether get_next_field
+   breaks ties by slew time, looks ahead, or follows the plan. They
+   are kept in its entry in policies[], and init may change them.
+
+   A new policy needs only the five functions and an entry in
+   policies[].
+
+*/
+
+#include "scheduler.h"
+
+extern int verbose;
+
+/************************************************************/
+
+/* depth given by LOOKAHEAD_DEPTH, or default_depth if not set */
+
+static int get_lookahead_depth(int default_depth)
+{
+    int depth;
+
+    depth=default_depth;
+    if(getenv("LOOKAHEAD_DEPTH")!=NULL){
+       sscanf(getenv("LOOKAHEAD_DEPTH"),"%d",&depth);
+    }
+    if(depth<0)depth=0;
+    if(depth>LOOKAHEAD_MAX_DEPTH)depth=LOOKAHEAD_MAX_DEPTH;
+
+    return(depth);
+}
+
+/************************************************************/
+
+static int init_events(Selection_Settings *s, Field_Events *e, int num_fields)
+{
+    if(verbose&&s->lookahead_depth>0){
+       fprintf(stderr,"init_events: looking ahead %d selections\n",
+          s->lookahead_depth);
+    }
+
+    return(init_field_events(e,num_fields));
+}
+
+/************************************************************/
+
+/* the settings of the policy are those of its entry in policies[] */
+
+static int init_policy(Selection_Settings *s, Field_Events *e, Field *sequence,
+        int num_fields, double jd)
+{
+    (void)sequence;
+    (void)jd;
+
+    return(init_events(s,e,num_fields));
+}
+
+/************************************************************/
+
+static int init_reference(Selection_Settings *s, Field_Events *e, Field *sequence,
+        int num_fields, double jd)
+{
+    s->lookahead_depth=get_lookahead_depth(0);
+
+    return(init_policy(s,e,sequence,num_fields,jd));
+}
+
+/************************************************************/
+
+static int init_lookahead(Selection_Settings *s, Field_Events *e, Field *sequence,
+        int num_fields, double jd)
+{
+    s->lookahead_depth=get_lookahead_depth(LOOKAHEAD_DEFAULT_DEPTH);
+
+    return(init_policy(s,e,sequence,num_fields,jd));
+}
+
+/************************************************************/
+
+static int init_planned(Selection_Settings *s, Field_Events *e, Field *sequence,
+        int num_fields, double jd)
+{
+    /* solving the plan takes up to PLAN_MAX_SEC, so it is done here,
+       before the first selection. If it can't be made, get_next_field
+       makes its own choices */
+
+    clear_plan();
+    make_plan(sequence,num_fields,jd);
+
+    return(init_events(s,e,num_fields));
+}
+
+/************************************************************/
+
+static void observed_field(Field_Events *e, Field *sequence, int i, double jd)
+{
+    (void)sequence;
+    (void)jd;
+
+    field_status_changed(e,i);
+}
+
+/************************************************************/
+
+static int added_fields(Field_Events *e, Field *sequence, int num_fields,
+        double jd)
+{
+    (void)sequence;
+    (void)jd;
+
+    return(add_field_events(e,num_fields));
+}
+
+/************************************************************/
+
+/* the plan has no visits of the new fields. It is solved again from
+   jd, taking the new fields with the old, as at init. If that fails
+   the old plan is kept, and the new fields are left to the fallback */
+
+static int added_planned_fields(Field_Events *e, Field *sequence,
+        int num_fields, double jd)
+{
+    if(add_field_events(e,num_fields)!=0)return(-1);
+
+    extend_plan(sequence,num_fields,jd);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* scan_next_field does not use the events, but they are kept as well,
+   for the main loop's idle wait (next_field_event), and updated as
+   get_next_field would, so that the pending status changes, and those
+   made by the caller (status_changed, observed), are consumed. Without
+   that next_field_event gives no change before the first update, and
+   a change now after the first observation, and the idle wait is
+   MAX_IDLE_WAIT_SEC or MIN_IDLE_WAIT_SEC instead of until the next
+   field can be selected */
+
+static int pick_scan(Selection_Settings *s, Field_Events *e, Field *sequence,
+        int num_fields, int i_prev, double jd, int bad_weather)
+{
+    update_field_events(e,sequence,jd,bad_weather);
+
+    return(scan_next_field(s,sequence,num_fields,i_prev,jd,bad_weather));
+}
+
+
+/************************************************************/
+
+/* settings: slew_cost_on, lookahead_depth, follow_plan */
+
+static Selection_Policy policies[] = {
+    {"reference","get_next_field as configured",
+       init_reference,field_status_changed,get_next_field,observed_field,
+       added_fields,{SLEW_COST_ON,0,0}},
+    {"least_time","ready field with least time left",
+       init_policy,field_status_changed,get_next_field,observed_field,
+       added_fields,{0,0,0}},
+    {"nearest","nearest of the ready fields with least time left",
+       init_policy,field_status_changed,get_next_field,observed_field,
+       added_fields,{1,0,0}},
+    {"lookahead","ready field chosen by lookahead",
+       init_lookahead,field_status_changed,get_next_field,observed_field,
+       added_fields,{SLEW_COST_ON,0,0}},
+    {"scan","rescan all fields on each selection",
+       init_policy,field_status_changed,pick_scan,observed_field,
+       added_fields,{SLEW_COST_ON,0,0}},
+    {"planned","ready field next in the whole-night plan",
+       init_planned,field_status_changed,get_next_field,observed_field,
+       added_planned_fields,{SLEW_COST_ON,0,1}},
+    {NULL,NULL,NULL,NULL,NULL,NULL,NULL,{0,0,0}}
+};
+
+/************************************************************/
+
+/* the policy with the given name, or NULL if there is none */
+
+Selection_Policy *get_selection_policy(char *name)
+{
+    int k;
+
+    for(k=0;policies[k].name!=NULL;k++){
+       if(strcmp(policies[k].name,name)==0)return(policies+k);
+    }
+
+    return(NULL);
+}
+
+/************************************************************/
+
+void print_selection_policies(FILE *output)
+{
+    int k;
+
+    for(k=0;policies[k].name!=NULL;k++){
+       fprintf(output,"  %-12s %s\n",policies[k].name,policies[k].description);
+    }
+}
+
+/************************************************************/
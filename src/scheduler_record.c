@@ -0,0 +1,1136 @@
+/* scheduler_record.c
+
+   Restart record of the fields being scheduled.
+
+   The record is a snapshot file (OBS_RECORD_FILE) plus an append-only
+   journal (OBS_JOURNAL_FILE).
+
+   The snapshot does not depend on the layout of Field in memory. It
+   is an Obs_Record_Header (magic, version, byte order, number of
+   fields, journal generation, time of the snapshot) followed by a
+   table of Obs_Record_Column entries, one per member of Field and
+   Field_History that is saved (see obs_columns below). The values of
+   each column are stored together, for all fields, in fixed-width
+   binary. read_obs_record maps the file, checks the header and the
+   column table, and copies each column it knows into the field table
+   by name. A column missing from the file is left zero, and columns
+   it does not know are ignored, so records stay readable across
+   changes to Field, MAX_OBS_PER_FIELD or STR_BUF_LEN. Records in the
+   old format (a text line and the raw Field array) are refused;
+   convert them with obs_record_convert.
+
+   The snapshot is rewritten only by save_obs_record: at start up,
+   when fields are added, and every OBS_SNAPSHOT_RECORDS journal
+   records. It is written to a temporary file, synced, and renamed
+   over the old snapshot, so a crash leaves either the old or the new
+   snapshot.
+
+   Between snapshots, journal_field appends one record to the journal
+   for each newly completed exposure of a field (or one record with
+   slot -1 for any other change of its state). Each record holds the
+   generation of the snapshot it follows, the scheduling state of the
+   field after the change, the values of the observation slot, and a
+   checksum. The state and slot values are the columns of obs_columns
+   (the script line aside, which does not change), one value each,
+   packed in fixed-width binary. The journal starts with a header and
+   a column table giving the name, type, size and place in the record
+   of each value, so like the snapshot it is replayed by name, and
+   stays readable across changes to Field. A journal written without
+   the header (raw Field structs, by older builds) is refused; fold it
+   into the snapshot with obs_record_convert.
+
+   load_obs_record reads the snapshot and replays the journal records
+   of the same generation. Replay stops at the first short or corrupt
+   record (a write cut off by a crash), and the journal is truncated
+   there before new records are appended. A journal laid out
+   differently from this build's is folded into a new snapshot, so
+   that records are never appended to it in another layout.
+
+*/
+
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "scheduler.h"
+
+extern int verbose;
+extern double focus_start;
+extern double focus_increment;
+extern double focus_default;
+
+/* the members of Field and Field_History saved in the snapshot */
+
+typedef struct {
+    char *name;
+    int type;
+    int size;              /* bytes per value */
+    int count;             /* values per field */
+    int history;           /* 1 for a member of Field_History */
+    size_t offset;         /* of member in Field or Field_History */
+} Obs_Column_Def;
+
+#define FIELD_COLUMN(member,type,size) \
+    {#member,type,size,1,0,offsetof(Field,member)}
+#define HISTORY_COLUMN(member,type,size,count) \
+    {#member,type,size,count,1,offsetof(Field_History,member)}
+
+static Obs_Column_Def obs_columns[]={
+    FIELD_COLUMN(status,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(doable,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(selection_code,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(field_number,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(line_number,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(ra,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(dec,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(sin_dec,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(cos_dec,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(gal_long,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(gal_lat,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(ecl_long,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(ecl_lat,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(epoch,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(shutter,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(expt,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(interval,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(n_required,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(survey_code,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(ut_rise,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(ut_set,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(jd_rise,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(jd_set,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(jd_next,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(n_done,OBS_COLUMN_INT,4),
+    FIELD_COLUMN(time_up,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(time_required,OBS_COLUMN_DOUBLE,8),
+    FIELD_COLUMN(time_left,OBS_COLUMN_DOUBLE,8),
+    HISTORY_COLUMN(script_line,OBS_COLUMN_CHAR,STR_BUF_LEN,1),
+    HISTORY_COLUMN(ut,OBS_COLUMN_DOUBLE,8,MAX_OBS_PER_FIELD),
+    HISTORY_COLUMN(jd,OBS_COLUMN_DOUBLE,8,MAX_OBS_PER_FIELD),
+    HISTORY_COLUMN(lst,OBS_COLUMN_DOUBLE,8,MAX_OBS_PER_FIELD),
+    HISTORY_COLUMN(ha,OBS_COLUMN_DOUBLE,8,MAX_OBS_PER_FIELD),
+    HISTORY_COLUMN(am,OBS_COLUMN_DOUBLE,8,MAX_OBS_PER_FIELD),
+    HISTORY_COLUMN(actual_expt,OBS_COLUMN_DOUBLE,8,MAX_OBS_PER_FIELD),
+    HISTORY_COLUMN(filename,OBS_COLUMN_CHAR,FILENAME_LENGTH,MAX_OBS_PER_FIELD)
+};
+
+#define NUM_OBS_COLUMNS (int)(sizeof(obs_columns)/sizeof(Obs_Column_Def))
+
+/************************************************************/
+
+/* the columns of obs_columns held by each journal record: every member
+   of Field, and one observation slot of each member of Field_History
+   kept per observation */
+
+static int journal_column(Obs_Column_Def *c)
+{
+     return(!c->history||c->count==MAX_OBS_PER_FIELD);
+}
+
+/************************************************************/
+
+/* fill in the journal header and column table of this build, with
+   the column values packed after the Obs_Journal_Record, and return
+   the number of columns */
+
+static int get_journal_layout(Obs_Journal_Header *header,
+     Obs_Record_Column *column)
+{
+     int j,n;
+     int64_t offset;
+     Obs_Column_Def *c;
+
+     memset((void *)header,0,sizeof(Obs_Journal_Header));
+     memcpy(header->magic,OBS_JOURNAL_HEADER_MAGIC,sizeof(header->magic));
+     header->version=OBS_JOURNAL_VERSION;
+     header->byte_order=OBS_RECORD_BYTE_ORDER;
+     header->header_size=sizeof(Obs_Journal_Header);
+     header->column_size=sizeof(Obs_Record_Column);
+
+     n=0;
+     offset=sizeof(Obs_Journal_Record);
+     for(j=0;j<NUM_OBS_COLUMNS;j++){
+       c=obs_columns+j;
+       if(!journal_column(c))continue;
+       memset((void *)(column+n),0,sizeof(Obs_Record_Column));
+       memcpy(column[n].name,c->name,strnlen(c->name,OBS_COLUMN_NAME_LENGTH));
+       column[n].type=c->type;
+       column[n].size=c->size;
+       column[n].count=1;
+       column[n].offset=offset;
+       offset=offset+c->size;
+       n++;
+     }
+
+     header->num_columns=n;
+     header->record_size=offset+sizeof(uint32_t);
+
+     return(n);
+}
+
+/************************************************************/
+
+/* add n bytes at p (or n zero bytes if p is NULL) to the Fletcher-style
+   sums a and b of a journal record */
+
+static void add_journal_checksum(unsigned int *a, unsigned int *b,
+     char *p, size_t n)
+{
+     size_t i;
+
+     for(i=0;i<n;i++){
+       *a=(*a+(p!=NULL ? (unsigned char)p[i] : 0))%65521;
+       *b=(*b+*a)%65521;
+     }
+}
+
+/************************************************************/
+
+/* write n bytes at p (or n zero bytes if p is NULL) to the journal,
+   adding them to the checksum. Returns 0, or -1 on an error */
+
+static int write_journal_bytes(FILE *output, char *p, size_t n,
+     unsigned int *a, unsigned int *b)
+{
+     size_t i;
+
+     add_journal_checksum(a,b,p,n);
+
+     if(p!=NULL){
+       if(n>0&&fwrite((void *)p,n,1,output)!=1)return(-1);
+     }
+     else{
+       for(i=0;i<n;i++){
+         if(fputc(0,output)==EOF)return(-1);
+       }
+     }
+
+     return(0);
+}
+
+/************************************************************/
+
+static int grow_journal(Obs_Journal *journal, int num_fields)
+{
+     int i,n_alloc;
+     int *n_journaled;
+
+     if(num_fields<=journal->max_fields)return(0);
+
+     n_alloc=journal->max_fields>0 ? journal->max_fields : FIELD_TABLE_BLOCK;
+     while(n_alloc<num_fields)n_alloc=2*n_alloc;
+
+     n_journaled=(int *)realloc(journal->n_journaled,n_alloc*sizeof(int));
+     if(n_journaled==NULL){
+       fprintf(stderr,"grow_journal: can't allocate %d entries\n",n_alloc);
+       return(-1);
+     }
+
+     for(i=journal->max_fields;i<n_alloc;i++){
+       n_journaled[i]=0;
+     }
+
+     journal->n_journaled=n_journaled;
+     journal->max_fields=n_alloc;
+
+     return(0);
+}
+
+/************************************************************/
+
+/* append a record of field index, and observation slot (or -1), to
+   the journal. Does not flush */
+
+static int write_journal_record(Obs_Journal *journal, Field *f, int index,
+     int slot)
+{
+     Obs_Journal_Record r;
+     Obs_Column_Def *c;
+     unsigned int a,b;
+     uint32_t checksum;
+     char *p;
+     int j,result;
+
+     memset((void *)&r,0,sizeof(r));
+     r.magic=OBS_JOURNAL_MAGIC;
+     r.generation=journal->generation;
+     r.index=index;
+     r.slot=slot;
+
+     /* the column values follow in the order of get_journal_layout. The
+        values of Field_History are those of the slot, or zero */
+
+     a=1;
+     b=0;
+     result=write_journal_bytes(journal->journal,(char *)&r,sizeof(r),&a,&b);
+     for(j=0;j<NUM_OBS_COLUMNS&&result==0;j++){
+       c=obs_columns+j;
+       if(!journal_column(c))continue;
+       if(!c->history){
+         p=(char *)f+c->offset;
+       }
+       else if(slot>=0&&slot<MAX_OBS_PER_FIELD){
+         p=(char *)f->hist+c->offset+slot*c->size;
+       }
+       else{
+         p=NULL;
+       }
+       result=write_journal_bytes(journal->journal,p,c->size,&a,&b);
+     }
+
+     checksum=(b<<16)|a;
+     if(result!=0||
+        fwrite((void *)&checksum,sizeof(checksum),1,journal->journal)!=1){
+       fprintf(stderr,"write_journal_record: ERROR writing record for field %d\n",
+          index);
+       return(-1);
+     }
+
+     journal->num_records++;
+
+     return(0);
+}
+
+/************************************************************/
+
+/* open the journal, truncating it if truncate_flag is set, otherwise
+   appending */
+
+static int open_journal(Obs_Journal *journal, int truncate_flag)
+{
+     Obs_Journal_Header header;
+     Obs_Record_Column column[NUM_OBS_COLUMNS];
+
+     if(journal->journal!=NULL)fclose(journal->journal);
+
+     journal->journal=fopen(journal->journal_file,truncate_flag ? "w" : "a");
+     if(journal->journal==NULL){
+       fprintf(stderr,"open_journal: can't open %s\n",journal->journal_file);
+       return(-1);
+     }
+
+     if(truncate_flag)journal->num_records=0;
+
+     /* a new journal starts with the layout of its records */
+
+     if(fseek(journal->journal,0,SEEK_END)!=0||ftell(journal->journal)==0){
+       get_journal_layout(&header,column);
+       if(fwrite((void *)&header,sizeof(header),1,journal->journal)!=1||
+          fwrite((void *)column,sizeof(Obs_Record_Column),header.num_columns,
+             journal->journal)!=(size_t)header.num_columns||
+          fflush(journal->journal)!=0){
+         fprintf(stderr,"open_journal: ERROR writing header of %s\n",
+            journal->journal_file);
+         fclose(journal->journal);
+         journal->journal=NULL;
+         return(-1);
+       }
+     }
+
+     return(0);
+}
+
+/************************************************************/
+
+/* Record the current state of field index in the journal. One record
+   is written for each exposure completed since the field was last
+   recorded, or a single state record if there are none. The journal
+   is synced before returning. Every OBS_SNAPSHOT_RECORDS records a
+   new snapshot is saved instead, which also empties the journal. */
+
+int journal_field(Field_Table *table, Obs_Journal *journal, int index,
+     struct tm *tm)
+{
+     int slot,n_records;
+     Field *f;
+
+     if(index<0||index>=table->num_fields)return(0);
+
+     if(journal->journal==NULL){
+       fprintf(stderr,"journal_field: journal is not open\n");
+       return(-1);
+     }
+
+     if(grow_journal(journal,table->num_fields)!=0){
+       return(-1);
+     }
+
+     f=table->fields+index;
+
+     /* an exposure marked undone will be journaled again when it is
+        repeated */
+
+     if(journal->n_journaled[index]>f->n_done){
+       journal->n_journaled[index]=f->n_done;
+     }
+
+     n_records=0;
+     for(slot=journal->n_journaled[index];slot<f->n_done&&slot<MAX_OBS_PER_FIELD;slot++){
+       if(write_journal_record(journal,f,index,slot)!=0)return(-1);
+       n_records++;
+     }
+     if(n_records==0&&write_journal_record(journal,f,index,-1)!=0){
+       return(-1);
+     }
+     journal->n_journaled[index]=f->n_done;
+
+     if(fflush(journal->journal)!=0||fsync(fileno(journal->journal))!=0){
+       fprintf(stderr,"journal_field: ERROR syncing journal %s\n",
+          journal->journal_file);
+       return(-1);
+     }
+
+     if(journal->num_records>=OBS_SNAPSHOT_RECORDS){
+       if(verbose){
+         fprintf(stderr,"journal_field: %d journal records. Saving snapshot\n",
+            journal->num_records);
+       }
+       return(save_obs_record(table,journal,tm));
+     }
+
+     return(0);
+}
+
+/************************************************************/
+
+/* address of the values of column c for field i */
+
+static char *column_address(Field_Table *table, int i, Obs_Column_Def *c)
+{
+     if(c->history){
+       return((char *)(table->history+i)+c->offset);
+     }
+     else{
+       return((char *)(table->fields+i)+c->offset);
+     }
+}
+
+/************************************************************/
+
+/* Write all the fields in table to file_name in the column format
+   described above. The file is written to file_name.tmp, synced, and
+   renamed, so file_name is replaced all at once. */
+
+int write_obs_record(char *file_name, Field_Table *table, struct tm *tm,
+     int generation)
+{
+     char tmp_file[STR_BUF_LEN+8];
+     char zero[8];
+     int i,j,num_fields,n_bytes;
+     int64_t offset;
+     Obs_Record_Header header;
+     Obs_Record_Column column[NUM_OBS_COLUMNS];
+     Obs_Journal_Header journal_header;
+     Obs_Column_Def *c;
+     FILE *output;
+
+     num_fields=table->num_fields;
+     get_journal_layout(&journal_header,column);
+
+     memset((void *)&header,0,sizeof(header));
+     memcpy(header.magic,OBS_RECORD_MAGIC,sizeof(header.magic));
+     header.version=OBS_RECORD_VERSION;
+     header.byte_order=OBS_RECORD_BYTE_ORDER;
+     header.header_size=sizeof(Obs_Record_Header);
+     header.column_size=sizeof(Obs_Record_Column);
+     header.num_columns=NUM_OBS_COLUMNS;
+     header.num_fields=num_fields;
+     header.generation=generation;
+     header.journal_record_size=journal_header.record_size;
+     header.year=tm->tm_year;
+     header.month=tm->tm_mon;
+     header.day=tm->tm_mday;
+     header.hour=tm->tm_hour;
+     header.minute=tm->tm_min;
+     header.second=tm->tm_sec;
+
+     /* lay out the column data after the column table */
+
+     memset((void *)column,0,sizeof(column));
+     memset((void *)zero,0,sizeof(zero));
+     offset=sizeof(header)+sizeof(column);
+     for(j=0;j<NUM_OBS_COLUMNS;j++){
+       c=obs_columns+j;
+       memcpy(column[j].name,c->name,strnlen(c->name,OBS_COLUMN_NAME_LENGTH));
+       column[j].type=c->type;
+       column[j].size=c->size;
+       column[j].count=c->count;
+       column[j].offset=offset;
+       offset=offset+(int64_t)num_fields*c->count*c->size;
+       offset=(offset+7)&~(int64_t)7;
+     }
+
+     sprintf(tmp_file,"%s.tmp",file_name);
+     output=fopen(tmp_file,"w");
+     if(output==NULL){
+      fprintf(stderr,"write_obs_record: can't open %s\n",tmp_file);
+      fflush(stderr);
+      return(-1);
+     }
+
+     if(fwrite((void *)&header,sizeof(header),1,output)!=1||
+        fwrite((void *)column,sizeof(column),1,output)!=1){
+      fprintf(stderr,"write_obs_record: ERROR writing header\n");
+      fflush(stderr);
+      fclose(output);
+      return(-1);
+     }
+
+     for(j=0;j<NUM_OBS_COLUMNS;j++){
+       c=obs_columns+j;
+       n_bytes=c->count*c->size;
+       for(i=0;i<num_fields;i++){
+         if(fwrite((void *)column_address(table,i,c),n_bytes,1,output)!=1){
+           fprintf(stderr,"write_obs_record: ERROR writing column %s\n",
+              c->name);
+           fflush(stderr);
+           fclose(output);
+           return(-1);
+         }
+       }
+       n_bytes=(int)(-(int64_t)num_fields*n_bytes&7);
+       if(n_bytes>0&&fwrite((void *)zero,n_bytes,1,output)!=1){
+         fprintf(stderr,"write_obs_record: ERROR writing column %s\n",
+            c->name);
+         fflush(stderr);
+         fclose(output);
+         return(-1);
+       }
+     }
+
+     if(fflush(output)!=0||fsync(fileno(output))!=0){
+      fprintf(stderr,"write_obs_record: ERROR syncing %s\n",tmp_file);
+      fflush(stderr);
+      fclose(output);
+      return(-1);
+     }
+     fclose(output);
+
+     if(rename(tmp_file,file_name)!=0){
+      fprintf(stderr,"write_obs_record: can't rename %s to %s\n",
+          tmp_file,file_name);
+      fflush(stderr);
+      return(-1);
+     }
+
+     return(0);
+}
+
+/************************************************************/
+
+/* Write a new snapshot of all the fields and empty the journal. */
+
+int save_obs_record(Field_Table *table, Obs_Journal *journal,
+     struct tm *tm)
+{
+     int i,num_fields,generation;
+
+     num_fields=table->num_fields;
+     generation=journal->generation+1;
+
+     if(write_obs_record(journal->record_file,table,tm,generation)!=0){
+      fprintf(stderr,"save_obs_record: can't save snapshot\n");
+      return(-1);
+     }
+
+     /* records of the previous generation are now in the snapshot.
+        Start an empty journal. Any old records left by a crash before
+        this point are skipped on loading since their generation
+        doesn't match */
+
+     journal->generation=generation;
+     if(open_journal(journal,1)!=0){
+      return(-1);
+     }
+
+     if(grow_journal(journal,num_fields)!=0){
+      return(-1);
+     }
+     for(i=0;i<num_fields;i++){
+      journal->n_journaled[i]=table->fields[i].n_done;
+     }
+
+     return(0);
+
+}
+
+/************************************************************/
+
+/* copy column c of the mapped record into the field table. The file
+   may hold fewer or more values per field, or longer or shorter
+   strings, than this build; extra values are dropped and missing
+   values are left zero */
+
+static int read_column(Field_Table *table, int num_fields,
+     Obs_Column_Def *c, Obs_Record_Column *column, char *data)
+{
+     int i,k,count,size;
+     char *dest,*src;
+
+     if(column->type!=c->type||
+        (c->type!=OBS_COLUMN_CHAR&&column->size!=c->size)){
+       fprintf(stderr,"read_column: column %s has type %d size %d, expected %d %d\n",
+          c->name,column->type,column->size,c->type,c->size);
+       return(-1);
+     }
+
+     count=column->count<c->count ? column->count : c->count;
+     size=column->size<c->size ? column->size : c->size;
+
+     if(column->count>c->count){
+       fprintf(stderr,
+          "read_column: keeping %d of %d values per field of column %s\n",
+          c->count,column->count,c->name);
+     }
+
+     for(i=0;i<num_fields;i++){
+       dest=column_address(table,i,c);
+       src=data+(int64_t)i*column->count*column->size;
+       for(k=0;k<count;k++){
+         memcpy(dest+k*c->size,src+k*column->size,size);
+         if(c->type==OBS_COLUMN_CHAR)dest[k*c->size+c->size-1]=0;
+       }
+     }
+
+     return(0);
+}
+
+/************************************************************/
+
+/* the entry for column c in a table of num_columns entries of
+   column_size bytes each, or NULL if there is none */
+
+static Obs_Record_Column *find_column(Obs_Column_Def *c,
+     Obs_Record_Column *table, int num_columns, int column_size)
+{
+     Obs_Record_Column *column;
+     int j;
+
+     for(j=0;j<num_columns;j++){
+       column=(Obs_Record_Column *)((char *)table+(int64_t)j*column_size);
+       if(strncmp(column->name,c->name,OBS_COLUMN_NAME_LENGTH)==0){
+         return(column);
+       }
+     }
+
+     return(NULL);
+}
+
+/************************************************************/
+
+/* keep the observation counts of field i, loaded from source, within
+   the MAX_OBS_PER_FIELD history slots of this build. A record written
+   by a build with a larger MAX_OBS_PER_FIELD can hold more. The
+   history past the last slot is dropped, and n_required is cut to the
+   slots there are, so that the field is never observed into a slot it
+   does not have */
+
+static void clip_observations(Field *f, int i, char *source)
+{
+     if(f->n_done>MAX_OBS_PER_FIELD||f->n_required>MAX_OBS_PER_FIELD){
+       fprintf(stderr,
+         "%s: field %d has %d of %d observations, only %d kept\n",
+         source,i,f->n_done,f->n_required,MAX_OBS_PER_FIELD);
+       if(f->n_done>MAX_OBS_PER_FIELD)f->n_done=MAX_OBS_PER_FIELD;
+       if(f->n_required>MAX_OBS_PER_FIELD)f->n_required=MAX_OBS_PER_FIELD;
+     }
+
+     if(f->n_done<0)f->n_done=0;
+}
+
+/************************************************************/
+
+/* Read the snapshot in file_name into table, which should be empty,
+   and copy its header to *header. Returns the number of fields read,
+   0 if there is no snapshot (or it is empty), or -1 on error. */
+
+int read_obs_record(char *file_name, Field_Table *table,
+     Obs_Record_Header *header)
+{
+     int i,j,fd,num_fields;
+     int64_t end;
+     char *map;
+     struct stat st;
+     Obs_Record_Column *column;
+     Obs_Column_Def *c;
+
+     memset((void *)header,0,sizeof(Obs_Record_Header));
+
+     fd=open(file_name,O_RDONLY);
+     if(fd<0){
+       fprintf(stderr,"read_obs_record: can't open file %s for reading\n",
+          file_name);
+       return(0);
+     }
+
+     if(fstat(fd,&st)!=0||st.st_size==0){
+       fprintf(stderr,"read_obs_record: %s is empty\n",file_name);
+       close(fd);
+       return(0);
+     }
+
+     map=(char *)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+     close(fd);
+     if(map==MAP_FAILED){
+       fprintf(stderr,"read_obs_record: can't map %s\n",file_name);
+       return(-1);
+     }
+
+     /* check the header before trusting anything it says */
+
+     if(st.st_size<(off_t)sizeof(Obs_Record_Header)||
+        memcmp(map,OBS_RECORD_MAGIC,strlen(OBS_RECORD_MAGIC))!=0){
+       fprintf(stderr,
+         "read_obs_record: %s is not in record format version %d.\n",
+         file_name,OBS_RECORD_VERSION);
+       fprintf(stderr,
+         "read_obs_record: convert old records with obs_record_convert\n");
+       munmap(map,st.st_size);
+       return(-1);
+     }
+
+     memcpy((void *)header,map,sizeof(Obs_Record_Header));
+
+     if(header->byte_order!=OBS_RECORD_BYTE_ORDER){
+       fprintf(stderr,"read_obs_record: %s was written with different byte order\n",
+          file_name);
+       munmap(map,st.st_size);
+       return(-1);
+     }
+
+     if(header->version>OBS_RECORD_VERSION){
+       fprintf(stderr,"read_obs_record: %s is version %d, newer than %d\n",
+          file_name,header->version,OBS_RECORD_VERSION);
+       munmap(map,st.st_size);
+       return(-1);
+     }
+
+     num_fields=header->num_fields;
+     end=header->header_size+(int64_t)header->num_columns*header->column_size;
+     if(num_fields<0||header->num_columns<0||
+        header->header_size<(int)sizeof(Obs_Record_Header)||
+        header->column_size<(int)sizeof(Obs_Record_Column)||
+        end>st.st_size){
+       fprintf(stderr,"read_obs_record: bad header in %s\n",file_name);
+       munmap(map,st.st_size);
+       return(-1);
+     }
+
+     for(j=0;j<header->num_columns;j++){
+       column=(Obs_Record_Column *)(map+header->header_size+j*header->column_size);
+       end=column->offset+(int64_t)num_fields*column->count*column->size;
+       if(column->offset<0||column->count<0||column->size<0||
+          end>st.st_size){
+         fprintf(stderr,"read_obs_record: column %d of %s is past end of file\n",
+            j,file_name);
+         munmap(map,st.st_size);
+         return(-1);
+       }
+     }
+
+     if(grow_field_table(table,num_fields)!=0){
+       fprintf(stderr,"read_obs_record: can't make room for %d fields\n",
+          num_fields);
+       munmap(map,st.st_size);
+       return(-1);
+     }
+
+     for(i=0;i<NUM_OBS_COLUMNS;i++){
+       c=obs_columns+i;
+       column=find_column(c,(Obs_Record_Column *)(map+header->header_size),
+          header->num_columns,header->column_size);
+       if(column==NULL){
+         fprintf(stderr,"read_obs_record: no column %s in %s, left zero\n",
+            c->name,file_name);
+         continue;
+       }
+       if(read_column(table,num_fields,c,column,map+column->offset)!=0){
+         munmap(map,st.st_size);
+         return(-1);
+       }
+     }
+
+     munmap(map,st.st_size);
+
+     for(i=0;i<num_fields;i++){
+       clip_observations(table->fields+i,i,"read_obs_record");
+     }
+
+     table->num_fields=num_fields;
+
+     return(num_fields);
+}
+
+/************************************************************/
+
+/* where the value of a column of obs_columns is in the records of the
+   journal being replayed */
+
+typedef struct {
+     Obs_Column_Def *c;
+     int offset;            /* bytes from start of record */
+     int size;              /* bytes copied */
+} Journal_Value;
+
+/************************************************************/
+
+/* Read the header and column table of the journal open on input, and
+   find where each column of this build is in its records. Returns the
+   number of values found, 0 if the header is missing or incomplete
+   (an empty journal, or one cut off before its first record), or -1
+   if the journal can't be read. *same_layout is set to 1 if the
+   journal was written in the layout of this build */
+
+static int read_journal_layout(FILE *input, char *file_name,
+     Obs_Journal_Header *header, Journal_Value *value, int *same_layout)
+{
+     Obs_Journal_Header ours;
+     Obs_Record_Column our_column[NUM_OBS_COLUMNS];
+     Obs_Record_Column *column,*table;
+     Obs_Column_Def *c;
+     int j,n_values,end;
+
+     *same_layout=0;
+
+     if(fread((void *)header,sizeof(Obs_Journal_Header),1,input)!=1){
+       return(0);
+     }
+
+     if(memcmp(header->magic,OBS_JOURNAL_HEADER_MAGIC,sizeof(header->magic))!=0){
+       fprintf(stderr,
+         "read_journal_layout: %s is not in journal format version %d.\n",
+         file_name,OBS_JOURNAL_VERSION);
+       fprintf(stderr,
+         "read_journal_layout: fold old journals into the snapshot with obs_record_convert\n");
+       return(-1);
+     }
+
+     if(header->byte_order!=OBS_RECORD_BYTE_ORDER){
+       fprintf(stderr,"read_journal_layout: %s was written with different byte order\n",
+          file_name);
+       return(-1);
+     }
+
+     if(header->version>OBS_JOURNAL_VERSION){
+       fprintf(stderr,"read_journal_layout: %s is version %d, newer than %d\n",
+          file_name,header->version,OBS_JOURNAL_VERSION);
+       return(-1);
+     }
+
+     if(header->header_size<(int)sizeof(Obs_Journal_Header)||
+        header->column_size<(int)sizeof(Obs_Record_Column)||
+        header->num_columns<0||header->num_columns>OBS_JOURNAL_MAX_COLUMNS||
+        header->record_size<(int)(sizeof(Obs_Journal_Record)+sizeof(uint32_t))){
+       fprintf(stderr,"read_journal_layout: bad header in %s\n",file_name);
+       return(-1);
+     }
+
+     table=(Obs_Record_Column *)malloc(header->num_columns*header->column_size+1);
+     if(table==NULL){
+       fprintf(stderr,"read_journal_layout: can't allocate column table of %s\n",
+          file_name);
+       return(-1);
+     }
+
+     if(fseek(input,header->header_size,SEEK_SET)!=0||
+        (header->num_columns>0&&
+         fread((void *)table,header->column_size,header->num_columns,input)!=
+           (size_t)header->num_columns)){
+       free(table);
+       return(0);
+     }
+
+     end=header->record_size-sizeof(uint32_t);
+     n_values=0;
+     for(j=0;j<NUM_OBS_COLUMNS;j++){
+       c=obs_columns+j;
+       if(!journal_column(c))continue;
+       column=find_column(c,table,header->num_columns,header->column_size);
+       if(column==NULL){
+         fprintf(stderr,"read_journal_layout: no column %s in %s, left as in the snapshot\n",
+            c->name,file_name);
+         continue;
+       }
+       if(column->type!=c->type||
+          (c->type!=OBS_COLUMN_CHAR&&column->size!=c->size)||
+          column->size<0||column->offset<(int64_t)sizeof(Obs_Journal_Record)||
+          column->offset+column->size>end){
+         fprintf(stderr,"read_journal_layout: bad column %s in %s\n",
+            c->name,file_name);
+         free(table);
+         return(-1);
+       }
+       value[n_values].c=c;
+       value[n_values].offset=column->offset;
+       value[n_values].size=column->size<c->size ? column->size : c->size;
+       n_values++;
+     }
+
+     get_journal_layout(&ours,our_column);
+     *same_layout=header->header_size==ours.header_size&&
+        header->column_size==ours.column_size&&
+        header->num_columns==ours.num_columns&&
+        header->record_size==ours.record_size&&
+        memcmp((void *)table,(void *)our_column,
+           ours.num_columns*sizeof(Obs_Record_Column))==0;
+
+     free(table);
+
+     return(n_values);
+}
+
+/************************************************************/
+
+/* apply the journal records that follow the snapshot just loaded.
+   Returns the number of records applied, or -1 if the journal can't
+   be read. *same_layout is set to 1 if new records can be appended to
+   the journal as it is */
+
+static int replay_journal(Field_Table *table, Obs_Journal *journal,
+     int *same_layout)
+{
+     int n_applied,n_skipped,n_values,slot,k;
+     long offset,end;
+     uint32_t checksum;
+     unsigned int a,b;
+     char *record,*dest;
+     FILE *input;
+     Field *f;
+     Obs_Column_Def *c;
+     Obs_Journal_Header header;
+     Obs_Journal_Record r;
+     Journal_Value value[NUM_OBS_COLUMNS];
+
+     *same_layout=1;
+
+     input=fopen(journal->journal_file,"r+");
+     if(input==NULL){
+       return(0);
+     }
+
+     n_values=read_journal_layout(input,journal->journal_file,&header,value,
+        same_layout);
+     if(n_values<0){
+       fclose(input);
+       return(-1);
+     }
+
+     /* a journal cut off in its header has no records. It is emptied,
+        and gets a new header when it is opened for appending */
+
+     if(n_values==0&&!*same_layout){
+       fseek(input,0,SEEK_END);
+       if(ftell(input)>0){
+         fprintf(stderr,
+           "replay_journal: discarding %ld bytes of incomplete journal header\n",
+           ftell(input));
+         if(ftruncate(fileno(input),0)!=0){
+           fprintf(stderr,"replay_journal: can't truncate %s\n",
+              journal->journal_file);
+         }
+       }
+       fclose(input);
+       *same_layout=1;
+       return(0);
+     }
+
+     record=(char *)malloc(header.record_size);
+     if(record==NULL){
+       fprintf(stderr,"replay_journal: can't allocate %d-byte record\n",
+          header.record_size);
+       fclose(input);
+       return(-1);
+     }
+
+     n_applied=0;
+     n_skipped=0;
+     offset=header.header_size+(long)header.num_columns*header.column_size;
+     fseek(input,offset,SEEK_SET);
+     while(fread((void *)record,header.record_size,1,input)==1){
+       memcpy((void *)&r,record,sizeof(r));
+       memcpy((void *)&checksum,record+header.record_size-sizeof(checksum),
+          sizeof(checksum));
+       a=1;
+       b=0;
+       add_journal_checksum(&a,&b,record,header.record_size-sizeof(checksum));
+       if(r.magic!=OBS_JOURNAL_MAGIC||checksum!=((b<<16)|a)){
+         break;
+       }
+       offset=offset+header.record_size;
+
+       if(r.generation!=journal->generation||
+          r.index<0||r.index>=table->num_fields){
+         n_skipped++;
+         continue;
+       }
+
+       /* the values of Field_History are those of the slot */
+
+       f=table->fields+r.index;
+       slot=r.slot;
+       for(k=0;k<n_values;k++){
+         c=value[k].c;
+         if(!c->history){
+           dest=(char *)f+c->offset;
+         }
+         else if(slot>=0&&slot<MAX_OBS_PER_FIELD){
+           dest=(char *)f->hist+c->offset+slot*c->size;
+         }
+         else{
+           continue;
+         }
+         if(c->type==OBS_COLUMN_CHAR)memset((void *)dest,0,c->size);
+         memcpy((void *)dest,record+value[k].offset,value[k].size);
+         if(c->type==OBS_COLUMN_CHAR)dest[c->size-1]=0;
+       }
+       clip_observations(f,r.index,"replay_journal");
+       n_applied++;
+     }
+     free(record);
+
+     /* drop a partly written record at the end, so that new
+        records are appended after the last good one */
+
+     fseek(input,0,SEEK_END);
+     end=ftell(input);
+     if(end!=offset){
+       fprintf(stderr,
+         "replay_journal: discarding %ld bytes of incomplete journal record\n",
+         end-offset);
+       if(ftruncate(fileno(input),offset)!=0){
+         fprintf(stderr,"replay_journal: can't truncate %s\n",
+            journal->journal_file);
+       }
+     }
+     fclose(input);
+
+     fprintf(stderr,"replay_journal: %d records applied, %d skipped\n",
+        n_applied,n_skipped);
+
+     journal->num_records=n_applied;
+
+     return(n_applied);
+}
+
+/************************************************************/
+
+/* Load the snapshot in file_name and replay journal_name on top of it.
+   Returns the number of fields loaded (0 if there is no snapshot), or
+   -1 on error. The journal is left open for journal_field. */
+
+int load_obs_record(char *file_name, char *journal_name, Field_Table *table,
+     Obs_Journal *journal)
+{
+     int i,n;
+     int num_fields;
+     int n_completed;
+     int n_started;
+     int n_fresh;
+     int same_layout;
+     Field *f;
+     Obs_Record_Header header;
+     struct tm tm;
+     time_t now;
+
+     strcpy(journal->record_file,file_name);
+     strcpy(journal->journal_file,journal_name);
+     journal->journal=NULL;
+     journal->generation=0;
+     journal->num_records=0;
+
+     n_fresh=0;
+     n_started=0;
+     n_completed=0;
+
+     num_fields=read_obs_record(file_name,table,&header);
+     if(num_fields<0){
+    fprintf(stderr,"load_obs_record: can't read %s\n",file_name);
+    return(-1);
+     }
+     else if(num_fields==0){
+    fprintf(stderr,"load_obs_record: no previous observations\n");
+    fprintf(stderr,"load_obs_record: starting new empty journal\n");
+    fflush(stderr);
+    if(open_journal(journal,1)!=0){
+      fprintf(stderr,"load_obs_record: can't create new journal\n");
+      return(-1);
+    }
+    return(0);
+     }
+
+     fprintf(stderr,"load_obs_record: %d fields, %d %d %d %d %d %d, generation %d\n",
+        num_fields,header.year,header.month,header.day,header.hour,
+        header.minute,header.second,header.generation);
+
+     journal->generation=header.generation;
+
+     if(replay_journal(table,journal,&same_layout)<0){
+      fprintf(stderr,"load_obs_record: can't replay journal %s\n",
+         journal_name);
+      return(-1);
+     }
+
+     /* new records can't be appended to a journal in another layout.
+        Fold it into a new snapshot, which starts a new journal */
+
+     if(!same_layout){
+      fprintf(stderr,
+        "load_obs_record: journal %s has another layout. Saving a new snapshot\n",
+        journal_name);
+      now=time(NULL);
+      localtime_r(&now,&tm);
+      if(save_obs_record(table,journal,&tm)!=0){
+        return(-1);
+      }
+     }
+     else{
+      if(grow_journal(journal,num_fields)!=0){
+        return(-1);
+      }
+      for(i=0;i<num_fields;i++){
+        journal->n_journaled[i]=table->fields[i].n_done;
+      }
+
+      if(open_journal(journal,0)!=0){
+        return(-1);
+      }
+     }
+
+     for(i=0;i<num_fields;i++){
+      f=table->fields+i;
+      if(f->n_done==0){
+          n_fresh++;
+      }
+      else if (f->n_done < f->n_required){
+           n_started++;
+      }
+      else {
+           n_completed++;
+      }
+      if(f->shutter==FOCUS_CODE){
+         n=f->n_required/2;
+         focus_start=focus_default-n*focus_increment;
+      }
+     }
+
+     fprintf(stderr,
+       "load_obs_record: %d total, %d fresh, %d started, %d completed\n",
+       num_fields, n_fresh,n_started,n_completed);
+
+     return(num_fields);
+}
+
+/************************************************************/
+
+int close_obs_record(Obs_Journal *journal)
+{
+     if(journal->journal!=NULL){
+       fclose(journal->journal);
+       journal->journal=NULL;
+     }
+
+     return(0);
+}
+
+/************************************************************/
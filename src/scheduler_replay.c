@@ -0,0 +1,364 @@
+/* scheduler_replay.c
+
+   Replay of a night through several selection policies, to compare
+   them without the telescope or camera.
+
+   With REPLAY_POLICIES set to a comma-separated list of policy names
+   (see scheduler_policy.c), the scheduler reads the sequence file and
+   date as usual, but rather than observing it replays the night
+   through each policy in turn, and prints one line per policy:
+
+     REPLAY_POLICIES=reference,lookahead scheduler sequence_file yyyy mm dd 0
+
+   Each replay starts from a fresh copy of the sequence at sunset and
+   steps through the night as the FAKE_RUN build does: each selected
+   field takes the slew predicted by the model of scheduler_slew.c,
+   then expt and exp_overhead_hours, and when nothing is selected
+   time advances by LOOP_WAIT_SEC. The weather is always good.
+
+   With REPLAY_ADD_FILE set to a sequence file, its fields are appended
+   to the sequence REPLAY_ADD_HOURS (default REPLAY_ADD_DEFAULT_HOURS)
+   after sunset, as main appends the fields of the .add script, and
+   the policy is told with fields_added.
+
+   For each policy it reports the visits made, the fields and must-do
+   fields completed (of those observable), the hours with the shutter
+   open, the overhead hours (slews and readouts), the dead hours with
+   no field selected before sunrise, and the mean time to select a
+   field.
+
+*/
+
+#include "scheduler.h"
+#include <sys/time.h>
+
+extern int verbose;
+extern double exp_overhead_hours;
+extern Visibility_Table visibility_table;
+
+typedef struct {
+    int num_observable;
+    int num_visits;
+    int num_completed;
+    int num_must_do;
+    int num_must_do_completed;
+    double open_hours;
+    double overhead_hours;
+    double dead_hours;
+    double select_sec;
+    int num_selections;
+} Replay_Totals;
+
+/************************************************************/
+
+/* load the DEFAULT site and the times of the night of date, and of the
+   nights 5, 10 and 15 days later, as main does */
+
+int load_replay_night(struct date_time date, Site_Params *site,
+        Night_Times *nt, Night_Times *nt_5day, Night_Times *nt_10day,
+        Night_Times *nt_15day)
+{
+    struct date_time date_5day,date_10day,date_15day;
+
+    date.h=0;
+    date.mn=0;
+    date.s=0;
+
+    strcpy(site->site_name,"DEFAULT");
+    load_site(&site->longit,&site->lat,&site->stdz,&site->use_dst,
+            site->zone_name,&site->zabr,&site->elevsea,&site->elev,
+            &site->horiz,site->site_name);
+    init_site_trig(site);
+
+    date_5day=date;
+    adjust_date(&date_5day,5);
+    init_night(date_5day,nt_5day,site,0);
+
+    date_10day=date;
+    adjust_date(&date_10day,10);
+    init_night(date_10day,nt_10day,site,0);
+
+    date_15day=date;
+    adjust_date(&date_15day,15);
+    init_night(date_15day,nt_15day,site,0);
+
+    init_night(date,nt,site,1);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* load the sequence in script_name into table and initialize its
+   fields and visibility at sunset. Returns the number of fields, and
+   the number observable in *num_observable, or -1 on an error */
+
+int load_replay_fields(char *script_name, Field_Table *table,
+        Night_Times *nt, Night_Times *nt_5day, Night_Times *nt_10day,
+        Night_Times *nt_15day, Site_Params *site, int *num_observable)
+{
+    Airmass_Table airmass;
+    Telescope_Status tel_status;
+    int num_fields;
+
+    memset((void *)&tel_status,0,sizeof(tel_status));
+    memset((void *)&airmass,0,sizeof(airmass));
+
+    num_fields=load_sequence(script_name,table);
+    if(num_fields<1){
+       fprintf(stderr,"load_replay_fields: Error loading script %s\n",
+          script_name);
+       return(-1);
+    }
+
+    *num_observable=init_fields(table->fields,num_fields,
+         nt,nt_5day,nt_10day,nt_15day,site,nt->jd_sunset,&tel_status);
+
+    if(load_airmass_table(&airmass,table->fields,num_fields,site)!=0||
+       load_visibility_table(&visibility_table,&airmass,table->fields,
+          num_fields,nt,site)!=0){
+       fprintf(stderr,"load_replay_fields: could not load visibility of %d fields\n",
+          num_fields);
+       free_airmass_table(&airmass);
+       return(-1);
+    }
+    free_airmass_table(&airmass);
+
+    return(num_fields);
+}
+
+/************************************************************/
+
+/* append the fields in script_name to table at jd, and reload the
+   visibility of all the fields. Returns the number of fields added,
+   and the number of them observable in *num_observable, or -1 on an
+   error */
+
+static int add_replay_fields(char *script_name, Field_Table *table,
+        Night_Times *nt, Night_Times *nt_5day, Night_Times *nt_10day,
+        Night_Times *nt_15day, Site_Params *site, double jd,
+        int *num_observable)
+{
+    Field_Table new_table;
+    Airmass_Table airmass;
+    Telescope_Status tel_status;
+    Night_Times nt_now;
+    int num_new_fields,result;
+
+    memset((void *)&tel_status,0,sizeof(tel_status));
+    memset((void *)&airmass,0,sizeof(airmass));
+    init_field_table(&new_table);
+
+    num_new_fields=load_sequence(script_name,&new_table);
+    if(num_new_fields<1){
+       fprintf(stderr,"add_replay_fields: Error loading script %s\n",
+          script_name);
+       free_field_table(&new_table);
+       return(-1);
+    }
+
+    /* init_fields moves jd_start up to jd, as it does in main. The
+       night is replayed again for the next policy, so a copy is moved */
+
+    nt_now=*nt;
+    *num_observable=init_fields(new_table.fields,num_new_fields,
+         &nt_now,nt_5day,nt_10day,nt_15day,site,jd,&tel_status);
+
+    result=num_new_fields;
+    if(add_new_fields(table,new_table.fields,num_new_fields)!=0||
+       load_airmass_table(&airmass,table->fields,table->num_fields,site)!=0||
+       load_visibility_table(&visibility_table,&airmass,table->fields,
+          table->num_fields,nt,site)!=0){
+       fprintf(stderr,"add_replay_fields: could not add %d fields\n",
+          num_new_fields);
+       result=-1;
+    }
+
+    free_airmass_table(&airmass);
+    free_field_table(&new_table);
+
+    return(result);
+}
+
+/************************************************************/
+
+/* replay the night through one policy */
+
+static int replay_policy(Selection_Policy *policy, char *script_name,
+        Night_Times *nt, Night_Times *nt_5day, Night_Times *nt_10day,
+        Night_Times *nt_15day, Site_Params *site, Replay_Totals *totals)
+{
+    Field_Table table;
+    Field_Events events;
+    Field *sequence,*f;
+    struct timeval t0,t1;
+    double jd,jd_exp,jd_add,ra,dec,slew_sec,dt;
+    char *add_file;
+    int i,i_prev,num_fields,num_observable;
+
+    memset((void *)totals,0,sizeof(Replay_Totals));
+    memset((void *)&events,0,sizeof(events));
+
+    init_field_table(&table);
+    num_fields=load_replay_fields(script_name,&table,nt,nt_5day,nt_10day,
+       nt_15day,site,&totals->num_observable);
+    if(num_fields<1){
+       free_field_table(&table);
+       return(-1);
+    }
+    sequence=table.fields;
+    jd=nt->jd_sunset;
+
+    add_file=getenv("REPLAY_ADD_FILE");
+    jd_add=nt->jd_sunset+REPLAY_ADD_DEFAULT_HOURS/24.0;
+    if(getenv("REPLAY_ADD_HOURS")!=NULL){
+       jd_add=nt->jd_sunset+atof(getenv("REPLAY_ADD_HOURS"))/24.0;
+    }
+
+    /* before init, which may solve a plan from the telescope position */
+
+    clear_slew_position();
+
+    if(policy->init(&policy->settings,&events,sequence,num_fields,jd)!=0){
+       fprintf(stderr,"replay_policy: could not initialize policy %s\n",
+          policy->name);
+       free_field_table(&table);
+       return(-1);
+    }
+
+    i_prev=-1;
+    while(jd<nt->jd_sunrise){
+
+       if(add_file!=NULL&&jd>=jd_add){
+          if(add_replay_fields(add_file,&table,nt,nt_5day,nt_10day,nt_15day,
+                 site,jd,&num_observable)<0||
+             policy->fields_added(&events,table.fields,table.num_fields,jd)!=0){
+             free_field_events(&events);
+             free_field_table(&table);
+             return(-1);
+          }
+          sequence=table.fields;
+          num_fields=table.num_fields;
+          totals->num_observable=totals->num_observable+num_observable;
+          add_file=NULL;
+       }
+
+       gettimeofday(&t0,NULL);
+       i=policy->pick(&policy->settings,&events,sequence,num_fields,i_prev,jd,0);
+       gettimeofday(&t1,NULL);
+       totals->select_sec=totals->select_sec+
+          (t1.tv_sec-t0.tv_sec)+1.0e-6*(t1.tv_usec-t0.tv_usec);
+       totals->num_selections++;
+
+       if(i<0){
+          totals->dead_hours=totals->dead_hours+LOOP_WAIT_SEC/3600.0;
+          jd=jd+LOOP_WAIT_SEC/86400.0;
+          continue;
+       }
+
+       f=sequence+i;
+
+       slew_sec=0.0;
+       if(f->shutter!=DARK_CODE&&f->shutter!=DOME_FLAT_CODE){
+          if(get_slew_position(&ra,&dec)==0){
+             slew_sec=get_slew_time_between(ra,dec,f->ra,f->dec);
+          }
+          record_slew(f->ra,f->dec,f->ra,f->dec,-1.0);
+       }
+
+       dt=f->expt+exp_overhead_hours;
+       if(f->shutter==FOCUS_CODE)dt=dt+FOCUS_OVERHEAD;
+
+       jd_exp=jd+slew_sec/86400.0;
+       f->n_done=f->n_done+1;
+       f->jd_next=jd_exp+(f->interval/24.0);
+       policy->observed(&events,sequence,i,jd_exp);
+
+       if(verbose){
+          fprintf(stderr,
+             "replay_policy: %s JD: %12.6f field %d n_done: %d n_wanted: %d slew %6.1f sec\n",
+             policy->name,jd_exp-2450000,f->field_number,f->n_done,
+             f->n_required,slew_sec);
+       }
+
+       totals->num_visits++;
+       totals->open_hours=totals->open_hours+f->expt;
+       totals->overhead_hours=totals->overhead_hours+
+          slew_sec/3600.0+dt-f->expt;
+       jd=jd_exp+dt/24.0;
+       i_prev=i;
+    }
+
+    for(i=0;i<num_fields;i++){
+       f=sequence+i;
+       if(f->survey_code==MUSTDO_SURVEY_CODE)totals->num_must_do++;
+       if(f->n_required>0&&f->n_done>=f->n_required){
+          totals->num_completed++;
+          if(f->survey_code==MUSTDO_SURVEY_CODE){
+             totals->num_must_do_completed++;
+          }
+       }
+    }
+
+    free_field_events(&events);
+    free_field_table(&table);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* replay the night of date through each policy in policy_names
+   (comma-separated) and print the totals of each. Returns 0, or -1
+   on an error */
+
+int replay_night(char *script_name, struct date_time date, char *policy_names)
+{
+    Site_Params site;
+    Night_Times nt,nt_5day,nt_10day,nt_15day;
+    Selection_Policy *policy;
+    Replay_Totals totals;
+    char names[STR_BUF_LEN],*name,*s;
+    int result;
+
+    load_replay_night(date,&site,&nt,&nt_5day,&nt_10day,&nt_15day);
+
+    printf("# replay of %s for %04d %02d %02d, jd %12.6f to %12.6f\n",
+       script_name,date.y,date.mo,date.d,nt.jd_sunset-2450000,
+       nt.jd_sunrise-2450000);
+    printf("# %-12s %7s %9s %8s %7s %8s %7s %9s\n","policy","visits",
+       "completed","must-do","open_h","overhd_h","dead_h","select_ms");
+
+    strncpy(names,policy_names,STR_BUF_LEN-1);
+    names[STR_BUF_LEN-1]=0;
+
+    result=0;
+    for(name=strtok_r(names,",",&s);name!=NULL;name=strtok_r(NULL,",",&s)){
+       policy=get_selection_policy(name);
+       if(policy==NULL){
+          fprintf(stderr,"replay_night: unknown selection policy %s. Choose one of:\n",
+             name);
+          print_selection_policies(stderr);
+          result=-1;
+          continue;
+       }
+
+       if(replay_policy(policy,script_name,&nt,&nt_5day,&nt_10day,&nt_15day,
+              &site,&totals)!=0){
+          result=-1;
+          continue;
+       }
+
+       printf("  %-12s %7d %4d/%-4d %3d/%-4d %7.3f %8.3f %7.3f %9.4f\n",
+          policy->name,totals.num_visits,totals.num_completed,
+          totals.num_observable,totals.num_must_do_completed,
+          totals.num_must_do,totals.open_hours,totals.overhead_hours,
+          totals.dead_hours,
+          totals.num_selections>0?1000.0*totals.select_sec/totals.num_selections:0.0);
+       fflush(stdout);
+    }
+
+    return(result);
+}
+
+/************************************************************/
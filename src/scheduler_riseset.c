@@ -0,0 +1,349 @@
+/* scheduler_riseset.c
+
+   Hour angle, airmass, and rise and set times of fields during the
+   observing window of the night, as used by init_fields.
+
+   get_jd_rise_time and get_jd_set_time solve the times directly from
+   the limiting hour angle (get_max_up_ha). The stepwise LST search
+   they replaced is kept as search_jd_rise_time and search_jd_set_time
+   (ANALYTIC_RISE_SET 0), and check_rise_set compares the two.
+
+*/
+
+#include "scheduler.h"
+
+extern int verbose1;
+
+/************************************************************/
+
+/* Return the largest absolute hour angle (hours) at which an object at
+   declination dec is below airmass max_am and within hour angle max_ha.
+   The object is up whenever fabs(ha) is less than this value.
+   If the object never gets below max_am, return -1.
+*/
+
+double get_max_up_ha(double dec, double max_am, double max_ha, Site_Params *site)
+{
+    double alt_min,ha_am;
+
+    if(max_am<=1.0)return(-1.0);
+
+    /* altitude where airmass equals max_am */
+    alt_min=asin(1.0/max_am)*DEG_IN_RADIAN;
+
+    /* ha_alt returns 1000 if object is always higher than alt_min
+       and -1000 if it is always lower */
+    ha_am=ha_alt(dec,site->lat,alt_min);
+    if(ha_am<-900.0)return(-1.0);
+    if(ha_am>900.0)ha_am=12.0;
+
+    if(ha_am<max_ha){
+       return(ha_am);
+    }
+    else{
+       return(max_ha);
+    }
+}
+
+/************************************************************/
+
+/* If object is already up at current jd, return current jd value.
+   If it rises before the end of the night, return with the rise time.
+   If it never rises, return -1
+
+   The rise time is solved directly from the limiting hour angle
+   (see get_max_up_ha) instead of stepping through the night.
+   Set ANALYTIC_RISE_SET to 0 (scheduler.h) to use the stepwise search
+   (search_jd_rise_time).
+
+   The hour angle and airmass at the rise time (or at the start of the
+   window, if the field does not rise) are returned in *ha and *am.
+   Pass NULL for am to skip the airmass, which the solution does not
+   need, and NULL for ha if it is not wanted either.
+*/
+
+double get_jd_rise_time(double ra,double dec, double max_am, double max_ha,
+       Night_Times *nt, Site_Params *site, double *am, double *ha)
+{
+#if ANALYTIC_RISE_SET
+    double ha_up,ha_start,dlst,lst_span,jd;
+
+    /* hour angle at start of observing window, and length of the
+       window in sidereal hours */
+
+    ha_start=get_ha(ra,nt->lst_start);
+    lst_span=(nt->jd_end-nt->jd_start)*SIDEREAL_DAY_IN_HOURS;
+
+    if(ha!=NULL)*ha=ha_start;
+    if(am!=NULL)*am=get_airmass(ha_start,dec,site);
+
+    ha_up=get_max_up_ha(dec,max_am,max_ha,site);
+    if(ha_up<0.0){
+       if(verbose1){
+          fprintf(stderr,"field never rises below am %10.6f\n",max_am);
+       }
+       return(-1.0);
+    }
+
+    /* already up */
+
+    if(fabs(ha_start)<ha_up)return(nt->jd_start);
+
+    /* hour angle increases with lst. If the field is east of the
+       limit, it rises when ha reaches -ha_up. If it is west of the
+       limit, it must first wrap through ha = 12 */
+
+    if(ha_start<=-ha_up){
+       dlst=-ha_up-ha_start;
+    }
+    else{
+       dlst=24.0-ha_up-ha_start;
+    }
+
+    if(dlst>lst_span){
+       if(verbose1){
+          fprintf(stderr,"field does not rise before end of night\n");
+       }
+       return(-1.0);
+    }
+
+    jd=nt->jd_start+(dlst/SIDEREAL_DAY_IN_HOURS);
+    if(ha!=NULL)*ha=-ha_up;
+    if(am!=NULL)*am=get_airmass(-ha_up,dec,site);
+
+    if(verbose1){
+       fprintf(stderr,"field rises at jd  %10.6f\n",jd);
+    }
+
+    return(jd);
+#else
+    double am_search,ha_search,jd;
+
+    jd=search_jd_rise_time(ra,dec,max_am,max_ha,nt,site,&am_search,&ha_search);
+    if(am!=NULL)*am=am_search;
+    if(ha!=NULL)*ha=ha_search;
+
+    return(jd);
+#endif
+}
+
+/************************************************************/
+
+/* If object is still up at end of observing window, return jd_end.
+   If it sets before the end of the night, return with the set time.
+   If it sets before the start of the night, return -1. 
+   Solved analytically as in get_jd_rise_time, and am and ha may
+   likewise be NULL.
+*/
+
+double get_jd_set_time(double ra,double dec, double max_am, double max_ha,
+       Night_Times *nt, Site_Params *site, double *am, double *ha)
+{
+#if ANALYTIC_RISE_SET
+    double ha_up,ha_end,dlst,lst_span,jd;
+
+    ha_end=get_ha(ra,nt->lst_end);
+    lst_span=(nt->jd_end-nt->jd_start)*SIDEREAL_DAY_IN_HOURS;
+
+    if(ha!=NULL)*ha=ha_end;
+    if(am!=NULL)*am=get_airmass(ha_end,dec,site);
+
+    ha_up=get_max_up_ha(dec,max_am,max_ha,site);
+    if(ha_up<0.0)return(-1.0);
+
+    /* still up */
+
+    if(fabs(ha_end)<ha_up)return(nt->jd_end);
+
+    /* going back in time from the end of the window, the field
+       sets when ha decreases to ha_up (wrapping through ha = -12
+       if it is east of the limit at the end of the window) */
+
+    if(ha_end>=ha_up){
+       dlst=ha_end-ha_up;
+    }
+    else{
+       dlst=ha_end+24.0-ha_up;
+    }
+
+    if(dlst>lst_span)return(-1.0);
+
+    jd=nt->jd_end-(dlst/SIDEREAL_DAY_IN_HOURS);
+    if(ha!=NULL)*ha=ha_up;
+    if(am!=NULL)*am=get_airmass(ha_up,dec,site);
+
+    return(jd);
+#else
+    double am_search,ha_search,jd;
+
+    jd=search_jd_set_time(ra,dec,max_am,max_ha,nt,site,&am_search,&ha_search);
+    if(am!=NULL)*am=am_search;
+    if(ha!=NULL)*ha=ha_search;
+
+    return(jd);
+#endif
+}
+
+/************************************************************/
+
+/* Stepwise search for rise time. Step through the night in
+   increments of LST_SEARCH_INCREMENT until the field is up. 
+   Replaced by get_jd_rise_time, but kept for reference
+   (ANALYTIC_RISE_SET 0)
+*/
+
+double search_jd_rise_time(double ra,double dec, double max_am, double max_ha,
+       Night_Times *nt, Site_Params *site, double *am, double *ha)
+{
+    double lst,jd,current_jd,dt;
+
+    /* get lst, hour angle, jd, and airmass at start time of observing window.
+       If am is less than max_am and absolute value of ha is less than max_am, 
+       object is already up. Return with jd.
+       Otherwise, stepwise search from jd_start to jd_end to find the 
+       time when am < max_am and fabs(ha) < max_ha (the rise time)
+       If it never rises, return -1. Otherwise return the jd when it does.
+    */
+
+    lst=nt->lst_start;
+    jd=nt->jd_start;
+
+    current_jd = get_jd();
+
+
+    *ha=get_ha(ra,lst);
+    *am=get_airmass(*ha,dec,site);
+
+    if(verbose1){
+       fprintf(stderr,"jd_start: %12.6f  lst_start: %10.6f\n",jd,lst);
+       fprintf(stderr,"ra: %12.6f  dec: %12.6f\n",ra,dec);
+       fprintf(stderr,"ha: %10.6f   am: %10.6f\n",*ha,*am);
+    }
+
+    if (*am < max_am && fabs (*ha) < max_ha ) {
+       if(verbose1){
+      fprintf(stderr,"init am and ha within limits. returning with jd = %12.6f\n",jd);
+       }
+       return (jd);
+    }
+     
+    if(verbose1){
+       fprintf(stderr,"init_fields: searching for jd at rise time\n");
+    }
+
+      
+    while(jd<nt->jd_end&&(*am>max_am||fabs(*ha)>max_ha)){
+    jd=jd+(LST_SEARCH_INCREMENT/SIDEREAL_DAY_IN_HOURS);
+    lst=lst+LST_SEARCH_INCREMENT;
+    if(lst>24.0)lst=lst-24.0;
+    *ha=get_ha(ra,lst);
+    *am=get_airmass(*ha,dec,site);
+    //if(verbose1){
+    //    fprintf(stderr,"jd: %12.6f lst: %10.6f am: %10.6f ha: %10.6f\n",
+    //       jd,lst,*am,*ha);
+    //}
+    }
+
+    if(*am>max_am){
+       if(verbose1){
+      fprintf(stderr,"field never rises below am %10.6f\n",max_am);
+       }
+       return(-1.0);
+    }
+    else if(fabs(*ha)>max_ha){
+       if(verbose1){
+      fprintf(stderr,"field ha is always greater than  %10.6f\n",max_ha);
+       }
+       return(-1.0);
+    }
+    else{
+       if(verbose1){
+      dt = (jd-current_jd)*24.0;
+      fprintf(stderr,"field rises at jd  %10.6f (in %10.6f h)\n",jd,dt);
+       }
+       return(jd);
+    }
+     
+    
+}
+
+/************************************************************/
+
+/* Stepwise search for set time (see search_jd_rise_time) */
+
+double search_jd_set_time(double ra,double dec, double max_am, double max_ha,
+       Night_Times *nt, Site_Params *site, double *am, double *ha)
+{
+    double lst,jd;
+
+    /* get lst, hour angle, jd, and airmass at end time of observing window.
+       If am is less than max_am and absolute value of ha is less than
+       max_ha, object is still up. Return with jd.
+       Otherwise, stepwise search from jd_end to jd_start to find the 
+       set_time. If it sets before lst_start, return -1. 
+       Otherwise return the jd when the am gets above max_am or 
+       the ha gets above max_ha*/
+
+
+    lst=nt->lst_end;
+    jd=nt->jd_end;
+    *ha=get_ha(ra,lst);
+    *am=get_airmass(*ha,dec,site);
+
+    if (*am < max_am && fabs (*ha) < max_ha ) return (jd);
+
+   
+    while(jd>nt->jd_start&&(*am>max_am||fabs(*ha)>max_ha)){
+      lst=lst-LST_SEARCH_INCREMENT;
+      jd=jd-(LST_SEARCH_INCREMENT/SIDEREAL_DAY_IN_HOURS);
+      if(lst<0.0)lst=lst+24.0;
+      *ha=get_ha(ra,lst);
+      *am=get_airmass(*ha,dec,site);
+    }
+
+    if(*am>max_am){
+       return(-1.0);
+    }
+    else if(fabs(*ha)>max_ha){
+       return(-1.0);
+    }
+    else{
+       return(jd);
+    }
+     
+    
+}
+/************************************************************/
+
+double get_airmass(double ha, double dec, Site_Params *site) {
+ 
+  double alt, az, am;
+
+  alt = altit(dec,ha,site->lat,&az);
+  if (alt <= 0) {
+     am=BELOW_HORIZON_AIRMASS; /* below horizon */
+  }
+  else{
+     am = 1.0/sin(alt/DEGTORAD);
+  }
+  return(am);
+}
+                                                   
+
+/************************************************************/
+
+double get_ha(double ra, double lst) {
+  double ha;
+ 
+  ha = lst - ra;
+  if (ha <= -12.0) {
+    ha += 24.0;
+  } else if (ha >= 12.0) {
+    ha -= 24.0;
+  }
+  return(ha);
+}
+
+/************************************************************/
+
+/************************************************************/
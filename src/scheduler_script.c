@@ -0,0 +1,397 @@
+/* scheduler_script.c
+
+   Reading the observing script. load_sequence reads a whole script,
+   and tail_sequence the lines appended to one (the .add script) since
+   it was last read. Both parse each line with parse_sequence_line.
+
+   Kept apart from scheduler.c so that check_tail can compare the two
+   readers without main.
+
+*/
+
+#include "scheduler.h"
+
+extern int verbose;
+extern double focus_start;
+extern double focus_increment;
+extern double focus_default;
+extern char filter_name[STR_BUF_LEN];
+extern char *filter_name_ptr;
+
+/************************************************************/
+
+int load_sequence(char *script_name, Field_Table *table)
+{
+
+    FILE *input;
+    int n_fields,line;
+    char string[STR_BUF_LEN+1];
+
+    /* if file can not be opened for reading, return error. Otherwise
+     * load any new sequences
+    */
+
+    input=fopen(script_name,"r");
+    if (input==NULL){
+       fprintf(stderr,"load_sequence: can't open file %s\n",script_name);
+       return(-1);
+    }
+
+    n_fields=0;
+    line=0;
+    string[STR_BUF_LEN-1]=0;
+    while(fgets(string,STR_BUF_LEN,input)!=NULL){
+
+      line++;
+
+      if(grow_field_table(table,n_fields+1)!=0){
+         fprintf(stderr,"load_sequence: can't make room for field on line %d\n",
+            line);
+         fclose(input);
+         return(-1);
+      }
+
+      table->fields[n_fields].field_number=n_fields;
+      n_fields=n_fields+parse_sequence_line(string,line,table->fields+n_fields);
+
+    } //while(fgets(string,STR_BUF_LEN,input)!=NULL){
+
+    fclose(input);
+
+    table->num_fields=n_fields;
+
+    return(n_fields);
+
+}
+
+/************************************************************/
+
+/* Parse line number line of a script, read into string (which must
+   have room for one more character). Comment and FILTER lines are
+   handled here. If the line is an acceptable field, it is loaded into
+   f (which must have its history) and 1 is returned. Otherwise 0 is
+   returned, and f may have been changed. */
+
+int parse_sequence_line(char *string, int line, Field *f)
+{
+    int n,n1;
+    char *s_ptr,shutter_flag[3],s[256];
+    int string_length=0;
+
+      // make sure last element if string is still 0. If not, the line read from the input is
+      // longer than buffer length (STR_BUF_LEN)
+      if(string[STR_BUF_LEN-1]!=0){
+      fprintf(stderr,"load_sequence: WARNING: sequence line [%d] is too long. Ignoring \n",line);
+      fflush(stderr);
+      string[STR_BUF_LEN-1]=0;
+      return(0);
+      }
+
+    /* get rid of leading spaces */
+    s_ptr=string;
+    while(strncmp(s_ptr," ",1)==0&&*s_ptr!=0)s_ptr++;
+
+    /* get length of string, starting at s_ptr */
+    string_length = strlen(s_ptr);
+
+    /* add a space to the end of s_ptr to make sure it is processed
+     * correctly by camera server
+    */
+
+    sprintf(s_ptr+string_length," ");
+    string_length++;
+
+    /* if there are more characters left in the string, and if the
+       current character is not "#", then read in the next line */
+
+     if (string_length<=1){
+       /* line too short, pass */
+       if(verbose){
+         fprintf(stderr,"WARNING: line [%d] is too short [%s]\n",line,s_ptr);
+       }
+       return(0);
+     }
+     else if (strncmp(s_ptr,"#",1)==0){
+       /* comment line. pass */
+       if(verbose){
+         fprintf(stderr,"line [%d] is a commented out [%s]\n",line,s_ptr);
+       }
+       return(0);
+     }
+     else if(strncmp(s_ptr,"FILTER",6) == 0 || strncmp(s_ptr,"filter",6)==0 ){
+       sscanf(s_ptr,"%s %s",s,filter_name);
+       filter_name_ptr=filter_name;
+       if(check_filter_name(filter_name)!=0){
+         fprintf(stderr,"WARNING: unexpeced filter name: %s",filter_name);
+       }
+       return(0);
+     }
+
+        f->line_number=line;
+        strcpy(f->hist->script_line,string);
+
+        n=sscanf(s_ptr,"%lf %lf %s %lf %lf %d %d",
+          &(f->ra),&(f->dec),shutter_flag,&(f->expt),&(f->interval),
+          &(f->n_required),&(f->survey_code));
+
+        if (f->survey_code == LIGO_SURVEY_CODE)f->survey_code = MUSTDO_SURVEY_CODE;
+        f->interval=f->interval/3600.0;
+        f->expt=f->expt/3600.0;
+
+        f->shutter=get_shutter_code(shutter_flag);
+
+        /* if this is a focus field, read the focus start, increment, and
+           default setting from the script line */
+
+        if(f->shutter==FOCUS_CODE){
+           sscanf(s_ptr,"%s %s %s %s %s %s %s %lf %lf",
+          s,s,s,s,s,s,s,&focus_increment,&focus_default);
+           n1 = f->n_required/2;
+           focus_start=focus_default-n1*focus_increment;
+           if(verbose){
+          fprintf(stderr,
+              "load_sequence: focus start, incr, default: %8.5f %8.5f %8.5f\n",
+              focus_start,focus_increment,focus_default);
+         fflush(stderr);
+           }
+          
+        }
+
+        /* if the focus parameters are out of range for a focus field
+           skip the field */
+
+        if(f->shutter==FOCUS_CODE&&
+           (focus_start<MIN_FOCUS||focus_increment<MIN_FOCUS_INCREMENT||
+          focus_start>MAX_FOCUS||focus_increment>MAX_FOCUS_INCREMENT||
+          focus_start+(f->n_required*focus_increment)>MAX_FOCUS)){
+           fprintf(stderr,"focus parameters out of range: %s",s_ptr);
+           return(0);
+        }
+
+         /* Also make sure 6 parameters are read from the line, and that
+           the parameters are within range. If not, skip this field. */
+
+        else if(n!=7||f->ra<0.0||f->ra>24.0||f->dec<-90.0||f->dec>90.0||
+          f->expt>MAX_EXPT||f->expt<0||
+          f->interval>MAX_INTERVAL||f->interval<MIN_INTERVAL||f->n_required<1||
+          f->n_required>MAX_OBS_PER_FIELD||f->shutter==BAD_CODE||
+          f->survey_code<MIN_SURVEY_CODE||f->survey_code>MAX_SURVEY_CODE){
+           fprintf(stderr,"load_sequence: bad field line %d: %s\n",
+          line,string);
+           return(0);
+        }
+
+        /* Accept the field */
+
+        return(1);
+}
+
+/************************************************************/
+
+/* hash of the bytes of a script read so far (FNV-1a) */
+
+static unsigned long hash_script_text(unsigned long hash, char *string)
+{
+    unsigned char *p;
+
+    for(p=(unsigned char *)string;*p!=0;p++){
+       hash=(hash^*p)*16777619UL;
+       hash=hash&0xffffffffUL;
+    }
+
+    return(hash);
+}
+
+/************************************************************/
+
+int init_script_tail(Script_Tail *tail, char *script_name)
+{
+    memset((void *)tail,0,sizeof(Script_Tail));
+    strcpy(tail->file_name,script_name);
+    tail->hash=2166136261UL;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* Read the fields on the lines appended to tail->file_name since the
+   last call, and load them into table (from index 0). Only complete
+   lines are read; a last line with no newline is read once the file
+   has stopped growing. If the file has been truncated or replaced,
+   the text already read is compared with the start of the new file.
+   If it matches, reading continues after it. Otherwise the whole file
+   is read as new. Returns the number of fields loaded, 0 if the file
+   does not exist or has nothing new, or -1 on error. */
+
+int tail_sequence(Script_Tail *tail, Field_Table *table)
+{
+    FILE *input;
+    int n_fields,line,restart;
+    long offset;
+    unsigned long hash;
+    char string[STR_BUF_LEN+1];
+    struct stat st;
+
+    table->num_fields=0;
+
+    if(stat(tail->file_name,&st)!=0){
+       return(0);
+    }
+
+    restart=(tail->offset>0&&
+       (st.st_ino!=tail->inode||st.st_dev!=tail->device||
+        st.st_size<tail->offset));
+
+    if(!restart&&st.st_size==tail->offset){
+       return(0);
+    }
+
+    input=fopen(tail->file_name,"r");
+    if (input==NULL){
+       fprintf(stderr,"tail_sequence: can't open file %s\n",tail->file_name);
+       return(-1);
+    }
+
+    /* after truncation or replacement, check whether the new file
+       starts with everything read so far */
+
+    if(restart){
+       hash=2166136261UL;
+       offset=0;
+       string[STR_BUF_LEN-1]=0;
+       while(offset<tail->offset&&fgets(string,STR_BUF_LEN,input)!=NULL){
+          hash=hash_script_text(hash,string);
+          offset=ftell(input);
+       }
+       if(offset==tail->offset&&hash==tail->hash){
+          fprintf(stderr,"tail_sequence: %s truncated or replaced, continuing after line %d\n",
+             tail->file_name,tail->line);
+       }
+       else{
+          fprintf(stderr,"tail_sequence: %s truncated or replaced, reading from start\n",
+             tail->file_name);
+          tail->offset=0;
+          tail->line=0;
+          tail->hash=2166136261UL;
+       }
+       tail->partial_size=0;
+    }
+
+    tail->inode=st.st_ino;
+    tail->device=st.st_dev;
+
+    if(fseek(input,tail->offset,SEEK_SET)!=0){
+       fprintf(stderr,"tail_sequence: can't seek to %ld in %s\n",
+          tail->offset,tail->file_name);
+       fclose(input);
+       return(-1);
+    }
+
+    n_fields=0;
+    line=tail->line;
+    string[STR_BUF_LEN-1]=0;
+    while(fgets(string,STR_BUF_LEN,input)!=NULL){
+
+      /* leave a last line without a newline for the next call, unless
+         it was already there last time */
+
+      if(strchr(string,'\n')==NULL&&feof(input)&&
+         st.st_size!=tail->partial_size){
+         tail->partial_size=st.st_size;
+         break;
+      }
+
+      line++;
+      tail->line=line;
+      tail->offset=ftell(input);
+      tail->hash=hash_script_text(tail->hash,string);
+
+      if(grow_field_table(table,n_fields+1)!=0){
+         fprintf(stderr,"tail_sequence: can't make room for field on line %d\n",
+            line);
+         fclose(input);
+         table->num_fields=n_fields;
+         return(-1);
+      }
+
+      table->fields[n_fields].field_number=n_fields;
+      n_fields=n_fields+parse_sequence_line(string,line,table->fields+n_fields);
+    }
+
+    fclose(input);
+
+    table->num_fields=n_fields;
+
+    return(n_fields);
+}
+
+/************************************************************/
+
+/* if name is an expected filter name (see  FILTER_NAME in scheduler.h)
+ * return 0. Otherwise return -1
+*/
+
+int check_filter_name(char *name)
+{
+    for (enum Filter_Index i =1; i<= NUM_FILTERS; i++){
+      if(strcmp(name, FILTER_NAME[i-1]) == 0) return(0);
+    }
+    return(-1);
+}
+/************************************************************/
+
+int get_shutter_code(char *shutter_flag)
+{
+      int code;
+
+      if(strcmp(shutter_flag,SKY_STRING)==0){
+        code=SKY_CODE;
+      }
+      else if(strcmp(shutter_flag,SKY_STRING_LC)==0){
+        code=SKY_CODE;
+      }
+      else if (strcmp(shutter_flag,DARK_STRING)==0){
+        code=DARK_CODE;
+      }
+      else if (strcmp(shutter_flag,DARK_STRING_LC)==0){
+        code=DARK_CODE;
+      }
+      else if (strcmp(shutter_flag,FOCUS_STRING)==0){
+        code=FOCUS_CODE;
+      }
+      else if (strcmp(shutter_flag,FOCUS_STRING_LC)==0){
+        code=FOCUS_CODE;
+      }
+      else if (strcmp(shutter_flag,OFFSET_STRING)==0){
+        code=OFFSET_CODE;
+      }
+      else if (strcmp(shutter_flag,OFFSET_STRING_LC)==0){
+        code=OFFSET_CODE;
+      }
+      else if (strcmp(shutter_flag,EVENING_FLAT_STRING)==0){
+        code=EVENING_FLAT_CODE;
+      }
+      else if (strcmp(shutter_flag,EVENING_FLAT_STRING_LC)==0){
+        code=EVENING_FLAT_CODE;
+      }
+      else if (strcmp(shutter_flag,MORNING_FLAT_STRING)==0){
+        code=MORNING_FLAT_CODE;
+      }
+      else if (strcmp(shutter_flag,MORNING_FLAT_STRING_LC)==0){
+        code=MORNING_FLAT_CODE;
+      }
+      else if (strcmp(shutter_flag,DOME_FLAT_STRING)==0){
+        code=DOME_FLAT_CODE;
+      }
+      else if (strcmp(shutter_flag,DOME_FLAT_STRING_LC)==0){
+        code=DOME_FLAT_CODE;
+      }
+      else{
+        code=BAD_CODE;
+      }
+
+      return(code);
+}
+
+/************************************************************/
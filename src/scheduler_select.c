@@ -0,0 +1,1094 @@
+/* scheduler_select.c
+
+   Choice of the next field to observe. get_next_field reads the
+   candidate sets kept by scheduler_events.c. scan_next_field is the
+   original selection, which updates and rescans every field on each
+   call; it is kept as the scan policy, and check_select compares the
+   two. update_field_status gives the status of one field at jd.
+
+*/
+
+#include "scheduler.h"
+
+extern int verbose;
+extern int verbose1;
+
+/************************************************************/
+
+/* cost of observing ready field f in place of ready field f_min, which
+   has the least time left: its time left plus SLEW_COST_WEIGHT times
+   the slew to it (hours). HUGE_VAL if f is not as urgent as f_min, or
+   if a visit to f would use up the time left for f_min */
+
+static double slew_cost(Field *f_min, Field *f)
+{
+    double slew_hours;
+
+    if(f->time_left>f_min->time_left+SLEW_TIE_HOURS)return(HUGE_VAL);
+
+    if(f->shutter==DARK_CODE||f->shutter==DOME_FLAT_CODE){
+       slew_hours=0.0;
+    }
+    else{
+       slew_hours=get_slew_time(f->ra,f->dec)/3600.0;
+    }
+
+    if(f!=f_min&&f->expt+slew_hours>=f_min->time_left)return(HUGE_VAL);
+
+    return(f->time_left+SLEW_COST_WEIGHT*slew_hours);
+}
+
+/************************************************************/
+
+/* of the ready fields as urgent as field i_min (see get_ready_ties),
+   choose the one with the least slew_cost. Returns its index */
+
+static int nearest_ready_field(Field_Events *events, Field *sequence,
+        int i_min, double jd, int bad_weather)
+{
+    int item[MAX_SLEW_CANDIDATES];
+    int n,k,i,i_best;
+    double cost,cost_best;
+
+    n=get_ready_ties(events,SLEW_TIE_HOURS,item,MAX_SLEW_CANDIDATES);
+    if(n<=1)return(i_min);
+
+    i_best=i_min;
+    cost_best=slew_cost(sequence+i_min,sequence+i_min);
+
+    for(k=0;k<n;k++){
+       i=item[k];
+       if(i==i_min)continue;
+       if(refresh_field_events(events,sequence,i,jd,bad_weather)!=READY_STATUS)continue;
+       cost=slew_cost(sequence+i_min,sequence+i);
+       if(cost<cost_best||(cost==cost_best&&i<i_best)){
+          cost_best=cost;
+          i_best=i;
+       }
+    }
+
+    if(verbose1&&i_best!=i_min){
+       fprintf(stderr,
+          "get_next_field: field %d (%6.1f sec slew) chosen over field %d (%6.1f sec slew) of %d ties\n",
+          i_best,get_slew_time(sequence[i_best].ra,sequence[i_best].dec),
+          i_min,get_slew_time(sequence[i_min].ra,sequence[i_min].dec),n);
+    }
+
+    return(i_best);
+}
+
+/************************************************************/
+
+/* Choose the next field to observe.
+
+   This is a two pass selection loop. In the first pass, consider 
+   every field. Call update_field_status to determine if the
+   field is observable, ready to be observed, and how much time 
+   is left to observe it. If there is a field with DO_NOW_STATUS 
+   (e.g. a dark) , choose that field and return with its field index. 
+   Otherwise, keep track of how many fields have READY_STATUS
+   and TOO_LATE_STATUS. For those with READY_STATUS,
+   update the minimum value of n_left (number of fields remaining 
+   for completion).
+
+   Before starting the second pass, check if the previously
+   observed field was the first in a pair and if the
+   second in the pair is ready to be observed. If so, choose
+   the second in the pair as the next field.
+
+   In the second pass, find all the fields that are ready to observe
+   (READY_STATUS) and have n_left matching the minimum value
+   determined in the first pass. Of these, select the field
+   that has the least time remaining (time_left) to complete the
+   required observations.
+   With s->slew_cost_on, the fields with no more than SLEW_TIE_HOURS
+   more time left than that are taken as equally urgent, and the one
+   with the least time left plus slew time (slew_cost) is chosen.
+
+   If there are no fields ready to observe, choose among the "late"
+   fields (TOO_LATE_STATUS) which are observable, but for which
+   there is not enough time to
+   observe all the remaining observations. Choose the late field with
+   the most amount of time left (least negative value) and shorten
+   the time interval between fields so that there is time left. Choose
+   this field.
+
+   If there are not late fields that can be shortened (while still
+   keeping interval > MIN_INTERVAL), return -1 (no field selected).
+
+*/
+
+int scan_next_field(Selection_Settings *s, Field *sequence,int num_fields,
+                int i_prev, double jd, int bad_weather)
+{
+     Field *f,*f_prev,*f_next;
+     double time_left_min,time_left,time_left_max,cost,cost_min;
+     int i,n_left,n_left_min,n_left_min_must_do;
+     int i_min,i_max,i_near,status,n_ready,n_late;
+     int n_do_now,i_min_dark, i_min_flat,i_min_do_now;
+     int n_ready_must_do,n_late_must_do;
+     char field_status[256];
+
+     if(i_prev>=0&&i_prev<num_fields-1){
+       f_prev=sequence+i_prev;
+       f_next=sequence+i_prev+1;
+     }
+     else{
+       f_prev=NULL;
+       f_next=NULL;
+     }
+
+     n_left_min=100000;
+     n_left_min_must_do=100000;
+     n_ready=0;
+     n_late=0;
+     n_do_now=0;
+     i_min_dark=-1;
+     i_min_flat=-1;
+     i_min_do_now=-1;
+     n_ready_must_do=0;
+     n_late_must_do=0;
+
+     if(verbose){  
+    fprintf(stderr,"get_next_field: updating field status\n");
+     }
+
+     for(i=0;i<num_fields;i++){
+     f=sequence+i;
+
+     update_field_status(f,jd,bad_weather);
+     if(verbose1){
+       get_field_status_string(f,field_status);
+       fprintf(stderr,"field %d status %s\n",i,field_status);
+     }
+
+#if 1
+     /* for any MUST-DO field with READY_STATUS, increment the count and update minimum
+        value of n_left */
+
+     if (f->status==READY_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE){
+        n_ready_must_do++;
+
+        n_left=f->n_required-f->n_done;
+        
+        if(n_left<n_left_min_must_do){
+         n_left_min_must_do=n_left;
+        }
+
+     }
+
+     /* status of DO_NOW_STATUS  means must do now (i.e. darks or 2nd offset
+        field).  Return field index */
+
+     else if(f->status==DO_NOW_STATUS){
+        n_do_now++;
+        if(i_min_do_now==-1)i_min_do_now=i;
+        if(f->shutter==DARK_CODE&&i_min_dark==-1)i_min_dark=i;
+        if((f->shutter==DOME_FLAT_CODE||f->shutter==EVENING_FLAT_CODE||
+          f->shutter==MORNING_FLAT_CODE)&&i_min_flat==-1)i_min_flat=i;
+        /*return(i);*/
+     }
+
+#else
+     /* status of DO_NOW_STATUS  means must do now (i.e. darks or 2nd offset
+        field).  Return field index */
+
+     if(f->status==DO_NOW_STATUS){
+        n_do_now++;
+        if(i_min_do_now==-1)i_min_do_now=i;
+        if(f->shutter==DARK_CODE&&i_min_dark==-1)i_min_dark=i;
+        if((f->shutter==DOME_FLAT_CODE||f->shutter==EVENING_FLAT_CODE||
+          f->shutter==MORNING_FLAT_CODE)&&i_min_flat==-1)i_min_flat=i;
+        /*return(i);*/
+     }
+
+     /* for any MUST-DO field with READY_STATUS, increment the count and update minimum
+        value of n_left */
+
+     else if (f->status==READY_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE){
+        n_ready_must_do++;
+
+        n_left=f->n_required-f->n_done;
+        
+        if(n_left<n_left_min_must_do){
+         n_left_min_must_do=n_left;
+        }
+
+     }
+#endif
+
+     /* for any other field with READY_STATUS, increment the count and update minimum
+        value of n_left */
+
+     else if (f->status==READY_STATUS){
+        n_ready++;
+
+        n_left=f->n_required-f->n_done;
+        
+        if(n_left<n_left_min){
+         n_left_min=n_left;
+        }
+
+     }
+
+     /* Also count fields with TOO_LATE_STATUS */
+
+     else if (f->status==TOO_LATE_STATUS){
+        n_late++;
+        if(f->survey_code==MUSTDO_SURVEY_CODE)n_late_must_do++;
+     }
+
+     } //for(i=0;i<num_fields;i++){
+
+     /* If there are MUST_DO fields with READY_STATUS, 
+    choose the one that has least time left to complete the 
+    required observations */       
+
+     if(n_ready_must_do>0){
+       if(verbose){
+       fprintf(stderr,"get_next_field: checking %d ready must-do fields \n",n_ready_must_do);
+       }
+      
+       if(verbose) {
+      fprintf(stderr,"get_next_field: %d must-do fields ready\n",n_ready_must_do);
+       }
+
+       time_left_min=10000.0;
+       i_min=-1;
+
+       for(i=0;i<num_fields;i++){
+     f=sequence+i;
+     if(f->status==READY_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE){
+        n_left=f->n_required-f->n_done;
+        if((f->n_required==6||n_left==n_left_min_must_do)&&f->time_left<time_left_min){
+         i_min=i;
+         time_left_min=f->time_left;
+        }
+     }
+       }
+
+       if(verbose){
+      fprintf(stderr,"get_next_field: returning ready must-do field : %d\n",i_min);
+       }
+       (sequence+i_min)->selection_code = LEAST_TIME_READY_MUST_DO;
+       return(i_min);
+
+     }
+
+      /* If there are MUST-DO fields with TOO_LATE_STATUS, choose the one
+    that has the least time left.  Shorten the interval so 
+    that time_left=0.  If still doable, choose this field*/
+
+     if (n_late_must_do>0){
+    if(verbose1){
+       fprintf(stderr,"get_next_field: checking %d too-late must-do fields \n",n_late_must_do);
+    }
+
+    if(verbose1) {
+      fprintf(stderr,"get_next_field: %d must-do late fields\n",n_late_must_do);
+    }
+
+    i_min=-1;
+    time_left_min=10000.0;
+    for(i=0;i<num_fields;i++){
+      f=sequence+i;
+      if(f->status==TOO_LATE_STATUS&&f->survey_code==MUSTDO_SURVEY_CODE&&f->time_left<time_left_min){
+          time_left_min=f->time_left;
+          i_min=i;
+      }
+    }
+
+    // This shouldn't happen
+    if(i_min<0){
+       fprintf(stderr,
+          "ERROR: get_next_field: n_late_must_do [%d] > 0 but non appear in the field list\n",
+          n_late_must_do);
+       fflush(stdout);
+       fflush(stderr);
+       //return(-1);
+    }
+       
+    if(verbose1){
+       fprintf(stderr,
+        "get_next_field: choosing field %d to shorten intervals\n",
+         i_min);
+    }
+       
+    f=sequence+i_min;
+    shorten_interval(f);
+    update_field_status(f,jd,bad_weather);
+
+    if(verbose1){
+       fprintf(stderr,
+          "get_next_field: interval shortened to %10.6f\n",
+          f->interval*3600.0);
+    }
+    if(verbose1){
+      fprintf(stderr,"get_next_field: returning late must-do field : %d\n",i_min);
+    }
+    (sequence+i_min)->selection_code = LEAST_TIME_LATE_MUST_DO;
+    return(i_min);
+     }
+
+ 
+     /* If there were fields with DO_NOW_STATUS, choose the first flat,
+    or else the first dark, or else the first field */
+
+     if(n_do_now>0){
+    if(verbose1){
+       fprintf(stderr,"get_next_field: checking %d do_now fields\n",n_do_now);
+    }
+
+    if(i_min_flat>=0){
+          if(verbose1){
+          fprintf(stderr,"get_next_field: returning i_min_flat: %d\n",i_min_flat);
+          }
+          (sequence+i_min_flat)->selection_code = FIRST_DO_NOW_FLAT;
+          return(i_min_flat);
+    }
+    else if(i_min_dark>=0){
+          if(verbose1){
+          fprintf(stderr,"get_next_field: returning i_min_dark: %d\n",i_min_dark);
+          }
+          (sequence+i_min_dark)->selection_code = FIRST_DO_NOW_DARK;
+          return(i_min_dark);
+    }
+    else{
+          if(verbose1){
+          fprintf(stderr,"get_next_field: returning i_min_do_now: %d\n",i_min_do_now);
+          }
+          (sequence+i_min_do_now)->selection_code = FIRST_DO_NOW;
+          return(i_min_do_now);
+    }
+     }
+  
+     /* if the pair to the previous fields is doable, choose the paired field */
+
+     if(f_prev!=NULL&&paired_fields(f_next,f_prev)&&f_next->doable){
+    if(verbose1){
+        fprintf(stderr,"get_next_field: checking for doable pair to previous field %d\n",i_prev);
+    }
+
+    if(verbose1){
+        fprintf(stderr,"get_next_field: field %d is paired with field %d \n",
+            i_prev+1,i_prev);
+    }
+    if(f_next->status==READY_STATUS){
+        if(verbose1){
+        fprintf(stderr,"get_next_field: returning paired field %d \n", i_prev+1);
+        }
+        (sequence+i_prev+1)->selection_code = FIRST_READY_PAIR;
+        return(i_prev+1);
+    }
+    else if(f_next->status==TOO_LATE_STATUS){
+      shorten_interval(f_next);
+      update_field_status(f_next,jd,bad_weather);
+      if(f_next->status==READY_STATUS){
+         if(verbose1){
+        fprintf(stderr,"get_next_field: returning late paired field %d \n", i_prev+1);
+         }
+         (sequence+i_prev+1)->selection_code = FIRST_LATE_PAIR;
+         return(i_prev+1);
+      }
+      else{
+         if(verbose1){
+           fprintf(stderr,"get_next_field: returning  not-ready paired field %d \n", i_prev+1);
+         }
+         (sequence+i_prev+1)->selection_code = FIRST_NOT_READY_LATE_PAIR;
+         return(i_prev+1);
+      }
+    }
+    else{
+         if(verbose1){
+           fprintf(stderr,
+          "get_next_field: returning paired field %d that is neither ready nor too late\n",
+          i_prev+1);
+         }
+         (sequence+i_prev+1)->selection_code = FIRST_NOT_READY_NOT_LATE_PAIR;
+         return(i_prev+1);
+    }
+     }
+
+     /* If there are fields with READY_STATUS, choose the one 
+    that has least time left to complete the required observations */
+
+     if(n_ready>0){
+     if(verbose1){
+        fprintf(stderr,"get_next_field: checking %d ready fields \n",n_ready);
+     }
+    
+     time_left_min=10000.0;
+     i_min=-1;
+
+     for(i=0;i<num_fields;i++){
+       f=sequence+i;
+       if(f->status==READY_STATUS){
+          n_left=f->n_required-f->n_done;
+          if(n_left==n_left_min&&f->time_left<time_left_min){
+           i_min=i;
+           time_left_min=f->time_left;
+          }
+       }
+     }
+     
+     i_near=i_min;
+     if(s->slew_cost_on){
+       cost_min=slew_cost(sequence+i_min,sequence+i_min);
+       for(i=0;i<num_fields;i++){
+         f=sequence+i;
+         if(f->status==READY_STATUS&&i!=i_min&&
+            f->n_required-f->n_done==n_left_min){
+            cost=slew_cost(sequence+i_min,f);
+            if(cost<cost_min){
+              i_near=i;
+              cost_min=cost;
+            }
+         }
+       }
+     }
+
+     if(s->lookahead_depth>0){
+       i=lookahead_next_field(sequence,num_fields,i_near,jd,bad_weather,
+          s->lookahead_depth);
+       if(i!=i_near){
+          if(verbose1){
+             fprintf(stderr,"get_next_field: returning lookahead ready field : %d\n",i);
+          }
+          (sequence+i)->selection_code = LOOKAHEAD_READY;
+          return(i);
+       }
+     }
+
+     if(i_near!=i_min){
+        if(verbose1){
+           fprintf(stderr,"get_next_field: returning nearest ready field : %d\n",i_near);
+        }
+        (sequence+i_near)->selection_code = NEAREST_READY;
+        return(i_near);
+     }
+
+     if(verbose1){
+        fprintf(stderr,"get_next_field: returning ready field : %d\n",i_min);
+     }
+
+     (sequence+i_min)->selection_code = LEAST_TIME_READY;
+     return(i_min);
+
+     }
+
+     /* If there are no observable fields ready to observe,  but there are
+    fields with TOO_LATE_STATUS, choose the first one with MUSTDO_SURVEY_CODE, or
+    else the field that has the most time left. Shorten the interval so 
+    that time_left=0.  If still doable, choose this field. Otherwise return -1 */
+
+     if (n_late>0){
+
+    if(verbose1){
+        fprintf(stderr,"get_next_field: checking %d late fields \n",n_late);
+    }
+
+    i_max=-1;
+    time_left_max=-1000;
+    for(i=0;i<num_fields;i++){
+      f=sequence+i;
+      if(f->status==TOO_LATE_STATUS&&f->time_left>time_left_max){
+          time_left_max=f->time_left;
+          i_max=i;
+      }
+    }
+
+
+    if(i_max<0){
+       if(verbose1)fprintf(stderr,"get_next_field: No fields to shorten\n");
+       //return(-1);
+    } 
+    else{
+       
+      if(verbose1){
+         fprintf(stderr,
+          "get_next_field: choosing field %d to shorten intervals\n",
+           i_max);
+      }
+         
+      f=sequence+i_max;
+      shorten_interval(f);
+      update_field_status(f,jd,bad_weather);
+      if(f->status==READY_STATUS){
+
+         if(verbose1){
+        fprintf(stderr,
+           "get_next_field: interval shortened to %10.6f\n",
+           f->interval*3600.0);
+         }
+         (sequence+i_max)->selection_code = MOST_TIME_READY_LATE;
+         return(i_max);
+      }
+      else{
+         if(verbose1){
+        fprintf(stderr,
+           "get_next_field: could not shorten interval of field %d\n",
+           i_max);
+         }
+      }  // if (f->status==READY_STATUS
+    } //if(i_max<0){
+ 
+     }  // if(n_late>0)
+
+     if(verbose) {
+    fprintf(stderr,"get_next_field: No fields to observe\n");
+     }
+     return(-1);
+
+}
+/*******************************************************/
+
+/* Choose the next field to observe, with the same rules and the same
+   choice as scan_next_field, but reading the candidate sets kept by
+   scheduler_events.c instead of updating and rescanning every field.
+   Only fields whose status can have changed since the last call are
+   re-evaluated. Candidates that are compared on time_left are
+   refreshed at jd before they are compared. */
+
+int get_next_field(Selection_Settings *s, Field_Events *events,
+                Field *sequence,int num_fields, int i_prev, double jd,
+                int bad_weather)
+{
+     Field *f,*f_prev,*f_next;
+     double time_left_min;
+     int i,k,n_left,n_left_min_must_do;
+     int i_min,i_max,i_min_dark,i_min_flat,i_min_do_now;
+
+     if(i_prev>=0&&i_prev<num_fields-1){
+       f_prev=sequence+i_prev;
+       f_next=sequence+i_prev+1;
+     }
+     else{
+       f_prev=NULL;
+       f_next=NULL;
+     }
+
+     if(verbose){  
+    fprintf(stderr,"get_next_field: updating field status\n");
+     }
+
+     update_field_events(events,sequence,jd,bad_weather);
+
+     /* If there are MUST_DO fields with READY_STATUS, 
+    choose the one that has least time left to complete the 
+    required observations. Refresh them first (in reverse, since
+    a field that is no longer ready is swapped out of the list) */       
+
+     for(k=events->ready_must_do.n-1;k>=0;k--){
+       refresh_field_events(events,sequence,events->ready_must_do.item[k],
+          jd,bad_weather);
+     }
+
+     if(events->ready_must_do.n>0){
+       if(verbose) {
+      fprintf(stderr,"get_next_field: %d must-do fields ready\n",
+          events->ready_must_do.n);
+       }
+
+       n_left_min_must_do=100000;
+       for(k=0;k<events->ready_must_do.n;k++){
+     f=sequence+events->ready_must_do.item[k];
+     n_left=f->n_required-f->n_done;
+     if(n_left<n_left_min_must_do)n_left_min_must_do=n_left;
+       }
+
+       time_left_min=10000.0;
+       i_min=-1;
+       for(k=0;k<events->ready_must_do.n;k++){
+     i=events->ready_must_do.item[k];
+     f=sequence+i;
+     n_left=f->n_required-f->n_done;
+     if((f->n_required==6||n_left==n_left_min_must_do)&&
+        (f->time_left<time_left_min||
+        (f->time_left==time_left_min&&i<i_min))){
+        i_min=i;
+        time_left_min=f->time_left;
+     }
+       }
+
+       if(i_min>=0){
+     if(verbose){
+        fprintf(stderr,"get_next_field: returning ready must-do field : %d\n",i_min);
+     }
+     (sequence+i_min)->selection_code = LEAST_TIME_READY_MUST_DO;
+     return(i_min);
+       }
+     }
+
+      /* If there are MUST-DO fields with TOO_LATE_STATUS, choose the one
+    that has the least time left.  Shorten the interval so 
+    that time_left=0.  If still doable, choose this field*/
+
+     for(k=events->late_must_do.n-1;k>=0;k--){
+       refresh_field_events(events,sequence,events->late_must_do.item[k],
+          jd,bad_weather);
+     }
+
+     if(events->late_must_do.n>0){
+    if(verbose1) {
+      fprintf(stderr,"get_next_field: %d must-do late fields\n",
+          events->late_must_do.n);
+    }
+
+    i_min=-1;
+    time_left_min=10000.0;
+    for(k=0;k<events->late_must_do.n;k++){
+      i=events->late_must_do.item[k];
+      f=sequence+i;
+      if(f->time_left<time_left_min||(f->time_left==time_left_min&&i<i_min)){
+          time_left_min=f->time_left;
+          i_min=i;
+      }
+    }
+
+    if(verbose1){
+       fprintf(stderr,
+        "get_next_field: choosing field %d to shorten intervals\n",
+         i_min);
+    }
+       
+    f=sequence+i_min;
+    shorten_interval(f);
+    refresh_field_events(events,sequence,i_min,jd,bad_weather);
+
+    if(verbose1){
+       fprintf(stderr,
+          "get_next_field: interval shortened to %10.6f\n",
+          f->interval*3600.0);
+    }
+    if(verbose1){
+      fprintf(stderr,"get_next_field: returning late must-do field : %d\n",i_min);
+    }
+    (sequence+i_min)->selection_code = LEAST_TIME_LATE_MUST_DO;
+    return(i_min);
+     }
+
+     /* If there were fields with DO_NOW_STATUS, choose the first flat,
+    or else the first dark, or else the first field */
+
+     if(events->do_now.n>0){
+    if(verbose1){
+       fprintf(stderr,"get_next_field: checking %d do_now fields\n",
+          events->do_now.n);
+    }
+
+    i_min_dark=-1;
+    i_min_flat=-1;
+    i_min_do_now=-1;
+    for(k=0;k<events->do_now.n;k++){
+      i=events->do_now.item[k];
+      f=sequence+i;
+      if(i_min_do_now==-1||i<i_min_do_now)i_min_do_now=i;
+      if(f->shutter==DARK_CODE&&(i_min_dark==-1||i<i_min_dark))i_min_dark=i;
+      if((f->shutter==DOME_FLAT_CODE||f->shutter==EVENING_FLAT_CODE||
+          f->shutter==MORNING_FLAT_CODE)&&(i_min_flat==-1||i<i_min_flat))i_min_flat=i;
+    }
+
+    if(i_min_flat>=0){
+          if(verbose1){
+          fprintf(stderr,"get_next_field: returning i_min_flat: %d\n",i_min_flat);
+          }
+          (sequence+i_min_flat)->selection_code = FIRST_DO_NOW_FLAT;
+          return(i_min_flat);
+    }
+    else if(i_min_dark>=0){
+          if(verbose1){
+          fprintf(stderr,"get_next_field: returning i_min_dark: %d\n",i_min_dark);
+          }
+          (sequence+i_min_dark)->selection_code = FIRST_DO_NOW_DARK;
+          return(i_min_dark);
+    }
+    else{
+          if(verbose1){
+          fprintf(stderr,"get_next_field: returning i_min_do_now: %d\n",i_min_do_now);
+          }
+          (sequence+i_min_do_now)->selection_code = FIRST_DO_NOW;
+          return(i_min_do_now);
+    }
+     }
+  
+     /* if the pair to the previous fields is doable, choose the paired field */
+
+     if(f_prev!=NULL&&paired_fields(f_next,f_prev)&&f_next->doable){
+    if(verbose1){
+        fprintf(stderr,"get_next_field: field %d is paired with field %d \n",
+            i_prev+1,i_prev);
+    }
+    refresh_field_events(events,sequence,i_prev+1,jd,bad_weather);
+    if(f_next->status==READY_STATUS){
+        if(verbose1){
+        fprintf(stderr,"get_next_field: returning paired field %d \n", i_prev+1);
+        }
+        (sequence+i_prev+1)->selection_code = FIRST_READY_PAIR;
+        return(i_prev+1);
+    }
+    else if(f_next->status==TOO_LATE_STATUS){
+      shorten_interval(f_next);
+      refresh_field_events(events,sequence,i_prev+1,jd,bad_weather);
+      if(f_next->status==READY_STATUS){
+         if(verbose1){
+        fprintf(stderr,"get_next_field: returning late paired field %d \n", i_prev+1);
+         }
+         (sequence+i_prev+1)->selection_code = FIRST_LATE_PAIR;
+         return(i_prev+1);
+      }
+      else{
+         if(verbose1){
+           fprintf(stderr,"get_next_field: returning  not-ready paired field %d \n", i_prev+1);
+         }
+         (sequence+i_prev+1)->selection_code = FIRST_NOT_READY_LATE_PAIR;
+         return(i_prev+1);
+      }
+    }
+    else{
+         if(verbose1){
+           fprintf(stderr,
+          "get_next_field: returning paired field %d that is neither ready nor too late\n",
+          i_prev+1);
+         }
+         (sequence+i_prev+1)->selection_code = FIRST_NOT_READY_NOT_LATE_PAIR;
+         return(i_prev+1);
+    }
+     }
+
+     /* If there are fields with READY_STATUS, choose the one with the
+    fewest observations left and, of those, the least time left to
+    complete them. This is the top of the ready heap. Refresh it
+    at jd, in case it has just crossed into TOO_LATE_STATUS. */
+
+     while(events->ready.n>0){
+     i_min=events->ready.item[0];
+     if(refresh_field_events(events,sequence,i_min,jd,bad_weather)!=READY_STATUS)continue;
+     if(events->ready.item[0]!=i_min)continue;
+
+     /* with a plan, the first of its next visits that is ready */
+
+     if(s->follow_plan){
+        k=planned_next_field(sequence,num_fields,jd,bad_weather);
+        if(k>=0&&refresh_field_events(events,sequence,k,jd,bad_weather)==READY_STATUS){
+           if(verbose1){
+              fprintf(stderr,"get_next_field: returning planned ready field %d of %d\n",
+                 k,events->ready.n);
+           }
+           (sequence+k)->selection_code = PLANNED_READY;
+           return(k);
+        }
+     }
+
+     i=i_min;
+     if(s->slew_cost_on){
+        i=nearest_ready_field(events,sequence,i_min,jd,bad_weather);
+     }
+
+     /* with lookahead, the ready field that leads to the best of the
+        next s->lookahead_depth selections */
+
+     if(s->lookahead_depth>0){
+        k=lookahead_next_field(sequence,num_fields,i,jd,bad_weather,
+           s->lookahead_depth);
+        if(k!=i&&refresh_field_events(events,sequence,k,jd,bad_weather)==READY_STATUS){
+           if(verbose1){
+              fprintf(stderr,"get_next_field: returning lookahead ready field %d of %d\n",
+                 k,events->ready.n);
+           }
+           (sequence+k)->selection_code = LOOKAHEAD_READY;
+           return(k);
+        }
+     }
+
+     if(i!=i_min){
+        if(verbose1){
+           fprintf(stderr,"get_next_field: returning nearest ready field %d of %d\n",
+              i,events->ready.n);
+        }
+        (sequence+i)->selection_code = NEAREST_READY;
+        return(i);
+     }
+
+     if(verbose1){
+        fprintf(stderr,"get_next_field: returning ready field %d of %d\n",
+           i_min,events->ready.n);
+     }
+
+     (sequence+i_min)->selection_code = LEAST_TIME_READY;
+     return(i_min);
+     }
+
+     /* If there are no observable fields ready to observe,  but there are
+    fields with TOO_LATE_STATUS, choose the field that has the most time
+    left (top of the late heap). Shorten the interval so 
+    that time_left=0.  If still doable, choose this field. Otherwise return -1 */
+
+     i_max=-1;
+     while(events->late.n>0){
+     i_max=events->late.item[0];
+     if(refresh_field_events(events,sequence,i_max,jd,bad_weather)!=TOO_LATE_STATUS){
+        i_max=-1;
+        continue;
+     }
+     if(events->late.item[0]==i_max)break;
+     }
+
+     if(i_max>=0){
+
+    if(verbose1){
+        fprintf(stderr,"get_next_field: checking %d late fields \n",
+           events->late.n);
+    }
+
+    if(verbose1){
+       fprintf(stderr,
+        "get_next_field: choosing field %d to shorten intervals\n",
+         i_max);
+    }
+         
+    f=sequence+i_max;
+    shorten_interval(f);
+    refresh_field_events(events,sequence,i_max,jd,bad_weather);
+    if(f->status==READY_STATUS){
+       if(verbose1){
+          fprintf(stderr,
+         "get_next_field: interval shortened to %10.6f\n",
+         f->interval*3600.0);
+       }
+       (sequence+i_max)->selection_code = MOST_TIME_READY_LATE;
+       return(i_max);
+    }
+    else{
+       if(verbose1){
+          fprintf(stderr,
+         "get_next_field: could not shorten interval of field %d\n",
+         i_max);
+       }
+    }  // if (f->status==READY_STATUS
+ 
+     }  // if(i_max>=0)
+
+     if(verbose) {
+    fprintf(stderr,"get_next_field: No fields to observe\n");
+     }
+     return(-1);
+
+}
+/*******************************************************/
+
+int paired_fields(Field *f1, Field *f2)
+{
+    double dra;
+
+    if(f1->shutter!=SKY_CODE||f2->shutter!=SKY_CODE)return(0);
+
+    /*dra=1.1*RA_STEP0/cos(f1->dec*DEG_TO_RAD);*/
+    dra=RA_STEP0/cos(f1->dec*DEG_TO_RAD);
+
+    if(f2->dec==f1->dec&&
+       fabs(clock_difference(f1->ra,f2->ra))<dra){
+    return(1);
+    }
+    else{
+    return(0);
+    }
+}
+
+/*******************************************************/
+
+/* shorten interval between exposures so that time_left=0. If new 
+   interval is less than MIN_INTERVAL, set doable to 0 */
+
+int shorten_interval(Field *f)
+{
+    double new_interval,new_time_required;
+
+
+    new_time_required=f->time_up;
+    new_interval = new_time_required/(f->n_required-f->n_done);
+    /*new_interval = f->interval/2.0;*/
+
+    if(new_interval>MIN_INTERVAL){
+       f->time_required=new_time_required;
+       f->interval=new_interval;
+       f->time_left=0;
+    }
+    else{
+       f->doable=0.0;
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* If not doable, already completed, or already set,  set doable flag to 0,
+   set status to NO_DOABLE_STATUS and return NOT_DOABLE_STATUS. 
+
+   If not yet risen or not yet ready to observe, don't change doable flag,
+   but still set status to NO_DOABLE_STATUS and return NOT_DOABLE_STATUS. 
+
+   For any dark, status to DO_NOW_STATUS and return status.
+
+   For focus, or flat ready to observe, set status to DO_NOW_STATUS if
+   the bad_weather flag is 0 and return status.
+
+   For any other field,  update time_required, time_up , and time left.
+   If time_left<0, keep doable = 1 but return TOO_LATE_STATUS.
+   Otherwise, this is field is observable. Return READY_STATUS 
+
+*/
+
+int  get_field_status_string(Field *f, char *string)
+{
+    switch (f->status){
+
+    case TOO_LATE_STATUS -1:
+      sprintf(string,"Too late");
+      break;
+    case NOT_DOABLE_STATUS -1:
+      sprintf(string,"Not doable");
+      break;
+    case READY_STATUS -1:
+      sprintf(string,"Ready");
+      break;
+    case DO_NOW_STATUS -1:
+      sprintf(string,"Do now");
+      break;
+    default:
+      sprintf(string,"Unknown status");
+      break;
+    }
+
+    return (0);
+}
+
+int update_field_status(Field *f, double jd, int bad_weather)
+{
+
+      /* Isn't doable */
+      if(f->doable==0){
+      f->status=NOT_DOABLE_STATUS;
+      return(NOT_DOABLE_STATUS);
+      }
+
+      /* Has been completed. */
+
+      else if(f->n_done==f->n_required){
+     f->doable=0; 
+     f->status=NOT_DOABLE_STATUS;
+     return(NOT_DOABLE_STATUS);
+      }
+    
+      /* hasn't risen yet */
+
+      else if(jd<f->jd_rise){
+     f->status=NOT_DOABLE_STATUS;
+     return(NOT_DOABLE_STATUS);
+      }
+
+      /* has already set 0 */
+
+      else if(jd>f->jd_set){
+     f->doable=0;
+     f->status=NOT_DOABLE_STATUS;
+     return(NOT_DOABLE_STATUS);
+      }
+
+      /* not yet time to reobserve */
+
+#if 1
+      else if (f->jd_next-jd>(MIN_EXECUTION_TIME/24.0)){
+#else
+      else if (f->jd_next-jd>f->interval/(2.0*24.0)){
+#endif
+        f->status=NOT_DOABLE_STATUS;
+        return(NOT_DOABLE_STATUS);
+      }
+
+
+      /* darks  and domes that  are ready to
+      observe get highest priority (DO_NOW_STATUS) */
+
+      else if (f->shutter==DARK_CODE||f->shutter==DOME_FLAT_CODE){
+        f->status=DO_NOW_STATUS;
+        return(DO_NOW_STATUS);
+      }
+
+
+      /* sky flats, focus and pointing_offsets fields  that are ready to
+     observe get highest priority (DO_NOW_STATUS)  as long as bad_weather flag is 0*/
+
+      else if (f->shutter==EVENING_FLAT_CODE||
+        f->shutter==MORNING_FLAT_CODE||f->shutter==FOCUS_CODE||
+        f->shutter==OFFSET_CODE){
+    if( !bad_weather){
+       f->status=DO_NOW_STATUS;
+       return(DO_NOW_STATUS);
+    }
+    else {
+       f->status=NOT_DOABLE_STATUS;
+       return(NOT_DOABLE_STATUS);
+    }
+      }      
+
+
+      /* Any other field is either ready to observe (READY_STATUS) or
+     too late to observe (TOO_LATE_STATUS ) */
+
+      else{
+
+      /* Update time_required, time_up , time left. */
+
+    f->time_required=(f->n_required-f->n_done)*f->interval;
+
+    /* time up is now to when the field sets */
+
+    f->time_up=(f->jd_set-jd)*24.0;
+
+    /* time left is time up - time required to finish the
+       observations.  */
+
+    f->time_left=f->time_up-f->time_required; 
+      
+    if(f->time_left<0){
+          f->status=TOO_LATE_STATUS;
+#if DEBUG
+  if ( f->field_number > 37 && f->field_number < 47 ){
+    fprintf(stderr,"update_field_status: field: %d jd: %12.6f time_required: %10.6f  jd_set: %12.6f time_up: %10.6f  time_left: %10.6f  status: %s\n",
+    f->field_number, jd, f->time_required, f->jd_set, f->time_up, f->time_left, "TOO_LATE");
+  }
+#endif
+          return(TOO_LATE_STATUS);
+    }
+    else{
+        f->status=READY_STATUS;
+#if DEBUG
+  if ( f->field_number > 37 && f->field_number < 47 ){
+    fprintf(stderr,"update_field_status: field: %d jd: %12.6f time_required: %10.6f  jd_set: %12.6f time_up: %10.6f  time_left: %10.6f  status: %s\n",
+    f->field_number, jd, f->time_required, f->jd_set, f->time_up, f->time_left, "READY_STATUS");
+  }
+#endif
+        return(READY_STATUS);
+    }
+      }
+}
+
+/************************************************************/
+
+/* Given two clock values (interval 0 to 24), return
+   their difference, h2 - h1, assuming there difference can not
+   be greater than 12 or less than -12 */
+
+double clock_difference(double h1,double h2)
+{
+   double dt;
+
+   dt = h2 - h1;
+   if(dt>12.0)dt=dt-24.0;
+   if(dt<-12.0)dt=dt+24.0;
+   
+   return (dt);
+}
+
+/************************************************************/
@@ -8,6 +8,9 @@
 
    SIGUSR2: resume observations
 
+   The pause and resume handlers also wake up the main loop if it is
+   idle (see scheduler_wait.c).
+
 */
 
 #include "scheduler.h"
@@ -76,6 +79,7 @@ void sigusr1_handler()
    }
 
    pause_flag=1;
+   wake_scheduler();
 
    return;
 }
@@ -95,6 +99,7 @@ void sigusr2_handler()
    }
 
    pause_flag=0;
+   wake_scheduler();
 
    return;
 }
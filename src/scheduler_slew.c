@@ -0,0 +1,227 @@
+/* scheduler_slew.c
+
+   Model of the time taken to point the telescope from one position
+   to another, used by get_next_field to choose the nearest of the
+   ready fields that are equally urgent.
+
+   The mount drives both axes at once, so a slew takes
+
+     settle + max(d_ha/rate_ha, d_dec/rate_dec)
+
+   where d_ha is the move in hour angle (the move in RA, deg, since
+   both ends are taken at the same LST) and d_dec the move in dec.
+   The rates and settling time start at SLEW_RATE_HA, SLEW_RATE_DEC
+   and SLEW_SETTLE_SEC, and are then fit to the pointing times that
+   observe_next_field measures (record_slew). Each slew is credited to
+   the axis that limits it under the current model, and a line
+   t = settle + d/rate is fit to each axis by least squares. The sums
+   are scaled down by 1/SLEW_FIT_SAMPLES on each slew so that the fit
+   follows changes in the mount. The settling time is the mean of the
+   intercepts of the axes that have a fit.
+
+   The position at the end of the last recorded slew is kept as the
+   current position for get_slew_time. Until the first slew it is
+   unknown, and get_slew_time returns 0 for every field.
+
+*/
+
+#include "scheduler.h"
+
+extern int verbose1;
+
+#define HA_AXIS 0
+#define DEC_AXIS 1
+
+typedef struct {
+    double s;   /* sum of weights */
+    double sx;  /* weighted sums of distance (deg) and time (sec) */
+    double sy;
+    double sxx;
+    double sxy;
+    double rate;      /* fitted rate (deg/sec) */
+    double settle;    /* fitted intercept (sec) */
+    int fit;          /* 1 if rate and settle are fitted */
+} Slew_Axis;
+
+static Slew_Axis slew_axis[2]={
+    {0.0,0.0,0.0,0.0,0.0,SLEW_RATE_HA,SLEW_SETTLE_SEC,0},
+    {0.0,0.0,0.0,0.0,0.0,SLEW_RATE_DEC,SLEW_SETTLE_SEC,0}};
+
+static double slew_settle=SLEW_SETTLE_SEC;
+
+static int position_known=0;
+static double ra_now,dec_now; /* hours, deg */
+
+/************************************************************/
+
+/* distance (deg) moved by each axis from ra0,dec0 to ra1,dec1 */
+
+static void slew_distance(double ra0, double dec0, double ra1, double dec1,
+        double *d_ha, double *d_dec)
+{
+    double d_ra;
+
+    d_ra=fabs(ra1-ra0);
+    while(d_ra>24.0)d_ra=d_ra-24.0;
+    if(d_ra>12.0)d_ra=24.0-d_ra;
+
+    *d_ha=d_ra*15.0;
+    *d_dec=fabs(dec1-dec0);
+}
+
+/************************************************************/
+
+static double model_slew_time(double d_ha, double d_dec)
+{
+    double t_ha,t_dec;
+
+    t_ha=d_ha/slew_axis[HA_AXIS].rate;
+    t_dec=d_dec/slew_axis[DEC_AXIS].rate;
+
+    if(t_ha>t_dec){
+      return(slew_settle+t_ha);
+    }
+    else{
+      return(slew_settle+t_dec);
+    }
+}
+
+/************************************************************/
+
+/* refit the rate and intercept of one axis. Keep the previous values
+   until there are enough slews spanning enough distance */
+
+static void fit_slew_axis(Slew_Axis *a)
+{
+    double det,slope,intercept;
+
+    if(a->s<SLEW_FIT_MIN_SAMPLES)return;
+
+    det=a->s*a->sxx-a->sx*a->sx;
+    if(det<=a->s*a->s*SLEW_FIT_MIN_DEG*SLEW_FIT_MIN_DEG)return;
+
+    slope=(a->s*a->sxy-a->sx*a->sy)/det;
+    intercept=(a->sy-slope*a->sx)/a->s;
+
+    if(slope<=1.0/SLEW_RATE_MAX||slope>=1.0/SLEW_RATE_MIN)return;
+    if(intercept<0.0)intercept=0.0;
+
+    a->rate=1.0/slope;
+    a->settle=intercept;
+    a->fit=1;
+}
+
+/************************************************************/
+
+/* add a measured slew of slew_sec from ra0,dec0 to ra1,dec1 (hours,deg)
+   to the fit, and take ra1,dec1 as the current position */
+
+void record_slew(double ra0, double dec0, double ra1, double dec1,
+        double slew_sec)
+{
+    Slew_Axis *a;
+    double d_ha,d_dec,d,decay,settle;
+    int k,n_fit;
+
+    ra_now=ra1;
+    dec_now=dec1;
+    position_known=1;
+
+    if(slew_sec<0.0||slew_sec>SLEW_FIT_MAX_SEC)return;
+
+    slew_distance(ra0,dec0,ra1,dec1,&d_ha,&d_dec);
+
+    if(d_ha/slew_axis[HA_AXIS].rate>d_dec/slew_axis[DEC_AXIS].rate){
+       a=slew_axis+HA_AXIS;
+       d=d_ha;
+    }
+    else{
+       a=slew_axis+DEC_AXIS;
+       d=d_dec;
+    }
+
+    decay=1.0-1.0/SLEW_FIT_SAMPLES;
+    for(k=0;k<2;k++){
+       slew_axis[k].s=slew_axis[k].s*decay;
+       slew_axis[k].sx=slew_axis[k].sx*decay;
+       slew_axis[k].sy=slew_axis[k].sy*decay;
+       slew_axis[k].sxx=slew_axis[k].sxx*decay;
+       slew_axis[k].sxy=slew_axis[k].sxy*decay;
+    }
+
+    a->s=a->s+1.0;
+    a->sx=a->sx+d;
+    a->sy=a->sy+slew_sec;
+    a->sxx=a->sxx+d*d;
+    a->sxy=a->sxy+d*slew_sec;
+
+    fit_slew_axis(a);
+
+    settle=0.0;
+    n_fit=0;
+    for(k=0;k<2;k++){
+       if(slew_axis[k].fit){
+         settle=settle+slew_axis[k].settle;
+         n_fit++;
+       }
+    }
+    if(n_fit>0)slew_settle=settle/n_fit;
+
+    if(verbose1){
+       fprintf(stderr,
+         "record_slew: %7.3f %7.3f deg in %7.2f sec (model %7.2f). rates %7.4f %7.4f deg/sec settle %6.2f sec\n",
+         d_ha,d_dec,slew_sec,model_slew_time(d_ha,d_dec),
+         slew_axis[HA_AXIS].rate,slew_axis[DEC_AXIS].rate,slew_settle);
+    }
+}
+
+/************************************************************/
+
+/* estimated time (sec) to slew from ra0, dec0 to ra1, dec1 (hours, deg) */
+
+double get_slew_time_between(double ra0, double dec0, double ra1, double dec1)
+{
+    double d_ha,d_dec;
+
+    slew_distance(ra0,dec0,ra1,dec1,&d_ha,&d_dec);
+
+    return(model_slew_time(d_ha,d_dec));
+}
+
+/************************************************************/
+
+/* current position (hours, deg) of the telescope, as of the last
+   recorded slew. Returns -1 if not known */
+
+int get_slew_position(double *ra, double *dec)
+{
+    if(!position_known)return(-1);
+
+    *ra=ra_now;
+    *dec=dec_now;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* forget the current position (e.g. before replaying a night) */
+
+void clear_slew_position()
+{
+    position_known=0;
+}
+
+/************************************************************/
+
+/* estimated time (sec) to slew from the current position to ra, dec
+   (hours, deg). 0 if the current position is not known */
+
+double get_slew_time(double ra, double dec)
+{
+    if(!position_known)return(0.0);
+
+    return(get_slew_time_between(ra_now,dec_now,ra,dec));
+}
+
+/************************************************************/
@@ -176,7 +176,7 @@ int binary_string_to_int(char *binaryString)
     int len = strlen(binaryString);
 
     for (int i = 0; i < len; i++) {
-        if (!isdigit(binaryString[i])) {
+        if (!isdigit((unsigned char)binaryString[i])) {
             return -1;
         }
         if (binaryString[i] != '0' && binaryString[i] != '1') {
@@ -237,26 +237,213 @@ int  get_string_status(char *keyword, char *reply, char *status)
 
 /*****************************************************/
 
+/* keywords of the status reply, found through a perfect hash of the
+ * keyword (see status_hash). field is the index in state_val for the
+ * controller states, or one of the *_KEY values below for the others.
+ * The table was made by trying hash constants until the keywords all
+ * fell in different slots. Check for collisions if a keyword is added.
+*/
+
+#define STATUS_HASH_SIZE 64 /* a power of 2 */
+#define MAX_STATE_BITS 30 /* longest state bit string */
+
+#define READY_KEY -1
+#define STATE_KEY -2
+#define ERROR_KEY -3
+#define COMMENT_KEY -4
+#define DATE_KEY -5
+
+typedef struct {
+  char *keyword;
+  int field;
+} Status_Keyword;
+
+static Status_Keyword status_keyword[STATUS_HASH_SIZE] = {
+    [ 5] = {"date", DATE_KEY},
+    [ 6] = {"POWERON", POWERON},
+    [ 7] = {"ERASING", ERASING},
+    [ 8] = {"ready", READY_KEY},
+    [ 9] = {"POWERBAD", POWERBAD},
+    [10] = {"PURGING", PURGING},
+    [11] = {"ERROR", ERROR},
+    [18] = {"AUTOFLUSH", AUTOFLUSH},
+    [19] = {"POWEROFF", POWEROFF},
+    [21] = {"UNKNOWN", UNKNOWN},
+    [24] = {"IDLE", IDLE},
+    [25] = {"FETCHING", FETCHING},
+    [32] = {"FLUSHING", FLUSHING},
+    [36] = {"comment", COMMENT_KEY},
+    [41] = {"ACTIVE", ACTIVE},
+    [43] = {"error", ERROR_KEY},
+    [44] = {"EXPOSING", EXPOSING},
+    [46] = {"AUTOCLEAR", AUTOCLEAR},
+    [49] = {"NOSTATUS", NOSTATUS},
+    [50] = {"READOUT_PENDING", READOUT_PENDING},
+    [52] = {"FETCH_PENDING", FETCH_PENDING},
+    [53] = {"ERRORED", ERRORED},
+    [55] = {"state", STATE_KEY},
+    [58] = {"READING", READING}
+};
+
+#define NUM_STATUS_KEYWORDS (NUM_STATES+5)
+
+/*****************************************************/
+/* slot in status_keyword for the n-character keyword at key, or -1
+   if it is not a status keyword */
+
+static int status_hash(char *key, int n)
+{
+  int h;
+
+  if (n < 2) return -1;
+
+  /* the reply may hold any byte, so hash them unsigned */
+
+  h = (n*31 + (unsigned char)key[1] + 2*(unsigned char)key[n-2]) &
+      (STATUS_HASH_SIZE-1);
+  if (status_keyword[h].keyword == NULL ||
+      strlen(status_keyword[h].keyword) != n ||
+      strncmp(status_keyword[h].keyword,key,n) != 0){
+     return -1;
+  }
+
+  return h;
+}
+
+/*****************************************************/
+/* copy the n-character value at value to string (size max_len) */
+
+static void copy_value(char *string, char *value, int n, int max_len)
+{
+  if (n > max_len-1) n = max_len-1;
+  strncpy(string,value,n);
+  string[n] = 0;
+}
+
+/*****************************************************/
 /* parse the keyword values from the reply string and store in
  * Camera_Status record.
+ *
+ * The reply (see get_value_string) is read in one pass: each quoted
+ * keyword followed by ":" is looked up in status_keyword, and its
+ * value, quoted or not, is stored in the field for that keyword.
+ * Other keywords are skipped. As before, a missing keyword leaves
+ * its flag False, its string "UNKNOWN" and its state value -1.
+ *
+ * Returns -1 if no status keyword was found.
 */
 
 int parse_status(char *reply,Camera_Status *status)
 {
-  int i;
-  char temp_string[1024];
+  int i,h,n,key_len,value_len,n_found,state;
+  char *p,*key,*value,*end;
+  char string[STR_BUF_LEN];
+  uint64_t found = 0;
+
+  status->ready = False;
+  status->error = False;
+  strcpy(status->state,"UNKNOWN");
+  strcpy(status->comment,"UNKNOWN");
+  strcpy(status->date,"UNKNOWN");
+  for (i=0;i<NUM_STATES;i++){
+     status->state_val[i]=-1;
+  }
 
-  status->ready= get_bool_status("ready",reply);
-  status->error= get_bool_status("error",reply);
+  n_found = 0;
+  p = reply;
+  while ((p = strchr(p,'\'')) != NULL){
+
+     key = p+1;
+     end = strchr(key,'\'');
+     if (end == NULL) break;
+     key_len = end - key;
+
+     /* a keyword is followed by ":" */
+
+     p = end+1;
+     while (*p == ' ') p++;
+     if (*p != ':') continue;
+     p++;
+     while (isspace((unsigned char)*p)) p++;
+
+     /* value is bracketed by quotes, or ends at the next separator */
+
+     if (*p == '\''){
+        value = p+1;
+        end = strchr(value,'\'');
+        if (end == NULL) break;
+        value_len = end - value;
+        p = end+1;
+     }
+     else{
+        value = p;
+        while (*p != 0 && *p != ',' && *p != '}' && *p != ']') p++;
+        end = p;
+        while (end > value && isspace((unsigned char)*(end-1))) end--;
+        value_len = end - value;
+     }
+
+     h = status_hash(key,key_len);
+     if (h < 0 || (found & ((uint64_t)1 << h))) continue;
+     found = found | ((uint64_t)1 << h);
+     n_found++;
+
+     switch (status_keyword[h].field){
+       case READY_KEY:
+         copy_value(string,value,value_len,sizeof(string));
+         status->ready = string_to_bool(string);
+         break;
+       case ERROR_KEY:
+         copy_value(string,value,value_len,sizeof(string));
+         status->error = string_to_bool(string);
+         break;
+       case STATE_KEY:
+         copy_value(status->state,value,value_len,STR_BUF_LEN);
+         break;
+       case COMMENT_KEY:
+         copy_value(status->comment,value,value_len,STR_BUF_LEN);
+         break;
+       case DATE_KEY:
+         copy_value(status->date,value,value_len,STR_BUF_LEN);
+         break;
+       default:
+
+         /* string of '0' and '1', one per controller. More than fit
+            in an int is not a state value */
+
+         state = 0;
+         for (i=0;i<value_len;i++){
+            if (i >= MAX_STATE_BITS){
+               state = -1;
+               break;
+            }
+            if (value[i] != '0' && value[i] != '1'){
+               if (isdigit((unsigned char)value[i])){
+                 copy_value(string,value,value_len,sizeof(string));
+                 fprintf(stderr,"ERROR: can not convert string [%s] to integer\n",string);
+                 fflush(stderr);
+               }
+               state = -1;
+               break;
+            }
+            state = (state << 1) | (value[i] - '0');
+         }
+         status->state_val[status_keyword[h].field] = state;
+         break;
+     }
+  }
 
-  get_string_status("state",reply,status->state);
-  get_string_status("comment",reply,status->comment);
-  get_string_status("date",reply,status->date);
+  if (n_found < NUM_STATUS_KEYWORDS){
+     for (h=0;h<STATUS_HASH_SIZE;h++){
+        if (status_keyword[h].keyword != NULL && ! (found & ((uint64_t)1 << h))){
+           fprintf(stderr,"ERROR: can not find keyword [%s] in status string [%s]\n",
+             status_keyword[h].keyword,reply);
+        }
+     }
+  }
 
-  for (i=0;i<NUM_STATES;i++){
-     status->state_val[i]=-1;
-     get_string_status(state_name[i],reply,temp_string);
-     status->state_val[i]=binary_string_to_int(temp_string);
+  if (n_found == 0){
+     return (-1);
   }
 
   return (0);
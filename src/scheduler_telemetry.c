@@ -0,0 +1,244 @@
+/* scheduler_telemetry.c
+
+   Background refresh of the telescope status.
+
+   A telemetry thread calls update_telescope_status every
+   TELEMETRY_PERIOD_SEC (TELEMETRY_RETRY_SEC while the controller does
+   not answer) and keeps the result in a snapshot guarded by
+   telemetry_lock. get_telescope_status copies the snapshot to the
+   caller, so the controller round trips are kept off the observing
+   path.
+
+   Each caller says how old a snapshot it accepts. If the snapshot is
+   older, the thread is woken to refresh at once and the caller waits
+   for it. A max_age_sec of 0 asks for values read after the call,
+   e.g. once the telescope has moved or been refocussed.
+
+   Once start_telemetry has been called, only the telemetry thread
+   reads the telescope status, so update_telescope_status must not be
+   called anywhere else. Before that, or if the thread could not be
+   started, get_telescope_status calls update_telescope_status itself.
+
+*/
+
+#include "scheduler.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+extern int verbose;
+
+static pthread_mutex_t telemetry_lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refresh_request=PTHREAD_COND_INITIALIZER; /* to thread */
+static pthread_cond_t refresh_done=PTHREAD_COND_INITIALIZER; /* to readers */
+
+/* all guarded by telemetry_lock */
+
+static int refresh_requested=0;
+static Telescope_Status snapshot; /* values from last good refresh */
+static int snapshot_ok=0;         /* 1 once snapshot has been filled */
+static double last_refresh_time=0.0; /* start of last refresh (sec) */
+static int last_refresh_result=-1;   /* its result */
+
+/* only changed before the thread starts */
+
+static int telemetry_running=0;
+
+/************************************************************/
+
+/* system time in seconds */
+
+static double get_system_time()
+{
+    struct timeval t;
+
+    gettimeofday(&t,NULL);
+
+    return(t.tv_sec+t.tv_usec*1.0e-6);
+}
+
+/************************************************************/
+
+static void set_timespec(struct timespec *t, double sec)
+{
+    t->tv_sec=(time_t)sec;
+    t->tv_nsec=(long)((sec-t->tv_sec)*1.0e9);
+    if(t->tv_nsec>999999999)t->tv_nsec=999999999;
+}
+
+/************************************************************/
+
+/* copy the values read from the controller. The pointing offsets
+   belong to the caller and are left alone */
+
+static void copy_telescope_values(Telescope_Status *to, Telescope_Status *from)
+{
+    to->lst=from->lst;
+    strcpy(to->filter_string,from->filter_string);
+    to->focus=from->focus;
+    to->dome_status=from->dome_status;
+    to->ut=from->ut;
+    to->ra=from->ra;
+    to->dec=from->dec;
+    to->weather=from->weather;
+    to->update_time=from->update_time;
+    to->valid=from->valid;
+}
+
+/************************************************************/
+
+static void *telemetry_thread(void *arg)
+{
+    Telescope_Status status;
+    struct timespec t_wake;
+    double t_start;
+    int result;
+
+    (void)arg;
+
+    memset((void *)&status,0,sizeof(status));
+
+    while(1){
+
+       t_start=get_system_time();
+       result=update_telescope_status(&status);
+
+       pthread_mutex_lock(&telemetry_lock);
+
+       if(result==0){
+          status.update_time=t_start;
+          copy_telescope_values(&snapshot,&status);
+          snapshot_ok=1;
+       }
+       last_refresh_time=t_start;
+       last_refresh_result=result;
+       pthread_cond_broadcast(&refresh_done);
+
+       /* sleep until the next refresh is due, or a reader asks for one */
+
+       if(result==0){
+          set_timespec(&t_wake,t_start+TELEMETRY_PERIOD_SEC);
+       }
+       else{
+          set_timespec(&t_wake,t_start+TELEMETRY_RETRY_SEC);
+       }
+
+       while(!refresh_requested){
+          if(pthread_cond_timedwait(&refresh_request,&telemetry_lock,
+                &t_wake)==ETIMEDOUT)break;
+       }
+       refresh_requested=0;
+
+       pthread_mutex_unlock(&telemetry_lock);
+    }
+
+    return(NULL);
+}
+
+/************************************************************/
+
+/* start the telemetry thread. If it can't be started, the status is
+   read on demand as before */
+
+int start_telemetry()
+{
+    pthread_t thread_id;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED);
+
+    if(pthread_create(&thread_id,&attr,telemetry_thread,NULL)!=0){
+       fprintf(stderr,
+          "start_telemetry: can't start telemetry thread. Reading status on demand\n");
+       fflush(stderr);
+       pthread_attr_destroy(&attr);
+       return(-1);
+    }
+
+    pthread_attr_destroy(&attr);
+    telemetry_running=1;
+
+    if(verbose){
+       fprintf(stderr,"start_telemetry: refreshing telescope status every %5.1f sec\n",
+          TELEMETRY_PERIOD_SEC);
+       fflush(stderr);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* copy to status the telescope values read no more than max_age_sec
+   ago, waiting for a new refresh if needed. Returns -1 if the
+   controller did not answer a refresh started in that time */
+
+int get_telescope_status(Telescope_Status *status, double max_age_sec)
+{
+    double t_min;
+    struct timespec t_end;
+    int result;
+
+    if(!telemetry_running){
+       return(update_telescope_status(status));
+    }
+
+    t_min=get_system_time()-max_age_sec;
+    set_timespec(&t_end,t_min+max_age_sec+TELEMETRY_WAIT_SEC);
+
+    pthread_mutex_lock(&telemetry_lock);
+
+    result=-1;
+    while(1){
+       if(snapshot_ok&&snapshot.update_time>=t_min){
+          copy_telescope_values(status,&snapshot);
+          result=0;
+          break;
+       }
+       else if(last_refresh_result!=0&&last_refresh_time>=t_min){
+          break;
+       }
+
+       refresh_requested=1;
+       pthread_cond_signal(&refresh_request);
+
+       if(pthread_cond_timedwait(&refresh_done,&telemetry_lock,
+             &t_end)==ETIMEDOUT){
+          fprintf(stderr,"get_telescope_status: timed out waiting for status\n");
+          fflush(stderr);
+          break;
+       }
+    }
+
+    pthread_mutex_unlock(&telemetry_lock);
+
+    return(result);
+}
+
+/************************************************************/
+
+/* read the telescope status now, as get_telescope_status(status,0.0),
+   and also require the values in the TEL_STATUS_ bits of required,
+   for callers that have just changed them (a pointing, a focus). An
+   update that misses one of them leaves the old value in status, so
+   the status is read again, up to TEL_STATUS_RETRIES times. Returns -1
+   if they still could not be read */
+
+int get_fresh_telescope_status(Telescope_Status *status, int required)
+{
+    int i;
+
+    for(i=0;i<=TEL_STATUS_RETRIES;i++){
+       if(get_telescope_status(status,0.0)!=0)return(-1);
+       if((status->valid&required)==required)return(0);
+
+       fprintf(stderr,"get_fresh_telescope_status: missing status values %d of %d\n",
+          required&~status->valid,required);
+       fflush(stderr);
+    }
+
+    return(-1);
+}
+
+/************************************************************/
@@ -19,7 +19,14 @@
 #define TEL_COMMAND_PORT 3911  /*nightime */
 
 
-#define COMMAND_WAIT_TIME 100000 /* useconds to wait between commands */
+#define COMMAND_WAIT_TIME 100000 /* useconds to wait between commands, if
+                                    the controller closes the connection
+                                    after each one */
+
+/* connections to the controller, kept open between commands */
+
+static Socket_Connection tel_connection;
+static Socket_Connection daytime_tel_connection;
 
 /* first word in reply from telescope controller */
 #define TEL_ERROR_REPLY "error"
@@ -68,6 +75,23 @@
 #define DEC_OFFSET_MIN -1.00 /* minimum RA pointing offset (deg ) */
 #define DEC_OFFSET_MAX  1.00 /* minimum RA pointing offset (deg ) */
 
+/* queries sent by update_telescope_status */
+
+enum Status_Query {DOME_QUERY, LST_QUERY, FOCUS_QUERY, POSITION_QUERY,
+                   WEATHER_QUERY, NUM_STATUS_QUERIES};
+
+static char *status_commands[NUM_STATUS_QUERIES]={DOMESTATUS_COMMAND,
+      LST_COMMAND, GETFOCUS_COMMAND, POSRD_COMMAND, WEATHER_COMMAND};
+
+/* connections for the status queries, one per query so that they can
+   all be in progress at once. Kept apart from tel_connection since
+   update_telescope_status runs in the telemetry thread */
+
+static Socket_Connection status_connection[NUM_STATUS_QUERIES];
+
+static int check_telescope_reply(char *reply);
+static int parse_weather_reply(char *reply, Weather_Info *weather);
+
 extern int verbose;
 extern int verbose1;
 extern int stop_flag;
@@ -172,7 +196,7 @@ int get_telescope_offsets(Field *f, Telescope_Status *status)
 
         /* form system command for offset script*/
 
-        sprintf(command_string,"%s %s\n",OFFSET_SCRIPT,f->filename);
+        sprintf(command_string,"%s %s\n",OFFSET_SCRIPT,f->hist->filename);
 
         if(verbose){
            fprintf(stderr,"get_telescope_offsets: %s\n",command_string);
@@ -271,7 +295,7 @@ int focus_telescope(Field *f, Telescope_Status *status, double focus_default)
         sprintf(command_string,"%s ",FOCUS_SCRIPT);
         for(i=0;i<f->n_done;i++){
            sprintf(command_string+strlen(command_string),"%s ",
-		f->filename+(i*FILENAME_LENGTH));
+		f->hist->filename+(i*FILENAME_LENGTH));
         }
         sprintf(command_string+strlen(command_string),"\n");
 
@@ -324,7 +348,7 @@ int focus_telescope(Field *f, Telescope_Status *status, double focus_default)
            fflush(stderr);
         }
 
-        if(update_telescope_status(status)!=0){
+        if(get_fresh_telescope_status(status,TEL_STATUS_FOCUS)!=0){
            fprintf(stderr,"focus_telescope: could not update telescope status\n");
            return(-1);
         }
@@ -645,43 +669,73 @@ int point_telescope(double ra, double dec, double ra_rate, double dec_rate)
 
 int update_telescope_status(Telescope_Status *status)
 {
-     char reply[MAXBUFSIZE];
-     char s[256],*s_ptr;
+     char reply_buf[NUM_STATUS_QUERIES][MAXBUFSIZE];
+     char *replies[NUM_STATUS_QUERIES];
+     int results[NUM_STATUS_QUERIES];
+     char s[256];
+     int i;
 
 
      status->ut=get_ut();
+     status->valid=0;
 
-     if(do_telescope_command(DOMESTATUS_COMMAND,reply,TELESCOPE_COMMAND_TIMEOUT,host_name)!=0){
-       fprintf(stderr,"update_telescope_status: error getting domestatus\n");
-       fflush(stderr);
-       return(-1);
+     for(i=0;i<NUM_STATUS_QUERIES;i++){
+       replies[i]=reply_buf[i];
      }
-     else if (strstr(reply, TEL_DONE_REPLY)!=NULL){
-       if(strstr(reply,"open")!=NULL){
+
+     /* the queries are independent. Send them all before waiting for
+        any reply */
+
+#if PARALLEL_STATUS_QUERIES
+     send_parallel_commands(status_connection,NUM_STATUS_QUERIES,host_name,
+          TEL_COMMAND_PORT,status_commands,replies,results,
+          TELESCOPE_COMMAND_TIMEOUT);
+     for(i=0;i<NUM_STATUS_QUERIES;i++){
+       if(results[i]==0){
+          results[i]=check_telescope_reply(replies[i]);
+       }
+     }
+#else
+     for(i=0;i<NUM_STATUS_QUERIES;i++){
+       results[i]=send_connection_command(status_connection,host_name,
+          TEL_COMMAND_PORT,status_commands[i],replies[i],
+          TELESCOPE_COMMAND_TIMEOUT);
+       if(results[i]==0){
+          results[i]=check_telescope_reply(replies[i]);
+       }
+     }
+#endif
+
+     /* a failed query leaves its values as they were */
+
+     for(i=0;i<NUM_STATUS_QUERIES;i++){
+       if(results[i]!=0){
+         fprintf(stderr,"update_telescope_status: error getting %s\n",
+            status_commands[i]);
+         fflush(stderr);
+       }
+     }
+
+     if(results[DOME_QUERY]==0){
+       if(strstr(replies[DOME_QUERY],"open")!=NULL){
          status->dome_status=1;
        }
        else{
          status->dome_status=0;
        }
+       status->valid=status->valid|TEL_STATUS_DOME;
      }
 
-
-     if(do_telescope_command(LST_COMMAND,reply,TELESCOPE_COMMAND_TIMEOUT,host_name)!=0){
-       fprintf(stderr,"update_telescope_status: error getting lst\n");
-       fflush(stderr);
-       return(-1);
-     }
-     else if (strstr(reply, TEL_DONE_REPLY)!=NULL){
-       sscanf(reply,"%s %lf",s,&(status->lst));
+     if(results[LST_QUERY]==0){
+       sscanf(replies[LST_QUERY],"%s %lf",s,&(status->lst));
+       status->valid=status->valid|TEL_STATUS_LST;
      }
 /* debug */
 /*status->lst=status->lst + 3.0;*/
 
-
-     if(get_telescope_focus(&(status->focus))!=0){
-       fprintf(stderr,"update_telescope_status: error getting focus\n");
-       fflush(stderr);
-       return(-1);
+     if(results[FOCUS_QUERY]==0){
+       sscanf(replies[FOCUS_QUERY],"%s %lf",s,&(status->focus));
+       status->valid=status->valid|TEL_STATUS_FOCUS;
      }
 
 #if 0
@@ -696,60 +750,72 @@ int update_telescope_status(Telescope_Status *status)
 #endif
      sprintf(status->filter_string,"UNKNOWN");
 
-
-
-     if(do_telescope_command(POSRD_COMMAND,reply,TELESCOPE_COMMAND_TIMEOUT,host_name)!=0){
-       fprintf(stderr,"update_telescope_status: error getting position\n");
-       fflush(stderr);
-       return(-1);
+     if(results[POSITION_QUERY]==0){
+       sscanf(replies[POSITION_QUERY],"%s %lf %lf",s,&(status->ra),&(status->dec));
+       status->valid=status->valid|TEL_STATUS_POSITION;
      }
-     else if (strstr(reply, TEL_DONE_REPLY)!=NULL){
-       sscanf(reply,"%s %lf %lf",s,&(status->ra),&(status->dec));
+
+     if(results[WEATHER_QUERY]==0){
+       if(parse_weather_reply(replies[WEATHER_QUERY],&(status->weather))==0){
+         status->valid=status->valid|TEL_STATUS_WEATHER;
+       }
+       else{
+         fprintf(stderr,"update_telescope_status: bad weather reply: %s\n",
+            replies[WEATHER_QUERY]);
+         fflush(stderr);
+       }
      }
 
+     /* the scheduler can't go on without the dome status and lst */
 
-     if(do_telescope_command(WEATHER_COMMAND,reply,TELESCOPE_COMMAND_TIMEOUT,host_name)!=0){
-       fprintf(stderr,"update_telescope_status: error getting weather\n");
-       fflush(stderr);
+     if((status->valid&TEL_STATUS_REQUIRED)!=TEL_STATUS_REQUIRED){
        return(-1);
      }
-     else if (strstr(reply, TEL_DONE_REPLY)!=NULL){
+
+     return(0);
+
+}
+/*****************************************************/
+
+/* read the weather values out of the reply to WEATHER_COMMAND. Returns
+   -1 if the reply has fewer values than expected */
+
+static int parse_weather_reply(char *reply, Weather_Info *weather)
+{
+     char *s_ptr;
 
        s_ptr=reply;
        s_ptr=strstr(s_ptr,":");
-       if(s_ptr!=NULL)
-          sscanf(s_ptr+1,"%lf",&((status->weather).temperature));
+       if(s_ptr==NULL)return(-1);
+       sscanf(s_ptr+1,"%lf",&(weather->temperature));
        s_ptr++;
 
        s_ptr=strstr(s_ptr,":");
-       if(s_ptr!=NULL)
-          sscanf(s_ptr+1,"%lf",&((status->weather).humidity));
+       if(s_ptr==NULL)return(-1);
+       sscanf(s_ptr+1,"%lf",&(weather->humidity));
        s_ptr++;
 
        s_ptr=strstr(s_ptr,":");
-       if(s_ptr!=NULL)
-          sscanf(s_ptr+1,"%lf",&((status->weather).wind_speed));
+       if(s_ptr==NULL)return(-1);
+       sscanf(s_ptr+1,"%lf",&(weather->wind_speed));
        s_ptr++;
 
        s_ptr=strstr(s_ptr,":");
-       if(s_ptr!=NULL)
-          sscanf(s_ptr+1,"%lf",&((status->weather).wind_direction));
+       if(s_ptr==NULL)return(-1);
+       sscanf(s_ptr+1,"%lf",&(weather->wind_direction));
        s_ptr++;
 
        s_ptr=strstr(s_ptr,":");
-       if(s_ptr!=NULL)
-          sscanf(s_ptr+1,"%lf",&((status->weather).dew_point));
+       if(s_ptr==NULL)return(-1);
+       sscanf(s_ptr+1,"%lf",&(weather->dew_point));
        s_ptr++;
 #if 0
        s_ptr=strstr(s_ptr,":");
        if(s_ptr!=NULL)
-          sscanf(s_ptr+1,"%lf",&((status->weather).dome_states));
+          sscanf(s_ptr+1,"%lf",&(weather->dome_states));
 #endif
 
-     }
-
      return(0);
-
 }
 /*****************************************************/
 
@@ -780,22 +846,11 @@ int print_telescope_status(Telescope_Status *status,FILE *output)
 
 /*****************************************************/
 
-int do_telescope_command(char *command, char *reply, int timeout, char *host)
-{
-
-     if(verbose1){
-        fprintf(stderr,"do_telescope_command: sending command: %s\n",command);
-        fflush(stderr);
-     }
-
-     if(send_command(command,reply,host,TEL_COMMAND_PORT,timeout)!=0){
-       fprintf(stderr,
-          "do_telescope_command: error sending command %s\n", command);
-       return(-1);
-        fflush(stderr);
-     }
-     if(COMMAND_WAIT_TIME>0)usleep(COMMAND_WAIT_TIME);
+/* return 0 if reply from the telescope controller says the command
+   was done, -1 if not */
 
+static int check_telescope_reply(char *reply)
+{
      if(strstr(reply,TEL_ERROR_REPLY)!=NULL||strlen(reply)==0){
        fprintf(stderr,
           "do_telescope_command: error executing commmand: %s\n", 
@@ -828,10 +883,7 @@ int do_telescope_command(char *command, char *reply, int timeout, char *host)
 
 /*****************************************************/
 
-/* use this function in daytime when telescope controller is off or when
-   dome has not yet opened */
-
-int do_daytime_telescope_command(char *command, char *reply, int timeout, char *host)
+int do_telescope_command(char *command, char *reply, int timeout, char *host)
 {
 
      if(verbose1){
@@ -839,41 +891,48 @@ int do_daytime_telescope_command(char *command, char *reply, int timeout, char *
         fflush(stderr);
      }
 
-     if(send_command(command,reply,host,DAYTIME_TEL_COMMAND_PORT,timeout)!=0){
+     if(send_connection_command(&tel_connection,host,TEL_COMMAND_PORT,
+          command,reply,timeout)!=0){
        fprintf(stderr,
           "do_telescope_command: error sending command %s\n", command);
        return(-1);
         fflush(stderr);
      }
-     if(COMMAND_WAIT_TIME>0)usleep(COMMAND_WAIT_TIME);
 
-     if(strstr(reply,TEL_ERROR_REPLY)!=NULL||strlen(reply)==0){
-       fprintf(stderr,
-          "do_telescope_command: error executing commmand: %s\n", 
-           reply);
-       return(-1);
-     }
-     else if(strstr(reply,TEL_BADVAL_REPLY)!=NULL||strlen(reply)==0){
-       fprintf(stderr,
-          "do_telescope_command: bad value executing: %s\n", 
-           reply);
-       return(-1);
-     }
-     else if (strstr(reply, TEL_DONE_REPLY)!=NULL){
+     /* the pause between commands is only needed when each command
+        makes a new connection */
 
-        if(verbose1){
-            fprintf(stderr,"do_telescope_command: reply was %s\n",reply);
-            fflush(stderr);
-        }
+     if(COMMAND_WAIT_TIME>0&&tel_connection.server_closes)usleep(COMMAND_WAIT_TIME);
 
-       return(0);
+     return(check_telescope_reply(reply));
+
+}
+
+/*****************************************************/
+
+/* use this function in daytime when telescope controller is off or when
+   dome has not yet opened */
+
+int do_daytime_telescope_command(char *command, char *reply, int timeout, char *host)
+{
+
+     if(verbose1){
+        fprintf(stderr,"do_telescope_command: sending command: %s\n",command);
+        fflush(stderr);
      }
-     else{
+
+     if(send_connection_command(&daytime_tel_connection,host,
+          DAYTIME_TEL_COMMAND_PORT,command,reply,timeout)!=0){
        fprintf(stderr,
-         "do_telescope_command: bad response from telescope : %s\n",
-         reply);
+          "do_telescope_command: error sending command %s\n", command);
        return(-1);
+        fflush(stderr);
+     }
+     if(COMMAND_WAIT_TIME>0&&daytime_tel_connection.server_closes){
+        usleep(COMMAND_WAIT_TIME);
      }
+
+     return(check_telescope_reply(reply));
 }
 
 /*****************************************************/
@@ -881,11 +940,12 @@ int do_daytime_telescope_command(char *command, char *reply, int timeout, char *
 double get_ut() {
 
   time_t t;
-  struct tm *tm;
+  struct tm *tm,tm_buf; /* gmtime_r, since the telemetry thread calls
+                           this too */
   double ut;
 
   time(&t);
-  tm = gmtime(&t);
+  tm = gmtime_r(&t,&tm_buf);
 
   /* get ut time in fractional hour for current day */
   ut = tm->tm_hour + tm->tm_min/60. + tm->tm_sec/3600.;
@@ -908,11 +968,12 @@ double get_ut() {
 double get_tm(struct tm *tm_out) {
 
   time_t t;
-  struct tm *tm;
+  struct tm *tm,tm_buf; /* gmtime_r, since the telemetry thread calls
+                           this too */
   double ut;
 
   time(&t);
-  tm = gmtime(&t);
+  tm = gmtime_r(&t,&tm_buf);
 
 
   /* use convention Jan is month 1, not 0 */
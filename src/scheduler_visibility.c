@@ -0,0 +1,358 @@
+/* scheduler_visibility.c
+
+   Per-night visibility of each field, as bitsets over fixed time slots.
+
+   The night, from sunset to sunrise, is cut into slots of
+   VISIBILITY_SLOT_MINUTES. For each field of the table, bit k is set
+   when the field can be observed throughout slot k:
+
+     sky fields    airmass below MAX_AIRMASS, hour angle within
+                   MAX_HOURANGLE, between jd_start and jd_end (the end of
+                   evening and start of morning twilight), dec within
+                   MIN_DEC and MAX_DEC, and not too close to the moon
+                   (moon_interference)
+     other fields  between jd_rise and jd_set, the window init_fields
+                   gives darks, flats, focus and offset fields
+
+   A slot is only marked if the limits hold at both of its ends, so
+   the bitsets never claim a field is up when it is not. They are
+   computed once per night (load_visibility_table, after init_fields),
+   one slot boundary at a time for all fields with get_airmass_batch,
+   at the local sidereal time of each boundary from lst(). jd_rise and
+   jd_set are extrapolated from lst_start and lst_end with
+   SIDEREAL_DAY_IN_HOURS, so a sky field's window here can differ from
+   them by a few minutes away from those ends of the night.
+
+   Questions about when a field is up then become bit tests, bit scans
+   and popcounts: whether it is up at jd (field_visible), when it is
+   next up (next_visible_jd) and until when (visible_until_jd), and
+   how long it is up between two times (visible_hours).
+
+   The bitsets say when a field can be observed, not whether it still
+   needs to be. Fields that have been completed, or found not doable,
+   keep their bits.
+
+*/
+
+#include "scheduler.h"
+
+extern int verbose;
+
+/************************************************************/
+
+/* make sure the table has room for num_fields fields of n_words each */
+
+static int grow_visibility_table(Visibility_Table *vis, int num_fields,
+        int n_words)
+{
+    int n_alloc;
+    uint64_t *bits;
+
+    n_alloc=vis->max_fields>0 ? vis->max_fields : VISIBILITY_TABLE_BLOCK;
+    while(n_alloc<num_fields)n_alloc=2*n_alloc;
+
+    if(n_alloc*n_words<=vis->max_words){
+       vis->max_fields=n_alloc;
+       return(0);
+    }
+
+    bits=(uint64_t *)realloc(vis->bits,n_alloc*n_words*sizeof(uint64_t));
+    if(bits==NULL){
+       fprintf(stderr,"grow_visibility_table: could not allocate %d fields\n",
+          n_alloc);
+       return(-1);
+    }
+
+    vis->bits=bits;
+    vis->max_fields=n_alloc;
+    vis->max_words=n_alloc*n_words;
+
+    return(0);
+}
+
+/************************************************************/
+
+/* 1 if sky field f passes the limits that do not change during the
+   night */
+
+static int sky_field_allowed(Field *f, Night_Times *nt)
+{
+    if(f->dec>MAX_DEC||f->dec<MIN_DEC)return(0);
+    if(moon_interference(f,nt,MIN_MOON_SEPARATION))return(0);
+
+    return(1);
+}
+
+/************************************************************/
+
+/* set bits k0 to k1-1 of row */
+
+static void set_slots(uint64_t *row, int k0, int k1)
+{
+    int k;
+
+    for(k=k0;k<k1;k++){
+       row[k>>6]=row[k>>6]|((uint64_t)1<<(k&63));
+    }
+}
+
+/************************************************************/
+
+/* compute the bitsets of the num_fields fields in sequence for the
+   night nt at site. table must hold the same fields
+   (load_airmass_table); its ha and am columns are overwritten. Call
+   after init_fields */
+
+int load_visibility_table(Visibility_Table *vis, Airmass_Table *table,
+        Field *sequence, int num_fields, Night_Times *nt, Site_Params *site)
+{
+    int i,k,k0,k1,n_slots,n_words;
+    int *allowed;
+    char *up_prev;
+    double jd,slot_days;
+    uint64_t *row;
+    Field *f;
+
+    if(table->num_fields<num_fields){
+       fprintf(stderr,"load_visibility_table: airmass table has %d of %d fields\n",
+          table->num_fields,num_fields);
+       return(-1);
+    }
+
+    slot_days=VISIBILITY_SLOT_MINUTES/1440.0;
+    n_slots=(int)((nt->jd_sunrise-nt->jd_sunset)/slot_days);
+    if(n_slots<1)n_slots=1;
+    n_words=(n_slots+63)/64;
+
+    if(grow_visibility_table(vis,num_fields,n_words)!=0){
+       fprintf(stderr,"load_visibility_table: could not load %d fields\n",
+          num_fields);
+       return(-1);
+    }
+
+    vis->num_fields=num_fields;
+    vis->n_slots=n_slots;
+    vis->n_words=n_words;
+    vis->jd0=nt->jd_sunset;
+    vis->slot_days=slot_days;
+    memset(vis->bits,0,num_fields*n_words*sizeof(uint64_t));
+
+    allowed=(int *)malloc(num_fields*sizeof(int));
+    up_prev=(char *)malloc(num_fields*sizeof(char));
+    if(allowed==NULL||up_prev==NULL){
+       fprintf(stderr,"load_visibility_table: could not allocate %d fields\n",
+          num_fields);
+       if(allowed!=NULL)free(allowed);
+       if(up_prev!=NULL)free(up_prev);
+       vis->num_fields=0;
+       return(-1);
+    }
+
+    /* fields other than sky fields are up over their window */
+
+    for(i=0;i<num_fields;i++){
+       f=sequence+i;
+       up_prev[i]=0;
+       allowed[i]=(f->shutter==SKY_CODE&&sky_field_allowed(f,nt));
+       if(f->shutter==SKY_CODE||!f->doable||f->jd_rise<0.0)continue;
+
+       k0=(int)ceil((f->jd_rise-vis->jd0)/slot_days);
+       k1=(int)floor((f->jd_set-vis->jd0)/slot_days);
+       if(k0<0)k0=0;
+       if(k1>n_slots)k1=n_slots;
+       set_slots(vis->bits+i*n_words,k0,k1);
+    }
+
+    /* sky fields: step through the slot boundaries in the dark part of
+       the night, marking slot k-1 where the field is up at both ends */
+
+    k0=(int)ceil((nt->jd_start-vis->jd0)/slot_days);
+    k1=(int)floor((nt->jd_end-vis->jd0)/slot_days);
+    if(k0<0)k0=0;
+    if(k1>n_slots)k1=n_slots;
+
+    for(k=k0;k<=k1;k++){
+       jd=vis->jd0+k*slot_days;
+       update_airmass_table(table,lst(jd,site->longit));
+
+       for(i=0;i<num_fields;i++){
+          if(!allowed[i])continue;
+          if(table->am[i]<MAX_AIRMASS&&fabs(table->ha[i])<MAX_HOURANGLE){
+             if(up_prev[i]){
+                row=vis->bits+i*n_words;
+                row[(k-1)>>6]=row[(k-1)>>6]|((uint64_t)1<<((k-1)&63));
+             }
+             up_prev[i]=1;
+          }
+          else{
+             up_prev[i]=0;
+          }
+       }
+    }
+
+    free(allowed);
+    free(up_prev);
+
+    if(verbose){
+       fprintf(stderr,
+          "load_visibility_table: %d fields, %d slots of %4.1f min from jd %12.6f\n",
+          num_fields,n_slots,VISIBILITY_SLOT_MINUTES,vis->jd0-2450000);
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* slot containing jd, or -1 if jd is outside the night */
+
+int get_visibility_slot(Visibility_Table *vis, double jd)
+{
+    double x;
+
+    x=(jd-vis->jd0)/vis->slot_days;
+    if(x<0.0||x>=vis->n_slots)return(-1);
+
+    return((int)x);
+}
+
+/************************************************************/
+
+/* 1 if field i is up at jd */
+
+int field_visible(Visibility_Table *vis, int i, double jd)
+{
+    int k;
+
+    if(i<0||i>=vis->num_fields)return(0);
+
+    k=get_visibility_slot(vis,jd);
+    if(k<0)return(0);
+
+    return((vis->bits[i*vis->n_words+(k>>6)]>>(k&63))&1);
+}
+
+/************************************************************/
+
+/* first slot from k on whose bit in row is value (0 or 1), or n_slots
+   if there is none */
+
+static int scan_slots(Visibility_Table *vis, uint64_t *row, int k, int value)
+{
+    int w;
+    uint64_t word,flip;
+
+    if(k>=vis->n_slots)return(vis->n_slots);
+
+    flip=value ? 0 : ~(uint64_t)0;
+    w=k>>6;
+    word=(row[w]^flip)&(~(uint64_t)0<<(k&63));
+    while(word==0){
+       w++;
+       if(w>=vis->n_words)return(vis->n_slots);
+       word=row[w]^flip;
+    }
+
+    k=64*w+__builtin_ctzll(word);
+    if(k>vis->n_slots)k=vis->n_slots;
+
+    return(k);
+}
+
+/************************************************************/
+
+/* first slot at or after jd, or n_slots if jd is after sunrise */
+
+static int first_slot(Visibility_Table *vis, double jd)
+{
+    double x;
+
+    x=(jd-vis->jd0)/vis->slot_days;
+    if(x<0.0)return(0);
+    if(x>=vis->n_slots)return(vis->n_slots);
+
+    return((int)x);
+}
+
+/************************************************************/
+
+/* jd at which field i is next up: jd itself if it is up then, else
+   the start of the next slot in which it is up. -1 if it is not up
+   again before sunrise */
+
+double next_visible_jd(Visibility_Table *vis, int i, double jd)
+{
+    int k;
+
+    if(i<0||i>=vis->num_fields)return(-1.0);
+
+    k=scan_slots(vis,vis->bits+i*vis->n_words,first_slot(vis,jd),1);
+    if(k>=vis->n_slots)return(-1.0);
+
+    if(vis->jd0+k*vis->slot_days<=jd)return(jd);
+
+    return(vis->jd0+k*vis->slot_days);
+}
+
+/************************************************************/
+
+/* jd at which field i stops being up, after it is next up at or after
+   jd (see next_visible_jd). -1 if it is not up again before sunrise */
+
+double visible_until_jd(Visibility_Table *vis, int i, double jd)
+{
+    int k;
+    uint64_t *row;
+
+    if(i<0||i>=vis->num_fields)return(-1.0);
+
+    row=vis->bits+i*vis->n_words;
+    k=scan_slots(vis,row,first_slot(vis,jd),1);
+    if(k>=vis->n_slots)return(-1.0);
+
+    k=scan_slots(vis,row,k,0);
+
+    return(vis->jd0+k*vis->slot_days);
+}
+
+/************************************************************/
+
+/* hours that field i is up between jd0 and jd1, to the nearest slot */
+
+double visible_hours(Visibility_Table *vis, int i, double jd0, double jd1)
+{
+    int k0,k1,w,n;
+    uint64_t *row,word;
+
+    if(i<0||i>=vis->num_fields)return(0.0);
+
+    k0=first_slot(vis,jd0);
+    k1=first_slot(vis,jd1);
+    if(k1<=k0)return(0.0);
+
+    row=vis->bits+i*vis->n_words;
+    n=0;
+    for(w=k0>>6;w<=(k1-1)>>6;w++){
+       word=row[w];
+       if(w==k0>>6)word=word&(~(uint64_t)0<<(k0&63));
+       if(w==(k1-1)>>6&&(k1&63)!=0)word=word&(~(~(uint64_t)0<<(k1&63)));
+       n=n+__builtin_popcountll(word);
+    }
+
+    return(n*vis->slot_days*24.0);
+}
+
+/************************************************************/
+
+void free_visibility_table(Visibility_Table *vis)
+{
+    if(vis->bits!=NULL)free(vis->bits);
+    vis->bits=NULL;
+    vis->num_fields=0;
+    vis->max_fields=0;
+    vis->max_words=0;
+    vis->n_slots=0;
+    vis->n_words=0;
+}
+
+/************************************************************/
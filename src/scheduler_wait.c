@@ -0,0 +1,257 @@
+/* scheduler_wait.c
+
+   Idle waits of the main loop.
+
+   Rather than sleep a fixed LOOP_WAIT_SEC, wait_for_event blocks in
+   one poll() on three descriptors and returns as soon as any of them
+   is ready:
+
+     a timerfd     set to the end of the wait (e.g. the next field
+                   status change, see next_field_event)
+     an inotify fd watching the directory of the .add script, so that
+                   new ToO lines are read at once
+     a self-pipe   written by the signal handlers (wake_scheduler), so
+                   that pause and resume take effect at once
+
+   If the inotify or timerfd descriptors can't be made, the wait still
+   works: without inotify it is cut to LOOP_WAIT_SEC so that the .add
+   script is still read as often as before, and without the timerfd
+   the poll() timeout is used instead.
+
+*/
+
+#include "scheduler.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+
+extern int verbose1;
+
+/* written by wake_scheduler from signal handlers, so it can't live in
+   Wait_Events */
+
+static int wakeup_pipe[2]={-1,-1};
+
+/************************************************************/
+
+static int set_nonblocking(int fd)
+{
+    int flags;
+
+    flags=fcntl(fd,F_GETFL);
+    if(flags<0||fcntl(fd,F_SETFL,flags|O_NONBLOCK)<0)return(-1);
+    if(fcntl(fd,F_SETFD,FD_CLOEXEC)<0)return(-1);
+
+    return(0);
+}
+
+/************************************************************/
+
+/* set up the descriptors to wait on. file_name is the .add script */
+
+int init_wait_events(Wait_Events *w, char *file_name)
+{
+    char *s;
+
+    w->inotify_fd=-1;
+    w->watch=-1;
+    w->timer_fd=-1;
+
+    if(wakeup_pipe[0]<0){
+       if(pipe(wakeup_pipe)!=0||set_nonblocking(wakeup_pipe[0])!=0||
+          set_nonblocking(wakeup_pipe[1])!=0){
+          fprintf(stderr,"init_wait_events: can't make wakeup pipe\n");
+          return(-1);
+       }
+    }
+
+    /* watch the directory, since the script may not exist yet and may
+       be replaced */
+
+    strcpy(w->dir_name,file_name);
+    s=strrchr(w->dir_name,'/');
+    if(s==NULL){
+       strcpy(w->file_name,file_name);
+       strcpy(w->dir_name,".");
+    }
+    else{
+       strcpy(w->file_name,s+1);
+       if(s==w->dir_name)s++;
+       *s=0;
+    }
+
+    w->inotify_fd=inotify_init();
+    if(w->inotify_fd<0||set_nonblocking(w->inotify_fd)!=0){
+       fprintf(stderr,"init_wait_events: WARNING: can't use inotify\n");
+    }
+    else{
+       w->watch=inotify_add_watch(w->inotify_fd,w->dir_name,
+          IN_MODIFY|IN_CLOSE_WRITE|IN_CREATE|IN_MOVED_TO);
+       if(w->watch<0){
+          fprintf(stderr,"init_wait_events: WARNING: can't watch %s\n",
+             w->dir_name);
+          close(w->inotify_fd);
+          w->inotify_fd=-1;
+       }
+    }
+
+    w->timer_fd=timerfd_create(CLOCK_MONOTONIC,0);
+    if(w->timer_fd<0||set_nonblocking(w->timer_fd)!=0){
+       fprintf(stderr,"init_wait_events: WARNING: can't use timerfd\n");
+       if(w->timer_fd>=0)close(w->timer_fd);
+       w->timer_fd=-1;
+    }
+
+    return(0);
+}
+
+/************************************************************/
+
+/* wake up wait_for_event. Safe to call from a signal handler */
+
+void wake_scheduler()
+{
+    int saved_errno;
+
+    if(wakeup_pipe[1]<0)return;
+
+    saved_errno=errno;
+    if(write(wakeup_pipe[1],"w",1)<0){
+       /* pipe full: a wakeup is already pending */
+    }
+    errno=saved_errno;
+}
+
+/************************************************************/
+
+/* return WAKE_ADD_FILE if the pending inotify events include the
+   watched file */
+
+static int read_inotify_events(Wait_Events *w)
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char *p;
+    int n,result;
+    struct inotify_event *event;
+
+    result=0;
+    while((n=read(w->inotify_fd,buf,sizeof(buf)))>0){
+       for(p=buf;p<buf+n;p=p+sizeof(struct inotify_event)+event->len){
+          event=(struct inotify_event *)p;
+          if(event->len>0&&strcmp(event->name,w->file_name)==0){
+             result=WAKE_ADD_FILE;
+          }
+       }
+    }
+
+    return(result);
+}
+
+/************************************************************/
+
+/* Wait up to wait_sec seconds, or until the .add script changes or a
+   signal handler calls wake_scheduler. Events for other files in the
+   directory, and other signals, don't end the wait. Returns a
+   combination of WAKE_TIMER, WAKE_ADD_FILE and WAKE_SIGNAL. */
+
+int wait_for_event(Wait_Events *w, double wait_sec)
+{
+    struct pollfd fds[3];
+    struct itimerspec timer;
+    struct timespec t_now,t_end;
+    char buf[64];
+    int n,n_fds,timeout_ms,result;
+    uint64_t expirations;
+
+    if(w->inotify_fd<0&&wait_sec>LOOP_WAIT_SEC)wait_sec=LOOP_WAIT_SEC;
+    if(wait_sec<0.0)wait_sec=0.0;
+
+    n_fds=0;
+    fds[n_fds].fd=wakeup_pipe[0];
+    fds[n_fds].events=POLLIN;
+    n_fds++;
+    if(w->inotify_fd>=0){
+       fds[n_fds].fd=w->inotify_fd;
+       fds[n_fds].events=POLLIN;
+       n_fds++;
+    }
+
+    memset((void *)&timer,0,sizeof(timer));
+    timer.it_value.tv_sec=(time_t)wait_sec;
+    timer.it_value.tv_nsec=(long)((wait_sec-(time_t)wait_sec)*1.0e9);
+    if(timer.it_value.tv_sec==0&&timer.it_value.tv_nsec==0){
+       timer.it_value.tv_nsec=1;
+    }
+
+    if(w->timer_fd>=0){
+       timerfd_settime(w->timer_fd,0,&timer,NULL);
+       fds[n_fds].fd=w->timer_fd;
+       fds[n_fds].events=POLLIN;
+       n_fds++;
+    }
+    else{
+       clock_gettime(CLOCK_MONOTONIC,&t_end);
+       t_end.tv_sec=t_end.tv_sec+timer.it_value.tv_sec;
+       t_end.tv_nsec=t_end.tv_nsec+timer.it_value.tv_nsec;
+    }
+
+    if(verbose1){
+       fprintf(stderr,"wait_for_event: waiting up to %9.3f sec\n",wait_sec);
+       fflush(stderr);
+    }
+
+    result=0;
+    while(result==0){
+
+       if(w->timer_fd>=0){
+          timeout_ms=-1;
+       }
+       else{
+          clock_gettime(CLOCK_MONOTONIC,&t_now);
+          timeout_ms=(t_end.tv_sec-t_now.tv_sec)*1000+
+             (t_end.tv_nsec-t_now.tv_nsec)/1000000;
+          if(timeout_ms<0)timeout_ms=0;
+       }
+
+       n=poll(fds,n_fds,timeout_ms);
+
+       /* a signal handler that wants the wait to end also writes to
+          the pipe, so an interrupted poll is otherwise retried */
+
+       if(n<0&&errno!=EINTR){
+          fprintf(stderr,"wait_for_event: poll error %d\n",errno);
+          sleep(LOOP_WAIT_SEC);
+          return(WAKE_TIMER);
+       }
+
+       /* drain whatever is ready, so the next wait starts clean */
+
+       while(read(wakeup_pipe[0],buf,sizeof(buf))>0){
+          result=result|WAKE_SIGNAL;
+       }
+       if(w->inotify_fd>=0){
+          result=result|read_inotify_events(w);
+       }
+       if(w->timer_fd>=0){
+          if(read(w->timer_fd,&expirations,sizeof(expirations))>0){
+             result=result|WAKE_TIMER;
+          }
+       }
+       else if(timeout_ms==0||n==0){
+          result=result|WAKE_TIMER;
+       }
+    }
+
+    /* disarm the timer */
+
+    if(w->timer_fd>=0){
+       memset((void *)&timer,0,sizeof(timer));
+       timerfd_settime(w->timer_fd,0,&timer,NULL);
+    }
+
+    return(result);
+}
+
+/************************************************************/
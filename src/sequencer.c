@@ -17,6 +17,8 @@
 
 #define TOLERANCE 0.05
 
+#define MAX_FIELDS 500  /* maximum number of fields per script */
+
 int verbose=1;
 int verbose1 = 0; /* set to 1 for very verbose */
 int pause_flag=0;
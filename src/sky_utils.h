@@ -159,7 +159,11 @@ void print_tonight(struct date_time date, double lat, double longit,
 		   short short_long, Night_Times *ntimes, int print_flag);
 
 
+double lst(double jd, double longit);
+
 double altit(double dec, double ha, double lat, double *az);
+
+double ha_alt(double dec, double lat, double alt);
  
 double secant_z(double alt);
 
@@ -7,6 +7,7 @@
 */
 
 #include "socket.h"
+#include <poll.h>
 
 double get_ut();
 extern int verbose;
@@ -21,6 +22,11 @@ int call_socket(char *hostname, u_short portnum, int read_timeout_sec);
 int establish(u_short portnum);
 int get_connection(int s);
 //int wait_pipe(int pipe, int timeout_sec);
+int send_connection_command(Socket_Connection *c, char *machine, int port,
+			char *command, char *reply, int timeout_sec);
+void close_connection(Socket_Connection *c);
+int send_parallel_commands(Socket_Connection *c, int n, char *machine, int port,
+			char **commands, char **replies, int *results, int timeout_sec);
 
 /************************************************************/
 
@@ -98,6 +104,365 @@ int send_command(char *command, char *reply, char *machine, int port, int timeou
 }
 
 
+/************************************************************/
+
+/* resolve machine:port into c->addr, unless already done */
+
+static int resolve_connection(Socket_Connection *c, char *machine, int port)
+{
+  struct addrinfo hints,*result;
+  char port_string[32];
+  int error;
+
+  if(c->resolved&&c->port==port&&strcmp(c->host,machine)==0)return(0);
+
+  close_connection(c);
+  c->resolved=0;
+
+  memset(&hints,0,sizeof(hints));
+  hints.ai_family=AF_UNSPEC;
+  hints.ai_socktype=SOCK_STREAM;
+  sprintf(port_string,"%d",port);
+
+  error=getaddrinfo(machine,port_string,&hints,&result);
+  if(error!=0||result==NULL){
+     fprintf(stderr,"resolve_connection[%d]: can't resolve %s: %s\n",
+         port,machine,gai_strerror(error));
+     fflush(stderr);
+     return(-1);
+  }
+
+  memcpy(&(c->addr),result->ai_addr,result->ai_addrlen);
+  c->addr_len=result->ai_addrlen;
+  c->family=result->ai_family;
+  strncpy(c->host,machine,MAXHOSTNAME);
+  c->port=port;
+  c->resolved=1;
+  freeaddrinfo(result);
+
+  return(0);
+}
+
+/************************************************************/
+
+/* open a connection to the resolved address, with keep-alive probes
+   so that a dead server is noticed while the connection is idle */
+
+static int open_connection(Socket_Connection *c)
+{
+  int s,on;
+
+  if ((s=socket(c->family,SOCK_STREAM,0)) < 0){
+     return(-1);
+  }
+
+  if (connect(s,(struct sockaddr *)&(c->addr),c->addr_len) < 0) {
+     close(s);
+     /* the address may have changed. Look it up again next time */
+     c->resolved=0;
+     return(-1);
+  }
+
+  on=1;
+  setsockopt(s,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+  setsockopt(s,SOL_SOCKET,SO_KEEPALIVE,&on,sizeof(on));
+#ifdef TCP_KEEPIDLE
+  on=KEEPALIVE_IDLE_SEC;
+  setsockopt(s,IPPROTO_TCP,TCP_KEEPIDLE,&on,sizeof(on));
+  on=KEEPALIVE_INTERVAL_SEC;
+  setsockopt(s,IPPROTO_TCP,TCP_KEEPINTVL,&on,sizeof(on));
+  on=KEEPALIVE_COUNT;
+  setsockopt(s,IPPROTO_TCP,TCP_KEEPCNT,&on,sizeof(on));
+#endif
+
+  c->fd=s;
+  c->connected=1;
+  c->n_connects++;
+  c->n_commands_open=0;
+
+  return(0);
+}
+
+/************************************************************/
+
+/* Discard anything left unread on connection s, such as the end of
+   a reply that arrived after read_data returned (with a new
+   connection for each command, it was dropped with the socket).
+   Return 1 if the server has closed the connection (or it has
+   failed), 0 if it is still open. Does not block */
+
+static int drain_connection(int s)
+{
+  char buf[MAXBUFSIZE];
+  int n;
+
+  while((n=recv(s,buf,sizeof(buf),MSG_DONTWAIT))>0){
+     if(verbose1){
+        fprintf(stderr,"drain_connection: discarding %d stale bytes\n",n);
+        fflush(stderr);
+     }
+  }
+  if(n==0)return(1);
+  if(errno!=EAGAIN&&errno!=EWOULDBLOCK)return(1);
+
+  return(0);
+}
+
+/************************************************************/
+
+void close_connection(Socket_Connection *c)
+{
+  if(c->connected)close(c->fd);
+  c->connected=0;
+  c->fd=-1;
+}
+
+/************************************************************/
+
+/* Like send_command, but over the persistent connection c, which is
+   opened (or re-opened) as needed. The address of machine is looked
+   up only when machine or port change, or after a failed connect.
+   If the command can't be written to a reused connection, it is sent
+   once more on a new connection. Once written, it is never resent:
+   the server may have run it even if no reply can be read, so a
+   failed read is an error. */
+
+int send_connection_command(Socket_Connection *c, char *machine, int port,
+			char *command, char *reply, int timeout_sec)
+{
+  int i,n,attempt,reused;
+  struct timeval tv;
+
+  for(i=0;i<MAXBUFSIZE;i++)reply[i]=0;
+
+  if(strlen(command)>MAXBUFSIZE){
+     fprintf(stderr,"send_connection_command[%d]: command size too long : %s\n",
+               port,command);
+     return(-1);
+  }
+
+  if(resolve_connection(c,machine,port)!=0){
+     return(-1);
+  }
+
+  for(attempt=0;attempt<2;attempt++){
+
+     /* a server that closes the connection after each reply is
+        noticed here, before the command is written */
+
+     if(c->connected&&drain_connection(c->fd)){
+        if(verbose1){
+           fprintf(stderr,"send_connection_command[%d]: connection closed by server\n",
+               port);
+           fflush(stderr);
+        }
+        close_connection(c);
+        c->server_closes=1;
+     }
+
+     reused=c->connected;
+     if(!c->connected&&open_connection(c)!=0){
+        fprintf(stderr,"send_connection_command [%d]: could not open socket with machine %s port %d\n",
+             port,machine,port);
+        fflush(stderr);
+        perror("send_connection_command: connect");
+        return(-1);
+     }
+
+     tv.tv_sec=timeout_sec;
+     tv.tv_usec=0;
+     setsockopt(c->fd,SOL_SOCKET,SO_RCVTIMEO,(const char*)&tv,sizeof tv);
+
+     if(verbose1){
+        fprintf(stderr,"send_connection_command [%d]: %12.6f writing command : [%s] (%s connection)\n",
+            port,get_ut(),command,reused ? "reused" : "new");
+        fflush(stderr);
+     }
+
+     n=send(c->fd,command,strlen(command),MSG_NOSIGNAL);
+     if(n!=(int)strlen(command)){
+        close_connection(c);
+        if(reused)continue;
+        fprintf(stderr,"send_connection_command[%d]: can't write data to socket\n",port);
+        return(-1);
+     }
+
+     c->n_commands++;
+     c->n_commands_open++;
+
+     n=read_data(c->fd,reply,MAXBUFSIZE,timeout_sec);
+     if(n<=0){
+        if(reused&&(n==0||errno==ECONNRESET||errno==EPIPE)){
+           c->server_closes=1;
+        }
+        fprintf(stderr,"send_connection_command[%d]: error reading command reply\n",port);
+        fflush(stderr);
+        close_connection(c);
+        return(-1);
+     }
+
+     if(verbose1){
+        fprintf(stderr,"send_connection_command[%d]: %12.6f reply is %s",port,get_ut(),reply);
+        fflush(stderr);
+     }
+
+     return(0);
+  }
+
+  fprintf(stderr,"send_connection_command[%d]: connection to %s failed twice\n",
+      port,machine);
+  fflush(stderr);
+
+  return(-1);
+}
+
+/************************************************************/
+
+/* open c if needed and write command to it. If a reused connection
+   turns out to be dead, one new connection is tried. Returns 0 if
+   the command was written */
+
+static int write_connection_command(Socket_Connection *c, char *command)
+{
+  int attempt;
+
+  for(attempt=0;attempt<2;attempt++){
+     if(c->connected&&drain_connection(c->fd)){
+        close_connection(c);
+        c->server_closes=1;
+     }
+     if(!c->connected&&open_connection(c)!=0){
+        return(-1);
+     }
+     c->reused=(c->n_commands_open>0);
+     if(send(c->fd,command,strlen(command),MSG_NOSIGNAL)==(ssize_t)strlen(command)){
+        c->n_commands++;
+        c->n_commands_open++;
+        return(0);
+     }
+     close_connection(c);
+  }
+
+  return(-1);
+}
+
+/************************************************************/
+
+/* Send commands[i] over connection c[i] to machine:port, for i=0 to
+   n-1, all at once, and wait for all the replies with one combined
+   timeout of timeout_sec. Each reply goes to replies[i] (MAXBUFSIZE
+   bytes), and results[i] is set to 0 if it arrived, -1 if not.
+   A reply is whatever the first read returns, as in read_data. A
+   command whose reused connection turns out to have been closed by
+   the server is sent again by itself. Returns the number of replies
+   received. */
+
+int send_parallel_commands(Socket_Connection *c, int n, char *machine, int port,
+			char **commands, char **replies, int *results, int timeout_sec)
+{
+  struct pollfd fds[n];
+  int index[n],retry[n];
+  int i,j,k,n_pending,n_ok,n_read,timeout_ms;
+  struct timeval t_now,t_end;
+
+  n_pending=0;
+  for(i=0;i<n;i++){
+     for(j=0;j<MAXBUFSIZE;j++)replies[i][j]=0;
+     results[i]=-1;
+     retry[i]=0;
+
+     if(strlen(commands[i])>MAXBUFSIZE-1||
+        resolve_connection(c+i,machine,port)!=0||
+        write_connection_command(c+i,commands[i])!=0){
+        fprintf(stderr,"send_parallel_commands[%d]: can't send %s\n",
+            port,commands[i]);
+        fflush(stderr);
+        continue;
+     }
+
+     if(verbose1){
+        fprintf(stderr,"send_parallel_commands [%d]: %12.6f sent command : [%s]\n",
+            port,get_ut(),commands[i]);
+        fflush(stderr);
+     }
+
+     fds[n_pending].fd=c[i].fd;
+     fds[n_pending].events=POLLIN;
+     index[n_pending]=i;
+     n_pending++;
+  }
+
+  gettimeofday(&t_end,NULL);
+  t_end.tv_sec=t_end.tv_sec+timeout_sec;
+
+  while(n_pending>0){
+     gettimeofday(&t_now,NULL);
+     timeout_ms=(t_end.tv_sec-t_now.tv_sec)*1000+
+        (t_end.tv_usec-t_now.tv_usec)/1000;
+     if(timeout_ms<=0)break;
+
+     k=poll(fds,n_pending,timeout_ms);
+     if(k<0&&errno==EINTR)continue;
+     if(k<=0)break;
+
+     for(j=n_pending-1;j>=0;j--){
+        if(fds[j].revents==0)continue;
+
+        i=index[j];
+        n_read=recv(c[i].fd,replies[i],MAXBUFSIZE-1,0);
+        if(n_read>0){
+           results[i]=0;
+           if(verbose1){
+              fprintf(stderr,"send_parallel_commands[%d]: %12.6f reply is %s",
+                  port,get_ut(),replies[i]);
+              fflush(stderr);
+           }
+        }
+        else{
+           /* a reused connection closed before the reply: most likely
+              the server did not get the command. The status queries
+              sent here change nothing, so they are safe to resend */
+           if(c[i].reused&&(n_read==0||errno==ECONNRESET)){
+              retry[i]=1;
+              c[i].server_closes=1;
+           }
+           else{
+              fprintf(stderr,"send_parallel_commands[%d]: error reading reply to %s\n",
+                  port,commands[i]);
+              fflush(stderr);
+           }
+           close_connection(c+i);
+        }
+
+        fds[j]=fds[n_pending-1];
+        index[j]=index[n_pending-1];
+        n_pending--;
+     }
+  }
+
+  /* drop connections with no reply, so a late reply is not read as
+     the answer to a later command */
+
+  for(j=0;j<n_pending;j++){
+     i=index[j];
+     fprintf(stderr,"send_parallel_commands[%d]: timeout waiting for reply to %s\n",
+         port,commands[i]);
+     fflush(stderr);
+     close_connection(c+i);
+  }
+
+  n_ok=0;
+  for(i=0;i<n;i++){
+     if(retry[i]){
+        results[i]=send_connection_command(c+i,machine,port,commands[i],
+           replies[i],timeout_sec);
+     }
+     if(results[i]==0)n_ok++;
+  }
+
+  return(n_ok);
+}
+
 /************************************************************/
 #if 0
 // not used
@@ -39,6 +39,38 @@ typedef struct {
 #define MAXHOSTNAME 1024
 #define MAXBUFSIZE 1024
 #define COMMAND_TIMEOUT_SEC 120
+#define KEEPALIVE_IDLE_SEC 60 /* idle time before keep-alive probes on a
+                                 persistent connection */
+#define KEEPALIVE_INTERVAL_SEC 10 /* time between keep-alive probes */
+#define KEEPALIVE_COUNT 3 /* unanswered probes before connection drops */
+
+/* persistent connection to a command server, reused by
+   send_connection_command. A static (zeroed) Socket_Connection is
+   ready to use. Not shared between threads */
+
+typedef struct {
+	char host[MAXHOSTNAME+1];   /* host and port of resolved address */
+	int port;
+	int resolved;               /* 1 if addr holds host's address */
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	int family;
+	int connected;              /* 1 if fd is an open connection */
+	int fd;
+	int server_closes;          /* 1 if server was seen to close the
+	                               connection between commands */
+	int n_connects;             /* connections opened */
+	int n_commands;             /* commands sent */
+	int n_commands_open;        /* commands sent on the open connection */
+	int reused;                 /* 1 if the last command went over a
+	                               connection that had been used before */
+} Socket_Connection;
+
+int send_connection_command(Socket_Connection *c, char *machine, int port,
+			char *command, char *reply, int timeout_sec);
+void close_connection(Socket_Connection *c);
+int send_parallel_commands(Socket_Connection *c, int n, char *machine, int port,
+			char **commands, char **replies, int *results, int timeout_sec);
 
 #if 0
 